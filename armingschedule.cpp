@@ -0,0 +1,147 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#include "armingschedule.h"
+
+#include <stddef.h>
+
+int ArmingWindow::fromMinute() const {
+  return _fromMinute;
+}
+
+int ArmingWindow::untilMinute() const {
+  return _untilMinute;
+}
+
+bool ArmingWindow::contains(int minute) const {
+  if (_fromMinute == _untilMinute) {
+    return true;
+  }
+  if (_fromMinute < _untilMinute) {
+    return minute >= _fromMinute && minute < _untilMinute;
+  }
+  return minute >= _fromMinute || minute < _untilMinute;
+}
+
+bool ArmingWindow::operator==(const ArmingWindow& other) const {
+  return _fromMinute == other._fromMinute && _untilMinute == other._untilMinute;
+}
+
+bool ArmingWindow::operator!=(const ArmingWindow& other) const {
+  return !(*this == other);
+}
+
+/*static*/
+bool ArmingSchedule::isArmed(const ArmingWindow* windows, int count,
+    int utcOffsetMinutes, uint32_t epochSeconds) {
+  int minute = (int) (secondOfDay(utcOffsetMinutes, epochSeconds) / 60UL);
+
+  if (0 == count) {
+    return true;
+  }
+
+  for (int i = 0; i < count; i++) {
+    if (windows[i].contains(minute)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/*
+Returns the seconds from the time until the next start or end of a window;
+the next time at which the sensor may be armed or disarmed. Returns zero if
+there are no windows.
+*/
+
+/*static*/
+uint32_t ArmingSchedule::secondsToBoundary(const ArmingWindow* windows, int count,
+    int utcOffsetMinutes, uint32_t epochSeconds) {
+  uint32_t second = secondOfDay(utcOffsetMinutes, epochSeconds);
+  uint32_t result = 0;
+
+  for (int i = 0; i < count * 2; i++) {
+    const ArmingWindow& window = windows[i / 2];
+    uint32_t boundary = (uint32_t) (0 == i % 2 ? window.fromMinute() : window.untilMinute()) * 60UL;
+    uint32_t seconds = (boundary + ARMING_DAY_SECONDS - second) % ARMING_DAY_SECONDS;
+
+    if (0 == seconds) {
+      seconds = ARMING_DAY_SECONDS;
+    }
+
+    if (0 == result || seconds < result) {
+      result = seconds;
+    }
+  }
+
+  return result;
+}
+
+/*
+Reads windows written as `HH:MM-HH:MM` separated by commas such as
+`18:00-07:00,12:00-13:00`. An empty text has no windows. Returns false if the
+text is not understood or there are more than `maxCount` windows.
+*/
+
+/*static*/
+bool ArmingSchedule::parse(const char* text, ArmingWindow* windows, int maxCount, int* count) {
+  const char* cursor = text;
+  int minutes[2];
+
+  *count = 0;
+
+  if (NULL == text || 0 == *text) {
+    return true;
+  }
+
+  while (true) {
+    if (*count >= maxCount) {
+      return false;
+    }
+
+    for (int i = 0; i < 2; i++) {
+      if (1 == i) {
+        if ('-' != *cursor) {
+          return false;
+        }
+        cursor++;
+      }
+
+      if (cursor[0] < '0' || cursor[0] > '9' || cursor[1] < '0' || cursor[1] > '9' || ':' != cursor[2]
+          || cursor[3] < '0' || cursor[3] > '5' || cursor[4] < '0' || cursor[4] > '9') {
+        return false;
+      }
+
+      int hour = (cursor[0] - '0') * 10 + (cursor[1] - '0');
+
+      if (hour > 23) {
+        return false;
+      }
+
+      minutes[i] = hour * 60 + (cursor[3] - '0') * 10 + (cursor[4] - '0');
+      cursor += 5;
+    }
+
+    windows[(*count)++] = ArmingWindow(minutes[0], minutes[1]);
+
+    if (0 == *cursor) {
+      return true;
+    }
+
+    if (',' != *cursor) {
+      return false;
+    }
+
+    cursor++;
+  }
+}
+
+// private
+/*static*/
+uint32_t ArmingSchedule::secondOfDay(int utcOffsetMinutes, uint32_t epochSeconds) {
+  long offsetSeconds = (long) (utcOffsetMinutes % ARMING_DAY_MINUTES) * 60L;
+  return (uint32_t) (((long) (epochSeconds % ARMING_DAY_SECONDS) + offsetSeconds
+    + (long) ARMING_DAY_SECONDS) % (long) ARMING_DAY_SECONDS);
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#ifndef ARMINGSCHEDULE_H
+#define ARMINGSCHEDULE_H
+
+#include <stdint.h>
+
+#define ARMING_DAY_MINUTES 1440
+#define ARMING_DAY_SECONDS 86400UL
+
+// No more than this many windows can be set from the serial console.
+
+#define ARMING_MAX_WINDOWS 4
+
+/*
+A window of the day in which the sensor is armed; from `fromMinute` up to but
+not including `untilMinute`, both in minutes after local midnight. A window
+whose `untilMinute` is before its `fromMinute` runs over midnight which is
+the usual case for a gate that only matters after hours. A window which
+starts and ends at the same minute covers the whole day.
+*/
+
+class ArmingWindow {
+  public:
+    constexpr ArmingWindow()
+      :
+      _fromMinute(0),
+      _untilMinute(0) {
+    }
+
+    constexpr ArmingWindow(int fromMinute, int untilMinute)
+      :
+      _fromMinute(fromMinute),
+      _untilMinute(untilMinute) {
+    }
+
+    int fromMinute() const;
+    int untilMinute() const;
+    bool contains(int minute) const;
+
+    template <class T> void printTo(T& stream) const {
+      printMinuteTo(stream, _fromMinute);
+      stream.print("-");
+      printMinuteTo(stream, _untilMinute);
+    }
+
+    bool operator==(const ArmingWindow& other) const;
+    bool operator!=(const ArmingWindow& other) const;
+
+  private:
+    template <class T> static void printMinuteTo(T& stream, int minute) {
+      stream.print(minute / 600);
+      stream.print((minute / 60) % 10);
+      stream.print(":");
+      stream.print((minute % 60) / 10);
+      stream.print(minute % 10);
+    }
+
+  private:
+    int _fromMinute;
+    int _untilMinute;
+};
+
+/*
+The sensor is armed while the local time of day is in any of the windows or
+at all times if there are no windows. The local time is the UTC time of the
+wall clock moved by `utcOffsetMinutes`; a change to or from daylight saving
+time needs the offset to be changed.
+*/
+
+class ArmingSchedule {
+  public:
+    static bool isArmed(const ArmingWindow* windows, int count,
+      int utcOffsetMinutes, uint32_t epochSeconds);
+    static uint32_t secondsToBoundary(const ArmingWindow* windows, int count,
+      int utcOffsetMinutes, uint32_t epochSeconds);
+
+    static bool parse(const char* text, ArmingWindow* windows, int maxCount, int* count);
+
+  private:
+    static uint32_t secondOfDay(int utcOffsetMinutes, uint32_t epochSeconds);
+};
+
+#endif // ARMINGSCHEDULE_H
@@ -0,0 +1,85 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#include "bounceprofile.h"
+
+BounceProfile::BounceProfile(unsigned long floorMillis, unsigned long ceilingMillis, uint16_t learnCount)
+  :
+  _floorMillis(floorMillis),
+  _ceilingMillis(ceilingMillis),
+  _learnCount(learnCount),
+  _learnedMillis(0),
+  _maxMillis(0),
+  _count(0) {
+  for (int i = 0; i < BOUNCE_PROFILE_BUCKETS; i++) {
+    _buckets[i] = 0;
+  }
+}
+
+/*
+Each bounce that is no longer than the learned value takes an eighth off it,
+rounding up so that the learned value is able to fall all the way to zero.
+*/
+
+void BounceProfile::record(unsigned long durationMillis) {
+  int index = 0;
+
+  while (index < BOUNCE_PROFILE_BUCKETS - 1 && (durationMillis >> index) > 0) {
+    index++;
+  }
+
+  if (_buckets[index] < UINT16_MAX) {
+    _buckets[index]++;
+  }
+
+  if (_count < UINT32_MAX) {
+    _count++;
+  }
+
+  if (durationMillis > _maxMillis) {
+    _maxMillis = durationMillis;
+  }
+
+  if (durationMillis > _learnedMillis) {
+    _learnedMillis = durationMillis;
+  } else {
+    _learnedMillis -= (_learnedMillis + 7) / 8;
+
+    if (durationMillis > _learnedMillis) {
+      _learnedMillis = durationMillis;
+    }
+  }
+}
+
+unsigned long BounceProfile::windowMillis() const {
+  if (_count < _learnCount) {
+    return _ceilingMillis;
+  }
+
+  unsigned long result = _learnedMillis * 2;
+
+  if (result < _floorMillis) {
+    return _floorMillis;
+  }
+  if (result > _ceilingMillis) {
+    return _ceilingMillis;
+  }
+  return result;
+}
+
+unsigned long BounceProfile::learnedMillis() const {
+  return _learnedMillis;
+}
+
+unsigned long BounceProfile::maxMillis() const {
+  return _maxMillis;
+}
+
+uint32_t BounceProfile::count() const {
+  return _count;
+}
+
+uint16_t BounceProfile::bucket(int index) const {
+  return _buckets[index];
+}
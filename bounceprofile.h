@@ -0,0 +1,69 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#ifndef BOUNCEPROFILE_H
+#define BOUNCEPROFILE_H
+
+#include <stdint.h>
+
+// Bucket `n` counts bounces shorter than 2^n milliseconds and the last bucket
+// also counts everything longer.
+
+#define BOUNCE_PROFILE_BUCKETS 8
+
+/*
+This learns how long an input bounces for each time that it changes so that
+the input need only wait for as long as it really bounces before its state is
+taken as settled. The learned value jumps straight up to any bounce that is
+longer and then falls back slowly as shorter bounces are seen. The window
+that the input waits for is twice the learned value, but never less than the
+floor nor more than the ceiling; until enough bounces have been seen it is
+the ceiling.
+*/
+
+class BounceProfile {
+  public:
+    BounceProfile(unsigned long floorMillis, unsigned long ceilingMillis, uint16_t learnCount);
+
+    void record(unsigned long durationMillis);
+
+    unsigned long windowMillis() const;
+    unsigned long learnedMillis() const;
+    unsigned long maxMillis() const;
+    uint32_t count() const;
+    uint16_t bucket(int index) const;
+
+    template <class T> void printTo(T& stream) const;
+
+  private:
+    unsigned long _floorMillis;
+    unsigned long _ceilingMillis;
+    uint16_t _learnCount;
+    unsigned long _learnedMillis;
+    unsigned long _maxMillis;
+    uint32_t _count;
+    uint16_t _buckets[BOUNCE_PROFILE_BUCKETS];
+};
+
+template <class T>
+void BounceProfile::printTo(T& stream) const {
+  stream.print("{count:");
+  stream.print(count());
+  stream.print(",learnedMillis:");
+  stream.print(learnedMillis());
+  stream.print(",windowMillis:");
+  stream.print(windowMillis());
+  stream.print(",maxMillis:");
+  stream.print(maxMillis());
+  stream.print(",buckets:");
+  for (int i = 0; i < BOUNCE_PROFILE_BUCKETS; i++) {
+    if (0 != i) {
+      stream.print(" ");
+    }
+    stream.print(bucket(i));
+  }
+  stream.print("}");
+}
+
+#endif // BOUNCEPROFILE_H
@@ -0,0 +1,62 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#include "circuitbreaker.h"
+
+CircuitBreaker::CircuitBreaker()
+  :
+  _failureLimit(0),
+  _coolDownMillis(0),
+  _failures(0),
+  _openedAt(0),
+  _trips(0) {
+}
+
+void CircuitBreaker::configure(uint8_t failureLimit, unsigned long coolDownMillis) {
+  _failureLimit = failureLimit;
+  _coolDownMillis = coolDownMillis;
+}
+
+/*
+Returns true if an attempt may be made; either the breaker is closed or it
+has been open for long enough that another attempt is due.
+*/
+
+bool CircuitBreaker::allows(uint64_t now) const {
+  return !isOpen() || now - _openedAt >= _coolDownMillis;
+}
+
+void CircuitBreaker::recordSuccess() {
+  _failures = 0;
+}
+
+/*
+A failure while the breaker is open was the attempt after a cool-down so the
+breaker starts another cool-down from now.
+*/
+
+void CircuitBreaker::recordFailure(uint64_t now) {
+  if (_failures < UINT8_MAX) {
+    _failures++;
+  }
+
+  if (0 != _failureLimit && _failures >= _failureLimit) {
+    if (_failures == _failureLimit) {
+      _trips++;
+    }
+    _openedAt = now;
+  }
+}
+
+bool CircuitBreaker::isOpen() const {
+  return 0 != _failureLimit && _failures >= _failureLimit;
+}
+
+uint8_t CircuitBreaker::failureCount() const {
+  return _failures;
+}
+
+uint32_t CircuitBreaker::tripCount() const {
+  return _trips;
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#ifndef CIRCUITBREAKER_H
+#define CIRCUITBREAKER_H
+
+#include <stdint.h>
+
+/*
+A circuit breaker stops a way of delivering notifications from being tried
+once it has failed `failureLimit` times in a row. The breaker is then open
+for `coolDownMillis` after which one more attempt is allowed; if that
+succeeds the breaker closes again and otherwise it stays open for another
+cool-down. A failure limit of zero means that the breaker never opens.
+*/
+
+class CircuitBreaker {
+  public:
+    CircuitBreaker();
+
+    void configure(uint8_t failureLimit, unsigned long coolDownMillis);
+
+    bool allows(uint64_t now) const;
+    void recordSuccess();
+    void recordFailure(uint64_t now);
+
+    bool isOpen() const;
+    uint8_t failureCount() const;
+    uint32_t tripCount() const;
+
+  private:
+    uint8_t _failureLimit;
+    unsigned long _coolDownMillis;
+    uint8_t _failures;
+    uint64_t _openedAt;
+    uint32_t _trips;
+};
+
+#endif // CIRCUITBREAKER_H
@@ -9,11 +9,22 @@
 
 /*static*/
 String Common::notificationMethodAsString(NotificationMethod value) {
+    return notificationMethodName(value);
+}
+
+/*
+As `notificationMethodAsString` but without building a `String`.
+*/
+
+/*static*/
+const char* Common::notificationMethodName(NotificationMethod value) {
     switch (value) {
         case LOG:
             return "LOG";
         case THREEMA:
             return "THREEMA";
+        case RELAY:
+            return "RELAY";
         default:
             return "???";
     }
@@ -24,5 +35,93 @@ NotificationMethod Common::notificationMethodFromString(String value) {
     if ("THREEMA" == value) {
         return THREEMA;
     }
+    if ("RELAY" == value) {
+        return RELAY;
+    }
     return LOG;
 }
+
+/*
+Unlike `notificationMethodFromString`, this ignores the case of the value and
+returns false rather than `LOG` if the value is not a notification method.
+*/
+
+/*static*/
+bool Common::parseNotificationMethod(const char* value, NotificationMethod* result) {
+    static const NotificationMethod methods[] = { LOG, THREEMA, RELAY };
+
+    for (size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+        if (0 == strcasecmp(value, notificationMethodName(methods[i]))) {
+            *result = methods[i];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+This is a plain bitwise CRC-32 (the same polynomial as used in Ethernet and
+zip) which is used to check that small blocks of data have not been
+corrupted. It is slow compared to a table driven implementation but it is
+only ever used over a handful of bytes so there is no need to hold a table
+in memory.
+*/
+
+/*static*/
+uint32_t Common::crc32(const uint8_t* data, size_t length) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+/*
+Decodes exactly `length` bytes from hex digits in either case. It fails if the
+text is not exactly that many hex digits.
+*/
+
+/*static*/
+bool Common::decodeHex(const char* hex, uint8_t* data, size_t length) {
+    if (NULL == hex) {
+        return false;
+    }
+    for (size_t i = 0; i < length * 2; i++) {
+        char ch = hex[i];
+        uint8_t nibble;
+        if (ch >= '0' && ch <= '9') {
+            nibble = ch - '0';
+        } else if (ch >= 'a' && ch <= 'f') {
+            nibble = 10 + (ch - 'a');
+        } else if (ch >= 'A' && ch <= 'F') {
+            nibble = 10 + (ch - 'A');
+        } else {
+            return false;
+        }
+        if (0 == (i & 1)) {
+            data[i / 2] = nibble << 4;
+        } else {
+            data[i / 2] |= nibble;
+        }
+    }
+    return 0 == hex[length * 2];
+}
+
+/*
+Encodes the data as lower case hex digits into `hex` which must have room for
+`(length * 2) + 1` characters. The text is terminated.
+*/
+
+/*static*/
+void Common::encodeHex(const uint8_t* data, size_t length, char* hex) {
+    static const char* HEXCHARS = "0123456789abcdef";
+    for (size_t i = 0; i < length; i++) {
+        hex[i * 2] = HEXCHARS[data[i] >> 4];
+        hex[(i * 2) + 1] = HEXCHARS[data[i] & 0x0f];
+    }
+    hex[length * 2] = 0;
+}
@@ -10,12 +10,14 @@
 
 /*
 This enum defines the different ways in which somebody could be notified about
-the sensor being open.
+the sensor being open. With `RELAY` the board does not notify anybody itself
+but passes the notifications to a hub on the local network which does.
 */
 
 enum NotificationMethod {
   LOG,
-  THREEMA
+  THREEMA,
+  RELAY
 };
 
 /*
@@ -25,7 +27,12 @@ This is a set of common functions that are used through the software.
 class Common {
 public:
   static String notificationMethodAsString(NotificationMethod value);
+  static const char* notificationMethodName(NotificationMethod value);
   static NotificationMethod notificationMethodFromString(String value);
+  static bool parseNotificationMethod(const char* value, NotificationMethod* result);
+  static uint32_t crc32(const uint8_t* data, size_t length);
+  static bool decodeHex(const char* hex, uint8_t* data, size_t length);
+  static void encodeHex(const uint8_t* data, size_t length, char* hex);
 };
 
 #endif // COMMON_H
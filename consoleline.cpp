@@ -0,0 +1,125 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#include "consoleline.h"
+
+#include <stddef.h>
+
+#define CONSOLE_BACKSPACE 0x08
+#define CONSOLE_DELETE 0x7F
+
+static bool consoleIsSpace(char ch) {
+  return ' ' == ch || '\t' == ch;
+}
+
+ConsoleLine::ConsoleLine()
+  :
+  _length(0),
+  _complete(false),
+  _overflowed(false) {
+  _buffer[0] = 0;
+}
+
+/*
+Takes the next character and returns true if it completed a line. An empty
+line is not taken to be complete so that a carriage return followed by a
+line feed only completes one line. Feeding in a character after a line was
+complete starts the next line.
+*/
+
+bool ConsoleLine::feed(char ch) {
+  if (_complete) {
+    clear();
+  }
+
+  switch (ch) {
+    case '\r':
+    case '\n':
+      if (0 == _length && !_overflowed) {
+        return false;
+      }
+      _buffer[_length] = 0;
+      _complete = true;
+      return true;
+    case CONSOLE_BACKSPACE:
+    case CONSOLE_DELETE:
+      if (0 != _length) {
+        _length--;
+      }
+      return false;
+    default:
+      if (_length >= CONSOLE_LINE_LENGTH) {
+        _overflowed = true;
+      } else {
+        _buffer[_length++] = ch;
+      }
+      return false;
+  }
+}
+
+void ConsoleLine::clear() {
+  _length = 0;
+  _complete = false;
+  _overflowed = false;
+  _buffer[0] = 0;
+}
+
+/*
+Returns true if the line that has just been completed was too long; what
+there is of it should not be acted on.
+*/
+
+bool ConsoleLine::overflowed() const {
+  return _overflowed;
+}
+
+/*
+Splits the completed line into words separated by spaces and returns how
+many there were. The last word that there is room for takes the rest of the
+line, less any trailing spaces, so that a value may have spaces in it.
+*/
+
+int ConsoleLine::split(char** words, int maxWords) {
+  int count = 0;
+  char* cursor = _buffer;
+
+  if (!_complete || _overflowed) {
+    return 0;
+  }
+
+  while (count < maxWords) {
+    while (consoleIsSpace(*cursor)) {
+      cursor++;
+    }
+
+    if (0 == *cursor) {
+      break;
+    }
+
+    words[count++] = cursor;
+
+    if (count == maxWords) {
+      char* end = cursor;
+
+      for (char* c = cursor; 0 != *c; c++) {
+        if (!consoleIsSpace(*c)) {
+          end = c + 1;
+        }
+      }
+
+      *end = 0;
+      break;
+    }
+
+    while (0 != *cursor && !consoleIsSpace(*cursor)) {
+      cursor++;
+    }
+
+    if (0 != *cursor) {
+      *(cursor++) = 0;
+    }
+  }
+
+  return count;
+}
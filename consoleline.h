@@ -0,0 +1,44 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#ifndef CONSOLELINE_H
+#define CONSOLELINE_H
+
+#include <stdint.h>
+
+// A line longer than this is discarded as a whole rather than being acted on
+// in part.
+
+#define CONSOLE_LINE_LENGTH 96
+
+/*
+This gathers the characters that arrive over the serial port into a line in a
+fixed buffer. The characters are fed in as they arrive, however many there
+happen to be, so that the main loop never waits for the rest of a line.
+Either of a carriage return or a line feed ends the line and a backspace
+takes back the last character.
+
+Once a line is complete it can be split into its words in place; the words
+point into the buffer so they are only good until the next character is fed
+in.
+*/
+
+class ConsoleLine {
+  public:
+    ConsoleLine();
+
+    bool feed(char ch);
+    void clear();
+
+    bool overflowed() const;
+    int split(char** words, int maxWords);
+
+  private:
+    char _buffer[CONSOLE_LINE_LENGTH + 1];
+    uint8_t _length;
+    bool _complete;
+    bool _overflowed;
+};
+
+#endif // CONSOLELINE_H
@@ -12,9 +12,16 @@ When a switch is toggled, there is a period over which the electronic
 contacts are being closed and the sensor can signal on and off
 sporadically. This delay is the period over which the signal from the
 switch is expected to stabilise and settle on a value.
+
+Each input learns how long it really bounces for and shortens the delay to
+suit, but never below `DEBOUNCE_MIN_DELAY`. Until it has seen
+`DEBOUNCE_LEARN_COUNT` changes it uses `DEBOUNCE_DELAY` which is also the
+longest that the delay can be.
 */
 
 #define DEBOUNCE_DELAY 100L
+#define DEBOUNCE_MIN_DELAY 5L
+#define DEBOUNCE_LEARN_COUNT 8
 
 // These are the various input and output pins on the board that are
 // used in this program. Remember that only certain pins support the
@@ -29,8 +36,102 @@ switch is expected to stabilise and settle on a value.
 
 #define MIN_PERIOD_TO_SHORT_SLEEP 5000L
 
+// While the sensor is open, the state retained over a reset is refreshed at
+// this interval so that the open duration is not lost.
+
+#define RETAINED_STATE_REFRESH_MILLIS 1000L
+
+// A notification is taken to be no longer in progress if its result has not
+// come back after this long; the result may have been lost from the event
+// bus.
+
+#define NOTIFY_RESULT_TIMEOUT_MILLIS (5UL * 60UL * 1000UL)
+
+// When the board runs from a battery or solar, this is the charge in mAh that
+// it may consume in a day. Notifications are then sent, deferred or dropped
+// to stay within it. Zero means that the board has an unlimited supply.
+
+#define ENERGY_DAILY_BUDGET_MAH 0
+
+// A notification that was deferred to save energy is sent after this long
+// even if no other notification has come along to share its Wifi session.
+
+#define ENERGY_DEFER_MAX_MILLIS (60UL * 60UL * 1000UL)
+
 #define DELAY_WIFI_CONNECT_MILLIS (20 * 1000)
 
+// These are the messages that are sent when no message settings have been
+// configured.
+
+#define MESSAGE_TEMPLATE_OPEN "Open \"{description}\""
+#define MESSAGE_TEMPLATE_STILL_OPEN "Still open \"{description}\" after {duration}"
+#define MESSAGE_TEMPLATE_CLOSE "Close \"{description}\""
+#define MESSAGE_TEMPLATE_FLAPPING "Flapping \"{description}\"; notifications paused"
+#define MESSAGE_TEMPLATE_SETTLED "Settled \"{description}\" {state}; {suppressed} notifications suppressed"
+
+// Notifications about a sensor are limited to a burst of this many after
+// which one more may be sent for each refill period. A sensor that exceeds
+// the limit is "flapping"; it is considered to have settled once the limit
+// has fully recovered and the sensor has not changed for the settle period.
+// These apply where the monitoring settings do not say otherwise.
+
+#define FLAP_NOTIFY_BURST_LIMIT 6
+#define FLAP_NOTIFY_REFILL_MINUTES 10
+#define FLAP_SETTLE_MINUTES 15
+
+// These are the longest times that sending an HTTP request may take to write
+// the request and then to receive the status of the response.
+
+#define HTTP_WRITE_DEADLINE_MILLIS (5 * 1000)
+#define HTTP_STATUS_DEADLINE_MILLIS (10 * 1000)
+
 #define HOST_THREEMA_MSG_API "msgapi.threema.ch"
 
+// This is how long a TLS connection to the gateway may take to be established.
+
+#define DELAY_TLS_CONNECT_MILLIS (10 * 1000)
+
+// An end-to-end encrypted message is padded with a random number of bytes up
+// to this many so that its length does not give away which message it is. The
+// gateway also requires that the padded message is at least the minimum
+// length.
+
+#define THREEMA_E2E_PADDING_MAX 32
+#define THREEMA_E2E_MIN_LENGTH 32
+
+// A detector that relays its notifications through a hub sends each event to
+// the hub over the local network and waits this long for the hub to
+// acknowledge it; it tries this many times in all.
+
+#define RELAY_DEFAULT_PORT 47810
+#define RELAY_ACK_TIMEOUT_MILLIS 500L
+#define RELAY_SEND_ATTEMPTS 4
+
+// Where notifications can fall back to other ways of being delivered, a way
+// that has failed this many times in a row is skipped for the cool-down
+// before it is tried again.
+
+#define DELIVERY_FAILURE_LIMIT 3
+#define DELIVERY_COOL_DOWN_MILLIS (30UL * 60UL * 1000UL)
+#define DELIVERY_MAX_FALLBACKS 2
+
+// A hub holds the events from its detectors for this long after the first of
+// them arrives so that they share a session with the gateway. It holds no
+// more than this many events at once. Events that could not be notified are
+// held for the retry period before they are tried again.
+
+#define RELAY_HUB_BATCH_MILLIS 2000L
+#define RELAY_HUB_RETRY_MILLIS (60L * 1000L)
+#define RELAY_HUB_QUEUE_LENGTH 16
+
+// The Wifi passphrase and the Threema secret are printed as this so that the
+// settings can be printed to the serial port without giving them away.
+
+#define SETTINGS_SECRET_MASK "********"
+
+// A line typed into the serial console is split into at most this many
+// words; a command, a field and a value which may itself have spaces in it.
+
+#define CONSOLE_MAX_WORDS 3
+
 #endif // CONSTANTS_H
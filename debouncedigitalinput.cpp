@@ -7,13 +7,26 @@
 #include <Arduino.h>
 
 #include "constants.h"
+#include "monotonicclock.h"
+
+/*
+The input starts out in the state that the pin is currently in. This means
+that after a reset the firmware carries on from the real state of the input
+rather than first seeing it as "off" and then having it change.
+*/
 
 DebouncedDigitalInput::DebouncedDigitalInput(int pin)
   :
   _pin(pin),
-  _state(false),
-  _stateDebounce(false),
-  _debounceStartTime(0L)
+  _state(LOW == digitalRead(pin)),
+  _stateDebounce(_state),
+  _settling(false),
+  _debounceStartTime(0L),
+  _edgeTime(0L),
+  _settledAt(0L),
+  _fedAt(0L),
+  _pollMillis(0L),
+  _bounceProfile(DEBOUNCE_MIN_DELAY, DEBOUNCE_DELAY, DEBOUNCE_LEARN_COUNT)
 {
 }
 
@@ -21,24 +34,81 @@ DebouncedDigitalInput::~DebouncedDigitalInput() {
 }
 
 void DebouncedDigitalInput::pulse() {
-  boolean currentState = (LOW == digitalRead(_pin));
-  long now = millis();
+  feed(digitalRead(_pin));
+}
+
+/*
+Takes a level of the pin which has been read elsewhere, such as by the
+`InputSampler` reading all of the sampled pins at once.
+
+The bounce is measured from the first change of the input to the last change
+before it settled. If the input changes again within `DEBOUNCE_DELAY` of
+being taken to have settled then the window was too short and the input was
+still bouncing; the whole of the bounce is recorded so that the window grows.
+The learned window may be shorter than the time between reads so the longer
+window, `DEBOUNCE_DELAY`, is what a late bounce is looked for within.
+
+A gap between reads that is longer than `DEBOUNCE_DELAY` is the board having
+slept or the input being sampled so it is not taken as the time between
+reads.
+*/
+
+void DebouncedDigitalInput::feed(int level) {
+  boolean currentState = (LOW == level);
+  uint64_t now = MonotonicClock::now();
+
+  if (0 != _fedAt && (now - _fedAt) < (uint64_t) DEBOUNCE_DELAY) {
+    _pollMillis = (unsigned long) (now - _fedAt);
+  }
+
+  _fedAt = now;
+
+  unsigned long window = windowMillis();
 
   if (currentState != _stateDebounce) {
+    if (!_settling) {
+      if (0 != _settledAt && (now - _settledAt) <= (uint64_t) DEBOUNCE_DELAY) {
+        _bounceProfile.record((unsigned long) (now - _edgeTime));
+      }
+      _edgeTime = now;
+      _settling = true;
+    }
     _debounceStartTime = now;
   }
 
-  if ((now - _debounceStartTime) > DEBOUNCE_DELAY) {
+  if ((now - _debounceStartTime) > window) {
+    if (_settling) {
+      _bounceProfile.record((unsigned long) (_debounceStartTime - _edgeTime));
+      _settling = false;
+      _settledAt = now;
+    }
     _state = _stateDebounce;
   }
 
   _stateDebounce = currentState;
 }
 
+int DebouncedDigitalInput::pin() const {
+  return _pin;
+}
+
 bool DebouncedDigitalInput::getState() {
   return _state;
 }
 
+/*
+This is the time at which the input first started to change away from its
+settled state; the start of the bouncing.
+*/
+
+uint64_t DebouncedDigitalInput::edgeAt() {
+  return _edgeTime;
+}
+
+const BounceProfile& DebouncedDigitalInput::bounceProfile() const {
+  return _bounceProfile;
+}
+
 /*
 The device should only go into sleep mode once the button has debounced and has
 settled on being on or off. This method will return true if the input has
@@ -46,6 +116,16 @@ settled down.
 */
 
 bool DebouncedDigitalInput::allowedToShortSleep() {
-  long now = millis();
-  return now > (_debounceStartTime + (DEBOUNCE_DELAY * 2));
+  uint64_t now = MonotonicClock::now();
+  return now > (_debounceStartTime + (windowMillis() * 2));
+}
+
+/*
+The window that the input waits for is that learned by the bounce profile
+but no shorter than the time between the reads of the input.
+*/
+
+// private
+unsigned long DebouncedDigitalInput::windowMillis() const {
+  return max(_bounceProfile.windowMillis(), _pollMillis);
 }
@@ -5,12 +5,18 @@
 #ifndef DEBOUNCEDIGITALINPUT_H
 #define DEBOUNCEDIGITALINPUT_H
 
+#include <stdint.h>
+
+#include "bounceprofile.h"
+
 /*
 Switches represent digital inputs but while the switch closes, there can be
 a moment where it is not actually fully closed. In this case it can oscillate
 between on and off for a moment. This is "bouncing" and this class will keep
 track of the bouncing giving the switch a period in which it is able to
-settle down.
+settle down. How long the period is comes from how long the switch has been
+seen to bounce for; see `BounceProfile`. The period is never shorter than the
+time between the reads of the input or a bounce could fall between two reads.
 */
 
 class DebouncedDigitalInput {
@@ -19,16 +25,32 @@ public:
   virtual ~DebouncedDigitalInput();
 
   void pulse();
+  void feed(int level);
+
+  int pin() const;
 
   bool getState();
 
   bool allowedToShortSleep();
 
+  uint64_t edgeAt();
+
+  const BounceProfile& bounceProfile() const;
+
+private:
+  unsigned long windowMillis() const;
+
 private:
   int _pin;
   bool _state;
   bool _stateDebounce;
-  long _debounceStartTime = 0L;
+  bool _settling;
+  uint64_t _debounceStartTime = 0L;
+  uint64_t _edgeTime = 0L;
+  uint64_t _settledAt = 0L;
+  uint64_t _fedAt = 0L;
+  unsigned long _pollMillis = 0L;
+  BounceProfile _bounceProfile;
 };
 
 #endif // DEBOUNCEDIGITALINPUT_H
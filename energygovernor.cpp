@@ -0,0 +1,97 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#include "energygovernor.h"
+
+EnergyModel::EnergyModel() {
+  _charges[ENERGY_ACTIVITY_AWAKE] = 20000UL;
+  _charges[ENERGY_ACTIVITY_SLEEP] = 5000UL;
+  _charges[ENERGY_ACTIVITY_WIFI_ASSOCIATE] = 300000UL;
+  _charges[ENERGY_ACTIVITY_TLS_HANDSHAKE] = 200000UL;
+  _charges[ENERGY_ACTIVITY_HTTP_SEND] = 50000UL;
+  _charges[ENERGY_ACTIVITY_SAMPLE] = 2UL;
+}
+
+uint32_t EnergyModel::charge(EnergyActivity activity) const {
+  return _charges[activity];
+}
+
+void EnergyModel::setCharge(EnergyActivity activity, uint32_t microCoulombs) {
+  _charges[activity] = microCoulombs;
+}
+
+EnergyGovernor::EnergyGovernor(const EnergyModel& model, uint64_t dailyBudgetMicroCoulombs)
+  :
+  _model(model),
+  _dailyBudget(dailyBudgetMicroCoulombs),
+  _spent(0),
+  _dayElapsedMillis(0) {
+}
+
+/*
+Accounts for time spent awake or asleep. This also moves the governor through
+the day; once a day has passed the consumption starts again from zero.
+*/
+
+void EnergyGovernor::elapse(EnergyActivity activity, uint32_t millis) {
+  _spent += ((uint64_t) _model.charge(activity) * millis) / 1000;
+  _dayElapsedMillis += millis;
+
+  while (_dayElapsedMillis >= ENERGY_DAY_MILLIS) {
+    _dayElapsedMillis -= ENERGY_DAY_MILLIS;
+    _spent = 0;
+  }
+}
+
+void EnergyGovernor::record(EnergyActivity activity, uint32_t count) {
+  _spent += (uint64_t) _model.charge(activity) * count;
+}
+
+/*
+Estimates the charge for a radio session in which the given number of HTTP
+requests are made; each request has its own TLS connection.
+*/
+
+uint64_t EnergyGovernor::estimateSession(uint32_t requests) const {
+  return _model.charge(ENERGY_ACTIVITY_WIFI_ASSOCIATE)
+    + (uint64_t) requests * (
+      _model.charge(ENERGY_ACTIVITY_TLS_HANDSHAKE)
+      + _model.charge(ENERGY_ACTIVITY_HTTP_SEND));
+}
+
+EnergyDecision EnergyGovernor::decide(NotificationPriority priority, uint64_t charge) const {
+  if (NOTIFICATION_PRIORITY_HIGH == priority) {
+    return ENERGY_DECISION_SEND;
+  }
+
+  uint64_t spentAfter = _spent + charge;
+  uint64_t sleepReserve = ((uint64_t) (ENERGY_DAY_MILLIS - _dayElapsedMillis)
+    * _model.charge(ENERGY_ACTIVITY_SLEEP)) / 1000;
+
+  if (spentAfter + sleepReserve > _dailyBudget) {
+    return ENERGY_DECISION_DROP;
+  }
+
+  if (NOTIFICATION_PRIORITY_LOW == priority) {
+    uint64_t pace = (_dailyBudget * _dayElapsedMillis) / ENERGY_DAY_MILLIS;
+
+    if (spentAfter > pace) {
+      return ENERGY_DECISION_DEFER;
+    }
+  }
+
+  return ENERGY_DECISION_SEND;
+}
+
+uint64_t EnergyGovernor::spent() const {
+  return _spent;
+}
+
+uint64_t EnergyGovernor::remaining() const {
+  return _spent < _dailyBudget ? _dailyBudget - _spent : 0;
+}
+
+uint32_t EnergyGovernor::dayElapsedMillis() const {
+  return _dayElapsedMillis;
+}
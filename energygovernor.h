@@ -0,0 +1,97 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#ifndef ENERGYGOVERNOR_H
+#define ENERGYGOVERNOR_H
+
+#include <stdint.h>
+
+#define ENERGY_DAY_MILLIS 86400000UL
+
+/*
+These are the activities that the board carries out which consume a
+significant amount of charge.
+*/
+
+enum EnergyActivity {
+  ENERGY_ACTIVITY_AWAKE,
+  ENERGY_ACTIVITY_SLEEP,
+  ENERGY_ACTIVITY_WIFI_ASSOCIATE,
+  ENERGY_ACTIVITY_TLS_HANDSHAKE,
+  ENERGY_ACTIVITY_HTTP_SEND,
+  ENERGY_ACTIVITY_SAMPLE,
+  ENERGY_ACTIVITY_COUNT
+};
+
+enum NotificationPriority {
+  NOTIFICATION_PRIORITY_HIGH,
+  NOTIFICATION_PRIORITY_NORMAL,
+  NOTIFICATION_PRIORITY_LOW
+};
+
+/*
+A notification can be sent now, deferred so that it is sent in the same radio
+session as the next notification that is sent, or dropped. It is up to the
+caller to send a deferred notification on its own if no other comes along.
+*/
+
+enum EnergyDecision {
+  ENERGY_DECISION_SEND,
+  ENERGY_DECISION_DEFER,
+  ENERGY_DECISION_DROP
+};
+
+/*
+The model holds the charge in microcoulombs (uA x s) that each activity
+consumes. For the awake and sleep activities this is the charge per second
+spent in that state. For the other activities it is the charge for carrying
+out the activity once over and above the charge of simply being awake; for
+a sample of the inputs it is the whole of the brief wake from sleep. The
+defaults are rough figures for an Arduino Nano 33 IoT and should be calibrated
+by measuring the current drawn by a real board.
+*/
+
+class EnergyModel {
+  public:
+    EnergyModel();
+
+    uint32_t charge(EnergyActivity activity) const;
+    void setCharge(EnergyActivity activity, uint32_t microCoulombs);
+
+  private:
+    uint32_t _charges[ENERGY_ACTIVITY_COUNT];
+};
+
+/*
+The governor keeps a running estimate of the charge consumed over the current
+day using the model. Given the remaining daily budget it decides what should
+happen to a notification of a given priority. A notification of high priority
+is always sent. A notification of normal priority is dropped if sending it
+would leave too little charge to get through the rest of the day asleep. A
+notification of low priority is also deferred while consumption is running
+ahead of the pace at which the budget can be spread over the day.
+*/
+
+class EnergyGovernor {
+  public:
+    EnergyGovernor(const EnergyModel& model, uint64_t dailyBudgetMicroCoulombs);
+
+    void elapse(EnergyActivity activity, uint32_t millis);
+    void record(EnergyActivity activity, uint32_t count);
+
+    uint64_t estimateSession(uint32_t requests) const;
+    EnergyDecision decide(NotificationPriority priority, uint64_t charge) const;
+
+    uint64_t spent() const;
+    uint64_t remaining() const;
+    uint32_t dayElapsedMillis() const;
+
+  private:
+    EnergyModel _model;
+    uint64_t _dailyBudget;
+    uint64_t _spent;
+    uint32_t _dayElapsedMillis;
+};
+
+#endif // ENERGYGOVERNOR_H
@@ -0,0 +1,197 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#include "eventbus.h"
+
+#include <string.h>
+
+#define EVENT_BUS_MASK (EVENT_BUS_CAPACITY - 1)
+#define EVENT_BUS_INTERRUPT_MASK (EVENT_BUS_INTERRUPT_CAPACITY - 1)
+
+EventBus::EventBus()
+  :
+  _head(0),
+  _subscribedMask(0),
+  _subscriberCount(0),
+  _interruptHead(0),
+  _interruptTail(0),
+  _interruptDropped(0) {
+  memset(_events, 0, sizeof(_events));
+  memset(_cursors, 0, sizeof(_cursors));
+  memset(_masks, 0, sizeof(_masks));
+  memset(_lost, 0, sizeof(_lost));
+  memset(_interruptEvents, 0, sizeof(_interruptEvents));
+}
+
+/*
+Returns the subscriber to pass to `take()` or `EVENT_BUS_NO_SUBSCRIBER` if
+there is no room for another. The subscriber only sees the events of the
+types in the mask that are posted from now on.
+*/
+
+int EventBus::subscribe(uint32_t typeMask) {
+  if (_subscriberCount >= EVENT_BUS_MAX_SUBSCRIBERS) {
+    return EVENT_BUS_NO_SUBSCRIBER;
+  }
+
+  _cursors[_subscriberCount] = _head;
+  _masks[_subscriberCount] = typeMask;
+  _lost[_subscriberCount] = 0;
+  _subscribedMask |= typeMask;
+  return _subscriberCount++;
+}
+
+/*
+Posts from the main loop. This never fails; if a subscriber is too far behind
+then the event overwrites the oldest one that it has yet to read and the
+subscriber moves past it, counting it as lost if it is of a type that the
+subscriber takes.
+*/
+
+void EventBus::post(const BusEvent& event) {
+  if (0 == (_subscribedMask & BUS_EVENT_MASK(event.type))) {
+    return;
+  }
+
+  if (_head >= EVENT_BUS_CAPACITY) {
+    uint32_t oldest = _head - EVENT_BUS_CAPACITY;
+    uint32_t oldestMask = BUS_EVENT_MASK(_events[oldest & EVENT_BUS_MASK].type);
+
+    for (int i = 0; i < _subscriberCount; i++) {
+      if (_cursors[i] == oldest) {
+        if (0 != (_masks[i] & oldestMask)) {
+          _lost[i]++;
+        }
+        _cursors[i]++;
+      }
+    }
+  }
+
+  _events[_head & EVENT_BUS_MASK] = event;
+  _head++;
+}
+
+/*
+Posts from an interrupt. The event is only seen by the subscribers once the
+main loop has called `pump()`. Returns false, and counts the event as
+dropped, if the queue is full.
+*/
+
+bool EventBus::postFromInterrupt(const BusEvent& event) {
+  uint8_t head = _interruptHead;
+  uint8_t next = (head + 1) & EVENT_BUS_INTERRUPT_MASK;
+
+  if (next == _interruptTail) {
+    _interruptDropped = _interruptDropped + 1;
+    return false;
+  }
+
+  _interruptEvents[head] = event;
+
+  // the event must be written out before the main loop can see the new head
+
+  __sync_synchronize();
+  _interruptHead = next;
+  return true;
+}
+
+/*
+Moves the events that the interrupts have posted onto the bus. An interrupt
+is not able to read the monotonic clock so its events are taken to have
+happened at `now` unless they say otherwise. The edges of each input are
+gathered into one event that counts them and has the last level of the pin.
+*/
+
+void EventBus::pump(uint64_t now) {
+  BusEvent edges[BUS_INPUT_COUNT];
+  uint8_t tail = _interruptTail;
+
+  memset(edges, 0, sizeof(edges));
+
+  while (tail != _interruptHead) {
+    __sync_synchronize();
+    BusEvent event = _interruptEvents[tail];
+
+    // the event must be read before the interrupt can reuse its slot
+
+    tail = (tail + 1) & EVENT_BUS_INTERRUPT_MASK;
+    __sync_synchronize();
+    _interruptTail = tail;
+
+    if (0 == event.at) {
+      event.at = now;
+    }
+
+    if (BUS_EVENT_EDGE == event.type && event.input < BUS_INPUT_COUNT) {
+      uint8_t count = edges[event.input].detail;
+      edges[event.input] = event;
+      edges[event.input].detail = 0xFF == count ? count : count + 1;
+    } else {
+      post(event);
+    }
+  }
+
+  for (int i = 0; i < BUS_INPUT_COUNT; i++) {
+    if (0 != edges[i].detail) {
+      post(edges[i]);
+    }
+  }
+}
+
+/*
+Copies the subscriber's next event into `event` and returns true, or returns
+false if the subscriber has read all of the events of the types that it
+subscribed to.
+*/
+
+bool EventBus::take(int subscriber, BusEvent* event) {
+  if (subscriber < 0 || subscriber >= _subscriberCount) {
+    return false;
+  }
+
+  while (_cursors[subscriber] != _head) {
+    const BusEvent& candidate = _events[_cursors[subscriber] & EVENT_BUS_MASK];
+    _cursors[subscriber]++;
+
+    if (0 != (_masks[subscriber] & BUS_EVENT_MASK(candidate.type))) {
+      *event = candidate;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/*
+Returns true if the subscriber has no events waiting for it.
+*/
+
+bool EventBus::isDrained(int subscriber) const {
+  if (subscriber < 0 || subscriber >= _subscriberCount) {
+    return true;
+  }
+
+  for (uint32_t cursor = _cursors[subscriber]; cursor != _head; cursor++) {
+    if (0 != (_masks[subscriber] & BUS_EVENT_MASK(_events[cursor & EVENT_BUS_MASK].type))) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+uint32_t EventBus::postedCount() const {
+  return _head;
+}
+
+uint32_t EventBus::interruptDroppedCount() const {
+  return _interruptDropped;
+}
+
+uint32_t EventBus::lostCount(int subscriber) const {
+  if (subscriber < 0 || subscriber >= _subscriberCount) {
+    return 0;
+  }
+  return _lost[subscriber];
+}
@@ -0,0 +1,145 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#ifndef EVENTBUS_H
+#define EVENTBUS_H
+
+#include <stdint.h>
+
+#include "notificationservice.h"
+
+// The capacities are powers of two so that the indices can wrap with a mask.
+// A subscriber that falls more than `EVENT_BUS_CAPACITY` events behind loses
+// the oldest of them.
+
+#define EVENT_BUS_CAPACITY 16
+#define EVENT_BUS_INTERRUPT_CAPACITY 8
+#define EVENT_BUS_MAX_SUBSCRIBERS 4
+
+#define EVENT_BUS_NO_SUBSCRIBER -1
+
+/*
+These are the kinds of event that travel on the bus;
+
+- `BUS_EVENT_EDGE` an input's pin changed level; posted from the interrupt
+- `BUS_EVENT_INPUT_STATE` an input has settled in a new state
+- `BUS_EVENT_PAUSE_TOGGLED` the button was pressed to toggle the pause
+- `BUS_EVENT_PHASE` the sensor moved to a new phase
+- `BUS_EVENT_NOTIFY_DUE` a notification is to be sent
+- `BUS_EVENT_NOTIFY_RESULT` a notification was sent, or failed to be
+*/
+
+enum BusEventType {
+  BUS_EVENT_EDGE,
+  BUS_EVENT_INPUT_STATE,
+  BUS_EVENT_PAUSE_TOGGLED,
+  BUS_EVENT_PHASE,
+  BUS_EVENT_NOTIFY_DUE,
+  BUS_EVENT_NOTIFY_RESULT,
+  BUS_EVENT_TYPE_COUNT
+};
+
+#define BUS_EVENT_MASK(type) (1UL << (type))
+
+enum BusInput {
+  BUS_INPUT_SENSOR,
+  BUS_INPUT_BUTTON,
+  BUS_INPUT_COUNT
+};
+
+/*
+The meaning of `value` and `detail` depends on the type of the event;
+
+- for an edge, `value` is the level of the pin after the last of the edges
+  and `detail` how many edges there were, up to 255
+- for an input state, `value` is true if the input is on
+- for a phase, `value` is the `SensorPhase` and `detail` the `IndicatorState`
+- for a notification, `value` is the `PendingNotification` and, for a result,
+  `detail` is true if it was delivered
+
+Only a due notification carries the `notification` itself.
+*/
+
+struct BusEvent {
+  uint8_t type;
+  uint8_t input;
+  uint8_t value;
+  uint8_t detail;
+  uint64_t at;
+  NotificationEvent notification;
+};
+
+/*
+This is a small publish / subscribe bus that carries events from the inputs
+to the services and between the services. Each subscriber reads the events
+at its own pace with its own cursor into a ring of the most recent events so
+that posting an event never waits for, nor depends on, any subscriber. An
+event of a type that no subscriber takes is not put in the ring at all so
+that it can not push out the events that are taken. A subscriber that is too
+slow loses its oldest events and the loss is counted against that subscriber
+alone, only for the events of the types that it takes.
+
+The ring itself is only touched from the main loop. Interrupts post into a
+separate single producer / single consumer queue instead; the interrupt only
+ever moves the head of that queue and `pump()`, from the main loop, only
+ever moves the tail so neither needs to lock out the other. The queue has
+one producer so interrupts which might preempt each other must not both post
+into it; the pins' interrupts on the board share one handler so they do not.
+A bouncing contact produces a burst of edges so `pump()` posts the edges of
+each input as one event that counts them.
+
+Nothing is allocated after construction.
+*/
+
+class EventBus {
+  public:
+    EventBus();
+
+    int subscribe(uint32_t typeMask);
+
+    void post(const BusEvent& event);
+    bool postFromInterrupt(const BusEvent& event);
+    void pump(uint64_t now);
+
+    bool take(int subscriber, BusEvent* event);
+    bool isDrained(int subscriber) const;
+
+    uint32_t postedCount() const;
+    uint32_t interruptDroppedCount() const;
+    uint32_t lostCount(int subscriber) const;
+
+    template <class T> void printTo(T& stream) const;
+
+  private:
+    BusEvent _events[EVENT_BUS_CAPACITY];
+    uint32_t _head;
+    uint32_t _cursors[EVENT_BUS_MAX_SUBSCRIBERS];
+    uint32_t _masks[EVENT_BUS_MAX_SUBSCRIBERS];
+    uint32_t _lost[EVENT_BUS_MAX_SUBSCRIBERS];
+    uint32_t _subscribedMask;
+    int _subscriberCount;
+
+    BusEvent _interruptEvents[EVENT_BUS_INTERRUPT_CAPACITY];
+    volatile uint8_t _interruptHead;
+    volatile uint8_t _interruptTail;
+    volatile uint32_t _interruptDropped;
+};
+
+template <class T>
+void EventBus::printTo(T& stream) const {
+  stream.print("{eventBus:{posted:");
+  stream.print(postedCount());
+  stream.print(",interruptDropped:");
+  stream.print(interruptDroppedCount());
+  stream.print(",lost:[");
+  for (int i = 0; i < _subscriberCount; i++) {
+    if (0 != i) {
+      stream.print(",");
+    }
+    stream.print(lostCount(i));
+  }
+  stream.println("]}}");
+}
+
+#endif // EVENTBUS_H
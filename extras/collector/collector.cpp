@@ -0,0 +1,278 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+
+// This program is a reference collector for the history that the boards
+// sync. It takes the batches that are POSTed to it over HTTP, decodes them
+// with the same code that the boards encode them with and writes a line of
+// CSV for each event. See the `README.md` for how to build and run it.
+
+#include <map>
+#include <string>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "historybatch.h"
+
+#define COLLECTOR_DEFAULT_PORT 47811
+#define COLLECTOR_HEAD_MAX_LENGTH 2048
+#define COLLECTOR_BODY_MAX_LENGTH 65536
+#define COLLECTOR_TIMEOUT_SECONDS 5
+#define COLLECTOR_BACKLOG 8
+
+static const char* COLLECTOR_RESPONSE_OK =
+  "HTTP/1.1 204 No Content\r\n"
+  "Connection: close\r\n"
+  "\r\n";
+
+static const char* COLLECTOR_RESPONSE_BAD_REQUEST =
+  "HTTP/1.1 400 Bad Request\r\n"
+  "Content-Length: 0\r\n"
+  "Connection: close\r\n"
+  "\r\n";
+
+struct CollectorOptions {
+  unsigned long port;
+  const char* outputPath;
+  bool loopbackOnly;
+};
+
+/*
+The number of the next event expected from each log; the key is the
+description and the log's identifier. An event numbered below this has been
+written already and is a copy from a batch that was sent again. This is only
+held in memory so a collector that is restarted may write some events twice.
+*/
+
+static std::map<std::string, uint32_t> collectorNextSequences;
+
+static void printUsage() {
+  fprintf(stderr,
+    "usage: collector [options]\n"
+    "  -p <port>     TCP port to listen on (%d)\n"
+    "  -o <path>     append the events to this file rather than the standard output\n"
+    "  -L            listen on the loopback only\n",
+    COLLECTOR_DEFAULT_PORT);
+}
+
+static bool parseOptions(int argc, char** argv, CollectorOptions* options) {
+  options->port = COLLECTOR_DEFAULT_PORT;
+  options->outputPath = NULL;
+  options->loopbackOnly = false;
+
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+
+    if (0 == strcmp("-p", argv[i]) && hasValue) {
+      options->port = strtoul(argv[++i], NULL, 10);
+    } else if (0 == strcmp("-o", argv[i]) && hasValue) {
+      options->outputPath = argv[++i];
+    } else if (0 == strcmp("-L", argv[i])) {
+      options->loopbackOnly = true;
+    } else {
+      return false;
+    }
+  }
+
+  return 0 != options->port && options->port <= 0xFFFF;
+}
+
+/*
+Reads up to and including the blank line that ends the headers. Anything of
+the body that arrived with them is left at the end of `head` and its length
+returned in `extraLength`.
+*/
+
+static bool readHead(int connection, char* head, size_t* headLength, size_t* extraLength) {
+  size_t length = 0;
+
+  while (length < COLLECTOR_HEAD_MAX_LENGTH - 1) {
+    ssize_t received = recv(connection, &head[length], COLLECTOR_HEAD_MAX_LENGTH - 1 - length, 0);
+
+    if (received <= 0) {
+      return false;
+    }
+
+    length += received;
+    head[length] = 0;
+
+    char* end = strstr(head, "\r\n\r\n");
+
+    if (NULL != end) {
+      *headLength = (end - head) + 4;
+      *extraLength = length - *headLength;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static long contentLength(const char* head) {
+  const char* line = head;
+
+  while (NULL != (line = strstr(line, "\r\n"))) {
+    line += 2;
+    if (0 == strncasecmp(line, "Content-Length:", 15)) {
+      return strtol(&line[15], NULL, 10);
+    }
+  }
+
+  return -1;
+}
+
+static bool readRequest(int connection, uint8_t* body, size_t* bodyLength) {
+  char head[COLLECTOR_HEAD_MAX_LENGTH];
+  size_t headLength;
+  size_t extraLength;
+
+  if (!readHead(connection, head, &headLength, &extraLength)
+      || 0 != strncmp("POST ", head, 5)) {
+    return false;
+  }
+
+  long length = contentLength(head);
+
+  if (length < 0 || length > COLLECTOR_BODY_MAX_LENGTH || (size_t) length < extraLength) {
+    return false;
+  }
+
+  memcpy(body, &head[headLength], extraLength);
+  size_t received = extraLength;
+
+  while (received < (size_t) length) {
+    ssize_t count = recv(connection, &body[received], length - received, 0);
+
+    if (count <= 0) {
+      return false;
+    }
+
+    received += count;
+  }
+
+  *bodyLength = length;
+  return true;
+}
+
+/*
+Writes a line for each event that has not been written before; the
+description, the log's identifier, the number of the event, the time on the
+board's clock, the time as a Unix time if the board knew it and whether the
+sensor opened or closed. Returns false if the batch is malformed.
+*/
+
+static bool writeEvents(const uint8_t* body, size_t bodyLength, FILE* output) {
+  HistoryBatchDecoder decoder(body, bodyLength);
+  HistoryBatchHeader header;
+  HistoryEvent event;
+
+  if (!decoder.header(&header)) {
+    return false;
+  }
+
+  char key[HISTORY_BATCH_DESCRIPTION_MAX_LENGTH + 16];
+  snprintf(key, sizeof(key), "%s/%08x", header.description, header.logId);
+
+  std::map<std::string, uint32_t>::iterator known = collectorNextSequences.find(key);
+  uint32_t nextSequence = collectorNextSequences.end() == known ? 0 : known->second;
+  uint32_t sequence = header.firstSequence;
+
+  if (0 != nextSequence && sequence > nextSequence) {
+    fprintf(stderr, "missed %lu events of [%s]\n",
+      (unsigned long) (sequence - nextSequence), key);
+  }
+
+  while (decoder.next(&event)) {
+    if (sequence >= nextSequence) {
+      fprintf(output, "\"%s\",%08x,%lu,%lu,", header.description, header.logId,
+        (unsigned long) sequence, (unsigned long) event.at);
+      if (0 != header.wallNow) {
+        fprintf(output, "%lld", (long long) header.wallNow - (long long) header.rtcNow
+          + (long long) event.at);
+      }
+      fprintf(output, ",%s\n", event.open ? "open" : "closed");
+      nextSequence = sequence + 1;
+    }
+    sequence++;
+  }
+
+  fflush(output);
+  collectorNextSequences[key] = nextSequence;
+  return !decoder.isFailed();
+}
+
+static void serve(int connection, FILE* output) {
+  static uint8_t body[COLLECTOR_BODY_MAX_LENGTH];
+  size_t bodyLength = 0;
+  struct timeval timeout = { COLLECTOR_TIMEOUT_SECONDS, 0 };
+
+  setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  const char* response = COLLECTOR_RESPONSE_BAD_REQUEST;
+
+  if (readRequest(connection, body, &bodyLength) && writeEvents(body, bodyLength, output)) {
+    response = COLLECTOR_RESPONSE_OK;
+  }
+
+  send(connection, response, strlen(response), MSG_NOSIGNAL);
+  close(connection);
+}
+
+int main(int argc, char** argv) {
+  CollectorOptions options;
+
+  if (!parseOptions(argc, argv, &options)) {
+    printUsage();
+    return 1;
+  }
+
+  FILE* output = stdout;
+
+  if (NULL != options.outputPath) {
+    output = fopen(options.outputPath, "a");
+
+    if (NULL == output) {
+      fprintf(stderr, "unable to open [%s]\n", options.outputPath);
+      return 1;
+    }
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  int reuse = 1;
+  struct sockaddr_in address;
+
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(options.loopbackOnly ? INADDR_LOOPBACK : INADDR_ANY);
+  address.sin_port = htons((uint16_t) options.port);
+
+  if (listener < 0
+      || 0 != setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse))
+      || 0 != bind(listener, (struct sockaddr*) &address, sizeof(address))
+      || 0 != listen(listener, COLLECTOR_BACKLOG)) {
+    fprintf(stderr, "unable to listen on port %lu\n", options.port);
+    return 1;
+  }
+
+  fprintf(stderr, "listening on port %lu\n", options.port);
+
+  while (true) {
+    int connection = accept(listener, NULL, NULL);
+
+    if (connection >= 0) {
+      serve(connection, output);
+    }
+  }
+}
@@ -0,0 +1,200 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#ifndef SIMULATOR_ARDUINO_H
+#define SIMULATOR_ARDUINO_H
+
+// This is a stand-in for the parts of the Arduino core that the firmware uses
+// so that the firmware can be compiled and run on a host computer by the
+// simulator. Time and the pins are simulated; see `simulator.h`.
+
+#include <ctype.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+typedef bool boolean;
+typedef uint8_t byte;
+typedef void (*voidFuncPtr)(void);
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define CHANGE 2
+#define FALLING 3
+#define RISING 4
+
+#define DEC 10
+#define HEX 16
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+void pinMode(uint32_t pin, uint32_t mode);
+int digitalRead(uint32_t pin);
+void digitalWrite(uint32_t pin, uint32_t value);
+
+// as on the SAMD boards, a pin's interrupt is numbered the same as the pin
+
+#define digitalPinToInterrupt(P) (P)
+
+void detachInterrupt(uint32_t pin);
+
+inline bool isAlphaNumeric(int c) { return 0 != isalnum(c); }
+inline bool isDigit(int c) { return 0 != isdigit(c); }
+inline bool isSpace(int c) { return 0 != isspace(c); }
+
+template <class T, class L>
+auto min(const T& a, const L& b) -> decltype((b < a) ? b : a) {
+  return (b < a) ? b : a;
+}
+
+template <class T, class L>
+auto max(const T& a, const L& b) -> decltype((b < a) ? b : a) {
+  return (a < b) ? b : a;
+}
+
+class String {
+  public:
+    String() {}
+    String(const char* value) : _value(NULL == value ? "" : value) {}
+    String(const std::string& value) : _value(value) {}
+    String(char value) : _value(1, value) {}
+    String(int value) : _value(std::to_string(value)) {}
+    String(unsigned int value) : _value(std::to_string(value)) {}
+    String(long value) : _value(std::to_string(value)) {}
+    String(unsigned long value) : _value(std::to_string(value)) {}
+
+    unsigned int length() const { return _value.size(); }
+    char charAt(unsigned int index) const { return index < _value.size() ? _value[index] : 0; }
+    const char* c_str() const { return _value.c_str(); }
+    long toInt() const { return atol(_value.c_str()); }
+
+    void toLowerCase() {
+      for (size_t i = 0; i < _value.size(); i++) {
+        _value[i] = tolower(_value[i]);
+      }
+    }
+
+    String& operator+=(const String& other) { _value += other._value; return *this; }
+    String& operator+=(const char* other) { _value += other; return *this; }
+    String& operator+=(char other) { _value += other; return *this; }
+
+    bool operator==(const String& other) const { return _value == other._value; }
+    bool operator!=(const String& other) const { return _value != other._value; }
+    bool operator<(const String& other) const { return _value < other._value; }
+    bool operator>=(const String& other) const { return _value >= other._value; }
+    bool operator==(const char* other) const { return _value == other; }
+    bool operator!=(const char* other) const { return _value != other; }
+    bool operator<(const char* other) const { return _value < other; }
+
+  private:
+    std::string _value;
+};
+
+inline String operator+(const String& a, const String& b) { String result(a); result += b; return result; }
+inline String operator+(const String& a, const char* b) { String result(a); result += b; return result; }
+inline String operator+(const char* a, const String& b) { String result(a); result += b; return result; }
+inline bool operator==(const char* a, const String& b) { return b == a; }
+
+class Print;
+
+class Printable {
+  public:
+    virtual ~Printable() {}
+    virtual size_t printTo(Print& p) const = 0;
+};
+
+class Print {
+  public:
+    virtual ~Print() {}
+
+    virtual size_t write(uint8_t c) = 0;
+
+    virtual size_t write(const uint8_t* buffer, size_t size) {
+      for (size_t i = 0; i < size; i++) {
+        write(buffer[i]);
+      }
+      return size;
+    }
+
+    size_t write(const char* value) { return write((const uint8_t*) value, strlen(value)); }
+
+    size_t print(const char* value) { return write(value); }
+    size_t print(const String& value) { return write(value.c_str()); }
+    size_t print(char value) { return write((uint8_t) value); }
+    size_t print(const Printable& value) { return value.printTo(*this); }
+    size_t print(int value, int base = DEC) { return printNumber((long long) value, base); }
+    size_t print(unsigned int value, int base = DEC) { return printNumber((unsigned long long) value, base); }
+    size_t print(long value, int base = DEC) { return printNumber((long long) value, base); }
+    size_t print(unsigned long value, int base = DEC) { return printNumber((unsigned long long) value, base); }
+    size_t print(long long value, int base = DEC) { return printNumber(value, base); }
+    size_t print(unsigned long long value, int base = DEC) { return printNumber(value, base); }
+    size_t print(unsigned char value, int base = DEC) { return printNumber((unsigned long long) value, base); }
+    size_t print(unsigned short value, int base = DEC) { return printNumber((unsigned long long) value, base); }
+    size_t print(double value, int digits = 2) {
+      char buffer[32];
+      snprintf(buffer, sizeof(buffer), "%.*f", digits, value);
+      return write(buffer);
+    }
+
+    template <class T> size_t println(const T& value) { size_t n = print(value); return n + println(); }
+    template <class T> size_t println(const T& value, int format) { size_t n = print(value, format); return n + println(); }
+    size_t println() { return write("\r\n"); }
+
+    virtual void flush() {}
+
+  private:
+    size_t printNumber(long long value, int base) {
+      char buffer[32];
+      snprintf(buffer, sizeof(buffer), HEX == base ? "%llX" : "%lld", value);
+      return write(buffer);
+    }
+
+    size_t printNumber(unsigned long long value, int base) {
+      char buffer[32];
+      snprintf(buffer, sizeof(buffer), HEX == base ? "%llX" : "%llu", value);
+      return write(buffer);
+    }
+};
+
+class Stream : public Print {
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+};
+
+/*
+The serial port writes to the standard output if the simulator is verbose and
+reads any input that the simulator has queued for it.
+*/
+
+class SimulatorSerial : public Stream {
+  public:
+    void begin(unsigned long baud) {}
+    void end() {}
+    operator bool() { return true; }
+
+    using Print::write;
+    virtual size_t write(uint8_t c);
+    virtual int available();
+    virtual int read();
+    virtual int peek();
+};
+
+extern SimulatorSerial Serial;
+
+#endif // SIMULATOR_ARDUINO_H
@@ -0,0 +1,21 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#ifndef SIMULATOR_ARDUINOLOWPOWER_H
+#define SIMULATOR_ARDUINOLOWPOWER_H
+
+// This is a stand-in for the ArduinoLowPower library. Deep sleep fast-forwards
+// the simulated time to the next change on a pin that can wake the board.
+
+#include <Arduino.h>
+
+class ArduinoLowPowerClass {
+  public:
+    void deepSleep();
+    void attachInterruptWakeup(uint32_t pin, voidFuncPtr callback, uint32_t mode);
+};
+
+extern ArduinoLowPowerClass LowPower;
+
+#endif // SIMULATOR_ARDUINOLOWPOWER_H
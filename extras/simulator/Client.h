@@ -0,0 +1,23 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#ifndef SIMULATOR_CLIENT_H
+#define SIMULATOR_CLIENT_H
+
+#include <Arduino.h>
+
+class Client : public Stream {
+  public:
+    virtual uint8_t connected() = 0;
+    virtual void stop() = 0;
+
+    using Print::write;
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size) = 0;
+
+    using Stream::read;
+    virtual int read(uint8_t* buffer, size_t size) = 0;
+};
+
+#endif // SIMULATOR_CLIENT_H
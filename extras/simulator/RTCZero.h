@@ -0,0 +1,39 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#ifndef SIMULATOR_RTCZERO_H
+#define SIMULATOR_RTCZERO_H
+
+// This is a stand-in for the RTCZero library. Unlike `millis()` the simulated
+// real time clock keeps running while the board is in deep sleep and its alarm
+// is able to wake the board.
+
+#include <Arduino.h>
+
+class RTCZero {
+  public:
+    enum Alarm_Match : uint8_t {
+      MATCH_OFF,
+      MATCH_SS,
+      MATCH_MMSS,
+      MATCH_HHMMSS,
+      MATCH_DHHMMSS,
+      MATCH_MMDDHHMMSS,
+      MATCH_YYMMDDHHMMSS
+    };
+
+    void begin(bool resetTime = false);
+    uint32_t getEpoch();
+
+    void setAlarmEpoch(uint32_t epoch);
+    void enableAlarm(Alarm_Match match);
+    void disableAlarm();
+    void attachInterrupt(voidFuncPtr callback);
+    void detachInterrupt();
+
+  private:
+    uint32_t _alarmEpoch;
+};
+
+#endif // SIMULATOR_RTCZERO_H
@@ -0,0 +1,147 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#ifndef SIMULATOR_WIFININA_H
+#define SIMULATOR_WIFININA_H
+
+// This is a stand-in for the WiFiNINA library. Associating with the access
+// point, looking up the server, connecting to it and the server's response
+// each take some simulated time. The requests that are sent are recorded by the simulator.
+// UDP is real; the packets go over the host's network so that several
+// simulated boards, each a process, can talk to each other over the loopback.
+// A plain TCP connection made with `connect` is also real so that the board
+// can reach a program such as a collector listening on the loopback.
+
+#include <Arduino.h>
+#include <Client.h>
+
+#include "utility/server_drv.h"
+
+#define WL_IDLE_STATUS 0
+#define WL_CONNECTED 3
+#define WL_CONNECT_FAILED 4
+#define WL_DISCONNECTED 6
+#define WL_NO_MODULE 255
+
+#define WIFI_FIRMWARE_LATEST_VERSION "1.5.0"
+
+#define SIMULATOR_REQUEST_MAX_LENGTH 1024
+#define SIMULATOR_RESPONSE_MAX_LENGTH 128
+#define SIMULATOR_PACKET_MAX_LENGTH 512
+
+class IPAddress : public Printable {
+  public:
+    IPAddress();
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d);
+    IPAddress(uint32_t address);
+
+    bool fromString(const char* address);
+    operator uint32_t() const;
+
+    uint8_t operator[](int index) const;
+    virtual size_t printTo(Print& p) const;
+
+  private:
+    uint8_t _octets[4];
+};
+
+class WiFiClass {
+  public:
+    WiFiClass();
+
+    int begin(const char* ssid, const char* passphrase);
+    int status();
+    void disconnect();
+
+    String SSID();
+    String SSID(uint8_t index);
+    IPAddress localIP();
+    String firmwareVersion();
+    int8_t scanNetworks();
+    unsigned long getTime();
+    int hostByName(const char* host, IPAddress& result);
+
+  private:
+    bool _associating;
+    unsigned long _associatedAt;
+};
+
+extern WiFiClass WiFi;
+
+class WiFiClient : public Client {
+  public:
+    WiFiClient();
+    WiFiClient(uint8_t sock);
+    virtual ~WiFiClient();
+
+    int connectSSL(const char* host, uint16_t port);
+    int connect(IPAddress ip, uint16_t port);
+    virtual uint8_t connected();
+    virtual void stop();
+
+    using Print::write;
+    virtual size_t write(uint8_t c);
+    virtual size_t write(const uint8_t* buffer, size_t size);
+
+    virtual int available();
+    virtual int read();
+    virtual int read(uint8_t* buffer, size_t size);
+    virtual int peek();
+
+  private:
+    bool responseArrived();
+    bool streamClosed();
+    size_t composeResponse();
+
+    uint8_t _socket;
+    int _stream;
+    bool _streamWritten;
+    char _request[SIMULATOR_REQUEST_MAX_LENGTH];
+    size_t _requestLength;
+    unsigned long _requestWrittenAt;
+    char _response[SIMULATOR_RESPONSE_MAX_LENGTH];
+    size_t _responseLength;
+    size_t _responseOffset;
+};
+
+class WiFiUDP : public Stream {
+  public:
+    WiFiUDP();
+    virtual ~WiFiUDP();
+
+    uint8_t begin(uint16_t port);
+    void stop();
+
+    int beginPacket(IPAddress ip, uint16_t port);
+    int endPacket();
+    int parsePacket();
+
+    using Print::write;
+    virtual size_t write(uint8_t c);
+    virtual size_t write(const uint8_t* buffer, size_t size);
+
+    virtual int available();
+    virtual int read();
+    int read(unsigned char* buffer, size_t size);
+    virtual int peek();
+
+    IPAddress remoteIP();
+    uint16_t remotePort();
+
+  private:
+    bool openSocket();
+
+    int _socket;
+    IPAddress _destinationIP;
+    uint16_t _destinationPort;
+    uint8_t _outgoing[SIMULATOR_PACKET_MAX_LENGTH];
+    size_t _outgoingLength;
+    IPAddress _remoteIP;
+    uint16_t _remotePort;
+    uint8_t _incoming[SIMULATOR_PACKET_MAX_LENGTH];
+    size_t _incomingLength;
+    size_t _incomingOffset;
+};
+
+#endif // SIMULATOR_WIFININA_H
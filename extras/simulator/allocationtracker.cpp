@@ -0,0 +1,328 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#include "allocationtracker.h"
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <new>
+
+struct LiveAllocation {
+  void* pointer;
+  size_t size;
+  uint16_t site;
+};
+
+struct AllocationSite {
+  void* address;
+  uint8_t phase;
+  uint32_t allocations;
+  uint64_t bytes;
+  uint32_t liveCount;
+  uint64_t liveBytes;
+};
+
+static const char* ALLOCATION_PHASE_NAMES[] = {
+  "simulator",
+  "setup",
+  "loop",
+  "teardown"
+};
+
+static_assert(sizeof(ALLOCATION_PHASE_NAMES) / sizeof(ALLOCATION_PHASE_NAMES[0]) == ALLOCATION_PHASE_COUNT,
+  "there must be a name for each allocation phase");
+
+static LiveAllocation allocationLive[ALLOCATION_TRACKER_MAX_LIVE];
+static AllocationSite allocationSites[ALLOCATION_TRACKER_MAX_SITES];
+static int allocationSiteCount = 0;
+static AllocationPhaseStats allocationPhaseStats[ALLOCATION_PHASE_COUNT];
+static AllocationPhase allocationPhase = ALLOCATION_PHASE_SIMULATOR;
+static size_t allocationLiveBytes = 0;
+static size_t allocationPeakLiveBytes = 0;
+static uint32_t allocationUntracked = 0;
+
+static size_t hashPointer(void* pointer) {
+  uintptr_t value = (uintptr_t) pointer;
+  value ^= value >> 17;
+  value *= 0x9E3779B1UL;
+  return (size_t) (value ^ (value >> 15)) % ALLOCATION_TRACKER_MAX_LIVE;
+}
+
+static int findSite(void* address, AllocationPhase phase) {
+  for (int i = 0; i < allocationSiteCount; i++) {
+    if (allocationSites[i].address == address && allocationSites[i].phase == phase) {
+      return i;
+    }
+  }
+
+  if (allocationSiteCount >= ALLOCATION_TRACKER_MAX_SITES) {
+    return -1;
+  }
+
+  AllocationSite& site = allocationSites[allocationSiteCount];
+  memset(&site, 0, sizeof(site));
+  site.address = address;
+  site.phase = phase;
+  return allocationSiteCount++;
+}
+
+/*static*/
+void AllocationTracker::recordAllocation(void* pointer, size_t size, void* address) {
+  int siteIndex = findSite(address, allocationPhase);
+  size_t index = hashPointer(pointer);
+  size_t probes = 0;
+
+  while (NULL != allocationLive[index].pointer && probes < ALLOCATION_TRACKER_MAX_LIVE) {
+    index = (index + 1) % ALLOCATION_TRACKER_MAX_LIVE;
+    probes++;
+  }
+
+  if (siteIndex < 0 || probes >= ALLOCATION_TRACKER_MAX_LIVE) {
+    allocationUntracked++;
+    return;
+  }
+
+  AllocationSite& site = allocationSites[siteIndex];
+  site.allocations++;
+  site.bytes += size;
+  site.liveCount++;
+  site.liveBytes += size;
+
+  allocationLive[index].pointer = pointer;
+  allocationLive[index].size = size;
+  allocationLive[index].site = siteIndex;
+
+  allocationPhaseStats[allocationPhase].allocations++;
+  allocationPhaseStats[allocationPhase].bytes += size;
+
+  if (ALLOCATION_PHASE_SIMULATOR != allocationPhase) {
+    allocationLiveBytes += size;
+    if (allocationLiveBytes > allocationPeakLiveBytes) {
+      allocationPeakLiveBytes = allocationLiveBytes;
+    }
+  }
+}
+
+/*
+Removes the allocation from the live table. The entries that follow it in the
+same run of the table are shifted back so that lookups never need to step
+over a gap.
+*/
+
+/*static*/
+void AllocationTracker::recordFree(void* pointer) {
+  if (NULL == pointer) {
+    return;
+  }
+
+  size_t index = hashPointer(pointer);
+  size_t probes = 0;
+
+  while (allocationLive[index].pointer != pointer) {
+    if (NULL == allocationLive[index].pointer || ++probes >= ALLOCATION_TRACKER_MAX_LIVE) {
+      return;
+    }
+    index = (index + 1) % ALLOCATION_TRACKER_MAX_LIVE;
+  }
+
+  LiveAllocation& live = allocationLive[index];
+  AllocationSite& site = allocationSites[live.site];
+
+  site.liveCount--;
+  site.liveBytes -= live.size;
+  allocationPhaseStats[allocationPhase].frees++;
+
+  if (ALLOCATION_PHASE_SIMULATOR != site.phase) {
+    allocationLiveBytes -= live.size;
+  }
+
+  live.pointer = NULL;
+
+  size_t gap = index;
+  size_t next = (index + 1) % ALLOCATION_TRACKER_MAX_LIVE;
+
+  while (NULL != allocationLive[next].pointer) {
+    size_t home = hashPointer(allocationLive[next].pointer);
+    bool canMove = (next > gap)
+      ? (home <= gap || home > next)
+      : (home <= gap && home > next);
+
+    if (canMove) {
+      allocationLive[gap] = allocationLive[next];
+      allocationLive[next].pointer = NULL;
+      gap = next;
+    }
+
+    next = (next + 1) % ALLOCATION_TRACKER_MAX_LIVE;
+  }
+}
+
+/*static*/
+AllocationPhase AllocationTracker::phase() {
+  return allocationPhase;
+}
+
+/*static*/
+void AllocationTracker::setPhase(AllocationPhase phase) {
+  allocationPhase = phase;
+}
+
+/*static*/
+uint32_t AllocationTracker::allocationCount(AllocationPhase phase) {
+  return allocationPhaseStats[phase].allocations;
+}
+
+/*
+This is the number of bytes that the firmware has allocated and not yet
+freed. The simulator's own allocations are not included.
+*/
+
+/*static*/
+size_t AllocationTracker::liveBytes() {
+  return allocationLiveBytes;
+}
+
+/*static*/
+size_t AllocationTracker::peakLiveBytes() {
+  return allocationPeakLiveBytes;
+}
+
+/*
+Returns the number of allocations made by the firmware that are still live.
+Once the firmware has been torn down, these have leaked.
+*/
+
+/*static*/
+uint32_t AllocationTracker::leakCount() {
+  uint32_t result = 0;
+  for (int i = 0; i < allocationSiteCount; i++) {
+    if (ALLOCATION_PHASE_SIMULATOR != allocationSites[i].phase) {
+      result += allocationSites[i].liveCount;
+    }
+  }
+  return result;
+}
+
+/*static*/
+const char* AllocationTracker::phaseName(AllocationPhase phase) {
+  return ALLOCATION_PHASE_NAMES[phase];
+}
+
+/*
+The function that made the allocation is found from the dynamic symbol table
+so the simulator should be linked with `-rdynamic`; otherwise only the
+address is printed.
+*/
+
+static void printSite(FILE* file, void* address) {
+  Dl_info info;
+
+  if (0 != dladdr(address, &info) && NULL != info.dli_sname) {
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(info.dli_sname, NULL, NULL, &status);
+    fprintf(file, "%s+0x%lx", 0 == status ? demangled : info.dli_sname,
+      (unsigned long) ((char*) address - (char*) info.dli_saddr));
+    free(demangled);
+  } else {
+    fprintf(file, "%p", address);
+  }
+}
+
+/*static*/
+void AllocationTracker::printTo(FILE* file) {
+  AllocationPhase priorPhase = allocationPhase;
+
+  // demangling allocates so it is kept apart from the firmware.
+  allocationPhase = ALLOCATION_PHASE_SIMULATOR;
+
+  fprintf(file, "%-22s %lu bytes\n", "peak heap", (unsigned long) allocationPeakLiveBytes);
+
+  for (int p = ALLOCATION_PHASE_SETUP; p < ALLOCATION_PHASE_COUNT; p++) {
+    const AllocationPhaseStats& stats = allocationPhaseStats[p];
+    fprintf(file, "%-22s %lu allocations, %lu frees, %llu bytes\n",
+      ALLOCATION_PHASE_NAMES[p], (unsigned long) stats.allocations,
+      (unsigned long) stats.frees, (unsigned long long) stats.bytes);
+  }
+
+  for (int i = 0; i < allocationSiteCount; i++) {
+    const AllocationSite& site = allocationSites[i];
+
+    if (ALLOCATION_PHASE_SIMULATOR == site.phase) {
+      continue;
+    }
+
+    fprintf(file, "  %s %s %lu allocations, %llu bytes",
+      0 == site.liveCount ? "    " : "leak",
+      ALLOCATION_PHASE_NAMES[site.phase], (unsigned long) site.allocations,
+      (unsigned long long) site.bytes);
+
+    if (0 != site.liveCount) {
+      fprintf(file, " (%lu live, %llu bytes)",
+        (unsigned long) site.liveCount, (unsigned long long) site.liveBytes);
+    }
+
+    fprintf(file, " at ");
+    printSite(file, site.address);
+    fprintf(file, "\n");
+  }
+
+  if (0 != allocationUntracked) {
+    fprintf(file, "%lu allocations were not tracked\n", (unsigned long) allocationUntracked);
+  }
+
+  allocationPhase = priorPhase;
+}
+
+AllocationPhaseScope::AllocationPhaseScope(AllocationPhase phase)
+  :
+  _priorPhase(AllocationTracker::phase()) {
+  AllocationTracker::setPhase(phase);
+}
+
+AllocationPhaseScope::~AllocationPhaseScope() {
+  AllocationTracker::setPhase(_priorPhase);
+}
+
+static void* trackedAllocate(size_t size, void* site) {
+  void* pointer = malloc(0 == size ? 1 : size);
+
+  if (NULL == pointer) {
+    throw std::bad_alloc();
+  }
+
+  AllocationTracker::recordAllocation(pointer, size, site);
+  return pointer;
+}
+
+static void trackedFree(void* pointer) {
+  AllocationTracker::recordFree(pointer);
+  free(pointer);
+}
+
+void* operator new(size_t size) {
+  return trackedAllocate(size, __builtin_return_address(0));
+}
+
+void* operator new[](size_t size) {
+  return trackedAllocate(size, __builtin_return_address(0));
+}
+
+void operator delete(void* pointer) noexcept {
+  trackedFree(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+  trackedFree(pointer);
+}
+
+void operator delete(void* pointer, size_t size) noexcept {
+  trackedFree(pointer);
+}
+
+void operator delete[](void* pointer, size_t size) noexcept {
+  trackedFree(pointer);
+}
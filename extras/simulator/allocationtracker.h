@@ -0,0 +1,71 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#ifndef ALLOCATIONTRACKER_H
+#define ALLOCATIONTRACKER_H
+
+// The simulator replaces the global `operator new` and `operator delete` so
+// that every allocation that the firmware makes on the heap is tracked. Each
+// allocation is attributed to the phase of the simulation that made it and to
+// the function that called `new`. The tracker's own records are kept in fixed
+// tables so that tracking does not itself allocate.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define ALLOCATION_TRACKER_MAX_LIVE 16384
+#define ALLOCATION_TRACKER_MAX_SITES 256
+
+/*
+Allocations made by the simulator itself are not the firmware's and are kept
+apart so that they do not count towards the firmware's budgets.
+*/
+
+enum AllocationPhase {
+  ALLOCATION_PHASE_SIMULATOR,
+  ALLOCATION_PHASE_SETUP,
+  ALLOCATION_PHASE_LOOP,
+  ALLOCATION_PHASE_TEARDOWN,
+  ALLOCATION_PHASE_COUNT
+};
+
+struct AllocationPhaseStats {
+  uint32_t allocations;
+  uint32_t frees;
+  uint64_t bytes;
+};
+
+class AllocationTracker {
+  public:
+    static void recordAllocation(void* pointer, size_t size, void* site);
+    static void recordFree(void* pointer);
+
+    static AllocationPhase phase();
+    static void setPhase(AllocationPhase phase);
+
+    static uint32_t allocationCount(AllocationPhase phase);
+    static size_t liveBytes();
+    static size_t peakLiveBytes();
+    static uint32_t leakCount();
+
+    static const char* phaseName(AllocationPhase phase);
+    static void printTo(FILE* file);
+};
+
+/*
+Attributes the allocations made while it is in scope to a phase and then
+restores the phase that was in effect before.
+*/
+
+class AllocationPhaseScope {
+  public:
+    AllocationPhaseScope(AllocationPhase phase);
+    ~AllocationPhaseScope();
+
+  private:
+    AllocationPhase _priorPhase;
+};
+
+#endif // ALLOCATIONTRACKER_H
@@ -0,0 +1,155 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#include "cryptocheck.h"
+
+#include <string.h>
+#include <time.h>
+
+#include "naclbox.h"
+#include "notificationservice.h"
+
+#define CRYPTO_CHECK_BENCH_MILLIS 500
+
+// These are the keys of "Alice" and "Bob" from RFC 7748 section 6.1 which are
+// also those of the `crypto_box` test in the NaCl distribution.
+
+static const uint8_t ALICE_SECRET_KEY[NACL_BOX_KEY_LENGTH] = {
+  0x77, 0x07, 0x6d, 0x0a, 0x73, 0x18, 0xa5, 0x7d, 0x3c, 0x16, 0xc1, 0x72, 0x51, 0xb2, 0x66, 0x45,
+  0xdf, 0x4c, 0x2f, 0x87, 0xeb, 0xc0, 0x99, 0x2a, 0xb1, 0x77, 0xfb, 0xa5, 0x1d, 0xb9, 0x2c, 0x2a
+};
+
+static const uint8_t ALICE_PUBLIC_KEY[NACL_BOX_KEY_LENGTH] = {
+  0x85, 0x20, 0xf0, 0x09, 0x89, 0x30, 0xa7, 0x54, 0x74, 0x8b, 0x7d, 0xdc, 0xb4, 0x3e, 0xf7, 0x5a,
+  0x0d, 0xbf, 0x3a, 0x0d, 0x26, 0x38, 0x1a, 0xf4, 0xeb, 0xa4, 0xa9, 0x8e, 0xaa, 0x9b, 0x4e, 0x6a
+};
+
+static const uint8_t BOB_SECRET_KEY[NACL_BOX_KEY_LENGTH] = {
+  0x5d, 0xab, 0x08, 0x7e, 0x62, 0x4a, 0x8a, 0x4b, 0x79, 0xe1, 0x7f, 0x8b, 0x83, 0x80, 0x0e, 0xe6,
+  0x6f, 0x3b, 0xb1, 0x29, 0x26, 0x18, 0xb6, 0xfd, 0x1c, 0x2f, 0x8b, 0x27, 0xff, 0x88, 0xe0, 0xeb
+};
+
+static const uint8_t BOB_PUBLIC_KEY[NACL_BOX_KEY_LENGTH] = {
+  0xde, 0x9e, 0xdb, 0x7d, 0x7b, 0x7d, 0xc1, 0xb4, 0xd3, 0x5b, 0x61, 0xc2, 0xec, 0xe4, 0x35, 0x37,
+  0x3f, 0x83, 0x43, 0xc8, 0x5b, 0x78, 0x67, 0x4d, 0xad, 0xfc, 0x7e, 0x14, 0x6f, 0x88, 0x2b, 0x4f
+};
+
+static const uint8_t SHARED_SECRET[NACL_BOX_KEY_LENGTH] = {
+  0x4a, 0x5d, 0x9d, 0x5b, 0xa4, 0xce, 0x2d, 0xe1, 0x72, 0x8e, 0x3b, 0xf4, 0x80, 0x35, 0x0f, 0x25,
+  0xe0, 0x7e, 0x21, 0xc9, 0x47, 0xd1, 0x9e, 0x33, 0x76, 0xf0, 0x9b, 0x3c, 0x1e, 0x16, 0x17, 0x42
+};
+
+static const uint8_t SHARED_KEY[NACL_BOX_KEY_LENGTH] = {
+  0x1b, 0x27, 0x55, 0x64, 0x73, 0xe9, 0x85, 0xd4, 0x62, 0xcd, 0x51, 0x19, 0x7a, 0x9a, 0x46, 0xc7,
+  0x60, 0x09, 0x54, 0x9e, 0xac, 0x64, 0x74, 0xf2, 0x06, 0xc4, 0xee, 0x08, 0x44, 0xf6, 0x83, 0x89
+};
+
+static const uint8_t NONCE[NACL_BOX_NONCE_LENGTH] = {
+  0x69, 0x69, 0x6e, 0xe9, 0x55, 0xb6, 0x2b, 0x73, 0xcd, 0x62, 0xbd, 0xa8,
+  0x75, 0xfc, 0x73, 0xd6, 0x82, 0x19, 0xe0, 0x03, 0x6b, 0x7a, 0x0b, 0x37
+};
+
+static const uint8_t MESSAGE[131] = {
+  0xbe, 0x07, 0x5f, 0xc5, 0x3c, 0x81, 0xf2, 0xd5, 0xcf, 0x14, 0x13, 0x16, 0xeb, 0xeb, 0x0c, 0x7b,
+  0x52, 0x28, 0xc5, 0x2a, 0x4c, 0x62, 0xcb, 0xd4, 0x4b, 0x66, 0x84, 0x9b, 0x64, 0x24, 0x4f, 0xfc,
+  0xe5, 0xec, 0xba, 0xaf, 0x33, 0xbd, 0x75, 0x1a, 0x1a, 0xc7, 0x28, 0xd4, 0x5e, 0x6c, 0x61, 0x29,
+  0x6c, 0xdc, 0x3c, 0x01, 0x23, 0x35, 0x61, 0xf4, 0x1d, 0xb6, 0x6c, 0xce, 0x31, 0x4a, 0xdb, 0x31,
+  0x0e, 0x3b, 0xe8, 0x25, 0x0c, 0x46, 0xf0, 0x6d, 0xce, 0xea, 0x3a, 0x7f, 0xa1, 0x34, 0x80, 0x57,
+  0xe2, 0xf6, 0x55, 0x6a, 0xd6, 0xb1, 0x31, 0x8a, 0x02, 0x4a, 0x83, 0x8f, 0x21, 0xaf, 0x1f, 0xde,
+  0x04, 0x89, 0x77, 0xeb, 0x48, 0xf5, 0x9f, 0xfd, 0x49, 0x24, 0xca, 0x1c, 0x60, 0x90, 0x2e, 0x52,
+  0xf0, 0xa0, 0x89, 0xbc, 0x76, 0x89, 0x70, 0x40, 0xe0, 0x82, 0xf9, 0x37, 0x76, 0x38, 0x48, 0x64,
+  0x5e, 0x07, 0x05
+};
+
+static const uint8_t BOX[NACL_BOX_TAG_LENGTH + sizeof(MESSAGE)] = {
+  0xf3, 0xff, 0xc7, 0x70, 0x3f, 0x94, 0x00, 0xe5, 0x2a, 0x7d, 0xfb, 0x4b, 0x3d, 0x33, 0x05, 0xd9,
+  0x8e, 0x99, 0x3b, 0x9f, 0x48, 0x68, 0x12, 0x73, 0xc2, 0x96, 0x50, 0xba, 0x32, 0xfc, 0x76, 0xce,
+  0x48, 0x33, 0x2e, 0xa7, 0x16, 0x4d, 0x96, 0xa4, 0x47, 0x6f, 0xb8, 0xc5, 0x31, 0xa1, 0x18, 0x6a,
+  0xc0, 0xdf, 0xc1, 0x7c, 0x98, 0xdc, 0xe8, 0x7b, 0x4d, 0xa7, 0xf0, 0x11, 0xec, 0x48, 0xc9, 0x72,
+  0x71, 0xd2, 0xc2, 0x0f, 0x9b, 0x92, 0x8f, 0xe2, 0x27, 0x0d, 0x6f, 0xb8, 0x63, 0xd5, 0x17, 0x38,
+  0xb4, 0x8e, 0xee, 0xe3, 0x14, 0xa7, 0xcc, 0x8a, 0xb9, 0x32, 0x16, 0x45, 0x48, 0xe5, 0x26, 0xae,
+  0x90, 0x22, 0x43, 0x68, 0x51, 0x7a, 0xcf, 0xea, 0xbd, 0x6b, 0xb3, 0x73, 0x2b, 0xc0, 0xe9, 0xda,
+  0x99, 0x83, 0x2b, 0x61, 0xca, 0x01, 0xb6, 0xde, 0x56, 0x24, 0x4a, 0x9e, 0x88, 0xd5, 0xf9, 0xb3,
+  0x79, 0x73, 0xf6, 0x22, 0xa4, 0x3d, 0x14, 0xa6, 0x59, 0x9b, 0x1f, 0x65, 0x4c, 0xb4, 0x5a, 0x74,
+  0xe3, 0x55, 0xa5
+};
+
+static double nowSeconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+/*static*/
+bool CryptoCheck::check(FILE* file, const char* name, bool passed) {
+  fprintf(file, "%-34s %s\n", name, passed ? "ok" : "FAILED");
+  return passed;
+}
+
+/*
+The steps are timed over about half a second each. The board is roughly a
+hundred times slower than a desktop computer and more so for Curve25519 which
+multiplies 64 bit numbers that the Cortex-M0+ has to build from 32 bit
+products; the point is to see how the steps compare.
+*/
+
+/*static*/
+bool CryptoCheck::run(FILE* file) {
+  uint8_t key[NACL_BOX_KEY_LENGTH];
+  uint8_t box[THREEMA_E2E_BOX_MAX_LENGTH];
+  uint8_t opened[sizeof(MESSAGE)];
+  bool passed = true;
+
+  NaclBox::derivePublicKey(key, ALICE_SECRET_KEY);
+  passed &= check(file, "curve25519 public key (alice)", 0 == memcmp(key, ALICE_PUBLIC_KEY, sizeof(key)));
+  NaclBox::derivePublicKey(key, BOB_SECRET_KEY);
+  passed &= check(file, "curve25519 public key (bob)", 0 == memcmp(key, BOB_PUBLIC_KEY, sizeof(key)));
+  NaclBox::scalarMult(key, ALICE_SECRET_KEY, BOB_PUBLIC_KEY);
+  passed &= check(file, "curve25519 shared secret", 0 == memcmp(key, SHARED_SECRET, sizeof(key)));
+  NaclBox::precompute(key, BOB_PUBLIC_KEY, ALICE_SECRET_KEY);
+  passed &= check(file, "box shared key (alice to bob)", 0 == memcmp(key, SHARED_KEY, sizeof(key)));
+  NaclBox::precompute(key, ALICE_PUBLIC_KEY, BOB_SECRET_KEY);
+  passed &= check(file, "box shared key (bob to alice)", 0 == memcmp(key, SHARED_KEY, sizeof(key)));
+
+  NaclBox::seal(box, MESSAGE, sizeof(MESSAGE), NONCE, SHARED_KEY);
+  passed &= check(file, "box seal", 0 == memcmp(box, BOX, sizeof(BOX)));
+  passed &= check(file, "box open", NaclBox::open(opened, BOX, sizeof(MESSAGE), NONCE, SHARED_KEY)
+    && 0 == memcmp(opened, MESSAGE, sizeof(MESSAGE)));
+
+  box[NACL_BOX_TAG_LENGTH + 7] ^= 1;
+  passed &= check(file, "box open rejects a changed box",
+    !NaclBox::open(opened, box, sizeof(MESSAGE), NONCE, SHARED_KEY));
+
+  fprintf(file, "\n");
+
+  const char* names[] = { "curve25519 public key", "box shared key", "box seal (largest message)" };
+  size_t length = THREEMA_E2E_BOX_MAX_LENGTH - NACL_BOX_TAG_LENGTH;
+  memset(box, 'x', sizeof(box));
+
+  for (int step = 0; step < 3; step++) {
+    unsigned long count = 0;
+    double start = nowSeconds();
+    double elapsed;
+
+    do {
+      switch (step) {
+        case 0:
+          NaclBox::derivePublicKey(key, ALICE_SECRET_KEY);
+          break;
+        case 1:
+          NaclBox::precompute(key, BOB_PUBLIC_KEY, ALICE_SECRET_KEY);
+          break;
+        default:
+          NaclBox::seal(box, box + NACL_BOX_TAG_LENGTH, length, NONCE, SHARED_KEY);
+          break;
+      }
+      count++;
+      elapsed = nowSeconds() - start;
+    } while (elapsed * 1000 < CRYPTO_CHECK_BENCH_MILLIS);
+
+    fprintf(file, "%-34s %.1f us\n", names[step], (elapsed * 1e6) / count);
+  }
+
+  return passed;
+}
@@ -0,0 +1,23 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#ifndef CRYPTOCHECK_H
+#define CRYPTOCHECK_H
+
+#include <stdio.h>
+
+/*
+This checks the NaCl box used for end-to-end Threema messages against
+published test vectors and then times each of its steps on the host.
+*/
+
+class CryptoCheck {
+  public:
+    static bool run(FILE* file);
+
+  private:
+    static bool check(FILE* file, const char* name, bool passed);
+};
+
+#endif // CRYPTOCHECK_H
@@ -0,0 +1,1247 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+
+// This program replays a trace of changes to the sensor and button through
+// the firmware and reports on what the firmware did. See the `README.md` for
+// how to build and run it.
+
+#include <algorithm>
+
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "allocationtracker.h"
+#include "cryptocheck.h"
+#include "simulator.h"
+#include "workstealingpool.h"
+
+#include "settings.h"
+#include "notificationservice.h"
+#include "eventbus.h"
+
+// the Arduino build generates these prototypes for the sketch
+
+NotificationService* createNotificationService(const Settings* settings);
+void postInputState(BusInput input, bool state);
+void awakeFromSensor();
+void awakeFromButton();
+
+#include "sensoropendetector.ino"
+
+#define SIMULATOR_DAY_MILLIS (24UL * 60UL * 60UL * 1000UL)
+#define SIMULATOR_MINUTE_MILLIS (60UL * 1000UL)
+#define SIMULATOR_DAY_MINUTES (24UL * 60UL)
+#define SIMULATOR_LINE_LENGTH 256
+#define SIMULATOR_FLEET_MAX_DETECTORS 64
+#define SIMULATOR_DESCRIPTION_LENGTH 24
+#define SIMULATOR_CAPACITY_MAX_DEVICES 100000UL
+#define SIMULATOR_SHIFT_SPREAD_MILLIS (5UL * SIMULATOR_MINUTE_MILLIS)
+
+static const NotificationMethod SIMULATOR_FALLBACK_METHODS[] = { THREEMA };
+
+/*
+This prints to the standard output for the parts of the firmware such as the
+latency trace which print themselves.
+*/
+
+class StandardOutput : public Print {
+  public:
+    using Print::write;
+    virtual size_t write(uint8_t c) {
+      putchar(c);
+      return 1;
+    }
+};
+
+struct SimulatorOptions {
+  const char* tracePath;
+  unsigned long stepMillis;
+  unsigned long tailMillis;
+  unsigned long synthesizeDays;
+  unsigned long opensPerDay;
+  unsigned long seed;
+  uint32_t loopAllocationBudget;
+  unsigned long fleetDetectors;
+  unsigned long relayPort;
+  unsigned long packetLossPercent;
+  unsigned long collectorPort;
+  unsigned long fallbackDeadlineSeconds;
+  unsigned long capacityDevices;
+  unsigned long workers;
+  unsigned long shiftMinute;
+  unsigned long sampleSeconds;
+  long networkSkewPpm;
+  const char* curvePath;
+  const char* consoleInputPath;
+  const char* armingWindows;
+  bool listNotifications;
+  bool memoryReport;
+  bool cryptoCheck;
+  bool verbose;
+};
+
+static void printUsage() {
+  fprintf(stderr,
+    "usage: sensorsim [options] (<trace.csv> | -s <days>)\n"
+    "       sensorsim -f <detectors> [options] (<trace.csv> | -s <days>)\n"
+    "       sensorsim -n <devices> [options] (<trace.csv> | -s <days>)\n"
+    "       sensorsim -c\n"
+    "  -s <days>     synthesize a trace of this many days instead of reading one\n"
+    "  -o <count>    openings of the sensor per day in a synthesized trace (8)\n"
+    "  -r <seed>     seed for the synthesized trace (1)\n"
+    "  -t <millis>   time the firmware takes to go around `loop()` (10)\n"
+    "  -e <minutes>  minutes to carry on after the last change in a trace (60)\n"
+    "  -b <count>    allocations allowed in a steady state `loop()` (0)\n"
+    "  -f <count>    run this many detectors, each a process, relaying through this one as the hub\n"
+    "  -p <port>     UDP port on the loopback that the hub listens on (47810)\n"
+    "  -u <percent>  percentage of the UDP packets that are lost (0)\n"
+    "  -y <port>     sync the history to a collector listening on this TCP port on the loopback\n"
+    "  -x <seconds>  relay to a hub that never answers and fall back to the gateway within this deadline\n"
+    "  -n <count>    run this many independent devices and report the load on the gateway\n"
+    "  -j <count>    worker processes that the devices are shared between (one per processor)\n"
+    "  -k <minute>   a shift change at this minute of each day opens every sensor\n"
+    "  -q <path>     write the requests and radios in each minute of a run of devices to a file\n"
+    "  -w <ppm>      the clocks on the network gain this many parts per million on the board's (0)\n"
+    "  -i <path>     type the lines of this file into the serial console once the board has started\n"
+    "  -a <seconds>  sample the sensor at this interval in deep sleep instead of it waking the board\n"
+    "  -g <windows>  only watch the sensor in these windows of the day in UTC such as 18:00-07:00\n"
+    "  -l            list the notifications that were sent; with -n, the devices\n"
+    "  -m            report on the memory allocated by the firmware\n"
+    "  -c            check the end-to-end cryptography against test vectors and time it\n"
+    "  -v            print the serial output of the firmware\n");
+}
+
+static bool parseOptions(int argc, char** argv, SimulatorOptions* options) {
+  options->tracePath = NULL;
+  options->stepMillis = 10;
+  options->tailMillis = 60UL * 60UL * 1000UL;
+  options->synthesizeDays = 0;
+  options->opensPerDay = 8;
+  options->seed = 1;
+  options->loopAllocationBudget = 0;
+  options->fleetDetectors = 0;
+  options->relayPort = RELAY_DEFAULT_PORT;
+  options->packetLossPercent = 0;
+  options->collectorPort = 0;
+  options->fallbackDeadlineSeconds = 0;
+  options->capacityDevices = 0;
+  options->workers = 0;
+  options->shiftMinute = ULONG_MAX;
+  options->sampleSeconds = 0;
+  options->networkSkewPpm = 0;
+  options->curvePath = NULL;
+  options->consoleInputPath = NULL;
+  options->armingWindows = NULL;
+  options->listNotifications = false;
+  options->memoryReport = false;
+  options->cryptoCheck = false;
+  options->verbose = false;
+
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+
+    if (0 == strcmp("-l", argv[i])) {
+      options->listNotifications = true;
+    } else if (0 == strcmp("-m", argv[i])) {
+      options->memoryReport = true;
+    } else if (0 == strcmp("-c", argv[i])) {
+      options->cryptoCheck = true;
+    } else if (0 == strcmp("-b", argv[i]) && hasValue) {
+      options->loopAllocationBudget = strtoul(argv[++i], NULL, 10);
+    } else if (0 == strcmp("-f", argv[i]) && hasValue) {
+      options->fleetDetectors = min(strtoul(argv[++i], NULL, 10),
+        (unsigned long) SIMULATOR_FLEET_MAX_DETECTORS);
+    } else if (0 == strcmp("-p", argv[i]) && hasValue) {
+      options->relayPort = strtoul(argv[++i], NULL, 10);
+    } else if (0 == strcmp("-u", argv[i]) && hasValue) {
+      options->packetLossPercent = min(strtoul(argv[++i], NULL, 10), 100UL);
+    } else if (0 == strcmp("-y", argv[i]) && hasValue) {
+      options->collectorPort = strtoul(argv[++i], NULL, 10);
+    } else if (0 == strcmp("-x", argv[i]) && hasValue) {
+      options->fallbackDeadlineSeconds = strtoul(argv[++i], NULL, 10);
+    } else if (0 == strcmp("-n", argv[i]) && hasValue) {
+      options->capacityDevices = min(strtoul(argv[++i], NULL, 10), SIMULATOR_CAPACITY_MAX_DEVICES);
+    } else if (0 == strcmp("-j", argv[i]) && hasValue) {
+      options->workers = min(strtoul(argv[++i], NULL, 10), (unsigned long) WORK_STEALING_MAX_WORKERS);
+    } else if (0 == strcmp("-k", argv[i]) && hasValue) {
+      options->shiftMinute = strtoul(argv[++i], NULL, 10);
+    } else if (0 == strcmp("-q", argv[i]) && hasValue) {
+      options->curvePath = argv[++i];
+    } else if (0 == strcmp("-w", argv[i]) && hasValue) {
+      options->networkSkewPpm = strtol(argv[++i], NULL, 10);
+    } else if (0 == strcmp("-i", argv[i]) && hasValue) {
+      options->consoleInputPath = argv[++i];
+    } else if (0 == strcmp("-a", argv[i]) && hasValue) {
+      options->sampleSeconds = strtoul(argv[++i], NULL, 10);
+    } else if (0 == strcmp("-g", argv[i]) && hasValue) {
+      options->armingWindows = argv[++i];
+    } else if (0 == strcmp("-v", argv[i])) {
+      options->verbose = true;
+    } else if (0 == strcmp("-s", argv[i]) && hasValue) {
+      options->synthesizeDays = strtoul(argv[++i], NULL, 10);
+    } else if (0 == strcmp("-o", argv[i]) && hasValue) {
+      options->opensPerDay = strtoul(argv[++i], NULL, 10);
+    } else if (0 == strcmp("-r", argv[i]) && hasValue) {
+      options->seed = strtoul(argv[++i], NULL, 10);
+    } else if (0 == strcmp("-t", argv[i]) && hasValue) {
+      options->stepMillis = max(1UL, strtoul(argv[++i], NULL, 10));
+    } else if (0 == strcmp("-e", argv[i]) && hasValue) {
+      options->tailMillis = strtoul(argv[++i], NULL, 10) * 60UL * 1000UL;
+    } else if ('-' != argv[i][0] && NULL == options->tracePath) {
+      options->tracePath = argv[i];
+    } else {
+      return false;
+    }
+  }
+
+  if (options->cryptoCheck) {
+    return true;
+  }
+
+  if (0 != options->capacityDevices && 0 != options->fleetDetectors) {
+    return false;
+  }
+
+  if ((0 != options->collectorPort || 0 != options->fallbackDeadlineSeconds)
+      && (0 != options->capacityDevices || 0 != options->fleetDetectors)) {
+    return false;
+  }
+
+  if (ULONG_MAX != options->shiftMinute && options->shiftMinute >= SIMULATOR_DAY_MINUTES) {
+    return false;
+  }
+
+  return (NULL == options->tracePath) != (0 == options->synthesizeDays);
+}
+
+static bool edgeIsBefore(const SimulatorEdge& a, const SimulatorEdge& b) {
+  return a.at < b.at;
+}
+
+/*
+Reads a trace with a line for each change in the form `<millis>,<input>,<value>`
+where the input is `sensor` with a value of `open` or `closed` or `button` with
+a value of `press` or `release`. A line `<millis>,end` marks the end of the
+trace. Blank lines and lines starting with `#` are ignored.
+*/
+
+static bool loadTrace(const char* path, unsigned long tailMillis,
+    std::vector<SimulatorEdge>* edges, unsigned long* endMillis) {
+  FILE* file = fopen(path, "r");
+
+  if (NULL == file) {
+    fprintf(stderr, "unable to open the trace [%s]\n", path);
+    return false;
+  }
+
+  char line[SIMULATOR_LINE_LENGTH];
+  int lineNumber = 0;
+  bool hasEnd = false;
+  unsigned long lastAt = 0;
+
+  while (NULL != fgets(line, sizeof(line), file)) {
+    char input[32];
+    char value[32];
+    unsigned long at;
+    SimulatorEdge edge;
+
+    lineNumber++;
+    line[strcspn(line, "\r\n")] = 0;
+
+    if (0 == line[0] || '#' == line[0]) {
+      continue;
+    }
+
+    int fields = sscanf(line, "%lu,%31[^,],%31s", &at, input, value);
+
+    if (2 == fields && 0 == strcmp("end", input)) {
+      *endMillis = at;
+      hasEnd = true;
+      continue;
+    }
+
+    edge.at = at;
+
+    if (3 == fields && 0 == strcmp("sensor", input)
+        && (0 == strcmp("open", value) || 0 == strcmp("closed", value))) {
+      edge.pin = PIN_SENSOR;
+      edge.level = 0 == strcmp("open", value) ? LOW : HIGH;
+    } else if (3 == fields && 0 == strcmp("button", input)
+        && (0 == strcmp("press", value) || 0 == strcmp("release", value))) {
+      edge.pin = PIN_BUTTON;
+      edge.level = 0 == strcmp("press", value) ? LOW : HIGH;
+    } else {
+      fprintf(stderr, "malformed line %d in the trace [%s]\n", lineNumber, line);
+      fclose(file);
+      return false;
+    }
+
+    edges->push_back(edge);
+    lastAt = max(lastAt, at);
+  }
+
+  fclose(file);
+
+  if (!hasEnd) {
+    *endMillis = lastAt + tailMillis;
+  }
+
+  std::stable_sort(edges->begin(), edges->end(), edgeIsBefore);
+  return true;
+}
+
+static unsigned long nextRandom(unsigned long* state) {
+  *state = (*state * 1103515245UL + 12345UL) & 0x7fffffffUL;
+  return *state;
+}
+
+/*
+Adds an edge on the sensor together with some contact bounce.
+*/
+
+static void addBouncingEdge(std::vector<SimulatorEdge>* edges, unsigned long at,
+    uint8_t level, unsigned long* randomState) {
+  int bounces = nextRandom(randomState) % 4;
+
+  for (int i = 0; i < bounces; i++) {
+    SimulatorEdge bounce = { at + i * 6, PIN_SENSOR, level };
+    SimulatorEdge back = { at + i * 6 + 3, PIN_SENSOR, (uint8_t) (HIGH == level ? LOW : HIGH) };
+    edges->push_back(bounce);
+    edges->push_back(back);
+  }
+
+  SimulatorEdge settled = { at + bounces * 6, PIN_SENSOR, level };
+  edges->push_back(settled);
+}
+
+/*
+Makes up a trace over the days requested with the sensor opened a number of
+times each day. Most openings are brief but now and then the sensor is left
+open for long enough to trigger reminders. If there is a shift change then
+the sensor is also opened within a few minutes of it each day; every device
+of a run does the same so their notifications come close together.
+*/
+
+static void synthesizeTrace(const SimulatorOptions& options,
+    std::vector<SimulatorEdge>* edges, unsigned long* endMillis) {
+  unsigned long randomState = options.seed;
+  unsigned long slotMillis = SIMULATOR_DAY_MILLIS / max(1UL, options.opensPerDay);
+
+  for (unsigned long day = 0; day < options.synthesizeDays; day++) {
+    for (unsigned long open = 0; open < options.opensPerDay; open++) {
+      unsigned long openAt = day * SIMULATOR_DAY_MILLIS + open * slotMillis
+        + nextRandom(&randomState) % (slotMillis / 4);
+      unsigned long openMillis;
+
+      if (0 == nextRandom(&randomState) % 16) {
+        openMillis = (40UL + nextRandom(&randomState) % 60UL) * 60UL * 1000UL;
+      } else {
+        openMillis = (5UL + nextRandom(&randomState) % 300UL) * 1000UL;
+      }
+
+      openMillis = min(openMillis, slotMillis / 2);
+
+      addBouncingEdge(edges, openAt, LOW, &randomState);
+      addBouncingEdge(edges, openAt + openMillis, HIGH, &randomState);
+    }
+
+    if (ULONG_MAX != options.shiftMinute) {
+      unsigned long openAt = day * SIMULATOR_DAY_MILLIS + options.shiftMinute * SIMULATOR_MINUTE_MILLIS
+        + nextRandom(&randomState) % SIMULATOR_SHIFT_SPREAD_MILLIS;
+      unsigned long openMillis = (5UL + nextRandom(&randomState) % 300UL) * 1000UL;
+
+      addBouncingEdge(edges, openAt, LOW, &randomState);
+      addBouncingEdge(edges, openAt + openMillis, HIGH, &randomState);
+    }
+  }
+
+  std::stable_sort(edges->begin(), edges->end(), edgeIsBefore);
+  *endMillis = options.synthesizeDays * SIMULATOR_DAY_MILLIS;
+}
+
+static void printDuration(const char* label, unsigned long millis) {
+  printf("%-22s %lu.%03lus (%.3f%%)\n", label, millis / 1000UL, millis % 1000UL,
+    0 == SimulatedHardware::endMillis() ? 0.0
+      : (100.0 * millis) / SimulatedHardware::endMillis());
+}
+
+struct SimulatorRun {
+  uint32_t openings;
+  bool open;
+  uint32_t loopsOverBudget;
+  uint32_t worstLoopAllocations;
+  uint32_t detections;
+  uint64_t detectionLatencyMillis;
+  unsigned long worstDetectionLatencyMillis;
+  bool armed;
+  unsigned long armedChangedAt;
+  unsigned long disarmedMillis;
+};
+
+/*
+The charge is estimated from the same model that the energy governor uses.
+*/
+
+static double chargePerDayMah(const SimulatorStats& stats, uint32_t samples, double days) {
+  EnergyModel model;
+
+  double microCoulombs =
+    ((double) stats.awakeMillis * model.charge(ENERGY_ACTIVITY_AWAKE)) / 1000.0
+    + ((double) stats.sleepMillis * model.charge(ENERGY_ACTIVITY_SLEEP)) / 1000.0
+    + (double) stats.wifiSessions * model.charge(ENERGY_ACTIVITY_WIFI_ASSOCIATE)
+    + (double) stats.tlsConnects * model.charge(ENERGY_ACTIVITY_TLS_HANDSHAKE)
+    + (double) (stats.httpRequests + stats.plainHttpRequests) * model.charge(ENERGY_ACTIVITY_HTTP_SEND)
+    + (double) samples * model.charge(ENERGY_ACTIVITY_SAMPLE);
+
+  return 0.0 == days ? 0.0 : microCoulombs / 3600000.0 / days;
+}
+
+static void printReport(const SimulatorOptions& options, const SimulatorRun& run) {
+  const SimulatorStats& stats = SimulatedHardware::stats();
+  const std::vector<SimulatorNotification>& notifications = SimulatedHardware::notifications();
+  double days = (double) SimulatedHardware::endMillis() / SIMULATOR_DAY_MILLIS;
+
+  if (options.listNotifications) {
+    for (size_t i = 0; i < notifications.size(); i++) {
+      const SimulatorNotification& notification = notifications[i];
+      printf("%lu %s \"%s\"\n", notification.at,
+        notification.to.c_str(), notification.text.c_str());
+    }
+  }
+
+  printf("%-22s %.3f\n", "simulated days", days);
+  printf("%-22s %lu\n", "sensor openings", (unsigned long) run.openings);
+  printf("%-22s %lu\n", "notifications", (unsigned long) notifications.size());
+  printDuration("awake", stats.awakeMillis);
+  printDuration("asleep", stats.sleepMillis);
+  printf("%-22s %lu\n", "deep sleeps", (unsigned long) stats.sleeps);
+  printf("%-22s %lu\n", "woken by alarm", (unsigned long) stats.alarmWakes);
+  printf("%-22s %lu\n", "wifi sessions", (unsigned long) stats.wifiSessions);
+  printf("%-22s %lu\n", "dns lookups", (unsigned long) stats.dnsLookups);
+  printf("%-22s %lu\n", "tls connections", (unsigned long) stats.tlsConnects);
+  printf("%-22s %lu\n", "http requests", (unsigned long) stats.httpRequests);
+  if (0 != options.fallbackDeadlineSeconds) {
+    FallbackNotificationService* fallback = (FallbackNotificationService*) notificationService;
+    printf("%-22s %lu\n", "fallbacks", (unsigned long) fallback->fallbackCount());
+    printf("%-22s %lu\n", "breaker skips", (unsigned long) fallback->skipCount());
+    printf("%-22s %lu\n", "breaker trips", (unsigned long) fallback->breaker(0).tripCount());
+    printf("%-22s %lu\n", "undelivered", (unsigned long) fallback->undeliveredCount());
+  }
+  if (0 != options.collectorPort) {
+    printf("%-22s %lu\n", "history requests", (unsigned long) stats.plainHttpRequests);
+    printf("%-22s %lu\n", "history synced", (unsigned long) historySync->syncedCount());
+    printf("%-22s %lu\n", "history sync failures", (unsigned long) historySync->failedCount());
+    printf("%-22s %lu\n", "history not synced",
+      (unsigned long) (HistoryLog::nextSequence() - HistoryLog::cursor()));
+  }
+  if (0 != options.sampleSeconds) {
+    printf("%-22s %lu\n", "input samples", (unsigned long) inputSampler->sampleCount());
+    printf("%-22s %lu\n", "samples that woke", (unsigned long) inputSampler->changeCount());
+    printf("%-22s %.3f mAh\n", "sample charge per day", 0.0 == days ? 0.0
+      : (double) inputSampler->sampleCount() * EnergyModel().charge(ENERGY_ACTIVITY_SAMPLE) / 3600000.0 / days);
+  }
+  if (NULL != options.armingWindows) {
+    unsigned long disarmedMillis = run.disarmedMillis;
+    if (!run.armed) {
+      disarmedMillis += SimulatedHardware::realMillis() - run.armedChangedAt;
+    }
+    printDuration("disarmed", disarmedMillis);
+  }
+  printf("%-22s %lums\n", "detection mean",
+    0 == run.detections ? 0UL : (unsigned long) (run.detectionLatencyMillis / run.detections));
+  printf("%-22s %lums\n", "detection worst", run.worstDetectionLatencyMillis);
+  printf("%-22s %ld\n", "changes missed",
+    (long) SimulatedHardware::burstCount(PIN_SENSOR, DEBOUNCE_DELAY) - (long) run.detections);
+  printf("%-22s %.3f mAh\n", "charge per day", chargePerDayMah(stats, inputSampler->sampleCount(), days));
+  if (WallClock::isKnown()) {
+    printf("%-22s %+lds\n", "wall clock error",
+      (long) WallClock::now(MonotonicClock::now()) - (long) SimulatedHardware::networkEpoch());
+  } else {
+    printf("%-22s %s\n", "wall clock error", "unknown");
+  }
+
+  StandardOutput output;
+  LatencyTrace::printTo(output);
+  WallClock::printTo(output, MonotonicClock::now());
+  sensorService->openStats().printTo(output, SimulatedHardware::realMillis());
+  printBounceProfilesTo(output);
+  eventBus->printTo(output);
+}
+
+/*
+Deletes everything that the firmware has built so that any of its allocations
+which are still live afterwards are known to have leaked.
+*/
+
+static void teardown() {
+  AllocationPhaseScope scope(ALLOCATION_PHASE_TEARDOWN);
+
+  delete relayHubService;
+  relayHubService = NULL;
+  delete sensorService;
+  sensorService = NULL;
+  delete notificationService;
+  notificationService = NULL;
+  delete historySync;
+  historySync = NULL;
+  delete indicatorService;
+  indicatorService = NULL;
+  delete eventBus;
+  eventBus = NULL;
+  delete buttonInput;
+  buttonInput = NULL;
+  delete inputSampler;
+  inputSampler = NULL;
+  delete sensorInput;
+  sensorInput = NULL;
+  delete settingsEditor;
+  settingsEditor = NULL;
+  delete settingsService;
+  settingsService = NULL;
+  delete energyGovernor;
+  energyGovernor = NULL;
+  activeSettings = NULL;
+}
+
+static void setupFirmware(SimulatorRun* run) {
+  {
+    AllocationPhaseScope scope(ALLOCATION_PHASE_SETUP);
+    setup();
+  }
+
+  run->openings = 0;
+  run->open = sensorInput->getState();
+  run->loopsOverBudget = 0;
+  run->worstLoopAllocations = 0;
+  run->detections = 0;
+  run->detectionLatencyMillis = 0;
+  run->worstDetectionLatencyMillis = 0;
+  run->armed = sensorArmed;
+  run->armedChangedAt = 0;
+  run->disarmedMillis = 0;
+}
+
+/*
+Goes around `loop()` once and then moves the time on. Going around `loop()`
+takes some time; but not so much that the next change in the trace is missed.
+*/
+
+static void loopFirmware(const SimulatorOptions& options, SimulatorRun* run) {
+  unsigned long loopAt = SimulatedHardware::realMillis();
+
+  {
+    // once the settings are applied, going around the loop should not need
+    // to allocate anything.
+
+    bool steady = WATCH == stateMachine;
+    uint32_t allocations = AllocationTracker::allocationCount(ALLOCATION_PHASE_LOOP);
+    AllocationPhaseScope scope(ALLOCATION_PHASE_LOOP);
+
+    loop();
+
+    allocations = AllocationTracker::allocationCount(ALLOCATION_PHASE_LOOP) - allocations;
+
+    if (steady && allocations > options.loopAllocationBudget) {
+      run->loopsOverBudget++;
+      run->worstLoopAllocations = max(run->worstLoopAllocations, allocations);
+    }
+  }
+
+  if (!run->open && sensorInput->getState()) {
+    run->openings++;
+  }
+
+  // how long the firmware took to see the change is measured from the start
+  // of the change's bounce in the trace.
+
+  if (run->open != sensorInput->getState()) {
+    unsigned long latency = SimulatedHardware::realMillis()
+      - SimulatedHardware::burstStartedAt(PIN_SENSOR, DEBOUNCE_DELAY);
+    run->detections++;
+    run->detectionLatencyMillis += latency;
+    run->worstDetectionLatencyMillis = max(run->worstDetectionLatencyMillis, latency);
+  }
+
+  run->open = sensorInput->getState();
+
+  // the sensor is armed or disarmed before the board sleeps in `loop()`
+
+  if (run->armed != sensorArmed) {
+    if (!run->armed) {
+      run->disarmedMillis += loopAt - run->armedChangedAt;
+    }
+    run->armed = sensorArmed;
+    run->armedChangedAt = loopAt;
+  }
+
+  if (!SimulatedHardware::finished()) {
+    unsigned long step = options.stepMillis;
+    unsigned long toNextEdge = SimulatedHardware::millisToNextEdge();
+
+    if (0 != toNextEdge) {
+      step = min(step, toNextEdge);
+    }
+
+    SimulatedHardware::advance(step);
+  }
+}
+
+/*
+Tears the firmware down and returns the status that the simulator should exit
+with; non-zero if the firmware allocated in a steady loop or leaked.
+*/
+
+static int finishFirmware(const SimulatorOptions& options, const SimulatorRun& run) {
+  teardown();
+
+  if (options.memoryReport) {
+    AllocationTracker::printTo(stdout);
+  }
+
+  int result = 0;
+
+  if (0 != run.loopsOverBudget) {
+    fprintf(stderr, "%lu loops went over the budget of %lu allocations; worst %lu\n",
+      (unsigned long) run.loopsOverBudget, (unsigned long) options.loopAllocationBudget,
+      (unsigned long) run.worstLoopAllocations);
+    result = 2;
+  }
+
+  if (0 != AllocationTracker::leakCount()) {
+    fprintf(stderr, "%lu allocations leaked; use -m for where they were made\n",
+      (unsigned long) AllocationTracker::leakCount());
+    result = 2;
+  }
+
+  return result;
+}
+
+/*
+Reads the whole of the file that is to be typed into the serial console.
+*/
+
+static bool loadConsoleInput(const char* path, std::string* input) {
+  FILE* file = fopen(path, "r");
+  char buffer[SIMULATOR_LINE_LENGTH];
+  size_t length;
+
+  if (NULL == file) {
+    fprintf(stderr, "unable to open [%s]\n", path);
+    return false;
+  }
+
+  while (0 != (length = fread(buffer, 1, sizeof(buffer), file))) {
+    input->append(buffer, length);
+  }
+
+  fclose(file);
+  return true;
+}
+
+static bool loadEdges(const SimulatorOptions& options, unsigned long seed,
+    std::vector<SimulatorEdge>* edges, unsigned long* endMillis) {
+  if (0 != options.synthesizeDays) {
+    SimulatorOptions seeded = options;
+    seeded.seed = seed;
+    synthesizeTrace(seeded, edges, endMillis);
+    return true;
+  }
+  return loadTrace(options.tracePath, options.tailMillis, edges, endMillis);
+}
+
+/*
+In a fleet, when syncing to a collector or when falling back, each board is
+set up as usual and is then given settings which are those of
+`staticsettings.h` but for the description, the notification method and the
+relay, collector and delivery settings. Each process sets up one board so it
+only needs one set of these settings.
+*/
+
+static void applyRunSettings(const char* description, NotificationMethod method,
+    const RelaySettings& relaySettings, const CollectorSettings& collectorSettings,
+    const DeliverySettings& deliverySettings) {
+  static Settings settings(
+    description,
+    *(STATICSETTINGS.wifiSettings()),
+    *(STATICSETTINGS.monitoringSettings()),
+    method,
+    *(STATICSETTINGS.threemaSettings()),
+    *(STATICSETTINGS.messageSettings()),
+    relaySettings,
+    collectorSettings,
+    deliverySettings);
+
+  settingsService->save(&settings);
+}
+
+/*
+This is what a detector tells the hub's process about its run once it has
+finished.
+*/
+
+struct FleetDetectorReport {
+  uint32_t openings;
+  uint32_t relayed;
+  uint32_t retries;
+  uint32_t unacknowledged;
+  uint32_t wifiSessions;
+  uint32_t tlsConnects;
+  uint32_t udpPacketsLost;
+};
+
+/*
+Runs a detector in a process of its own. It waits until the hub is listening
+and then runs through its trace, relaying its notifications to the hub on the
+loopback. Each detector synthesizes its own trace from a seed of its own.
+*/
+
+static int runFleetDetector(const SimulatorOptions& options, int index,
+    int readyPipe, int reportPipe) {
+  std::vector<SimulatorEdge> edges;
+  unsigned long endMillis = 0;
+  char ready;
+  static char description[SIMULATOR_DESCRIPTION_LENGTH];
+
+  if (1 != read(readyPipe, &ready, 1)) {
+    return 1;
+  }
+
+  if (!loadEdges(options, options.seed + index, &edges, &endMillis)) {
+    return 1;
+  }
+
+  snprintf(description, sizeof(description), "Detector %d", index + 1);
+
+  SimulatedHardware::setPacketLoss(options.packetLossPercent, options.seed + index);
+  SimulatedHardware::reset(edges, endMillis);
+
+  SimulatorRun run;
+  setupFirmware(&run);
+  applyRunSettings(description, RELAY,
+    RelaySettings("127.0.0.1", (int) options.relayPort), CollectorSettings(), DeliverySettings());
+
+  while (!SimulatedHardware::finished()) {
+    loopFirmware(options, &run);
+  }
+
+  // the notification service is known to be the relay as set above.
+
+  RelayNotificationService* relay = (RelayNotificationService*) notificationService;
+  const SimulatorStats& stats = SimulatedHardware::stats();
+  FleetDetectorReport report;
+  report.openings = run.openings;
+  report.relayed = relay->relayedCount();
+  report.retries = relay->retryCount();
+  report.unacknowledged = relay->unacknowledgedCount();
+  report.wifiSessions = stats.wifiSessions;
+  report.tlsConnects = stats.tlsConnects;
+  report.udpPacketsLost = stats.udpPacketsLost;
+
+  if (sizeof(report) != write(reportPipe, &report, sizeof(report))) {
+    return 1;
+  }
+
+  return finishFirmware(options, run);
+}
+
+/*
+This process is the hub. The detectors are started first but wait until the
+hub is listening. The hub then runs until every detector has finished and it
+has notified everything that they relayed to it. Its own sensor stays closed.
+*/
+
+static int runFleet(const SimulatorOptions& options) {
+  std::vector<SimulatorEdge> edges;
+  int readyPipe[2];
+  int reportPipe[2];
+  pid_t detectors[SIMULATOR_FLEET_MAX_DETECTORS];
+  int running = (int) options.fleetDetectors;
+  int result = 0;
+
+  if (0 != pipe(readyPipe) || 0 != pipe(reportPipe)) {
+    fprintf(stderr, "unable to create the pipes for the fleet\n");
+    return 1;
+  }
+
+  fflush(stdout);
+
+  for (int i = 0; i < running; i++) {
+    detectors[i] = fork();
+
+    if (0 == detectors[i]) {
+      close(readyPipe[1]);
+      close(reportPipe[0]);
+      exit(runFleetDetector(options, i, readyPipe[0], reportPipe[1]));
+    }
+  }
+
+  close(readyPipe[0]);
+  close(reportPipe[1]);
+
+  SimulatedHardware::setPacketLoss(options.packetLossPercent, options.seed);
+  SimulatedHardware::reset(edges, ULONG_MAX);
+
+  SimulatorRun run;
+  setupFirmware(&run);
+  applyRunSettings(STATICSETTINGS.description(), STATICSETTINGS.notificationMethod(),
+    RelaySettings((int) options.relayPort), CollectorSettings(), DeliverySettings());
+
+  while (NULL == relayHubService || WL_CONNECTED != WiFi.status()) {
+    loopFirmware(options, &run);
+  }
+
+  loopFirmware(options, &run);
+
+  for (int i = 0; i < running; i++) {
+    if (1 != write(readyPipe[1], "r", 1)) {
+      result = 1;
+    }
+  }
+
+  close(readyPipe[1]);
+
+  while (0 != running || 0 != relayHubService->queueLength()) {
+    loopFirmware(options, &run);
+
+    int status;
+    pid_t finished;
+
+    while (0 < (finished = waitpid(-1, &status, WNOHANG))) {
+      running--;
+      if (!WIFEXITED(status) || 0 != WEXITSTATUS(status)) {
+        result = 2;
+      }
+    }
+  }
+
+  FleetDetectorReport total;
+  FleetDetectorReport report;
+  memset(&total, 0, sizeof(total));
+
+  while (sizeof(report) == read(reportPipe[0], &report, sizeof(report))) {
+    total.openings += report.openings;
+    total.relayed += report.relayed;
+    total.retries += report.retries;
+    total.unacknowledged += report.unacknowledged;
+    total.wifiSessions += report.wifiSessions;
+    total.tlsConnects += report.tlsConnects;
+    total.udpPacketsLost += report.udpPacketsLost;
+  }
+
+  close(reportPipe[0]);
+
+  const SimulatorStats& stats = SimulatedHardware::stats();
+  const std::vector<SimulatorNotification>& notifications = SimulatedHardware::notifications();
+
+  if (options.listNotifications) {
+    for (size_t i = 0; i < notifications.size(); i++) {
+      printf("%lu %s \"%s\"\n", notifications[i].at,
+        notifications[i].to.c_str(), notifications[i].text.c_str());
+    }
+  }
+
+  printf("%-22s %lu\n", "detectors", options.fleetDetectors);
+  printf("%-22s %lu\n", "sensor openings", (unsigned long) total.openings);
+  printf("%-22s %lu\n", "events relayed", (unsigned long) total.relayed);
+  printf("%-22s %lu\n", "relay retries", (unsigned long) total.retries);
+  printf("%-22s %lu\n", "unacknowledged", (unsigned long) total.unacknowledged);
+  printf("%-22s %lu\n", "udp packets lost",
+    (unsigned long) (total.udpPacketsLost + stats.udpPacketsLost));
+  printf("%-22s %lu\n", "detector wifi sessions", (unsigned long) total.wifiSessions);
+  printf("%-22s %lu\n", "detector tls", (unsigned long) total.tlsConnects);
+  printf("%-22s %lu\n", "hub events received", (unsigned long) relayHubService->receivedCount());
+  printf("%-22s %lu\n", "hub duplicates", (unsigned long) relayHubService->duplicateCount());
+  printf("%-22s %lu\n", "hub refused", (unsigned long) relayHubService->refusedCount());
+  printf("%-22s %lu\n", "hub batches", (unsigned long) relayHubService->batchCount());
+  printf("%-22s %lu\n", "notifications", (unsigned long) notifications.size());
+  printf("%-22s %lu\n", "hub wifi sessions", (unsigned long) stats.wifiSessions);
+  printf("%-22s %lu\n", "hub dns lookups", (unsigned long) stats.dnsLookups);
+  printf("%-22s %lu\n", "hub tls connections", (unsigned long) stats.tlsConnects);
+  printf("%-22s %lu\n", "hub http requests", (unsigned long) stats.httpRequests);
+
+  int finishResult = finishFirmware(options, run);
+  return 0 != result ? result : finishResult;
+}
+
+/*
+This is what each device of a capacity run leaves for the report.
+*/
+
+struct CapacityDeviceResult {
+  uint32_t openings;
+  uint32_t wifiSessions;
+  uint32_t httpRequests;
+  double chargePerDayMah;
+};
+
+/*
+A capacity run keeps its results in memory that is shared between its
+processes. Each minute of the run has the number of requests made to the
+gateway in it and the time for which radios were on in it; both summed over
+all of the devices. The devices add to these with atomic operations as any
+number of them may be finishing at once.
+*/
+
+struct CapacityShared {
+  void* memory;
+  size_t length;
+  unsigned long minutes;
+  uint64_t* radioMillis;
+  CapacityDeviceResult* devices;
+  uint32_t* requests;
+};
+
+static bool createCapacityShared(unsigned long devices, unsigned long minutes,
+    CapacityShared* shared) {
+  size_t radioLength = minutes * sizeof(uint64_t);
+  size_t devicesLength = devices * sizeof(CapacityDeviceResult);
+  size_t requestsLength = minutes * sizeof(uint32_t);
+
+  shared->length = radioLength + devicesLength + requestsLength;
+  shared->minutes = minutes;
+  shared->memory = mmap(NULL, shared->length, PROT_READ | PROT_WRITE,
+    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+  if (MAP_FAILED == shared->memory) {
+    return false;
+  }
+
+  // the mapping starts out zeroed.
+
+  uint8_t* memory = (uint8_t*) shared->memory;
+  shared->radioMillis = (uint64_t*) memory;
+  shared->devices = (CapacityDeviceResult*) (memory + radioLength);
+  shared->requests = (uint32_t*) (memory + radioLength + devicesLength);
+  return true;
+}
+
+static void addRadioSpan(CapacityShared* shared, unsigned long from, unsigned long to) {
+  while (from < to && from / SIMULATOR_MINUTE_MILLIS < shared->minutes) {
+    unsigned long minute = from / SIMULATOR_MINUTE_MILLIS;
+    unsigned long until = min(to, (minute + 1) * SIMULATOR_MINUTE_MILLIS);
+    __atomic_fetch_add(&shared->radioMillis[minute], (uint64_t) (until - from), __ATOMIC_RELAXED);
+    from = until;
+  }
+}
+
+/*
+Runs one device through its trace as a board of its own would and adds what
+it did to the shared results. Each device synthesizes its own trace from a
+seed of its own. This is run in a process of its own because the firmware
+keeps its services in globals and its state in RAM that survives a reset;
+each device must start as a board does when it is first powered on.
+*/
+
+static int runCapacityDevice(const SimulatorOptions& options, uint32_t index,
+    CapacityShared* shared) {
+  std::vector<SimulatorEdge> edges;
+  unsigned long endMillis = 0;
+
+  if (!loadEdges(options, options.seed + index, &edges, &endMillis)) {
+    return 1;
+  }
+
+  SimulatedHardware::reset(edges, endMillis);
+
+  SimulatorRun run;
+  setupFirmware(&run);
+
+  while (!SimulatedHardware::finished()) {
+    loopFirmware(options, &run);
+  }
+
+  // a radio that is still on counts until the end of the run.
+
+  SimulatedHardware::recordRadio(false);
+
+  const SimulatorStats& stats = SimulatedHardware::stats();
+  const std::vector<SimulatorNotification>& notifications = SimulatedHardware::notifications();
+  const std::vector<SimulatorSpan>& radioSpans = SimulatedHardware::radioSpans();
+  CapacityDeviceResult& result = shared->devices[index];
+
+  result.openings = run.openings;
+  result.wifiSessions = stats.wifiSessions;
+  result.httpRequests = stats.httpRequests;
+  result.chargePerDayMah = chargePerDayMah(stats, inputSampler->sampleCount(),
+    (double) endMillis / SIMULATOR_DAY_MILLIS);
+
+  for (size_t i = 0; i < notifications.size(); i++) {
+    unsigned long minute = notifications[i].at / SIMULATOR_MINUTE_MILLIS;
+    if (minute < shared->minutes) {
+      __atomic_fetch_add(&shared->requests[minute], 1, __ATOMIC_RELAXED);
+    }
+  }
+
+  for (size_t i = 0; i < radioSpans.size(); i++) {
+    addRadioSpan(shared, radioSpans[i].from, radioSpans[i].to);
+  }
+
+  return finishFirmware(options, run);
+}
+
+/*
+A worker takes devices from the pool until there are none left, running each
+in a process that it forks for the device.
+*/
+
+static int runCapacityWorker(const SimulatorOptions& options, int worker,
+    WorkStealingPool* pool, CapacityShared* shared) {
+  uint32_t device;
+  int result = 0;
+
+  while (pool->take(worker, &device)) {
+    pid_t child = fork();
+
+    if (0 == child) {
+      exit(runCapacityDevice(options, device, shared));
+    }
+
+    int status;
+
+    if (child < 0 || child != waitpid(child, &status, 0)
+        || !WIFEXITED(status) || 0 != WEXITSTATUS(status)) {
+      result = 2;
+    }
+  }
+
+  return result;
+}
+
+static void formatMinute(unsigned long minute, char* buffer, size_t length) {
+  snprintf(buffer, length, "day %lu %02lu:%02lu",
+    minute / SIMULATOR_DAY_MINUTES + 1,
+    (minute % SIMULATOR_DAY_MINUTES) / 60,
+    minute % 60);
+}
+
+static bool chargeIsLess(const CapacityDeviceResult& a, const CapacityDeviceResult& b) {
+  return a.chargePerDayMah < b.chargePerDayMah;
+}
+
+static bool writeCurve(const char* path, const CapacityShared& shared) {
+  FILE* file = fopen(path, "w");
+
+  if (NULL == file) {
+    fprintf(stderr, "unable to write the curve to [%s]\n", path);
+    return false;
+  }
+
+  fprintf(file, "minute,requests,radios\n");
+
+  for (unsigned long i = 0; i < shared.minutes; i++) {
+    fprintf(file, "%lu,%lu,%.3f\n", i, (unsigned long) shared.requests[i],
+      (double) shared.radioMillis[i] / SIMULATOR_MINUTE_MILLIS);
+  }
+
+  fclose(file);
+  return true;
+}
+
+/*
+Runs a large number of devices, each independently of the others, to see the
+load that they would put on the gateway together and the charge that each
+uses. The number of radios that are on in a minute is the time for which
+radios were on in that minute divided by its length; it is how many devices
+were on the Wifi at once on average over that minute.
+*/
+
+static int runCapacity(const SimulatorOptions& options) {
+  std::vector<SimulatorEdge> edges;
+  unsigned long endMillis = 0;
+  unsigned long devices = options.capacityDevices;
+  int workers = (int) options.workers;
+  int result = 0;
+  CapacityShared shared;
+
+  // every device's trace lasts for as long as this one.
+
+  if (!loadEdges(options, options.seed, &edges, &endMillis)) {
+    return 1;
+  }
+
+  if (0 == workers) {
+    workers = (int) min((long) WORK_STEALING_MAX_WORKERS, max(1L, sysconf(_SC_NPROCESSORS_ONLN)));
+  }
+
+  workers = (int) min((unsigned long) workers, devices);
+
+  WorkStealingPool* pool = WorkStealingPool::create((uint32_t) devices, workers);
+
+  if (NULL == pool || !createCapacityShared(devices,
+      (endMillis + SIMULATOR_MINUTE_MILLIS - 1) / SIMULATOR_MINUTE_MILLIS, &shared)) {
+    fprintf(stderr, "unable to map the memory shared by the workers\n");
+    WorkStealingPool::destroy(pool);
+    return 1;
+  }
+
+  fflush(stdout);
+
+  for (int i = 0; i < workers; i++) {
+    pid_t worker = fork();
+
+    if (0 == worker) {
+      exit(runCapacityWorker(options, i, pool, &shared));
+    }
+
+    if (worker < 0) {
+      result = 1;
+    }
+  }
+
+  int status;
+
+  while (0 < wait(&status)) {
+    if (!WIFEXITED(status) || 0 != WEXITSTATUS(status)) {
+      result = 2;
+    }
+  }
+
+  std::vector<CapacityDeviceResult> results(shared.devices, shared.devices + devices);
+  std::vector<uint32_t> requests(shared.requests, shared.requests + shared.minutes);
+  CapacityDeviceResult total;
+  unsigned long busiestMinute = 0;
+  unsigned long radioMinute = 0;
+  double meanCharge = 0.0;
+  char when[32];
+
+  memset(&total, 0, sizeof(total));
+
+  for (unsigned long i = 0; i < devices; i++) {
+    total.openings += results[i].openings;
+    total.wifiSessions += results[i].wifiSessions;
+    total.httpRequests += results[i].httpRequests;
+    meanCharge += results[i].chargePerDayMah / devices;
+
+    if (options.listNotifications) {
+      printf("device %lu %.3f mAh %lu requests\n", i + 1,
+        results[i].chargePerDayMah, (unsigned long) results[i].httpRequests);
+    }
+  }
+
+  for (unsigned long i = 0; i < shared.minutes; i++) {
+    if (shared.requests[i] > shared.requests[busiestMinute]) {
+      busiestMinute = i;
+    }
+    if (shared.radioMillis[i] > shared.radioMillis[radioMinute]) {
+      radioMinute = i;
+    }
+  }
+
+  std::sort(requests.begin(), requests.end());
+  std::sort(results.begin(), results.end(), chargeIsLess);
+
+  printf("%-22s %lu\n", "devices", devices);
+  printf("%-22s %d\n", "workers", workers);
+  printf("%-22s %lu\n", "work steals", (unsigned long) pool->stealCount());
+  printf("%-22s %.3f\n", "simulated days", (double) endMillis / SIMULATOR_DAY_MILLIS);
+  printf("%-22s %lu\n", "sensor openings", (unsigned long) total.openings);
+  printf("%-22s %lu\n", "wifi sessions", (unsigned long) total.wifiSessions);
+  printf("%-22s %lu\n", "http requests", (unsigned long) total.httpRequests);
+  printf("%-22s %.3f\n", "requests/minute mean",
+    0 == shared.minutes ? 0.0 : (double) total.httpRequests / shared.minutes);
+  printf("%-22s %lu\n", "requests/minute p99",
+    0 == shared.minutes ? 0UL : (unsigned long) requests[(shared.minutes * 99) / 100]);
+  formatMinute(busiestMinute, when, sizeof(when));
+  printf("%-22s %lu (%s)\n", "requests/minute peak",
+    0 == shared.minutes ? 0UL : (unsigned long) shared.requests[busiestMinute], when);
+  formatMinute(radioMinute, when, sizeof(when));
+  printf("%-22s %.3f (%s)\n", "radios on peak",
+    0 == shared.minutes ? 0.0 : (double) shared.radioMillis[radioMinute] / SIMULATOR_MINUTE_MILLIS, when);
+  printf("%-22s %.3f mAh\n", "charge per day mean", meanCharge);
+  printf("%-22s %.3f mAh\n", "charge per day p50", results[devices / 2].chargePerDayMah);
+  printf("%-22s %.3f mAh\n", "charge per day p90", results[(devices * 9) / 10].chargePerDayMah);
+  printf("%-22s %.3f mAh\n", "charge per day max", results[devices - 1].chargePerDayMah);
+
+  if (NULL != options.curvePath && !writeCurve(options.curvePath, shared)) {
+    result = 1;
+  }
+
+  munmap(shared.memory, shared.length);
+  WorkStealingPool::destroy(pool);
+  return result;
+}
+
+int main(int argc, char** argv) {
+  SimulatorOptions options;
+  std::vector<SimulatorEdge> edges;
+  unsigned long endMillis = 0;
+
+  if (!parseOptions(argc, argv, &options)) {
+    printUsage();
+    return 1;
+  }
+
+  if (options.cryptoCheck) {
+    return CryptoCheck::run(stdout) ? 0 : 2;
+  }
+
+  SimulatedHardware::setVerbose(options.verbose);
+  SimulatedHardware::setNetworkSkew(options.networkSkewPpm);
+
+  if (0 != options.fleetDetectors) {
+    return runFleet(options);
+  }
+
+  if (0 != options.capacityDevices) {
+    return runCapacity(options);
+  }
+
+  if (!loadEdges(options, options.seed, &edges, &endMillis)) {
+    return 1;
+  }
+
+  std::string consoleInput;
+
+  if (NULL != options.consoleInputPath && !loadConsoleInput(options.consoleInputPath, &consoleInput)) {
+    return 1;
+  }
+
+  SimulatedHardware::reset(edges, endMillis);
+  SimulatedHardware::setSerialInput(consoleInput);
+
+  SimulatorRun run;
+  setupFirmware(&run);
+
+  // nothing listens for a hub on the relay port so every event that is
+  // relayed goes unacknowledged and falls back to the gateway.
+
+  if (0 != options.fallbackDeadlineSeconds) {
+    applyRunSettings(STATICSETTINGS.description(), RELAY,
+      RelaySettings("127.0.0.1", (int) options.relayPort),
+      0 != options.collectorPort
+        ? CollectorSettings("127.0.0.1", (int) options.collectorPort, "/history")
+        : CollectorSettings(),
+      DeliverySettings(SIMULATOR_FALLBACK_METHODS, (int) options.fallbackDeadlineSeconds));
+  } else if (0 != options.collectorPort) {
+    applyRunSettings(STATICSETTINGS.description(), STATICSETTINGS.notificationMethod(),
+      *(STATICSETTINGS.relaySettings()),
+      CollectorSettings("127.0.0.1", (int) options.collectorPort, "/history"),
+      DeliverySettings());
+  }
+
+  // the settings are changed as they would be from the serial console; the
+  // sensor is then sampled as if it were on a pin without a wake interrupt.
+
+  if (0 != options.sampleSeconds) {
+    char sampleSeconds[SIMULATOR_DESCRIPTION_LENGTH];
+    snprintf(sampleSeconds, sizeof(sampleSeconds), "%lu", options.sampleSeconds);
+    settingsEditor->set("monitoring.sampleSeconds", sampleSeconds);
+  }
+
+  if (NULL != options.armingWindows
+      && SETTINGS_EDIT_OK != settingsEditor->set("monitoring.armingWindows", options.armingWindows)) {
+    fprintf(stderr, "the arming windows [%s] are not understood\n", options.armingWindows);
+    return 1;
+  }
+
+  while (!SimulatedHardware::finished()) {
+    loopFirmware(options, &run);
+  }
+
+  printReport(options, run);
+  return finishFirmware(options, run);
+}
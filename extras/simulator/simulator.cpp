@@ -0,0 +1,1189 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#include "simulator.h"
+
+#include "allocationtracker.h"
+
+#include <Arduino.h>
+#include <ArduinoLowPower.h>
+#include <RTCZero.h>
+#include <WiFiNINA.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SIMULATOR_PIN_COUNT 32
+#define SIMULATOR_RTC_EPOCH 1672531200UL
+
+// the address is 203.0.113.10 in the order that the octets are in memory
+
+#define SIMULATOR_GATEWAY_ADDRESS 0x0A7100CBUL
+
+static const char* SIMULATOR_RESPONSE =
+  "HTTP/1.1 200 OK\r\n"
+  "Date: %s\r\n"
+  "Content-Length: 0\r\n"
+  "Connection: close\r\n"
+  "\r\n";
+
+static std::vector<SimulatorEdge> simulatorEdges;
+static size_t simulatorNextEdge = 0;
+static std::vector<SimulatorNotification> simulatorNotifications;
+static std::vector<SimulatorSpan> simulatorRadioSpans;
+static bool simulatorRadioOn = false;
+static unsigned long simulatorRadioOnAt = 0;
+static uint8_t simulatorPinLevels[SIMULATOR_PIN_COUNT];
+static voidFuncPtr simulatorPinInterrupts[SIMULATOR_PIN_COUNT];
+static unsigned long simulatorRealMillis = 0;
+static unsigned long simulatorAwakeMillis = 0;
+static unsigned long simulatorEndMillis = 0;
+static unsigned long simulatorAlarmMillis = 0;
+static voidFuncPtr simulatorAlarmInterrupt = NULL;
+static bool simulatorFinished = false;
+static bool simulatorVerbose = false;
+static SimulatorStats simulatorStats;
+static SimulatorTimings simulatorTimings = { 2500L, 300L, 1500L, 400L };
+static bool simulatorSockets[MAX_SOCK_NUM];
+static unsigned long simulatorPacketLossPercent = 0;
+static unsigned long simulatorPacketLossState = 1;
+static long simulatorNetworkSkewPpm = 0;
+static std::string simulatorSerialInput;
+static size_t simulatorSerialInputNext = 0;
+
+SimulatorSerial Serial;
+WiFiClass WiFi;
+ArduinoLowPowerClass LowPower;
+
+/*static*/
+void SimulatedHardware::reset(const std::vector<SimulatorEdge>& edges, unsigned long endMillis) {
+  simulatorEdges = edges;
+  simulatorNextEdge = 0;
+  simulatorNotifications.clear();
+  simulatorRadioSpans.clear();
+  simulatorRadioOn = false;
+  simulatorRealMillis = 0;
+  simulatorAwakeMillis = 0;
+  simulatorEndMillis = endMillis;
+  simulatorAlarmMillis = 0;
+  simulatorAlarmInterrupt = NULL;
+  simulatorFinished = false;
+  memset(&simulatorStats, 0, sizeof(simulatorStats));
+  memset(simulatorSockets, 0, sizeof(simulatorSockets));
+
+  // the inputs are pulled up so they are high until something pulls them low
+  // and they have no interrupts until the firmware attaches them
+
+  for (int i = 0; i < SIMULATOR_PIN_COUNT; i++) {
+    simulatorPinLevels[i] = HIGH;
+    simulatorPinInterrupts[i] = NULL;
+  }
+
+  applyEdges();
+}
+
+/*static*/
+unsigned long SimulatedHardware::realMillis() {
+  return simulatorRealMillis;
+}
+
+/*static*/
+unsigned long SimulatedHardware::awakeMillis() {
+  return simulatorAwakeMillis;
+}
+
+/*static*/
+unsigned long SimulatedHardware::endMillis() {
+  return simulatorEndMillis;
+}
+
+/*static*/
+bool SimulatedHardware::finished() {
+  return simulatorFinished;
+}
+
+/*static*/
+bool SimulatedHardware::verbose() {
+  return simulatorVerbose;
+}
+
+/*static*/
+void SimulatedHardware::setVerbose(bool verbose) {
+  simulatorVerbose = verbose;
+}
+
+/*
+Drops this percentage of the UDP packets that are sent. Which are dropped is
+decided from the seed so that a run can be repeated.
+*/
+
+/*static*/
+void SimulatedHardware::setPacketLoss(unsigned long percent, unsigned long seed) {
+  simulatorPacketLossPercent = percent;
+  simulatorPacketLossState = seed;
+}
+
+/*
+Makes the clocks out on the network gain this many parts per million on the
+board's RTC; a negative skew makes them lose.
+*/
+
+/*static*/
+void SimulatedHardware::setNetworkSkew(long ppm) {
+  simulatorNetworkSkewPpm = ppm;
+}
+
+/*
+The input is available to be read from the serial port straight away, as if
+it had all been typed in at once.
+*/
+
+/*static*/
+void SimulatedHardware::setSerialInput(const std::string& input) {
+  simulatorSerialInput = input;
+  simulatorSerialInputNext = 0;
+}
+
+/*static*/
+unsigned long SimulatedHardware::networkEpoch() {
+  long long millis = (long long) simulatorRealMillis;
+  millis += (millis * simulatorNetworkSkewPpm) / 1000000LL;
+  return SIMULATOR_RTC_EPOCH + (unsigned long) (millis / 1000LL);
+}
+
+/*static*/
+bool SimulatedHardware::losePacket() {
+  simulatorStats.udpPacketsSent++;
+
+  if (0 == simulatorPacketLossPercent) {
+    return false;
+  }
+
+  simulatorPacketLossState = (simulatorPacketLossState * 1103515245UL + 12345UL) & 0x7fffffffUL;
+
+  if ((simulatorPacketLossState >> 8) % 100 < simulatorPacketLossPercent) {
+    simulatorStats.udpPacketsLost++;
+    return true;
+  }
+
+  return false;
+}
+
+/*
+Sets the real time at which the RTC alarm will wake the board from deep sleep
+or, if zero, turns the alarm off.
+*/
+
+/*static*/
+void SimulatedHardware::setAlarm(unsigned long at) {
+  simulatorAlarmMillis = at;
+}
+
+/*static*/
+void SimulatedHardware::setAlarmInterrupt(voidFuncPtr callback) {
+  simulatorAlarmInterrupt = callback;
+}
+
+/*
+Moves both clocks on while the board is awake. The simulation is finished once
+the real time reaches the end of the trace.
+*/
+
+/*static*/
+void SimulatedHardware::advance(unsigned long millis) {
+  simulatorRealMillis += millis;
+  simulatorAwakeMillis += millis;
+  simulatorStats.awakeMillis += millis;
+  applyEdges();
+
+  if (simulatorRealMillis >= simulatorEndMillis) {
+    simulatorFinished = true;
+  }
+}
+
+/*
+Returns the real time until the next change in the trace or zero if there are
+no more changes.
+*/
+
+/*static*/
+unsigned long SimulatedHardware::millisToNextEdge() {
+  if (simulatorNextEdge >= simulatorEdges.size()) {
+    return 0;
+  }
+  return simulatorEdges[simulatorNextEdge].at - simulatorRealMillis;
+}
+
+/*
+Only the real time moves on in deep sleep. A pin is only able to wake the
+board if the firmware has attached an interrupt to it so the board sleeps
+until the next change on such a pin, the RTC alarm or, if there is neither,
+until the end of the trace. Changes on the other pins still happen while the
+board sleeps.
+*/
+
+/*static*/
+void SimulatedHardware::deepSleep() {
+  unsigned long wakeAt = simulatorEndMillis;
+  bool alarm = false;
+
+  if (0 != simulatorAlarmMillis
+      && simulatorAlarmMillis > simulatorRealMillis
+      && simulatorAlarmMillis < wakeAt) {
+    wakeAt = simulatorAlarmMillis;
+    alarm = true;
+  }
+
+  for (size_t i = simulatorNextEdge; i < simulatorEdges.size() && simulatorEdges[i].at <= wakeAt; i++) {
+    uint32_t pin = simulatorEdges[i].pin;
+    if (pin < SIMULATOR_PIN_COUNT && NULL != simulatorPinInterrupts[pin]
+        && (!alarm || simulatorEdges[i].at < wakeAt)) {
+      wakeAt = simulatorEdges[i].at;
+      alarm = false;
+      break;
+    }
+  }
+
+  if (alarm) {
+    simulatorStats.alarmWakes++;
+  }
+
+  if (wakeAt > simulatorRealMillis) {
+    simulatorStats.sleepMillis += wakeAt - simulatorRealMillis;
+    simulatorRealMillis = wakeAt;
+  }
+
+  simulatorStats.sleeps++;
+  applyEdges();
+
+  if (alarm && NULL != simulatorAlarmInterrupt) {
+    simulatorAlarmInterrupt();
+  }
+
+  if (simulatorRealMillis >= simulatorEndMillis) {
+    simulatorFinished = true;
+  }
+}
+
+/*static*/
+int SimulatedHardware::pinLevel(uint32_t pin) {
+  if (pin >= SIMULATOR_PIN_COUNT) {
+    return LOW;
+  }
+  return simulatorPinLevels[pin];
+}
+
+/*static*/
+void SimulatedHardware::detachPinInterrupt(uint32_t pin) {
+  if (pin < SIMULATOR_PIN_COUNT) {
+    simulatorPinInterrupts[pin] = NULL;
+  }
+}
+
+/*
+The changes on a pin which are less than `gapMillis` apart are taken to be one
+burst; the bouncing of a switch. Returns the time at which the last burst on
+the pin in the trace so far started or zero if there has been none.
+*/
+
+/*static*/
+unsigned long SimulatedHardware::burstStartedAt(uint32_t pin, unsigned long gapMillis) {
+  unsigned long startedAt = 0;
+  bool found = false;
+
+  for (size_t i = simulatorNextEdge; i > 0; i--) {
+    const SimulatorEdge& edge = simulatorEdges[i - 1];
+    if (edge.pin == pin) {
+      if (found && startedAt - edge.at >= gapMillis) {
+        break;
+      }
+      startedAt = edge.at;
+      found = true;
+    }
+  }
+
+  return startedAt;
+}
+
+/*
+Returns the number of bursts of changes on the pin in the whole of the trace
+which left the pin at a different level to that which it started at.
+*/
+
+/*static*/
+uint32_t SimulatedHardware::burstCount(uint32_t pin, unsigned long gapMillis) {
+  uint32_t count = 0;
+  uint8_t level = HIGH;
+  uint8_t burstLevel = HIGH;
+  unsigned long lastAt = 0;
+  bool found = false;
+
+  for (size_t i = 0; i < simulatorEdges.size(); i++) {
+    const SimulatorEdge& edge = simulatorEdges[i];
+    if (edge.pin == pin) {
+      if (found && edge.at - lastAt >= gapMillis) {
+        if (level != burstLevel) {
+          count++;
+        }
+        burstLevel = level;
+      }
+      level = edge.level;
+      lastAt = edge.at;
+      found = true;
+    }
+  }
+
+  if (found && level != burstLevel) {
+    count++;
+  }
+
+  return count;
+}
+
+/*static*/
+SimulatorTimings& SimulatedHardware::timings() {
+  return simulatorTimings;
+}
+
+/*static*/
+SimulatorStats& SimulatedHardware::stats() {
+  return simulatorStats;
+}
+
+/*static*/
+const std::vector<SimulatorNotification>& SimulatedHardware::notifications() {
+  return simulatorNotifications;
+}
+
+/*static*/
+const std::vector<SimulatorSpan>& SimulatedHardware::radioSpans() {
+  return simulatorRadioSpans;
+}
+
+/*static*/
+void SimulatedHardware::recordWifiSession() {
+  simulatorStats.wifiSessions++;
+}
+
+/*
+The radio is on from when association starts until the Wifi is disconnected.
+Asking for it to be turned on when it already is, or off when it already is,
+makes no difference.
+*/
+
+/*static*/
+void SimulatedHardware::recordRadio(bool on) {
+  if (on == simulatorRadioOn) {
+    return;
+  }
+
+  simulatorRadioOn = on;
+
+  if (on) {
+    simulatorRadioOnAt = simulatorRealMillis;
+  } else {
+    AllocationPhaseScope scope(ALLOCATION_PHASE_SIMULATOR);
+    SimulatorSpan span = { simulatorRadioOnAt, simulatorRealMillis };
+    simulatorRadioSpans.push_back(span);
+  }
+}
+
+/*static*/
+void SimulatedHardware::recordDnsLookup() {
+  simulatorStats.dnsLookups++;
+}
+
+/*static*/
+void SimulatedHardware::recordTlsConnect() {
+  simulatorStats.tlsConnects++;
+}
+
+/*
+A request over a plain connection is only counted; whatever is at the other
+end deals with it.
+*/
+
+/*static*/
+void SimulatedHardware::recordPlainRequest() {
+  simulatorStats.plainHttpRequests++;
+}
+
+static int decodeHexDigit(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'A' && c <= 'F') {
+    return 10 + c - 'A';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return 10 + c - 'a';
+  }
+  return -1;
+}
+
+static std::string decodeFormValue(const std::string& value) {
+  std::string result;
+
+  for (size_t i = 0; i < value.size(); i++) {
+    if ('+' == value[i]) {
+      result += ' ';
+    } else if ('%' == value[i] && i + 2 < value.size()
+        && decodeHexDigit(value[i + 1]) >= 0 && decodeHexDigit(value[i + 2]) >= 0) {
+      result += (char) ((decodeHexDigit(value[i + 1]) << 4) | decodeHexDigit(value[i + 2]));
+      i += 2;
+    } else {
+      result += value[i];
+    }
+  }
+
+  return result;
+}
+
+/*
+Picks the recipient and the text out of the form in the body of a request
+that has been sent to the simulated server.
+*/
+
+/*static*/
+void SimulatedHardware::recordRequest(const char* request, size_t length) {
+  AllocationPhaseScope scope(ALLOCATION_PHASE_SIMULATOR);
+  std::string whole(request, length);
+  size_t bodyStart = whole.find("\r\n\r\n");
+  SimulatorNotification notification;
+
+  simulatorStats.httpRequests++;
+
+  if (std::string::npos == bodyStart) {
+    return;
+  }
+
+  std::string body = whole.substr(bodyStart + 4);
+  size_t fieldStart = 0;
+
+  while (fieldStart <= body.size()) {
+    size_t fieldEnd = body.find('&', fieldStart);
+
+    if (std::string::npos == fieldEnd) {
+      fieldEnd = body.size();
+    }
+
+    std::string field = body.substr(fieldStart, fieldEnd - fieldStart);
+    size_t equals = field.find('=');
+
+    if (std::string::npos != equals) {
+      std::string name = field.substr(0, equals);
+      std::string value = decodeFormValue(field.substr(equals + 1));
+
+      if ("to" == name) {
+        notification.to = value;
+      } else if ("text" == name) {
+        notification.text = value;
+      } else if ("box" == name) {
+        // the simulator cannot read an end-to-end message.
+        notification.text = "(end-to-end; " + std::to_string(value.size() / 2) + " bytes)";
+      }
+    }
+
+    fieldStart = fieldEnd + 1;
+  }
+
+  notification.at = simulatorRealMillis;
+  simulatorNotifications.push_back(notification);
+}
+
+// private
+/*static*/
+void SimulatedHardware::applyEdges() {
+  while (simulatorNextEdge < simulatorEdges.size()
+      && simulatorEdges[simulatorNextEdge].at <= simulatorRealMillis) {
+    const SimulatorEdge& edge = simulatorEdges[simulatorNextEdge];
+    if (edge.pin < SIMULATOR_PIN_COUNT) {
+      bool changed = simulatorPinLevels[edge.pin] != edge.level;
+      simulatorPinLevels[edge.pin] = edge.level;
+
+      // the pin's interrupt runs as soon as the level changes
+      if (changed && NULL != simulatorPinInterrupts[edge.pin]) {
+        simulatorPinInterrupts[edge.pin]();
+      }
+    }
+    simulatorNextEdge++;
+  }
+}
+
+// ---------------------------------------------------------------------------
+// Arduino core
+
+unsigned long millis() {
+  return SimulatedHardware::awakeMillis();
+}
+
+unsigned long micros() {
+  return SimulatedHardware::awakeMillis() * 1000UL;
+}
+
+void delay(unsigned long ms) {
+  SimulatedHardware::advance(ms);
+}
+
+void delayMicroseconds(unsigned int us) {
+}
+
+void yield() {
+}
+
+void pinMode(uint32_t pin, uint32_t mode) {
+}
+
+int digitalRead(uint32_t pin) {
+  return SimulatedHardware::pinLevel(pin);
+}
+
+void digitalWrite(uint32_t pin, uint32_t value) {
+}
+
+void detachInterrupt(uint32_t pin) {
+  SimulatedHardware::detachPinInterrupt(pin);
+}
+
+size_t SimulatorSerial::write(uint8_t c) {
+  if (SimulatedHardware::verbose()) {
+    putchar(c);
+  }
+  return 1;
+}
+
+int SimulatorSerial::available() {
+  return (int) (simulatorSerialInput.size() - simulatorSerialInputNext);
+}
+
+int SimulatorSerial::read() {
+  if (simulatorSerialInputNext >= simulatorSerialInput.size()) {
+    return -1;
+  }
+  return (uint8_t) simulatorSerialInput[simulatorSerialInputNext++];
+}
+
+int SimulatorSerial::peek() {
+  if (simulatorSerialInputNext >= simulatorSerialInput.size()) {
+    return -1;
+  }
+  return (uint8_t) simulatorSerialInput[simulatorSerialInputNext];
+}
+
+// ---------------------------------------------------------------------------
+// ArduinoLowPower
+
+void ArduinoLowPowerClass::deepSleep() {
+  SimulatedHardware::deepSleep();
+}
+
+// only a change of level is simulated.
+
+void ArduinoLowPowerClass::attachInterruptWakeup(uint32_t pin, voidFuncPtr callback, uint32_t mode) {
+  if (pin < SIMULATOR_PIN_COUNT) {
+    simulatorPinInterrupts[pin] = CHANGE == mode ? callback : NULL;
+  }
+}
+
+// ---------------------------------------------------------------------------
+// RTCZero
+
+void RTCZero::begin(bool resetTime) {
+}
+
+uint32_t RTCZero::getEpoch() {
+  return SIMULATOR_RTC_EPOCH + SimulatedHardware::realMillis() / 1000UL;
+}
+
+void RTCZero::setAlarmEpoch(uint32_t epoch) {
+  _alarmEpoch = epoch;
+}
+
+// only a match on the whole of the date and time is simulated.
+
+void RTCZero::enableAlarm(Alarm_Match match) {
+  if (MATCH_YYMMDDHHMMSS == match && _alarmEpoch >= SIMULATOR_RTC_EPOCH) {
+    SimulatedHardware::setAlarm((_alarmEpoch - SIMULATOR_RTC_EPOCH) * 1000UL);
+  } else {
+    SimulatedHardware::setAlarm(0);
+  }
+}
+
+void RTCZero::disableAlarm() {
+  SimulatedHardware::setAlarm(0);
+}
+
+void RTCZero::attachInterrupt(voidFuncPtr callback) {
+  SimulatedHardware::setAlarmInterrupt(callback);
+}
+
+void RTCZero::detachInterrupt() {
+  SimulatedHardware::setAlarmInterrupt(NULL);
+}
+
+// ---------------------------------------------------------------------------
+// WiFiNINA
+
+IPAddress::IPAddress() {
+  memset(_octets, 0, sizeof(_octets));
+}
+
+IPAddress::IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+  _octets[0] = a;
+  _octets[1] = b;
+  _octets[2] = c;
+  _octets[3] = d;
+}
+
+IPAddress::IPAddress(uint32_t address) {
+  memcpy(_octets, &address, sizeof(_octets));
+}
+
+bool IPAddress::fromString(const char* address) {
+  unsigned int octets[4];
+  char extra;
+
+  if (4 != sscanf(address, "%u.%u.%u.%u%c", &octets[0], &octets[1], &octets[2], &octets[3], &extra)) {
+    return false;
+  }
+
+  for (int i = 0; i < 4; i++) {
+    if (octets[i] > 255) {
+      return false;
+    }
+    _octets[i] = (uint8_t) octets[i];
+  }
+
+  return true;
+}
+
+IPAddress::operator uint32_t() const {
+  uint32_t address;
+  memcpy(&address, _octets, sizeof(address));
+  return address;
+}
+
+uint8_t IPAddress::operator[](int index) const {
+  return _octets[index];
+}
+
+size_t IPAddress::printTo(Print& p) const {
+  size_t result = 0;
+  for (int i = 0; i < 4; i++) {
+    if (0 != i) {
+      result += p.print('.');
+    }
+    result += p.print(_octets[i]);
+  }
+  return result;
+}
+
+WiFiClass::WiFiClass()
+  :
+  _associating(false),
+  _associatedAt(0L) {
+}
+
+/*
+Association completes a fixed time after it was started.
+*/
+
+int WiFiClass::begin(const char* ssid, const char* passphrase) {
+  SimulatedHardware::recordWifiSession();
+  SimulatedHardware::recordRadio(true);
+  _associating = true;
+  _associatedAt = millis() + SimulatedHardware::timings().associateMillis;
+  return status();
+}
+
+int WiFiClass::status() {
+  if (!_associating) {
+    return WL_IDLE_STATUS;
+  }
+  return millis() >= _associatedAt ? WL_CONNECTED : WL_IDLE_STATUS;
+}
+
+void WiFiClass::disconnect() {
+  SimulatedHardware::recordRadio(false);
+  _associating = false;
+}
+
+String WiFiClass::SSID() {
+  return String("simulated");
+}
+
+String WiFiClass::SSID(uint8_t index) {
+  return String("simulated");
+}
+
+IPAddress WiFiClass::localIP() {
+  return IPAddress(192, 168, 1, 2);
+}
+
+String WiFiClass::firmwareVersion() {
+  return String(WIFI_FIRMWARE_LATEST_VERSION);
+}
+
+// the time is only known once the network time has been fetched over the
+// network.
+
+unsigned long WiFiClass::getTime() {
+  if (WL_CONNECTED != status()) {
+    return 0;
+  }
+  return SimulatedHardware::networkEpoch();
+}
+
+int WiFiClass::hostByName(const char* host, IPAddress& result) {
+  if (WL_CONNECTED != status()) {
+    return 0;
+  }
+  SimulatedHardware::recordDnsLookup();
+  delay(SimulatedHardware::timings().dnsLookupMillis);
+  result = IPAddress((uint32_t) SIMULATOR_GATEWAY_ADDRESS);
+  return 1;
+}
+
+int8_t WiFiClass::scanNetworks() {
+  return 1;
+}
+
+/*static*/
+uint8_t ServerDrv::getSocket() {
+  for (uint8_t i = 0; i < MAX_SOCK_NUM; i++) {
+    if (!simulatorSockets[i]) {
+      return i;
+    }
+  }
+  return NO_SOCKET_AVAIL;
+}
+
+/*
+As on the Wifi module, the host name is looked up whenever one is given and
+the address is only used without one. A connection to any address other than
+the gateway's is never answered.
+*/
+
+/*static*/
+void ServerDrv::startClient(const char* host, uint8_t hostLength, uint32_t ipAddress,
+    uint16_t port, uint8_t sock, uint8_t protMode) {
+  if (WL_CONNECTED != WiFi.status()) {
+    return;
+  }
+
+  if (0 != hostLength) {
+    IPAddress resolved;
+    WiFi.hostByName(host, resolved);
+    ipAddress = (uint32_t) resolved;
+  }
+
+  SimulatedHardware::recordTlsConnect();
+  delay(SimulatedHardware::timings().tlsConnectMillis);
+  simulatorSockets[sock] = SIMULATOR_GATEWAY_ADDRESS == ipAddress;
+}
+
+/*static*/
+void ServerDrv::stopClient(uint8_t sock) {
+  simulatorSockets[sock] = false;
+}
+
+/*static*/
+bool ServerDrv::isOpen(uint8_t sock) {
+  return NO_SOCKET_AVAIL != sock && simulatorSockets[sock];
+}
+
+WiFiClient::WiFiClient()
+  :
+  _socket(NO_SOCKET_AVAIL),
+  _stream(-1),
+  _streamWritten(false),
+  _requestLength(0),
+  _requestWrittenAt(0L),
+  _responseLength(0),
+  _responseOffset(0) {
+}
+
+WiFiClient::WiFiClient(uint8_t sock)
+  :
+  _socket(sock),
+  _stream(-1),
+  _streamWritten(false),
+  _requestLength(0),
+  _requestWrittenAt(0L),
+  _responseLength(0),
+  _responseOffset(0) {
+}
+
+WiFiClient::~WiFiClient() {
+}
+
+int WiFiClient::connectSSL(const char* host, uint16_t port) {
+  _socket = ServerDrv::getSocket();
+
+  if (NO_SOCKET_AVAIL == _socket) {
+    return 0;
+  }
+
+  ServerDrv::startClient(host, strlen(host), 0, port, _socket, TLS_MODE);
+  _requestLength = 0;
+  _responseLength = 0;
+  _responseOffset = 0;
+  return ServerDrv::isOpen(_socket) ? 1 : 0;
+}
+
+/*
+Connects over the host's network. Only the loopback is likely to answer.
+*/
+
+int WiFiClient::connect(IPAddress ip, uint16_t port) {
+  struct sockaddr_in address;
+
+  stop();
+
+  if (WL_CONNECTED != WiFi.status()) {
+    return 0;
+  }
+
+  _stream = socket(AF_INET, SOCK_STREAM, 0);
+
+  if (_stream < 0) {
+    return 0;
+  }
+
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = (uint32_t) ip;
+  address.sin_port = htons(port);
+
+  if (0 != ::connect(_stream, (struct sockaddr*) &address, sizeof(address))) {
+    close(_stream);
+    _stream = -1;
+    return 0;
+  }
+
+  _streamWritten = false;
+  return 1;
+}
+
+uint8_t WiFiClient::connected() {
+  if (_stream >= 0) {
+    return available() > 0 || !streamClosed();
+  }
+  return ServerDrv::isOpen(_socket)
+    && (!responseArrived() || _responseOffset < composeResponse());
+}
+
+/*
+The request is recorded as the connection is closed so that it is recorded
+once however many writes it took to send it.
+*/
+
+void WiFiClient::stop() {
+  if (_stream >= 0) {
+    if (_streamWritten) {
+      SimulatedHardware::recordPlainRequest();
+    }
+    close(_stream);
+    _stream = -1;
+  }
+  if (ServerDrv::isOpen(_socket) && 0 != _requestLength) {
+    SimulatedHardware::recordRequest(_request, _requestLength);
+  }
+  if (NO_SOCKET_AVAIL != _socket) {
+    ServerDrv::stopClient(_socket);
+  }
+  _socket = NO_SOCKET_AVAIL;
+  _requestLength = 0;
+}
+
+size_t WiFiClient::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t WiFiClient::write(const uint8_t* buffer, size_t size) {
+  if (_stream >= 0) {
+    ssize_t sent = send(_stream, buffer, size, MSG_NOSIGNAL);
+    _streamWritten = _streamWritten || sent > 0;
+    return sent > 0 ? sent : 0;
+  }
+
+  if (!ServerDrv::isOpen(_socket)) {
+    return 0;
+  }
+
+  size_t count = min(size, SIMULATOR_REQUEST_MAX_LENGTH - _requestLength);
+  memcpy(&_request[_requestLength], buffer, count);
+  _requestLength += count;
+  _requestWrittenAt = millis();
+  return count;
+}
+
+/*
+As with UDP, the other end runs in real time so this waits a moment of real
+time for the response to arrive.
+*/
+
+int WiFiClient::available() {
+  if (_stream >= 0) {
+    struct pollfd waiting;
+    int count = 0;
+
+    waiting.fd = _stream;
+    waiting.events = POLLIN;
+    waiting.revents = 0;
+
+    if (poll(&waiting, 1, 1) <= 0 || 0 != ioctl(_stream, FIONREAD, &count)) {
+      return 0;
+    }
+    return count;
+  }
+
+  if (!ServerDrv::isOpen(_socket) || !responseArrived()) {
+    return 0;
+  }
+  return composeResponse() - _responseOffset;
+}
+
+int WiFiClient::read() {
+  uint8_t c;
+  return 1 == read(&c, 1) ? c : -1;
+}
+
+int WiFiClient::read(uint8_t* buffer, size_t size) {
+  if (_stream >= 0) {
+    ssize_t received = recv(_stream, buffer, size, MSG_DONTWAIT);
+    return received > 0 ? received : 0;
+  }
+
+  size_t count = min((size_t) available(), size);
+  memcpy(buffer, &_response[_responseOffset], count);
+  _responseOffset += count;
+  return count;
+}
+
+int WiFiClient::peek() {
+  if (_stream >= 0) {
+    uint8_t c;
+    return 1 == recv(_stream, &c, 1, MSG_PEEK | MSG_DONTWAIT) ? c : -1;
+  }
+  return 0 == available() ? -1 : _response[_responseOffset];
+}
+
+/*
+Returns true once the other end of a plain connection has closed it and
+everything that it sent has been read.
+*/
+
+// private
+bool WiFiClient::streamClosed() {
+  uint8_t c;
+  ssize_t received = recv(_stream, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+  return 0 == received || (received < 0 && EAGAIN != errno && EWOULDBLOCK != errno);
+}
+
+/*
+The server responds a fixed time after the last of the request was written.
+*/
+
+// private
+bool WiFiClient::responseArrived() {
+  return 0 != _requestLength
+    && millis() >= _requestWrittenAt + SimulatedHardware::timings().responseMillis;
+}
+
+/*
+The response is dated with the network's clock as it is first read. Returns
+its length.
+*/
+
+// private
+size_t WiFiClient::composeResponse() {
+  if (0 == _responseLength) {
+    time_t now = (time_t) SimulatedHardware::networkEpoch();
+    struct tm fields;
+    char date[40];
+
+    gmtime_r(&now, &fields);
+    strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &fields);
+    _responseLength = snprintf(_response, sizeof(_response), SIMULATOR_RESPONSE, date);
+  }
+  return _responseLength;
+}
+
+WiFiUDP::WiFiUDP()
+  :
+  _socket(-1),
+  _destinationPort(0),
+  _outgoingLength(0),
+  _remotePort(0),
+  _incomingLength(0),
+  _incomingOffset(0) {
+}
+
+WiFiUDP::~WiFiUDP() {
+  stop();
+}
+
+/*
+Listens on the loopback only; the other simulated boards are on this host.
+*/
+
+uint8_t WiFiUDP::begin(uint16_t port) {
+  struct sockaddr_in address;
+
+  if (!openSocket()) {
+    return 0;
+  }
+
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(port);
+
+  if (0 != bind(_socket, (struct sockaddr*) &address, sizeof(address))) {
+    stop();
+    return 0;
+  }
+
+  return 1;
+}
+
+void WiFiUDP::stop() {
+  if (_socket >= 0) {
+    close(_socket);
+  }
+  _socket = -1;
+  _incomingLength = 0;
+  _incomingOffset = 0;
+}
+
+/*
+As with the Wifi module, a packet can be sent without `begin` in which case
+the replies come back to the port that it was sent from.
+*/
+
+int WiFiUDP::beginPacket(IPAddress ip, uint16_t port) {
+  if (WL_CONNECTED != WiFi.status() || !openSocket()) {
+    return 0;
+  }
+  _destinationIP = ip;
+  _destinationPort = port;
+  _outgoingLength = 0;
+  return 1;
+}
+
+int WiFiUDP::endPacket() {
+  struct sockaddr_in address;
+
+  if (_socket < 0 || WL_CONNECTED != WiFi.status()) {
+    return 0;
+  }
+
+  if (SimulatedHardware::losePacket()) {
+    return 1;
+  }
+
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = (uint32_t) _destinationIP;
+  address.sin_port = htons(_destinationPort);
+
+  ssize_t sent = sendto(_socket, _outgoing, _outgoingLength, 0,
+    (struct sockaddr*) &address, sizeof(address));
+
+  return sent == (ssize_t) _outgoingLength ? 1 : 0;
+}
+
+/*
+The other boards run in real time and not in the simulated time of this one
+so if there is no packet waiting then this waits a moment of real time for
+one. This keeps a board that is waiting on another from getting too far
+ahead of it.
+*/
+
+int WiFiUDP::parsePacket() {
+  struct sockaddr_in address;
+  socklen_t addressLength = sizeof(address);
+  struct pollfd waiting;
+
+  _incomingLength = 0;
+  _incomingOffset = 0;
+
+  if (_socket < 0 || WL_CONNECTED != WiFi.status()) {
+    return 0;
+  }
+
+  waiting.fd = _socket;
+  waiting.events = POLLIN;
+  waiting.revents = 0;
+
+  if (poll(&waiting, 1, 1) <= 0) {
+    return 0;
+  }
+
+  ssize_t received = recvfrom(_socket, _incoming, sizeof(_incoming), MSG_DONTWAIT,
+    (struct sockaddr*) &address, &addressLength);
+
+  if (received <= 0) {
+    return 0;
+  }
+
+  _incomingLength = received;
+  _remoteIP = IPAddress((uint32_t) address.sin_addr.s_addr);
+  _remotePort = ntohs(address.sin_port);
+  return received;
+}
+
+size_t WiFiUDP::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t WiFiUDP::write(const uint8_t* buffer, size_t size) {
+  size_t count = min(size, SIMULATOR_PACKET_MAX_LENGTH - _outgoingLength);
+  memcpy(&_outgoing[_outgoingLength], buffer, count);
+  _outgoingLength += count;
+  return count;
+}
+
+int WiFiUDP::available() {
+  return _incomingLength - _incomingOffset;
+}
+
+int WiFiUDP::read() {
+  unsigned char c;
+  return 1 == read(&c, 1) ? c : -1;
+}
+
+int WiFiUDP::read(unsigned char* buffer, size_t size) {
+  size_t count = min((size_t) available(), size);
+  memcpy(buffer, &_incoming[_incomingOffset], count);
+  _incomingOffset += count;
+  return count;
+}
+
+int WiFiUDP::peek() {
+  return 0 == available() ? -1 : _incoming[_incomingOffset];
+}
+
+IPAddress WiFiUDP::remoteIP() {
+  return _remoteIP;
+}
+
+uint16_t WiFiUDP::remotePort() {
+  return _remotePort;
+}
+
+// private
+bool WiFiUDP::openSocket() {
+  if (_socket < 0) {
+    _socket = socket(AF_INET, SOCK_DGRAM, 0);
+  }
+  return _socket >= 0;
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+// The simulator runs the unmodified firmware on a host computer against a
+// trace of changes to the sensor and button pins. There are two clocks; the
+// real time which the trace is in and which always runs, and the time that
+// `millis()` returns which, as on the board, stops while in deep sleep. While
+// the board is asleep the real time is fast-forwarded to the next change.
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <Arduino.h>
+
+/*
+A change in the level of a pin at a point in real time.
+*/
+
+struct SimulatorEdge {
+  unsigned long at;
+  uint8_t pin;
+  uint8_t level;
+};
+
+/*
+These are the times that the simulated Wifi takes to carry out each step of
+sending a notification.
+*/
+
+struct SimulatorTimings {
+  unsigned long associateMillis;
+  unsigned long dnsLookupMillis;
+  unsigned long tlsConnectMillis;
+  unsigned long responseMillis;
+};
+
+/*
+A span of real time; for example while the Wifi radio was on.
+*/
+
+struct SimulatorSpan {
+  unsigned long from;
+  unsigned long to;
+};
+
+/*
+A notification that was accepted by the simulated server.
+*/
+
+struct SimulatorNotification {
+  unsigned long at;
+  std::string to;
+  std::string text;
+};
+
+struct SimulatorStats {
+  unsigned long awakeMillis;
+  unsigned long sleepMillis;
+  uint32_t sleeps;
+  uint32_t alarmWakes;
+  uint32_t wifiSessions;
+  uint32_t dnsLookups;
+  uint32_t tlsConnects;
+  uint32_t httpRequests;
+  uint32_t plainHttpRequests;
+  uint32_t udpPacketsSent;
+  uint32_t udpPacketsLost;
+};
+
+class SimulatedHardware {
+  public:
+    static void reset(const std::vector<SimulatorEdge>& edges, unsigned long endMillis);
+
+    static unsigned long realMillis();
+    static unsigned long awakeMillis();
+    static unsigned long endMillis();
+    static bool finished();
+    static bool verbose();
+    static void setVerbose(bool verbose);
+    static void setPacketLoss(unsigned long percent, unsigned long seed);
+    static void setAlarm(unsigned long at);
+    static void setAlarmInterrupt(voidFuncPtr callback);
+    static void setNetworkSkew(long ppm);
+    static void setSerialInput(const std::string& input);
+    static unsigned long networkEpoch();
+
+    static void advance(unsigned long millis);
+    static unsigned long millisToNextEdge();
+    static void deepSleep();
+
+    static int pinLevel(uint32_t pin);
+    static void detachPinInterrupt(uint32_t pin);
+    static unsigned long burstStartedAt(uint32_t pin, unsigned long gapMillis);
+    static uint32_t burstCount(uint32_t pin, unsigned long gapMillis);
+
+    static SimulatorTimings& timings();
+    static SimulatorStats& stats();
+    static const std::vector<SimulatorNotification>& notifications();
+    static const std::vector<SimulatorSpan>& radioSpans();
+
+    static void recordWifiSession();
+    static void recordRadio(bool on);
+    static void recordDnsLookup();
+    static void recordTlsConnect();
+    static void recordRequest(const char* request, size_t length);
+    static void recordPlainRequest();
+    static bool losePacket();
+
+  private:
+    static void applyEdges();
+};
+
+#endif // SIMULATOR_H
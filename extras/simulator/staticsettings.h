@@ -0,0 +1,14 @@
+// These settings are used by the simulator when there is no `staticsettings.h`
+// alongside the firmware. Nothing is really sent so the credentials are fake.
+
+static constexpr const char* STATICRECIPIENTS[] = {
+      "SIMULATE"
+    };
+
+static constexpr Settings STATICSETTINGS(
+      "Main Gate",
+      WifiSettings("simulated", "simulated"),
+      MonitoringSettings(2, 30, 4),
+      THREEMA,
+      ThreemaSettings("*SIMULAT", "simulated", STATICRECIPIENTS)
+    );
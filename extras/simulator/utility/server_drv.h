@@ -0,0 +1,31 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#ifndef SIMULATOR_SERVER_DRV_H
+#define SIMULATOR_SERVER_DRV_H
+
+// This is a stand-in for the part of the WiFiNINA library's driver that opens
+// client sockets on the Wifi module.
+
+#include <stdint.h>
+
+#define MAX_SOCK_NUM 10
+#define NO_SOCKET_AVAIL 255
+
+typedef enum eProtMode {
+  TCP_MODE,
+  UDP_MODE,
+  TLS_MODE
+} tProtMode;
+
+class ServerDrv {
+  public:
+    static uint8_t getSocket();
+    static void startClient(const char* host, uint8_t hostLength, uint32_t ipAddress,
+      uint16_t port, uint8_t sock, uint8_t protMode = TCP_MODE);
+    static void stopClient(uint8_t sock);
+    static bool isOpen(uint8_t sock);
+};
+
+#endif // SIMULATOR_SERVER_DRV_H
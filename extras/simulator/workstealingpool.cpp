@@ -0,0 +1,142 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#include "workstealingpool.h"
+
+#include <new>
+
+#include <stddef.h>
+#include <sys/mman.h>
+
+static uint64_t packShard(uint32_t next, uint32_t end) {
+  return (uint64_t) next | ((uint64_t) end << 32);
+}
+
+static uint32_t shardNext(uint64_t shard) {
+  return (uint32_t) shard;
+}
+
+static uint32_t shardEnd(uint64_t shard) {
+  return (uint32_t) (shard >> 32);
+}
+
+/*
+Returns NULL if the shared memory could not be mapped.
+*/
+
+/*static*/
+WorkStealingPool* WorkStealingPool::create(uint32_t items, int workers) {
+  void* memory = mmap(NULL, sizeof(WorkStealingPool), PROT_READ | PROT_WRITE,
+    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+  if (MAP_FAILED == memory) {
+    return NULL;
+  }
+
+  return new (memory) WorkStealingPool(items, workers);
+}
+
+/*static*/
+void WorkStealingPool::destroy(WorkStealingPool* pool) {
+  if (NULL != pool) {
+    munmap(pool, sizeof(WorkStealingPool));
+  }
+}
+
+/*
+The items are split as evenly as they can be with the first workers taking
+one more item each where they do not divide exactly.
+*/
+
+WorkStealingPool::WorkStealingPool(uint32_t items, int workers)
+  :
+  _workers(workers < 1 ? 1 : (workers > WORK_STEALING_MAX_WORKERS ? WORK_STEALING_MAX_WORKERS : workers)),
+  _steals(0) {
+  uint32_t start = 0;
+
+  for (int i = 0; i < WORK_STEALING_MAX_WORKERS; i++) {
+    uint32_t length = 0;
+
+    if (i < _workers) {
+      length = items / _workers + ((uint32_t) i < items % _workers ? 1 : 0);
+    }
+
+    _shards[i] = packShard(start, start + length);
+    start += length;
+  }
+}
+
+/*
+Takes the next item for the worker; stealing more work if its own shard has
+run out. Returns false once there is no work left anywhere.
+*/
+
+bool WorkStealingPool::take(int worker, uint32_t* item) {
+  uint64_t* shard = &_shards[worker];
+
+  while (true) {
+    uint64_t current = __atomic_load_n(shard, __ATOMIC_ACQUIRE);
+    uint32_t next = shardNext(current);
+    uint32_t end = shardEnd(current);
+
+    if (next < end) {
+      if (__atomic_compare_exchange_n(shard, &current, packShard(next + 1, end),
+          false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        *item = next;
+        return true;
+      }
+      continue;
+    }
+
+    if (!steal(worker)) {
+      return false;
+    }
+  }
+}
+
+uint32_t WorkStealingPool::stealCount() const {
+  return __atomic_load_n(&_steals, __ATOMIC_ACQUIRE);
+}
+
+/*
+The worker's own shard is empty so no other worker will try to take from it
+until the stolen items have been put into it. Returns false if no shard has
+anything left.
+*/
+
+// private
+bool WorkStealingPool::steal(int worker) {
+  while (true) {
+    int victim = -1;
+    uint64_t victimShard = 0;
+    uint32_t most = 0;
+
+    for (int i = 0; i < _workers; i++) {
+      uint64_t current = __atomic_load_n(&_shards[i], __ATOMIC_ACQUIRE);
+      uint32_t next = shardNext(current);
+      uint32_t end = shardEnd(current);
+
+      if (i != worker && next < end && end - next > most) {
+        victim = i;
+        victimShard = current;
+        most = end - next;
+      }
+    }
+
+    if (victim < 0) {
+      return false;
+    }
+
+    uint32_t next = shardNext(victimShard);
+    uint32_t end = shardEnd(victimShard);
+    uint32_t middle = next + (end - next) / 2;
+
+    if (__atomic_compare_exchange_n(&_shards[victim], &victimShard, packShard(next, middle),
+        false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      __atomic_store_n(&_shards[worker], packShard(middle, end), __ATOMIC_RELEASE);
+      __atomic_fetch_add(&_steals, 1, __ATOMIC_ACQ_REL);
+      return true;
+    }
+  }
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#ifndef SIMULATOR_WORKSTEALINGPOOL_H
+#define SIMULATOR_WORKSTEALINGPOOL_H
+
+#include <stdint.h>
+
+#define WORK_STEALING_MAX_WORKERS 256
+
+/*
+This shares out a number of items of work between worker processes. Each
+worker starts with a shard of its own; a run of consecutive items that it
+takes from the front. A worker that has run out takes the back half of
+whichever shard has the most left so that the workers finish at about the
+same time even though some items take longer than others.
+
+The pool lives in memory that is shared between the processes so it must be
+created before the workers are forked. Each shard is a single 64-bit word
+holding the next item and the end of the shard and is only changed by
+compare-and-swap so no locks are needed.
+*/
+
+class WorkStealingPool {
+  public:
+    static WorkStealingPool* create(uint32_t items, int workers);
+    static void destroy(WorkStealingPool* pool);
+
+    bool take(int worker, uint32_t* item);
+    uint32_t stealCount() const;
+
+  private:
+    WorkStealingPool(uint32_t items, int workers);
+
+    bool steal(int worker);
+
+  private:
+    int _workers;
+    uint32_t _steals;
+    uint64_t _shards[WORK_STEALING_MAX_WORKERS];
+};
+
+#endif // SIMULATOR_WORKSTEALINGPOOL_H
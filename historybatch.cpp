@@ -0,0 +1,222 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#include "historybatch.h"
+
+#include <string.h>
+
+// a varint of up to 64 bits takes no more than ten groups of seven bits.
+
+#define HISTORY_BATCH_VARINT_MAX_LENGTH 10
+
+static uint64_t encodeEvent(uint32_t previousAt, const HistoryEvent& event) {
+  int64_t delta = (int64_t) event.at - (int64_t) previousAt;
+  uint64_t zigzag = ((uint64_t) delta << 1) ^ (uint64_t) (delta >> 63);
+  return (zigzag << 1) | (event.open ? 1 : 0);
+}
+
+HistoryBatchEncoder::HistoryBatchEncoder(uint8_t* buffer, size_t length)
+  :
+  _buffer(buffer),
+  _capacity(length),
+  _length(0),
+  _previousAt(0),
+  _count(0) {
+}
+
+/*
+Starts the batch again with the header. Returns false if the header does not
+fit. A description that is too long is cut short.
+*/
+
+bool HistoryBatchEncoder::begin(const HistoryBatchHeader& header) {
+  size_t descriptionLength = strnlen(header.description, HISTORY_BATCH_DESCRIPTION_MAX_LENGTH);
+
+  _length = 0;
+  _count = 0;
+  _previousAt = header.rtcNow;
+
+  if (_capacity < 2) {
+    return false;
+  }
+
+  _buffer[_length++] = HISTORY_BATCH_MAGIC;
+  _buffer[_length++] = HISTORY_BATCH_VERSION;
+
+  if (!putVarint(header.logId)
+      || !putVarint(header.firstSequence)
+      || !putVarint(header.rtcNow)
+      || !putVarint(header.wallNow)
+      || !putVarint(descriptionLength)
+      || _capacity - _length < descriptionLength) {
+    _length = 0;
+    return false;
+  }
+
+  memcpy(&_buffer[_length], header.description, descriptionLength);
+  _length += descriptionLength;
+  return true;
+}
+
+/*
+Returns false, leaving the batch as it was, if the event does not fit.
+*/
+
+bool HistoryBatchEncoder::add(const HistoryEvent& event) {
+  size_t length = _length;
+
+  if (0 == length || !putVarint(encodeEvent(_previousAt, event))) {
+    _length = length;
+    return false;
+  }
+
+  _previousAt = event.at;
+  _count++;
+  return true;
+}
+
+size_t HistoryBatchEncoder::length() const {
+  return _length;
+}
+
+uint16_t HistoryBatchEncoder::count() const {
+  return _count;
+}
+
+// private
+bool HistoryBatchEncoder::putVarint(uint64_t value) {
+  uint8_t groups[HISTORY_BATCH_VARINT_MAX_LENGTH];
+  size_t count = 0;
+
+  do {
+    groups[count] = (uint8_t) (value & 0x7F);
+    value >>= 7;
+    if (0 != value) {
+      groups[count] |= 0x80;
+    }
+    count++;
+  } while (0 != value);
+
+  if (_capacity - _length < count) {
+    return false;
+  }
+
+  memcpy(&_buffer[_length], groups, count);
+  _length += count;
+  return true;
+}
+
+HistoryBatchDecoder::HistoryBatchDecoder(const uint8_t* buffer, size_t length)
+  :
+  _buffer(buffer),
+  _length(length),
+  _offset(0),
+  _previousAt(0),
+  _failed(false) {
+}
+
+/*
+Decodes the header which must be done before the events are decoded. Returns
+false if the batch is not one that this understands.
+*/
+
+bool HistoryBatchDecoder::header(HistoryBatchHeader* header) {
+  uint32_t descriptionLength;
+
+  _offset = 0;
+  _failed = _length < 2
+    || HISTORY_BATCH_MAGIC != _buffer[0]
+    || HISTORY_BATCH_VERSION != _buffer[1];
+
+  if (_failed) {
+    return false;
+  }
+
+  _offset = 2;
+  _failed = !getVarint32(&header->logId)
+    || !getVarint32(&header->firstSequence)
+    || !getVarint32(&header->rtcNow)
+    || !getVarint32(&header->wallNow)
+    || !getVarint32(&descriptionLength)
+    || descriptionLength > HISTORY_BATCH_DESCRIPTION_MAX_LENGTH
+    || _length - _offset < descriptionLength;
+
+  if (_failed) {
+    return false;
+  }
+
+  memcpy(header->description, &_buffer[_offset], descriptionLength);
+  header->description[descriptionLength] = 0;
+  _offset += descriptionLength;
+  _previousAt = header->rtcNow;
+  return true;
+}
+
+/*
+Returns false once there are no more events or if the batch turned out to be
+malformed; `isFailed` tells the two apart.
+*/
+
+bool HistoryBatchDecoder::next(HistoryEvent* event) {
+  uint64_t value;
+
+  if (_failed || _offset >= _length) {
+    return false;
+  }
+
+  if (!getVarint(&value)) {
+    _failed = true;
+    return false;
+  }
+
+  uint64_t zigzag = value >> 1;
+  int64_t at = (int64_t) _previousAt
+    + (int64_t) ((zigzag >> 1) ^ (0 - (zigzag & 1)));
+
+  if (at < 0 || at > (int64_t) UINT32_MAX) {
+    _failed = true;
+    return false;
+  }
+
+  event->at = (uint32_t) at;
+  event->open = 0 != (value & 1);
+  _previousAt = event->at;
+  return true;
+}
+
+bool HistoryBatchDecoder::isFailed() const {
+  return _failed;
+}
+
+// private
+bool HistoryBatchDecoder::getVarint(uint64_t* value) {
+  *value = 0;
+
+  for (int i = 0; i < HISTORY_BATCH_VARINT_MAX_LENGTH; i++) {
+    if (_offset >= _length) {
+      return false;
+    }
+
+    uint8_t group = _buffer[_offset++];
+    *value |= (uint64_t) (group & 0x7F) << (7 * i);
+
+    if (0 == (group & 0x80)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// private
+bool HistoryBatchDecoder::getVarint32(uint32_t* value) {
+  uint64_t wide;
+
+  if (!getVarint(&wide) || wide > UINT32_MAX) {
+    return false;
+  }
+
+  *value = (uint32_t) wide;
+  return true;
+}
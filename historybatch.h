@@ -0,0 +1,103 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#ifndef HISTORYBATCH_H
+#define HISTORYBATCH_H
+
+// The reference collector in `extras/collector` includes this file too so
+// that it decodes the batches with the same code that the board encodes them
+// with; it must only use the standard C++ library.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HISTORY_BATCH_MAGIC 0xB7
+#define HISTORY_BATCH_VERSION 1
+
+#define HISTORY_BATCH_DESCRIPTION_MAX_LENGTH 32
+
+/*
+An opening or a closing of the sensor. The time is in seconds of the board's
+real time clock.
+*/
+
+struct HistoryEvent {
+  uint32_t at;
+  bool open;
+};
+
+/*
+The events of a batch are consecutive in the board's log and the first of
+them is numbered `firstSequence`. A log is identified by `logId` which is
+chosen afresh each time that the log has to be started again so that the
+numbers of a new log are not taken for those of an old one. The board's
+clock reads `rtcNow` when the batch is sent and, if the board knows the
+time from the network, the time then is `wallNow`; otherwise `wallNow` is
+zero. The collector works out the time of each event from these.
+*/
+
+struct HistoryBatchHeader {
+  char description[HISTORY_BATCH_DESCRIPTION_MAX_LENGTH + 1];
+  uint32_t logId;
+  uint32_t firstSequence;
+  uint32_t rtcNow;
+  uint32_t wallNow;
+};
+
+/*
+A batch is;
+
+  magic, version, varint logId, varint firstSequence, varint rtcNow,
+  varint wallNow, varint length, description[length], event...
+
+and each event is a single varint; the difference in time from the event
+before, or from `rtcNow` for the first event, zigzag encoded and shifted up
+one bit with the lowest bit set if the sensor opened. The varints are the
+usual base-128 groups, least significant first. Events are usually seconds
+or minutes apart so most take two or three bytes. There is no count of the
+events; they run to the end of the body.
+*/
+
+class HistoryBatchEncoder {
+  public:
+    HistoryBatchEncoder(uint8_t* buffer, size_t length);
+
+    bool begin(const HistoryBatchHeader& header);
+    bool add(const HistoryEvent& event);
+
+    size_t length() const;
+    uint16_t count() const;
+
+  private:
+    bool putVarint(uint64_t value);
+
+  private:
+    uint8_t* _buffer;
+    size_t _capacity;
+    size_t _length;
+    uint32_t _previousAt;
+    uint16_t _count;
+};
+
+class HistoryBatchDecoder {
+  public:
+    HistoryBatchDecoder(const uint8_t* buffer, size_t length);
+
+    bool header(HistoryBatchHeader* header);
+    bool next(HistoryEvent* event);
+    bool isFailed() const;
+
+  private:
+    bool getVarint(uint64_t* value);
+    bool getVarint32(uint32_t* value);
+
+  private:
+    const uint8_t* _buffer;
+    size_t _length;
+    size_t _offset;
+    uint32_t _previousAt;
+    bool _failed;
+};
+
+#endif // HISTORYBATCH_H
@@ -0,0 +1,144 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#include "historylog.h"
+
+#include <stddef.h>
+
+#include "common.h"
+
+#define HISTORY_LOG_MAGIC 0x4B15702E
+
+struct HistoryLogEntry {
+  uint32_t at;
+  uint8_t open;
+};
+
+struct HistoryLogRecord {
+  uint32_t magic;
+  uint32_t logId;
+  uint32_t nextSequence;
+  uint32_t cursor;
+  uint32_t dropped;
+  HistoryLogEntry entries[HISTORY_LOG_CAPACITY];
+  uint32_t crc;
+};
+
+// The `.noinit` section is not zeroed by the start-up code so the record
+// survives a reset that does not remove power from the board.
+
+static HistoryLogRecord historyLogRecord __attribute__ ((section (".noinit")));
+
+static uint32_t historyLogCrc() {
+  return Common::crc32(
+    (const uint8_t*) &historyLogRecord,
+    offsetof(HistoryLogRecord, crc));
+}
+
+static void historyLogSeal() {
+  historyLogRecord.crc = historyLogCrc();
+}
+
+/*
+Keeps the retained log if it is valid; otherwise starts a new one. The events
+are numbered from one so that a cursor of zero is never valid.
+*/
+
+/*static*/
+void HistoryLog::begin() {
+  uint32_t crc = historyLogCrc();
+
+  if (HISTORY_LOG_MAGIC == historyLogRecord.magic
+      && crc == historyLogRecord.crc
+      && historyLogRecord.cursor <= historyLogRecord.nextSequence) {
+    return;
+  }
+
+  uint32_t logId = crc ^ historyLogRecord.crc ^ micros();
+
+  memset(&historyLogRecord, 0, sizeof(historyLogRecord));
+  historyLogRecord.magic = HISTORY_LOG_MAGIC;
+  historyLogRecord.logId = 0 == logId ? 1 : logId;
+  historyLogRecord.nextSequence = 1;
+  historyLogRecord.cursor = 1;
+  historyLogSeal();
+}
+
+/*
+Adds an event to the log. If the log is full then the oldest event is lost
+and, if it had not been synced, the cursor is moved past it and it is counted
+as dropped.
+*/
+
+/*static*/
+void HistoryLog::append(uint32_t at, bool open) {
+  uint32_t sequence = historyLogRecord.nextSequence;
+  HistoryLogEntry& entry = historyLogRecord.entries[sequence % HISTORY_LOG_CAPACITY];
+
+  entry.at = at;
+  entry.open = open ? 1 : 0;
+  historyLogRecord.nextSequence = sequence + 1;
+
+  if (historyLogRecord.nextSequence - historyLogRecord.cursor > HISTORY_LOG_CAPACITY) {
+    historyLogRecord.cursor++;
+    historyLogRecord.dropped++;
+  }
+
+  historyLogSeal();
+}
+
+/*static*/
+uint32_t HistoryLog::logId() {
+  return historyLogRecord.logId;
+}
+
+/*static*/
+uint32_t HistoryLog::cursor() {
+  return historyLogRecord.cursor;
+}
+
+/*static*/
+uint32_t HistoryLog::nextSequence() {
+  return historyLogRecord.nextSequence;
+}
+
+/*static*/
+uint32_t HistoryLog::droppedCount() {
+  return historyLogRecord.dropped;
+}
+
+/*
+Copies the event numbered `sequence` into `event`. Returns false if there is
+no such event in the log; either it has not happened yet or it has been
+overwritten.
+*/
+
+/*static*/
+bool HistoryLog::event(uint32_t sequence, HistoryEvent* event) {
+  uint32_t nextSequence = historyLogRecord.nextSequence;
+
+  if (sequence >= nextSequence || nextSequence - sequence > HISTORY_LOG_CAPACITY) {
+    return false;
+  }
+
+  const HistoryLogEntry& entry = historyLogRecord.entries[sequence % HISTORY_LOG_CAPACITY];
+  event->at = entry.at;
+  event->open = 0 != entry.open;
+  return true;
+}
+
+/*
+Records that the collector has taken every event before `sequence`. The
+cursor only ever moves forward.
+*/
+
+/*static*/
+void HistoryLog::advanceCursor(uint32_t sequence) {
+  if (sequence <= historyLogRecord.cursor || sequence > historyLogRecord.nextSequence) {
+    return;
+  }
+
+  historyLogRecord.cursor = sequence;
+  historyLogSeal();
+}
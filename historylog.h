@@ -0,0 +1,46 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#ifndef HISTORYLOG_H
+#define HISTORYLOG_H
+
+#include <Arduino.h>
+
+#include "historybatch.h"
+
+// This is how many events the log holds. Once it is full, each new event
+// takes the place of the oldest whether or not that has been synced.
+
+#define HISTORY_LOG_CAPACITY 128
+
+/*
+This is a log of each opening and closing of the sensor so that the history
+can be synced to a collector. The events are numbered in order and the log
+remembers a cursor; the number of the first event that the collector has not
+yet taken. Like `RetainedState`, the log is kept in RAM that is not
+initialized at start-up, protected by a magic number and a CRC, so that it
+and its cursor survive a reset of the board that does not remove power. The
+times of the events are taken from the RTC rather than from the monotonic
+clock for the same reason; the RTC carries on across a reset but the
+monotonic clock starts again.
+
+When the log has to be started afresh, it is given a new `logId`. The RAM
+holds noise after a power-on so a checksum of the discarded record is mixed
+into the identifier.
+*/
+
+class HistoryLog {
+  public:
+    static void begin();
+    static void append(uint32_t at, bool open);
+
+    static uint32_t logId();
+    static uint32_t cursor();
+    static uint32_t nextSequence();
+    static uint32_t droppedCount();
+    static bool event(uint32_t sequence, HistoryEvent* event);
+    static void advanceCursor(uint32_t sequence);
+};
+
+#endif // HISTORYLOG_H
@@ -0,0 +1,144 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#include "historysync.h"
+
+#include "historybatch.h"
+#include "historylog.h"
+#include "latencytrace.h"
+#include "monotonicclock.h"
+#include "wallclock.h"
+
+#define HISTORY_SYNC_CONTENT_TYPE "application/octet-stream"
+
+HistorySync::HistorySync(
+  const char* description,
+  const CollectorSettings* collectorSettings,
+  EnergyGovernor* energyGovernor)
+  :
+  _description(NULL == description ? "" : description),
+  _collectorSettings(*collectorSettings),
+  _energyGovernor(energyGovernor),
+  _hasAddress(false),
+  _syncedCount(0),
+  _failedCount(0) {
+  if (_collectorSettings.isEnabled()) {
+    _hasAddress = _address.fromString(_collectorSettings.address());
+  }
+
+  if (!_hasAddress) {
+#ifdef SERIAL_ENABLED
+    Serial.println("invalid address for the collector; the history will not be synced");
+#endif
+  }
+}
+
+HistorySync::~HistorySync() {
+}
+
+uint32_t HistorySync::syncedCount() const {
+  return _syncedCount;
+}
+
+uint32_t HistorySync::failedCount() const {
+  return _failedCount;
+}
+
+/*
+The Wifi must already be up. The notification that brought it up has been
+sent by now so its latency trace is ended; the sync is not part of it.
+*/
+
+void HistorySync::sync() {
+  if (!_hasAddress || WL_CONNECTED != WiFi.status()) {
+    return;
+  }
+
+  LatencyTrace::end();
+
+  for (int i = 0; i < HISTORY_SYNC_MAX_POSTS && HistoryLog::cursor() != HistoryLog::nextSequence(); i++) {
+    if (!post()) {
+      return;
+    }
+  }
+}
+
+/*
+Sends one batch starting from the cursor. Returns true if the collector took
+it.
+*/
+
+// private
+bool HistorySync::post() {
+  HistoryBatchHeader header;
+  strncpy(header.description, _description, HISTORY_BATCH_DESCRIPTION_MAX_LENGTH);
+  header.description[HISTORY_BATCH_DESCRIPTION_MAX_LENGTH] = 0;
+  header.logId = HistoryLog::logId();
+  header.firstSequence = HistoryLog::cursor();
+  header.rtcNow = MonotonicClock::epoch();
+  header.wallNow = WallClock::now(MonotonicClock::now());
+
+  // only ask the Wifi module for the time, which costs a round trip to a
+  // time server, if no response has carried a `Date` yet
+
+  if (0 == header.wallNow) {
+    header.wallNow = (uint32_t) WiFi.getTime();
+  }
+
+  HistoryBatchEncoder encoder(_body, sizeof(_body));
+  HistoryEvent event;
+  uint32_t sequence = header.firstSequence;
+
+  if (!encoder.begin(header)) {
+    return false;
+  }
+
+  while (HistoryLog::event(sequence, &event) && encoder.add(event)) {
+    sequence++;
+  }
+
+  if (0 == encoder.count()) {
+    return false;
+  }
+
+  WiFiClient client;
+
+  if (1 != client.connect(_address, (uint16_t) _collectorSettings.port())) {
+#ifdef SERIAL_ENABLED
+    Serial.println("unable to connect to the collector");
+#endif
+    _failedCount++;
+    return false;
+  }
+
+  if (NULL != _energyGovernor) {
+    _energyGovernor->record(ENERGY_ACTIVITY_HTTP_SEND, 1);
+  }
+
+  _httpSender.begin(_collectorSettings.address(), _collectorSettings.path());
+  _httpSender.setBody(HISTORY_SYNC_CONTENT_TYPE, _body, encoder.length());
+  int statusCode = _httpSender.post(client);
+  client.stop();
+
+  if (2 != statusCode / 100) {
+#ifdef SERIAL_ENABLED
+    Serial.print("failed to sync the history; status code [");
+    Serial.print(statusCode);
+    Serial.println("]");
+#endif
+    _failedCount++;
+    return false;
+  }
+
+  HistoryLog::advanceCursor(sequence);
+  _syncedCount += encoder.count();
+
+#ifdef SERIAL_ENABLED
+  Serial.print("did sync [");
+  Serial.print(encoder.count());
+  Serial.println("] events of the history");
+#endif
+
+  return true;
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#ifndef HISTORYSYNC_H
+#define HISTORYSYNC_H
+
+#include <Arduino.h>
+#include <WiFiNINA.h>
+
+#include "energygovernor.h"
+#include "httpsender.h"
+#include "settings.h"
+
+// A batch of this length holds well over a hundred events; the log is
+// unlikely to need more than one batch to catch up.
+
+#define HISTORY_SYNC_BODY_MAX_LENGTH 512
+#define HISTORY_SYNC_MAX_POSTS 4
+
+/*
+This sends the events in the history log that the collector has not yet
+taken. It does not bring the Wifi up itself; it is run by the notification
+service while the Wifi is up for a notification so that the history costs
+no session of its own. The events go in batches of as many as fit, each in
+a POST of its own, and the log's cursor is moved on past a batch once the
+collector has responded with a `2xx` status. A batch that fails is sent
+again next time; the collector should ignore events that it already has.
+*/
+
+class HistorySync {
+  public:
+    HistorySync(
+      const char* description,
+      const CollectorSettings* collectorSettings,
+      EnergyGovernor* energyGovernor);
+    ~HistorySync();
+
+    void sync();
+
+    uint32_t syncedCount() const;
+    uint32_t failedCount() const;
+
+  private:
+    bool post();
+
+  private:
+    const char* _description;
+    CollectorSettings _collectorSettings;
+    EnergyGovernor* _energyGovernor;
+    IPAddress _address;
+    bool _hasAddress;
+    HttpSender _httpSender;
+    uint8_t _body[HISTORY_SYNC_BODY_MAX_LENGTH];
+    uint32_t _syncedCount;
+    uint32_t _failedCount;
+};
+
+#endif // HISTORYSYNC_H
@@ -0,0 +1,390 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#include "httpsender.h"
+
+#include "constants.h"
+#include "httputils.h"
+#include "latencytrace.h"
+#include "monotonicclock.h"
+#include "wallclock.h"
+
+#define HTTP_SENDER_POLL_MILLIS 10L
+#define HTTP_SENDER_READ_CHUNK 16
+
+static const char* HTTP_PROTOCOL = "HTTP/";
+static const char* HTTP_DATE_HEADER_NAME = "date:";
+
+HttpStatusLineParser::HttpStatusLineParser() {
+  reset();
+}
+
+void HttpStatusLineParser::reset() {
+  _state = STATUS_LINE_PROTOCOL;
+  _count = 0;
+  _statusCode = 0;
+}
+
+void HttpStatusLineParser::consume(uint8_t ch) {
+  switch (_state) {
+    case STATUS_LINE_PROTOCOL:
+      if (ch != HTTP_PROTOCOL[_count]) {
+        _state = STATUS_LINE_FAILED;
+      } else {
+        _count++;
+        if (0 == HTTP_PROTOCOL[_count]) {
+          _state = STATUS_LINE_VERSION;
+        }
+      }
+      break;
+    case STATUS_LINE_VERSION:
+      if (' ' == ch) {
+        _state = STATUS_LINE_CODE;
+        _count = 0;
+      } else if (!isDigit(ch) && '.' != ch) {
+        _state = STATUS_LINE_FAILED;
+      }
+      break;
+    case STATUS_LINE_CODE:
+      if (!isDigit(ch)) {
+        _state = STATUS_LINE_FAILED;
+      } else {
+        _statusCode = (_statusCode * 10) + (ch - '0');
+        _count++;
+        if (3 == _count) {
+          _state = STATUS_LINE_COMPLETE;
+        }
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+bool HttpStatusLineParser::isComplete() const {
+  return STATUS_LINE_COMPLETE == _state;
+}
+
+bool HttpStatusLineParser::isFailed() const {
+  return STATUS_LINE_FAILED == _state;
+}
+
+int HttpStatusLineParser::statusCode() const {
+  return _statusCode;
+}
+
+HttpDateHeaderParser::HttpDateHeaderParser() {
+  reset();
+}
+
+/*
+The parse starts part way through the status line so the rest of that line
+is skipped first.
+*/
+
+void HttpDateHeaderParser::reset() {
+  _state = DATE_HEADER_SKIP;
+  _count = 0;
+  _hasDate = false;
+  _date[0] = 0;
+}
+
+void HttpDateHeaderParser::consume(uint8_t ch) {
+  switch (_state) {
+    case DATE_HEADER_SKIP:
+      if ('\n' == ch) {
+        _state = DATE_HEADER_LINE_START;
+      }
+      break;
+    case DATE_HEADER_LINE_START:
+      if ('\n' == ch) {
+        _state = DATE_HEADER_COMPLETE;
+        break;
+      }
+      if ('\r' == ch) {
+        break;
+      }
+      _state = DATE_HEADER_NAME;
+      _count = 0;
+      // fall through
+    case DATE_HEADER_NAME:
+      if (HTTP_DATE_HEADER_NAME[_count] != tolower(ch)) {
+        _state = '\n' == ch ? DATE_HEADER_LINE_START : DATE_HEADER_SKIP;
+      } else {
+        _count++;
+        if (0 == HTTP_DATE_HEADER_NAME[_count]) {
+          _state = DATE_HEADER_VALUE;
+          _count = 0;
+        }
+      }
+      break;
+    case DATE_HEADER_VALUE:
+      if ('\n' == ch) {
+        _date[_count] = 0;
+        _hasDate = 0 != _count;
+        _state = DATE_HEADER_LINE_START;
+      } else if ('\r' != ch && !(' ' == ch && 0 == _count)
+          && _count < HTTP_DATE_HEADER_MAX_LENGTH - 1) {
+        _date[_count++] = ch;
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+bool HttpDateHeaderParser::isComplete() const {
+  return DATE_HEADER_COMPLETE == _state;
+}
+
+bool HttpDateHeaderParser::hasDate() const {
+  return _hasDate;
+}
+
+const char* HttpDateHeaderParser::date() const {
+  return _hasDate ? _date : NULL;
+}
+
+HttpSender::HttpSender()
+  :
+  _host(NULL),
+  _path(NULL),
+  _fieldCount(0),
+  _contentType(NULL),
+  _body(NULL),
+  _bodyLength(0) {
+}
+
+/*
+Starts a new request. The host, path, field names and values and the body are
+not copied so they must remain valid until `post` has been called.
+*/
+
+void HttpSender::begin(const char* host, const char* path) {
+  _host = host;
+  _path = path;
+  _fieldCount = 0;
+  _contentType = NULL;
+  _body = NULL;
+  _bodyLength = 0;
+}
+
+bool HttpSender::addFormField(const char* name, const char* value) {
+  if (_fieldCount >= HTTP_SENDER_MAX_FIELDS) {
+    return false;
+  }
+  _fieldNames[_fieldCount] = name;
+  _fieldValues[_fieldCount] = value;
+  _fieldCount++;
+  return true;
+}
+
+/*
+Sends `body` as it is in place of any form fields.
+*/
+
+void HttpSender::setBody(const char* contentType, const uint8_t* body, size_t length) {
+  _contentType = contentType;
+  _body = body;
+  _bodyLength = length;
+}
+
+/*
+Sends the request and returns the HTTP status code of the response or one of
+the `HTTP_SENDER_ERROR_...` values if there was a problem.
+*/
+
+int HttpSender::post(Client& client) {
+  size_t length = composeRequest();
+
+  if (0 == length) {
+    return HTTP_SENDER_ERROR_TOO_LONG;
+  }
+
+  int result = writeRequest(client, length);
+
+  if (0 != result) {
+    return result;
+  }
+
+  LatencyTrace::mark(LATENCY_STAGE_POST, MonotonicClock::now());
+  result = readStatus(client);
+  LatencyTrace::mark(LATENCY_STAGE_RESPONSE, MonotonicClock::now());
+
+  return result;
+}
+
+/*
+Assembles the whole request into the buffer. The length of the body is
+worked out first so that the `Content-Length` header can be written ahead of
+it. Returns zero if the request does not fit into the buffer.
+*/
+
+// private
+size_t HttpSender::composeRequest() {
+  if (NULL != _body) {
+    size_t headLength = composeHead(_contentType, _bodyLength);
+
+    if (0 == headLength) {
+      return 0;
+    }
+
+    memcpy(&_buffer[headLength], _body, _bodyLength);
+    return headLength + _bodyLength;
+  }
+
+  size_t bodyLength = 0;
+
+  for (uint8_t i = 0; i < _fieldCount; i++) {
+    bodyLength += (0 == i ? 0 : 1) + strlen(_fieldNames[i]) + 1
+      + HttpUtils::encodeFormValue(_fieldValues[i], NULL, 0);
+  }
+
+  size_t length = composeHead("application/x-www-form-urlencoded", bodyLength);
+
+  if (0 == length) {
+    return 0;
+  }
+
+  for (uint8_t i = 0; i < _fieldCount; i++) {
+    size_t nameLength = strlen(_fieldNames[i]);
+
+    if (0 != i) {
+      _buffer[length++] = '&';
+    }
+
+    memcpy(&_buffer[length], _fieldNames[i], nameLength);
+    length += nameLength;
+    _buffer[length++] = '=';
+    length += HttpUtils::encodeFormValue(
+      _fieldValues[i], &_buffer[length], HTTP_SENDER_BUFFER_LENGTH - length);
+  }
+
+  return length;
+}
+
+/*
+Writes the request line and the headers. Returns their length or zero if they
+and a body of `bodyLength` do not fit into the buffer.
+*/
+
+// private
+size_t HttpSender::composeHead(const char* contentType, size_t bodyLength) {
+  int headLength = snprintf(_buffer, HTTP_SENDER_BUFFER_LENGTH,
+    "POST %s HTTP/1.1\r\n"
+    "Host: %s\r\n"
+    "Content-Type: %s\r\n"
+    "Connection: close\r\n"
+    "Content-Length: %u\r\n"
+    "\r\n",
+    _path, _host, contentType, (unsigned int) bodyLength);
+
+  if (headLength < 0 || (size_t) headLength + bodyLength > HTTP_SENDER_BUFFER_LENGTH) {
+    return 0;
+  }
+
+  return headLength;
+}
+
+// private
+int HttpSender::writeRequest(Client& client, size_t length) {
+  unsigned long start = millis();
+  size_t written = 0;
+
+  while (written < length) {
+    size_t count = client.write((const uint8_t*) &_buffer[written], length - written);
+
+    if (0 == count) {
+      if (!client.connected()) {
+        return HTTP_SENDER_ERROR_WRITE;
+      }
+      if ((millis() - start) >= HTTP_WRITE_DEADLINE_MILLIS) {
+        return HTTP_SENDER_ERROR_TIMED_OUT;
+      }
+      delay(HTTP_SENDER_POLL_MILLIS);
+    }
+
+    written += count;
+  }
+
+  return 0;
+}
+
+/*
+Reads the response only as far as the status code and then the headers so
+far as they have already arrived. The rest of the response is of no interest
+and is discarded when the caller closes the connection.
+*/
+
+// private
+int HttpSender::readStatus(Client& client) {
+  unsigned long start = millis();
+  uint8_t chunk[HTTP_SENDER_READ_CHUNK];
+  HttpStatusLineParser parser;
+  HttpDateHeaderParser dateParser;
+
+  while (!parser.isComplete()) {
+    if (parser.isFailed()) {
+      return HTTP_SENDER_ERROR_INVALID_RESPONSE;
+    }
+
+    int available = client.available();
+
+    if (available > 0) {
+      int count = client.read(chunk, min(available, HTTP_SENDER_READ_CHUNK));
+
+      for (int i = 0; i < count; i++) {
+        if (parser.isComplete()) {
+          dateParser.consume(chunk[i]);
+        } else {
+          parser.consume(chunk[i]);
+        }
+      }
+    } else {
+      if (!client.connected()) {
+        return HTTP_SENDER_ERROR_INVALID_RESPONSE;
+      }
+      if ((millis() - start) >= HTTP_STATUS_DEADLINE_MILLIS) {
+        return HTTP_SENDER_ERROR_TIMED_OUT;
+      }
+      delay(HTTP_SENDER_POLL_MILLIS);
+    }
+  }
+
+  readDate(client, dateParser);
+  return parser.statusCode();
+}
+
+/*
+The `Date` header is only taken if it has arrived by the time the status code
+has; this never waits on the server so a response without it costs nothing.
+*/
+
+// private
+void HttpSender::readDate(Client& client, HttpDateHeaderParser& parser) {
+  uint8_t chunk[HTTP_SENDER_READ_CHUNK];
+  uint32_t epochSeconds;
+
+  while (!parser.isComplete() && !parser.hasDate()) {
+    int available = client.available();
+
+    if (available <= 0) {
+      break;
+    }
+
+    int count = client.read(chunk, min(available, HTTP_SENDER_READ_CHUNK));
+
+    if (count <= 0) {
+      break;
+    }
+
+    for (int i = 0; i < count; i++) {
+      parser.consume(chunk[i]);
+    }
+  }
+
+  if (parser.hasDate() && WallClock::parseHttpDate(parser.date(), &epochSeconds)) {
+    WallClock::observe(epochSeconds, MonotonicClock::now());
+  }
+}
@@ -0,0 +1,128 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#ifndef HTTP_SENDER_H
+#define HTTP_SENDER_H
+
+#include <Arduino.h>
+#include <Client.h>
+
+#define HTTP_SENDER_BUFFER_LENGTH 768
+#define HTTP_SENDER_MAX_FIELDS 6
+
+#define HTTP_SENDER_ERROR_TOO_LONG -1
+#define HTTP_SENDER_ERROR_WRITE -2
+#define HTTP_SENDER_ERROR_TIMED_OUT -3
+#define HTTP_SENDER_ERROR_INVALID_RESPONSE -4
+
+#define HTTP_DATE_HEADER_MAX_LENGTH 32
+
+/*
+This parses the status line of an HTTP/1.x response; for example
+`HTTP/1.1 200 OK`. It is fed one byte at a time and keeps no copy of the
+bytes so it does not matter how the response arrives. Once the three digits
+of the status code have been seen, the parse is complete and nothing further
+of the response is needed.
+*/
+
+class HttpStatusLineParser {
+  public:
+    HttpStatusLineParser();
+
+    void reset();
+    void consume(uint8_t ch);
+
+    bool isComplete() const;
+    bool isFailed() const;
+    int statusCode() const;
+
+  private:
+    enum State {
+      STATUS_LINE_PROTOCOL,
+      STATUS_LINE_VERSION,
+      STATUS_LINE_CODE,
+      STATUS_LINE_COMPLETE,
+      STATUS_LINE_FAILED
+    };
+
+  private:
+    State _state;
+    uint8_t _count;
+    int _statusCode;
+};
+
+/*
+This picks the value of the `Date` header out of the headers of a response.
+It is fed the bytes that follow the status code, one at a time, and is
+complete at the blank line that ends the headers. Only the value of the
+`Date` header is kept.
+*/
+
+class HttpDateHeaderParser {
+  public:
+    HttpDateHeaderParser();
+
+    void reset();
+    void consume(uint8_t ch);
+
+    bool isComplete() const;
+    bool hasDate() const;
+    const char* date() const;
+
+  private:
+    enum State {
+      DATE_HEADER_SKIP,
+      DATE_HEADER_LINE_START,
+      DATE_HEADER_NAME,
+      DATE_HEADER_VALUE,
+      DATE_HEADER_COMPLETE
+    };
+
+  private:
+    State _state;
+    uint8_t _count;
+    bool _hasDate;
+    char _date[HTTP_DATE_HEADER_MAX_LENGTH];
+};
+
+/*
+This sends a POST request over a client that is already connected. The body
+is either form fields or, if one is set, a body of some other type. The
+whole of the request is assembled in a fixed buffer and written in one go.
+Only the status line of the response and whatever of the headers has already
+arrived with it are read; the caller should then close the connection. If
+the headers carry a `Date` then it is given to the `WallClock`. Each phase
+has a deadline so that a slow or stalled server cannot hold up the device for
+long.
+*/
+
+class HttpSender {
+  public:
+    HttpSender();
+
+    void begin(const char* host, const char* path);
+    bool addFormField(const char* name, const char* value);
+    void setBody(const char* contentType, const uint8_t* body, size_t length);
+    int post(Client& client);
+
+  private:
+    size_t composeRequest();
+    size_t composeHead(const char* contentType, size_t bodyLength);
+    int writeRequest(Client& client, size_t length);
+    int readStatus(Client& client);
+    void readDate(Client& client, HttpDateHeaderParser& parser);
+
+  private:
+    const char* _host;
+    const char* _path;
+    const char* _fieldNames[HTTP_SENDER_MAX_FIELDS];
+    const char* _fieldValues[HTTP_SENDER_MAX_FIELDS];
+    uint8_t _fieldCount;
+    const char* _contentType;
+    const uint8_t* _body;
+    size_t _bodyLength;
+    char _buffer[HTTP_SENDER_BUFFER_LENGTH];
+};
+
+#endif // HTTP_SENDER_H
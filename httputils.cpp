@@ -9,28 +9,41 @@
 /*
 HTTP requests can carry a payload or query parameters that carry form-value
 encoded text. This encoding is a form of text escaping and this function
-will escape the characters as necessary.
+will escape the characters as necessary into the buffer. The length of the
+encoded value is returned even if it did not fit into the buffer so passing
+a `NULL` buffer can be used to find the length that the encoded value will
+be. The buffer is not terminated.
 */
 
 /*static*/
-String HttpUtils::encodeFormValue(String value) {
-  String result;
-  for (int i = 0; i < value.length(); i++) {
-    uint8_t ch = value.charAt(i);
+size_t HttpUtils::encodeFormValue(const char* value, char* buffer, size_t bufferSize) {
+  static const char* HEXCHARS = "0123456789ABCDEF";
+  size_t length = 0;
+
+  for (; 0 != *value; value++) {
+    uint8_t ch = *value;
     if (' ' == ch) {
-      result += '+';
+      if (length < bufferSize) {
+        buffer[length] = '+';
+      }
+      length++;
     }
     else {
       if (isAlphaNumeric(ch)) {
-        result += (char) ch;
+        if (length < bufferSize) {
+          buffer[length] = (char) ch;
+        }
+        length++;
       }
       else {
-        static char* HEXCHARS = "0123456789ABCDEF";
-        result += '%';
-        result += HEXCHARS[(ch >> 4)];
-        result += HEXCHARS[(ch & 0x0f)];
+        if (length + 3 <= bufferSize) {
+          buffer[length] = '%';
+          buffer[length + 1] = HEXCHARS[(ch >> 4)];
+          buffer[length + 2] = HEXCHARS[(ch & 0x0f)];
+        }
+        length += 3;
       }
     }
   }
-  return result;
+  return length;
 }
@@ -9,7 +9,7 @@
 
 class HttpUtils {
   public:
-    static String encodeFormValue(String value);
+    static size_t encodeFormValue(const char* value, char* buffer, size_t bufferSize);
 
 };
 
@@ -4,10 +4,14 @@
  */
 #include "indicatorservice.h"
 
-IndicatorService::IndicatorService(int ledPin)
+#include "monotonicclock.h"
+
+IndicatorService::IndicatorService(int ledPin, EventBus* eventBus)
   :
   _state(INDICATOR_CLOSED),
-  _ledPin(ledPin) {
+  _ledPin(ledPin),
+  _eventBus(eventBus),
+  _subscriber(eventBus->subscribe(BUS_EVENT_MASK(BUS_EVENT_PHASE))) {
 }
 
 void IndicatorService::setState(IndicatorState state) {
@@ -15,12 +19,18 @@ void IndicatorService::setState(IndicatorState state) {
 }
 
 void IndicatorService::pulse() {
+  BusEvent event;
+
+  while (_eventBus->take(_subscriber, &event)) {
+    setState((IndicatorState) event.detail);
+  }
+
   digitalWrite(_ledPin, _deriveLedValue());
 }
 
 bool IndicatorService::_deriveLedValue() {
-  unsigned long now = millis();
-  
+  uint64_t now = MonotonicClock::now();
+
   switch (_state) {
     case INDICATOR_CLOSED:
       return LOW;
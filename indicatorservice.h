@@ -7,6 +7,8 @@
 
 #include <Arduino.h>
 
+#include "eventbus.h"
+
 enum IndicatorState {
   INDICATOR_CLOSED,
   INDICATOR_PAUSED_UNTIL_CLOSE,
@@ -17,12 +19,13 @@ enum IndicatorState {
 /*
 The indicator is a flashing LED light which shows various situations by flashing in
 different ways. This service is sent a `pulse()` method invocation and it should
-flash the LED as necessary during the pulse.
+flash the LED as necessary during the pulse. It learns of the changes in the
+sensor's phase from the event bus as it pulses.
 */
 
 class IndicatorService {
 public:
-  IndicatorService(int ledPin);
+  IndicatorService(int ledPin, EventBus* eventBus);
 
   void setState(IndicatorState state);
   void pulse();
@@ -33,6 +36,8 @@ private:
 private:
   IndicatorState _state;
   int _ledPin;
+  EventBus* _eventBus;
+  int _subscriber;
 };
 
 #endif // INDICATOR_H
@@ -0,0 +1,159 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#include "inputsampler.h"
+
+#include "monotonicclock.h"
+
+InputSampler::InputSampler()
+  :
+  _intervalSeconds(0),
+  _inputCount(0),
+  _sampleCount(0),
+  _changeCount(0) {
+  for (int i = 0; i < INPUT_SAMPLER_MAX_INPUTS; i++) {
+    _inputs[i] = NULL;
+  }
+}
+
+/*
+An interval of zero stops the sampling.
+*/
+
+void InputSampler::setIntervalSeconds(uint32_t seconds) {
+  _intervalSeconds = seconds;
+}
+
+/*
+Returns false if there is no room for the input. Adding an input which is
+already sampled has no effect.
+*/
+
+bool InputSampler::add(DebouncedDigitalInput* input) {
+  for (int i = 0; i < _inputCount; i++) {
+    if (_inputs[i] == input) {
+      return true;
+    }
+  }
+
+  if (_inputCount >= INPUT_SAMPLER_MAX_INPUTS) {
+    return false;
+  }
+
+  _inputs[_inputCount++] = input;
+  return true;
+}
+
+void InputSampler::remove(DebouncedDigitalInput* input) {
+  for (int i = 0; i < _inputCount; i++) {
+    if (_inputs[i] == input) {
+      _inputs[i] = _inputs[--_inputCount];
+      _inputs[_inputCount] = NULL;
+      return;
+    }
+  }
+}
+
+bool InputSampler::isSampling() const {
+  return 0 != _intervalSeconds && 0 != _inputCount;
+}
+
+/*
+Sleeps until a pin wakes the board, a sampled input starts to change or,
+unless `wakeAt` is zero, the clock reaches `wakeAt`. Returns how long the
+board slept for in all. The last stretch before `wakeAt` is slept in one go
+as the board will go around `loop()` when it wakes anyway.
+*/
+
+unsigned long InputSampler::sleep(uint64_t wakeAt) {
+  unsigned long sleptMillis = 0;
+
+  if (!isSampling()) {
+    return MonotonicClock::sleep(wakeAt);
+  }
+
+  while (true) {
+    uint64_t now = MonotonicClock::now();
+
+    if (0 != wakeAt && wakeAt <= now) {
+      return sleptMillis;
+    }
+
+    if (0 != wakeAt && (wakeAt - now) <= (uint64_t) _intervalSeconds * 1000UL) {
+      return sleptMillis + MonotonicClock::sleep(wakeAt);
+    }
+
+    sleptMillis += MonotonicClock::sleepSeconds(_intervalSeconds);
+
+    // a pin with a wake interrupt woke the board
+
+    if (!MonotonicClock::wokeFromAlarm()) {
+      return sleptMillis;
+    }
+
+    _sampleCount++;
+
+    if (sample()) {
+      _changeCount++;
+      return sleptMillis;
+    }
+  }
+}
+
+uint32_t InputSampler::sampleCount() const {
+  return _sampleCount;
+}
+
+/*
+This is the number of samples which found an input changing and so kept the
+board awake.
+*/
+
+uint32_t InputSampler::changeCount() const {
+  return _changeCount;
+}
+
+/*
+On the board the port registers are read once each and the level of each pin
+is picked out of them so that the pins are read at the same moment and
+without the overhead of `digitalRead()`.
+*/
+
+// private
+void InputSampler::readLevels(int* levels) const {
+#ifdef ARDUINO_ARCH_SAMD
+  uint32_t ports[2] = { PORT->Group[PORTA].IN.reg, PORT->Group[PORTB].IN.reg };
+
+  for (int i = 0; i < _inputCount; i++) {
+    const PinDescription& description = g_APinDescription[_inputs[i]->pin()];
+    levels[i] = 0 != (ports[description.ulPort] & (1UL << description.ulPin)) ? HIGH : LOW;
+  }
+#else
+  for (int i = 0; i < _inputCount; i++) {
+    levels[i] = digitalRead(_inputs[i]->pin());
+  }
+#endif
+}
+
+/*
+Feeds the levels to the debouncers and returns true if any of the inputs has
+started to change; it then needs the board awake to settle.
+*/
+
+// private
+bool InputSampler::sample() {
+  int levels[INPUT_SAMPLER_MAX_INPUTS];
+  bool changing = false;
+
+  readLevels(levels);
+
+  for (int i = 0; i < _inputCount; i++) {
+    _inputs[i]->feed(levels[i]);
+    if (!_inputs[i]->allowedToShortSleep()) {
+      changing = true;
+    }
+  }
+
+  return changing;
+}
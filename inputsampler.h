@@ -0,0 +1,67 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#ifndef INPUTSAMPLER_H
+#define INPUTSAMPLER_H
+
+#include <Arduino.h>
+
+#include "debouncedigitalinput.h"
+
+#define INPUT_SAMPLER_MAX_INPUTS 4
+
+/*
+An input on a pin without a "low power" wake up interrupt is not able to wake
+the board from deep sleep. Instead the sampler has the real time clock wake
+the board every `intervalSeconds` and reads the levels of all of the sampled
+pins at once from the port registers. The levels are fed to the debouncer of
+each input and if none of them has started to change then the board goes
+straight back to sleep without going around `loop()`; a sample keeps the
+board awake for some microseconds.
+
+The cost of sampling is that a change is noticed up to `intervalSeconds`
+late; the real time clock only counts whole seconds so that is the shortest
+interval. Against that, each sample costs a little charge; see
+`ENERGY_ACTIVITY_SAMPLE`.
+*/
+
+class InputSampler {
+  public:
+    InputSampler();
+
+    void setIntervalSeconds(uint32_t seconds);
+    bool add(DebouncedDigitalInput* input);
+    void remove(DebouncedDigitalInput* input);
+    bool isSampling() const;
+
+    unsigned long sleep(uint64_t wakeAt);
+
+    uint32_t sampleCount() const;
+    uint32_t changeCount() const;
+
+    template <class T> void printTo(T& stream) const {
+      stream.print("{inputSampler:{intervalSeconds:");
+      stream.print(_intervalSeconds);
+      stream.print(",inputs:");
+      stream.print(_inputCount);
+      stream.print(",samples:");
+      stream.print(_sampleCount);
+      stream.print(",changes:");
+      stream.print(_changeCount);
+      stream.println("}}");
+    }
+
+  private:
+    void readLevels(int* levels) const;
+    bool sample();
+
+  private:
+    uint32_t _intervalSeconds;
+    DebouncedDigitalInput* _inputs[INPUT_SAMPLER_MAX_INPUTS];
+    int _inputCount;
+    uint32_t _sampleCount;
+    uint32_t _changeCount;
+};
+
+#endif // INPUTSAMPLER_H
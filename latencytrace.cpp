@@ -0,0 +1,149 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#include "latencytrace.h"
+
+static const char* LATENCY_STAGE_NAMES[] = {
+  "debounce",
+  "notifyDelay",
+  "wifiAssociate",
+  "tlsConnect",
+  "post",
+  "response"
+};
+
+static_assert(sizeof(LATENCY_STAGE_NAMES) / sizeof(LATENCY_STAGE_NAMES[0]) == LATENCY_STAGE_COUNT,
+  "there must be a name for each latency stage");
+
+static LatencyHistogram latencyHistograms[LATENCY_STAGE_COUNT];
+static LatencySpan latencyRecentSpans[LATENCY_TRACE_RECENT_SPANS];
+static int latencyRecentSpanCount = 0;
+static int latencyRecentSpanNext = 0;
+static uint16_t latencyLastCorrelationId = 0;
+static uint16_t latencyCorrelationId = 0;
+static uint64_t latencyMarkedAt = 0;
+
+LatencyHistogram::LatencyHistogram()
+  :
+  _count(0),
+  _maxMillis(0) {
+  for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+    _buckets[i] = 0;
+  }
+}
+
+void LatencyHistogram::record(unsigned long durationMillis) {
+  int index = 0;
+
+  while (index < LATENCY_HISTOGRAM_BUCKETS - 1 && (durationMillis >> index) > 0) {
+    index++;
+  }
+
+  if (_buckets[index] < UINT16_MAX) {
+    _buckets[index]++;
+  }
+
+  _count++;
+
+  if (durationMillis > _maxMillis) {
+    _maxMillis = durationMillis;
+  }
+}
+
+uint32_t LatencyHistogram::count() const {
+  return _count;
+}
+
+unsigned long LatencyHistogram::maxMillis() const {
+  return _maxMillis;
+}
+
+uint16_t LatencyHistogram::bucket(int index) const {
+  return _buckets[index];
+}
+
+/*
+Starts tracing a new notification with the first stage starting at the time
+supplied. Any notification that was still being traced is abandoned. Returns
+the correlation identifier of the new trace.
+*/
+
+/*static*/
+uint16_t LatencyTrace::begin(uint64_t at) {
+  latencyLastCorrelationId++;
+
+  // zero is reserved to mean that there is no trace in flight
+  if (0 == latencyLastCorrelationId) {
+    latencyLastCorrelationId++;
+  }
+
+  latencyCorrelationId = latencyLastCorrelationId;
+  latencyMarkedAt = at;
+  return latencyCorrelationId;
+}
+
+/*
+Marks the end of a stage of the notification that is in flight. The stage is
+taken to have started when the previous stage ended. Nothing is recorded if
+there is no notification in flight.
+*/
+
+/*static*/
+void LatencyTrace::mark(LatencyStage stage, uint64_t at) {
+  if (0 == latencyCorrelationId) {
+    return;
+  }
+
+  LatencySpan& span = latencyRecentSpans[latencyRecentSpanNext];
+  span.correlationId = latencyCorrelationId;
+  span.stage = stage;
+  span.at = (unsigned long) latencyMarkedAt;
+  span.durationMillis = (unsigned long) (at - latencyMarkedAt);
+
+  latencyHistograms[stage].record(span.durationMillis);
+
+  latencyRecentSpanNext = (latencyRecentSpanNext + 1) % LATENCY_TRACE_RECENT_SPANS;
+
+  if (latencyRecentSpanCount < LATENCY_TRACE_RECENT_SPANS) {
+    latencyRecentSpanCount++;
+  }
+
+  latencyMarkedAt = at;
+}
+
+/*static*/
+void LatencyTrace::end() {
+  latencyCorrelationId = 0;
+}
+
+/*static*/
+uint16_t LatencyTrace::correlationId() {
+  return latencyCorrelationId;
+}
+
+/*static*/
+const LatencyHistogram& LatencyTrace::histogram(LatencyStage stage) {
+  return latencyHistograms[stage];
+}
+
+/*static*/
+const char* LatencyTrace::stageName(LatencyStage stage) {
+  return LATENCY_STAGE_NAMES[stage];
+}
+
+/*static*/
+int LatencyTrace::recentSpanCount() {
+  return latencyRecentSpanCount;
+}
+
+/*
+Returns the recent spans from the oldest at index zero to the newest.
+*/
+
+/*static*/
+const LatencySpan& LatencyTrace::recentSpan(int index) {
+  int oldest = (latencyRecentSpanNext + LATENCY_TRACE_RECENT_SPANS - latencyRecentSpanCount)
+    % LATENCY_TRACE_RECENT_SPANS;
+  return latencyRecentSpans[(oldest + index) % LATENCY_TRACE_RECENT_SPANS];
+}
@@ -0,0 +1,118 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#ifndef LATENCYTRACE_H
+#define LATENCYTRACE_H
+
+#include <stdint.h>
+
+#define LATENCY_HISTOGRAM_BUCKETS 24
+#define LATENCY_TRACE_RECENT_SPANS 16
+
+/*
+These are the stages that a notification passes through from the sensor
+first changing to the server responding. Each stage is a span from the end of
+the previous stage.
+*/
+
+enum LatencyStage {
+  LATENCY_STAGE_DEBOUNCE,
+  LATENCY_STAGE_NOTIFY_DELAY,
+  LATENCY_STAGE_WIFI_ASSOCIATE,
+  LATENCY_STAGE_TLS_CONNECT,
+  LATENCY_STAGE_POST,
+  LATENCY_STAGE_RESPONSE,
+  LATENCY_STAGE_COUNT
+};
+
+struct LatencySpan {
+  uint16_t correlationId;
+  uint8_t stage;
+  unsigned long at;
+  unsigned long durationMillis;
+};
+
+/*
+A histogram of durations with buckets of doubling size; bucket `n` counts
+durations below 2^n milliseconds and the last bucket also counts everything
+longer.
+*/
+
+class LatencyHistogram {
+  public:
+    LatencyHistogram();
+
+    void record(unsigned long durationMillis);
+
+    uint32_t count() const;
+    unsigned long maxMillis() const;
+    uint16_t bucket(int index) const;
+
+  private:
+    uint16_t _buckets[LATENCY_HISTOGRAM_BUCKETS];
+    uint32_t _count;
+    unsigned long _maxMillis;
+};
+
+/*
+This keeps track of the notification that is currently in flight. Each
+notification is given a correlation identifier when it begins and every
+stage that it passes through is stamped with that identifier. The durations
+of the stages are gathered into a histogram for each stage and the most
+recent spans are kept so that they can be printed.
+*/
+
+class LatencyTrace {
+  public:
+    static uint16_t begin(uint64_t at);
+    static void mark(LatencyStage stage, uint64_t at);
+    static void end();
+
+    static uint16_t correlationId();
+    static const LatencyHistogram& histogram(LatencyStage stage);
+    static const char* stageName(LatencyStage stage);
+
+    static int recentSpanCount();
+    static const LatencySpan& recentSpan(int index);
+
+    template <class T> static void printTo(T& stream);
+};
+
+template <class T>
+void LatencyTrace::printTo(T& stream) {
+  stream.println("{latencyHistograms:[");
+  for (int s = 0; s < LATENCY_STAGE_COUNT; s++) {
+    const LatencyHistogram& stageHistogram = histogram((LatencyStage) s);
+    stream.print("{stage:");
+    stream.print(stageName((LatencyStage) s));
+    stream.print(",count:");
+    stream.print(stageHistogram.count());
+    stream.print(",max:");
+    stream.print(stageHistogram.maxMillis());
+    stream.print(",buckets:");
+    for (int b = 0; b < LATENCY_HISTOGRAM_BUCKETS; b++) {
+      if (0 != b) {
+        stream.print(" ");
+      }
+      stream.print(stageHistogram.bucket(b));
+    }
+    stream.println("}");
+  }
+  stream.println("],recentSpans:[");
+  for (int i = 0; i < recentSpanCount(); i++) {
+    const LatencySpan& span = recentSpan(i);
+    stream.print("{id:");
+    stream.print(span.correlationId);
+    stream.print(",stage:");
+    stream.print(stageName((LatencyStage) span.stage));
+    stream.print(",at:");
+    stream.print(span.at);
+    stream.print(",took:");
+    stream.print(span.durationMillis);
+    stream.println("}");
+  }
+  stream.println("]}");
+}
+
+#endif // LATENCYTRACE_H
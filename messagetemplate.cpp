@@ -0,0 +1,301 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#include "messagetemplate.h"
+
+#include <string.h>
+
+#include "wallclock.h"
+
+struct MessageFieldName {
+  MessageField field;
+  const char* name;
+};
+
+static const MessageFieldName MESSAGE_FIELD_NAMES[] = {
+  { MESSAGE_FIELD_DESCRIPTION, "description" },
+  { MESSAGE_FIELD_OPEN_DURATION, "duration" },
+  { MESSAGE_FIELD_OPEN_COUNT, "count" },
+  { MESSAGE_FIELD_UPTIME, "uptime" },
+  { MESSAGE_FIELD_STATE, "state" },
+  { MESSAGE_FIELD_SUPPRESSED_COUNT, "suppressed" },
+  { MESSAGE_FIELD_STATS_OPENS, "opens" },
+  { MESSAGE_FIELD_STATS_OPENS_PER_DAY, "perday" },
+  { MESSAGE_FIELD_STATS_MEAN, "mean" },
+  { MESSAGE_FIELD_STATS_MAX, "max" },
+  { MESSAGE_FIELD_STATS_P50, "p50" },
+  { MESSAGE_FIELD_STATS_P90, "p90" },
+  { MESSAGE_FIELD_STATS_P99, "p99" },
+  { MESSAGE_FIELD_DATE, "date" },
+  { MESSAGE_FIELD_TIME, "time" }
+};
+
+#define MESSAGE_FIELD_NAME_COUNT (sizeof(MESSAGE_FIELD_NAMES) / sizeof(MESSAGE_FIELD_NAMES[0]))
+
+static MessageField lookupField(const char* name, size_t length) {
+  for (size_t i = 0; i < MESSAGE_FIELD_NAME_COUNT; i++) {
+    if (strlen(MESSAGE_FIELD_NAMES[i].name) == length
+      && 0 == strncmp(MESSAGE_FIELD_NAMES[i].name, name, length)) {
+      return MESSAGE_FIELD_NAMES[i].field;
+    }
+  }
+  return MESSAGE_FIELD_LITERAL;
+}
+
+static void append(char* buffer, size_t bufferSize, size_t* length, const char* value, size_t valueLength) {
+  while (valueLength > 0 && *length + 1 < bufferSize) {
+    buffer[(*length)++] = *(value++);
+    valueLength--;
+  }
+}
+
+static void appendUnsigned(char* buffer, size_t bufferSize, size_t* length, unsigned long value) {
+  // each byte needs fewer than three decimal digits so this holds the digits
+  // of `ULONG_MAX` whether an `unsigned long` has 32 bits, as on the board,
+  // or 64 bits, as on most hosts.
+  char digits[3 * sizeof(unsigned long)];
+  size_t digitCount = 0;
+
+  do {
+    digits[sizeof(digits) - (++digitCount)] = '0' + (value % 10);
+    value /= 10;
+  } while (0 != value);
+
+  append(buffer, bufferSize, length, &digits[sizeof(digits) - digitCount], digitCount);
+}
+
+/*
+Writes a duration as the two most significant units; for example "3h 20m".
+*/
+
+static void appendDuration(char* buffer, size_t bufferSize, size_t* length, uint64_t millis) {
+  unsigned long seconds = (unsigned long) (millis / 1000);
+
+  if (seconds < 60) {
+    appendUnsigned(buffer, bufferSize, length, seconds);
+    append(buffer, bufferSize, length, "s", 1);
+  } else if (seconds < 60 * 60) {
+    appendUnsigned(buffer, bufferSize, length, seconds / 60);
+    append(buffer, bufferSize, length, "m", 1);
+  } else if (seconds < 24 * 60 * 60) {
+    appendUnsigned(buffer, bufferSize, length, seconds / (60 * 60));
+    append(buffer, bufferSize, length, "h ", 2);
+    appendUnsigned(buffer, bufferSize, length, (seconds / 60) % 60);
+    append(buffer, bufferSize, length, "m", 1);
+  } else {
+    appendUnsigned(buffer, bufferSize, length, seconds / (24 * 60 * 60));
+    append(buffer, bufferSize, length, "d ", 2);
+    appendUnsigned(buffer, bufferSize, length, (seconds / (60 * 60)) % 24);
+    append(buffer, bufferSize, length, "h", 1);
+  }
+}
+
+static void appendTwoDigits(char* buffer, size_t bufferSize, size_t* length, unsigned long value) {
+  if (value < 10) {
+    append(buffer, bufferSize, length, "0", 1);
+  }
+  appendUnsigned(buffer, bufferSize, length, value);
+}
+
+/*
+Writes the date or the time of day in UTC. A wall time of zero means that the
+time is not known and a "?" is written in place of it.
+*/
+
+static void appendWallClock(char* buffer, size_t bufferSize, size_t* length,
+    uint32_t wallSeconds, MessageField field) {
+  WallClockCivil civil;
+
+  if (0 == wallSeconds) {
+    append(buffer, bufferSize, length, "?", 1);
+    return;
+  }
+
+  WallClock::toCivil(wallSeconds, &civil);
+
+  if (MESSAGE_FIELD_DATE == field) {
+    appendUnsigned(buffer, bufferSize, length, civil.year);
+    append(buffer, bufferSize, length, "-", 1);
+    appendTwoDigits(buffer, bufferSize, length, civil.month);
+    append(buffer, bufferSize, length, "-", 1);
+    appendTwoDigits(buffer, bufferSize, length, civil.day);
+  } else {
+    appendTwoDigits(buffer, bufferSize, length, civil.hour);
+    append(buffer, bufferSize, length, ":", 1);
+    appendTwoDigits(buffer, bufferSize, length, civil.minute);
+    append(buffer, bufferSize, length, " UTC", 4);
+  }
+}
+
+/*
+Writes one of the statistics of the sensor being open. Without statistics a
+"?" is written in place of the value.
+*/
+
+static void appendStatistic(char* buffer, size_t bufferSize, size_t* length,
+    const MessageContext& context, MessageField field) {
+  const OpenStats* stats = context.openStats;
+
+  if (NULL == stats) {
+    append(buffer, bufferSize, length, "?", 1);
+    return;
+  }
+
+  switch (field) {
+    case MESSAGE_FIELD_STATS_OPENS:
+      appendUnsigned(buffer, bufferSize, length, stats->count());
+      break;
+    case MESSAGE_FIELD_STATS_OPENS_PER_DAY: {
+      uint32_t tenths = stats->opensPerDayTenths(context.statsMillis);
+      appendUnsigned(buffer, bufferSize, length, tenths / 10);
+      append(buffer, bufferSize, length, ".", 1);
+      appendUnsigned(buffer, bufferSize, length, tenths % 10);
+      break;
+    }
+    case MESSAGE_FIELD_STATS_MEAN:
+      appendDuration(buffer, bufferSize, length, stats->meanMillis());
+      break;
+    case MESSAGE_FIELD_STATS_MAX:
+      appendDuration(buffer, bufferSize, length, stats->maxMillis());
+      break;
+    case MESSAGE_FIELD_STATS_P50:
+      appendDuration(buffer, bufferSize, length, stats->quantileMillis(500));
+      break;
+    case MESSAGE_FIELD_STATS_P90:
+      appendDuration(buffer, bufferSize, length, stats->quantileMillis(900));
+      break;
+    case MESSAGE_FIELD_STATS_P99:
+      appendDuration(buffer, bufferSize, length, stats->quantileMillis(990));
+      break;
+    default:
+      break;
+  }
+}
+
+MessageTemplate::MessageTemplate()
+  :
+  _segmentCount(0) {
+  _text[0] = 0;
+}
+
+/*
+Parses the text of the template. Returns false if the template is too long,
+has too many segments or has a placeholder that is not known; in which case
+the template is left empty.
+*/
+
+bool MessageTemplate::parse(const char* text) {
+  size_t textLength = strlen(text);
+
+  _segmentCount = 0;
+  _text[0] = 0;
+
+  if (textLength >= MESSAGE_TEMPLATE_MAX_LENGTH) {
+    return false;
+  }
+
+  memcpy(_text, text, textLength + 1);
+
+  size_t i = 0;
+
+  while (i < textLength) {
+    if (_segmentCount >= MESSAGE_TEMPLATE_MAX_SEGMENTS) {
+      _segmentCount = 0;
+      return false;
+    }
+
+    Segment& segment = _segments[_segmentCount];
+
+    if ('{' == _text[i]) {
+      const char* close = strchr(&_text[i], '}');
+
+      if (NULL == close) {
+        _segmentCount = 0;
+        return false;
+      }
+
+      size_t nameLength = close - &_text[i + 1];
+      segment.field = lookupField(&_text[i + 1], nameLength);
+
+      if (MESSAGE_FIELD_LITERAL == segment.field) {
+        _segmentCount = 0;
+        return false;
+      }
+
+      segment.offset = 0;
+      segment.length = 0;
+      i += nameLength + 2;
+    } else {
+      size_t start = i;
+
+      while (i < textLength && '{' != _text[i]) {
+        i++;
+      }
+
+      segment.field = MESSAGE_FIELD_LITERAL;
+      segment.offset = start;
+      segment.length = i - start;
+    }
+
+    _segmentCount++;
+  }
+
+  return true;
+}
+
+/*
+Renders the message into the buffer. The message is truncated if it does not
+fit and the buffer is always terminated. The length of the message is
+returned.
+*/
+
+size_t MessageTemplate::render(const MessageContext& context, char* buffer, size_t bufferSize) const {
+  size_t length = 0;
+
+  if (0 == bufferSize) {
+    return 0;
+  }
+
+  for (uint8_t i = 0; i < _segmentCount; i++) {
+    const Segment& segment = _segments[i];
+
+    switch (segment.field) {
+      case MESSAGE_FIELD_LITERAL:
+        append(buffer, bufferSize, &length, &_text[segment.offset], segment.length);
+        break;
+      case MESSAGE_FIELD_DESCRIPTION:
+        append(buffer, bufferSize, &length, context.description, strlen(context.description));
+        break;
+      case MESSAGE_FIELD_OPEN_DURATION:
+        appendDuration(buffer, bufferSize, &length, context.openDurationMillis);
+        break;
+      case MESSAGE_FIELD_OPEN_COUNT:
+        appendUnsigned(buffer, bufferSize, &length, context.openCount);
+        break;
+      case MESSAGE_FIELD_UPTIME:
+        appendDuration(buffer, bufferSize, &length, context.uptimeMillis);
+        break;
+      case MESSAGE_FIELD_STATE:
+        if (context.open) {
+          append(buffer, bufferSize, &length, "open", 4);
+        } else {
+          append(buffer, bufferSize, &length, "closed", 6);
+        }
+        break;
+      case MESSAGE_FIELD_SUPPRESSED_COUNT:
+        appendUnsigned(buffer, bufferSize, &length, context.suppressedCount);
+        break;
+      case MESSAGE_FIELD_DATE:
+      case MESSAGE_FIELD_TIME:
+        appendWallClock(buffer, bufferSize, &length, context.wallSeconds, (MessageField) segment.field);
+        break;
+      default:
+        appendStatistic(buffer, bufferSize, &length, context, (MessageField) segment.field);
+        break;
+    }
+  }
+
+  buffer[length] = 0;
+  return length;
+}
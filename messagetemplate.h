@@ -0,0 +1,90 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#ifndef MESSAGETEMPLATE_H
+#define MESSAGETEMPLATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "openstats.h"
+
+#define MESSAGE_TEMPLATE_MAX_LENGTH 96
+#define MESSAGE_TEMPLATE_MAX_SEGMENTS 16
+#define MESSAGE_MAX_LENGTH 160
+
+/*
+These are the values that can be substituted into a message. In the text of a
+template they are written as `{description}`, `{duration}`, `{count}`,
+`{uptime}`, `{state}` (either "open" or "closed") and `{suppressed}` (the
+number of notifications that were held back while the sensor was flapping).
+
+The statistics of how long the sensor has been open for are `{opens}` (the
+number of times it has been opened), `{perday}` (opens per day), `{mean}`,
+`{max}`, `{p50}`, `{p90}` and `{p99}`; see `openstats.h`.
+
+The time of the notification is `{date}` (for example "2023-06-01") and
+`{time}` (for example "14:05 UTC"); see `wallclock.h`. Until the board has
+learned the time these are written as "?".
+*/
+
+enum MessageField {
+  MESSAGE_FIELD_LITERAL,
+  MESSAGE_FIELD_DESCRIPTION,
+  MESSAGE_FIELD_OPEN_DURATION,
+  MESSAGE_FIELD_OPEN_COUNT,
+  MESSAGE_FIELD_UPTIME,
+  MESSAGE_FIELD_STATE,
+  MESSAGE_FIELD_SUPPRESSED_COUNT,
+  MESSAGE_FIELD_STATS_OPENS,
+  MESSAGE_FIELD_STATS_OPENS_PER_DAY,
+  MESSAGE_FIELD_STATS_MEAN,
+  MESSAGE_FIELD_STATS_MAX,
+  MESSAGE_FIELD_STATS_P50,
+  MESSAGE_FIELD_STATS_P90,
+  MESSAGE_FIELD_STATS_P99,
+  MESSAGE_FIELD_DATE,
+  MESSAGE_FIELD_TIME
+};
+
+struct MessageContext {
+  const char* description;
+  unsigned long openDurationMillis;
+  unsigned int openCount;
+  uint64_t uptimeMillis;
+  bool open;
+  unsigned int suppressedCount;
+  const OpenStats* openStats;
+  uint64_t statsMillis;
+  uint32_t wallSeconds;
+};
+
+/*
+A message template is parsed once into a list of segments each of which is
+either some literal text from the template or a field. Rendering the template
+then only has to copy the segments into a buffer. Neither parsing nor
+rendering allocate memory on the heap.
+*/
+
+class MessageTemplate {
+  public:
+    MessageTemplate();
+
+    bool parse(const char* text);
+    size_t render(const MessageContext& context, char* buffer, size_t bufferSize) const;
+
+  private:
+    struct Segment {
+      uint8_t field;
+      uint8_t offset;
+      uint8_t length;
+    };
+
+  private:
+    char _text[MESSAGE_TEMPLATE_MAX_LENGTH];
+    Segment _segments[MESSAGE_TEMPLATE_MAX_SEGMENTS];
+    uint8_t _segmentCount;
+};
+
+#endif // MESSAGETEMPLATE_H
@@ -0,0 +1,119 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#include "monotonicclock.h"
+
+#include <ArduinoLowPower.h>
+
+static RTCZero* clockRtc = NULL;
+static uint64_t clockNow = 0;
+static unsigned long clockMillis = 0;
+static volatile bool clockAlarmWoke = false;
+
+static void awakeFromAlarm() {
+  clockAlarmWoke = true;
+}
+
+/*
+The clock starts from the current value of `millis()` so that it agrees with
+it until the board first sleeps.
+*/
+
+/*static*/
+void MonotonicClock::begin(RTCZero* rtc) {
+  clockRtc = rtc;
+  clockMillis = millis();
+  clockNow = clockMillis;
+}
+
+/*
+The difference from the last reading of `millis()` is taken as unsigned so
+that it is still right when `millis()` wraps around. This relies on the clock
+being read at least once every 49 days which the main loop does.
+*/
+
+/*static*/
+uint64_t MonotonicClock::now() {
+  unsigned long current = millis();
+  clockNow += (unsigned long) (current - clockMillis);
+  clockMillis = current;
+  return clockNow;
+}
+
+/*static*/
+uint32_t MonotonicClock::epoch() {
+  return clockRtc->getEpoch();
+}
+
+/*
+Puts the board into deep sleep until a pin wakes it or, unless `wakeAt` is
+zero, until the clock reaches `wakeAt`. Returns how long the board slept for.
+
+The RTC only counts whole seconds and the current second is already partly
+gone so the alarm is set a second later than it might be; the board wakes up
+to a second late but never early. For the same reason a short sleep that is
+ended by a pin may be counted as up to a second out.
+*/
+
+/*static*/
+unsigned long MonotonicClock::sleep(uint64_t wakeAt) {
+  uint64_t sleepAt = now();
+
+  if (0 != wakeAt && wakeAt <= sleepAt) {
+    return 0;
+  }
+
+  uint32_t sleepEpoch = clockRtc->getEpoch();
+
+  if (0 == wakeAt) {
+    return sleepUntilEpoch(sleepEpoch, 0);
+  }
+
+  return sleepUntilEpoch(sleepEpoch, sleepEpoch + (uint32_t) ((wakeAt - sleepAt + 999) / 1000) + 1);
+}
+
+/*
+Puts the board into deep sleep until a pin wakes it or the RTC has counted
+`seconds` more seconds. As the current second is already partly gone the
+board sleeps for a little less than `seconds` but the wakes are a steady
+`seconds` apart. Returns how long the board slept for.
+*/
+
+/*static*/
+unsigned long MonotonicClock::sleepSeconds(uint32_t seconds) {
+  now();
+  uint32_t sleepEpoch = clockRtc->getEpoch();
+  return sleepUntilEpoch(sleepEpoch, sleepEpoch + seconds);
+}
+
+/*static*/
+bool MonotonicClock::wokeFromAlarm() {
+  return clockAlarmWoke;
+}
+
+// private
+/*static*/
+unsigned long MonotonicClock::sleepUntilEpoch(uint32_t sleepEpoch, uint32_t alarmEpoch) {
+  clockAlarmWoke = false;
+
+  if (0 != alarmEpoch) {
+    clockRtc->setAlarmEpoch(alarmEpoch);
+    clockRtc->enableAlarm(RTCZero::MATCH_YYMMDDHHMMSS);
+    clockRtc->attachInterrupt(awakeFromAlarm);
+  }
+
+  LowPower.deepSleep();
+
+  if (0 != alarmEpoch) {
+    clockRtc->disableAlarm();
+    clockRtc->detachInterrupt();
+  }
+
+  // `millis()` did not advance in deep sleep
+
+  unsigned long sleptMillis = (clockRtc->getEpoch() - sleepEpoch) * 1000UL;
+  clockNow += sleptMillis;
+  clockMillis = millis();
+  return sleptMillis;
+}
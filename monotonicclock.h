@@ -0,0 +1,41 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#ifndef MONOTONICCLOCK_H
+#define MONOTONICCLOCK_H
+
+#include <Arduino.h>
+#include <RTCZero.h>
+
+/*
+This clock counts milliseconds from when the board started. Unlike `millis()`
+it carries on counting while the board is in deep sleep and, being 64 bits,
+it does not wrap around. The RTC keeps running in deep sleep but only counts
+whole seconds so while the board is awake the clock follows `millis()` and
+the RTC is only used to find out how long the board slept for.
+
+Because the clock is only told about a sleep by `sleep`, the board must be
+put into deep sleep through this clock.
+
+`epoch` reads the seconds of the RTC itself. These carry on across a reset of
+the board which restarts this clock from zero.
+
+`sleepSeconds` is for waking at a steady interval. `wokeFromAlarm` says if
+the last sleep was ended by the RTC rather than by a pin.
+*/
+
+class MonotonicClock {
+  public:
+    static void begin(RTCZero* rtc);
+    static uint64_t now();
+    static uint32_t epoch();
+    static unsigned long sleep(uint64_t wakeAt);
+    static unsigned long sleepSeconds(uint32_t seconds);
+    static bool wokeFromAlarm();
+
+  private:
+    static unsigned long sleepUntilEpoch(uint32_t sleepEpoch, uint32_t alarmEpoch);
+};
+
+#endif // MONOTONICCLOCK_H
@@ -0,0 +1,532 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#include "naclbox.h"
+
+#include <string.h>
+
+// The field arithmetic follows TweetNaCl; a field element is sixteen limbs of
+// sixteen bits held in 64 bit integers so that products can be summed without
+// carrying after each one. It is small and runs in constant time.
+
+typedef int64_t FieldElement[16];
+
+#define SALSA20_BLOCK_LENGTH 64
+
+static const uint8_t SALSA20_SIGMA[16] = {
+  'e', 'x', 'p', 'a', 'n', 'd', ' ', '3', '2', '-', 'b', 'y', 't', 'e', ' ', 'k'
+};
+
+static const uint8_t CURVE25519_BASE_POINT[NACL_BOX_KEY_LENGTH] = { 9 };
+
+static const FieldElement CURVE25519_A24 = { 0xDB41, 1 };
+
+static uint32_t load32(const uint8_t* data) {
+  return (uint32_t) data[0]
+    | ((uint32_t) data[1] << 8)
+    | ((uint32_t) data[2] << 16)
+    | ((uint32_t) data[3] << 24);
+}
+
+static void store32(uint8_t* data, uint32_t value) {
+  data[0] = (uint8_t) value;
+  data[1] = (uint8_t) (value >> 8);
+  data[2] = (uint8_t) (value >> 16);
+  data[3] = (uint8_t) (value >> 24);
+}
+
+static uint32_t rotate(uint32_t value, int count) {
+  return (value << count) | (value >> (32 - count));
+}
+
+/*
+Sets up the Salsa20 state from a key and sixteen bytes of input; for Salsa20
+itself the input is the nonce and the block counter.
+*/
+
+static void salsa20Setup(uint32_t state[16], const uint8_t input[16], const uint8_t key[NACL_BOX_KEY_LENGTH]) {
+  state[0] = load32(&SALSA20_SIGMA[0]);
+  state[5] = load32(&SALSA20_SIGMA[4]);
+  state[10] = load32(&SALSA20_SIGMA[8]);
+  state[15] = load32(&SALSA20_SIGMA[12]);
+
+  for (int i = 0; i < 4; i++) {
+    state[1 + i] = load32(&key[i * 4]);
+    state[11 + i] = load32(&key[16 + (i * 4)]);
+    state[6 + i] = load32(&input[i * 4]);
+  }
+}
+
+static void salsa20Rounds(uint32_t x[16]) {
+  for (int i = 0; i < 20; i += 2) {
+    // columns
+
+    x[4] ^= rotate(x[0] + x[12], 7);
+    x[8] ^= rotate(x[4] + x[0], 9);
+    x[12] ^= rotate(x[8] + x[4], 13);
+    x[0] ^= rotate(x[12] + x[8], 18);
+    x[9] ^= rotate(x[5] + x[1], 7);
+    x[13] ^= rotate(x[9] + x[5], 9);
+    x[1] ^= rotate(x[13] + x[9], 13);
+    x[5] ^= rotate(x[1] + x[13], 18);
+    x[14] ^= rotate(x[10] + x[6], 7);
+    x[2] ^= rotate(x[14] + x[10], 9);
+    x[6] ^= rotate(x[2] + x[14], 13);
+    x[10] ^= rotate(x[6] + x[2], 18);
+    x[3] ^= rotate(x[15] + x[11], 7);
+    x[7] ^= rotate(x[3] + x[15], 9);
+    x[11] ^= rotate(x[7] + x[3], 13);
+    x[15] ^= rotate(x[11] + x[7], 18);
+
+    // rows
+
+    x[1] ^= rotate(x[0] + x[3], 7);
+    x[2] ^= rotate(x[1] + x[0], 9);
+    x[3] ^= rotate(x[2] + x[1], 13);
+    x[0] ^= rotate(x[3] + x[2], 18);
+    x[6] ^= rotate(x[5] + x[4], 7);
+    x[7] ^= rotate(x[6] + x[5], 9);
+    x[4] ^= rotate(x[7] + x[6], 13);
+    x[5] ^= rotate(x[4] + x[7], 18);
+    x[11] ^= rotate(x[10] + x[9], 7);
+    x[8] ^= rotate(x[11] + x[10], 9);
+    x[9] ^= rotate(x[8] + x[11], 13);
+    x[10] ^= rotate(x[9] + x[8], 18);
+    x[12] ^= rotate(x[15] + x[14], 7);
+    x[13] ^= rotate(x[12] + x[15], 9);
+    x[14] ^= rotate(x[13] + x[12], 13);
+    x[15] ^= rotate(x[14] + x[13], 18);
+  }
+}
+
+/*
+XORs the XSalsa20 key stream starting at `offset` into `length` bytes of
+`input`. If `input` is NULL then the key stream itself is output.
+*/
+
+static void xsalsa20Xor(uint8_t* output, const uint8_t* input, size_t length, size_t offset,
+    const uint8_t nonce[NACL_BOX_NONCE_LENGTH], const uint8_t key[NACL_BOX_KEY_LENGTH]) {
+  uint8_t subKey[NACL_BOX_KEY_LENGTH];
+  uint8_t counterInput[16];
+  uint8_t block[SALSA20_BLOCK_LENGTH];
+  uint32_t initial[16];
+  uint32_t working[16];
+
+  NaclBox::hsalsa20(subKey, nonce, key);
+
+  memcpy(counterInput, &nonce[16], 8);
+  uint64_t counter = offset / SALSA20_BLOCK_LENGTH;
+  size_t position = offset % SALSA20_BLOCK_LENGTH;
+  size_t done = 0;
+
+  while (done < length) {
+    for (int i = 0; i < 8; i++) {
+      counterInput[8 + i] = (uint8_t) (counter >> (i * 8));
+    }
+
+    salsa20Setup(initial, counterInput, subKey);
+    memcpy(working, initial, sizeof(working));
+    salsa20Rounds(working);
+
+    for (int i = 0; i < 16; i++) {
+      store32(&block[i * 4], working[i] + initial[i]);
+    }
+
+    for (; position < SALSA20_BLOCK_LENGTH && done < length; position++, done++) {
+      output[done] = (NULL == input ? 0 : input[done]) ^ block[position];
+    }
+
+    position = 0;
+    counter++;
+  }
+
+  NaclBox::wipe(subKey, sizeof(subKey));
+  NaclBox::wipe(block, sizeof(block));
+  NaclBox::wipe(initial, sizeof(initial));
+  NaclBox::wipe(working, sizeof(working));
+}
+
+/*static*/
+void NaclBox::hsalsa20(uint8_t output[NACL_BOX_KEY_LENGTH],
+    const uint8_t input[16], const uint8_t key[NACL_BOX_KEY_LENGTH]) {
+  uint32_t x[16];
+
+  salsa20Setup(x, input, key);
+  salsa20Rounds(x);
+
+  store32(&output[0], x[0]);
+  store32(&output[4], x[5]);
+  store32(&output[8], x[10]);
+  store32(&output[12], x[15]);
+  store32(&output[16], x[6]);
+  store32(&output[20], x[7]);
+  store32(&output[24], x[8]);
+  store32(&output[28], x[9]);
+
+  wipe(x, sizeof(x));
+}
+
+/*static*/
+void NaclBox::stream(uint8_t* output, size_t length,
+    const uint8_t nonce[NACL_BOX_NONCE_LENGTH], const uint8_t key[NACL_BOX_KEY_LENGTH]) {
+  xsalsa20Xor(output, NULL, length, 0, nonce, key);
+}
+
+/*
+This is Poly1305 with five limbs of 26 bits so that the products fit into 64
+bits. The Cortex-M0+ has a 32 bit multiplier only and the compiler expands
+each 64 bit product but there are only 25 of them for each 16 bytes.
+*/
+
+/*static*/
+void NaclBox::poly1305(uint8_t tag[NACL_BOX_TAG_LENGTH],
+    const uint8_t* message, size_t length, const uint8_t key[NACL_BOX_KEY_LENGTH]) {
+  const uint32_t mask = 0x3ffffff;
+
+  uint32_t r0 = load32(&key[0]) & 0x3ffffff;
+  uint32_t r1 = (load32(&key[3]) >> 2) & 0x3ffff03;
+  uint32_t r2 = (load32(&key[6]) >> 4) & 0x3ffc0ff;
+  uint32_t r3 = (load32(&key[9]) >> 6) & 0x3f03fff;
+  uint32_t r4 = (load32(&key[12]) >> 8) & 0x00fffff;
+
+  uint32_t s1 = r1 * 5;
+  uint32_t s2 = r2 * 5;
+  uint32_t s3 = r3 * 5;
+  uint32_t s4 = r4 * 5;
+
+  uint32_t h0 = 0, h1 = 0, h2 = 0, h3 = 0, h4 = 0;
+  uint8_t final[16];
+
+  while (0 != length) {
+    const uint8_t* block = message;
+    uint32_t hibit = 1UL << 24;
+
+    if (length < 16) {
+      memset(final, 0, sizeof(final));
+      memcpy(final, message, length);
+      final[length] = 1;
+      block = final;
+      hibit = 0;
+      length = 0;
+    } else {
+      message += 16;
+      length -= 16;
+    }
+
+    h0 += load32(&block[0]) & mask;
+    h1 += (load32(&block[3]) >> 2) & mask;
+    h2 += (load32(&block[6]) >> 4) & mask;
+    h3 += (load32(&block[9]) >> 6) & mask;
+    h4 += (load32(&block[12]) >> 8) | hibit;
+
+    uint64_t d0 = ((uint64_t) h0 * r0) + ((uint64_t) h1 * s4) + ((uint64_t) h2 * s3) + ((uint64_t) h3 * s2) + ((uint64_t) h4 * s1);
+    uint64_t d1 = ((uint64_t) h0 * r1) + ((uint64_t) h1 * r0) + ((uint64_t) h2 * s4) + ((uint64_t) h3 * s3) + ((uint64_t) h4 * s2);
+    uint64_t d2 = ((uint64_t) h0 * r2) + ((uint64_t) h1 * r1) + ((uint64_t) h2 * r0) + ((uint64_t) h3 * s4) + ((uint64_t) h4 * s3);
+    uint64_t d3 = ((uint64_t) h0 * r3) + ((uint64_t) h1 * r2) + ((uint64_t) h2 * r1) + ((uint64_t) h3 * r0) + ((uint64_t) h4 * s4);
+    uint64_t d4 = ((uint64_t) h0 * r4) + ((uint64_t) h1 * r3) + ((uint64_t) h2 * r2) + ((uint64_t) h3 * r1) + ((uint64_t) h4 * r0);
+
+    uint32_t c = (uint32_t) (d0 >> 26); h0 = (uint32_t) d0 & mask;
+    d1 += c; c = (uint32_t) (d1 >> 26); h1 = (uint32_t) d1 & mask;
+    d2 += c; c = (uint32_t) (d2 >> 26); h2 = (uint32_t) d2 & mask;
+    d3 += c; c = (uint32_t) (d3 >> 26); h3 = (uint32_t) d3 & mask;
+    d4 += c; c = (uint32_t) (d4 >> 26); h4 = (uint32_t) d4 & mask;
+    h0 += c * 5; c = h0 >> 26; h0 &= mask;
+    h1 += c;
+  }
+
+  // fully carry and then reduce modulo 2^130 - 5 by computing h + 5 - 2^130
+  // and keeping it only if that did not go below zero.
+
+  uint32_t c = h1 >> 26; h1 &= mask;
+  h2 += c; c = h2 >> 26; h2 &= mask;
+  h3 += c; c = h3 >> 26; h3 &= mask;
+  h4 += c; c = h4 >> 26; h4 &= mask;
+  h0 += c * 5; c = h0 >> 26; h0 &= mask;
+  h1 += c;
+
+  uint32_t g0 = h0 + 5; c = g0 >> 26; g0 &= mask;
+  uint32_t g1 = h1 + c; c = g1 >> 26; g1 &= mask;
+  uint32_t g2 = h2 + c; c = g2 >> 26; g2 &= mask;
+  uint32_t g3 = h3 + c; c = g3 >> 26; g3 &= mask;
+  uint32_t g4 = h4 + c - (1UL << 26);
+
+  uint32_t select = (g4 >> 31) - 1;
+  h0 = (h0 & ~select) | (g0 & select);
+  h1 = (h1 & ~select) | (g1 & select);
+  h2 = (h2 & ~select) | (g2 & select);
+  h3 = (h3 & ~select) | (g3 & select);
+  h4 = (h4 & ~select) | (g4 & select);
+
+  // add the second half of the key
+
+  uint64_t f = (uint64_t) (h0 | (h1 << 26)) + load32(&key[16]);
+  store32(&tag[0], (uint32_t) f);
+  f = (uint64_t) ((h1 >> 6) | (h2 << 20)) + load32(&key[20]) + (f >> 32);
+  store32(&tag[4], (uint32_t) f);
+  f = (uint64_t) ((h2 >> 12) | (h3 << 14)) + load32(&key[24]) + (f >> 32);
+  store32(&tag[8], (uint32_t) f);
+  f = (uint64_t) ((h3 >> 18) | (h4 << 8)) + load32(&key[28]) + (f >> 32);
+  store32(&tag[12], (uint32_t) f);
+
+  wipe(final, sizeof(final));
+}
+
+static void fieldCarry(FieldElement o) {
+  for (int i = 0; i < 16; i++) {
+    o[i] += (int64_t) 1 << 16;
+    int64_t c = o[i] >> 16;
+    if (i < 15) {
+      o[i + 1] += c - 1;
+    } else {
+      o[0] += 38 * (c - 1);
+    }
+    o[i] -= c * ((int64_t) 1 << 16);
+  }
+}
+
+/*
+Swaps `p` and `q` if `swap` is one without branching on it.
+*/
+
+static void fieldSwap(FieldElement p, FieldElement q, int swap) {
+  int64_t mask = ~((int64_t) swap - 1);
+  for (int i = 0; i < 16; i++) {
+    int64_t t = mask & (p[i] ^ q[i]);
+    p[i] ^= t;
+    q[i] ^= t;
+  }
+}
+
+static void fieldPack(uint8_t output[NACL_BOX_KEY_LENGTH], const FieldElement n) {
+  FieldElement m;
+  FieldElement t;
+
+  memcpy(t, n, sizeof(t));
+  fieldCarry(t);
+  fieldCarry(t);
+  fieldCarry(t);
+
+  for (int j = 0; j < 2; j++) {
+    m[0] = t[0] - 0xffed;
+    for (int i = 1; i < 15; i++) {
+      m[i] = t[i] - 0xffff - ((m[i - 1] >> 16) & 1);
+      m[i - 1] &= 0xffff;
+    }
+    m[15] = t[15] - 0x7fff - ((m[14] >> 16) & 1);
+    int borrow = (int) ((m[15] >> 16) & 1);
+    m[14] &= 0xffff;
+    fieldSwap(t, m, 1 - borrow);
+  }
+
+  for (int i = 0; i < 16; i++) {
+    output[2 * i] = (uint8_t) (t[i] & 0xff);
+    output[(2 * i) + 1] = (uint8_t) (t[i] >> 8);
+  }
+}
+
+static void fieldUnpack(FieldElement o, const uint8_t input[NACL_BOX_KEY_LENGTH]) {
+  for (int i = 0; i < 16; i++) {
+    o[i] = input[2 * i] + ((int64_t) input[(2 * i) + 1] << 8);
+  }
+  o[15] &= 0x7fff;
+}
+
+static void fieldAdd(FieldElement o, const FieldElement a, const FieldElement b) {
+  for (int i = 0; i < 16; i++) {
+    o[i] = a[i] + b[i];
+  }
+}
+
+static void fieldSubtract(FieldElement o, const FieldElement a, const FieldElement b) {
+  for (int i = 0; i < 16; i++) {
+    o[i] = a[i] - b[i];
+  }
+}
+
+static void fieldMultiply(FieldElement o, const FieldElement a, const FieldElement b) {
+  int64_t t[31];
+
+  memset(t, 0, sizeof(t));
+
+  for (int i = 0; i < 16; i++) {
+    for (int j = 0; j < 16; j++) {
+      t[i + j] += a[i] * b[j];
+    }
+  }
+
+  for (int i = 0; i < 15; i++) {
+    t[i] += 38 * t[i + 16];
+  }
+
+  memcpy(o, t, sizeof(FieldElement));
+  fieldCarry(o);
+  fieldCarry(o);
+}
+
+/*
+Inverts by raising to the power p - 2.
+*/
+
+static void fieldInvert(FieldElement o, const FieldElement input) {
+  FieldElement c;
+
+  memcpy(c, input, sizeof(c));
+
+  for (int a = 253; a >= 0; a--) {
+    fieldMultiply(c, c, c);
+    if (2 != a && 4 != a) {
+      fieldMultiply(c, c, input);
+    }
+  }
+
+  memcpy(o, c, sizeof(c));
+}
+
+/*
+This is the Montgomery ladder over Curve25519. It takes the same steps
+whatever the bits of the scalar are so that the time taken does not reveal
+the secret key.
+*/
+
+/*static*/
+void NaclBox::scalarMult(uint8_t output[NACL_BOX_KEY_LENGTH],
+    const uint8_t scalar[NACL_BOX_KEY_LENGTH], const uint8_t point[NACL_BOX_KEY_LENGTH]) {
+  uint8_t z[NACL_BOX_KEY_LENGTH];
+  FieldElement x, a, b, c, d, e, f;
+
+  memcpy(z, scalar, sizeof(z));
+  z[31] = (z[31] & 127) | 64;
+  z[0] &= 248;
+
+  fieldUnpack(x, point);
+
+  memcpy(b, x, sizeof(b));
+  memset(a, 0, sizeof(a));
+  memset(c, 0, sizeof(c));
+  memset(d, 0, sizeof(d));
+  a[0] = 1;
+  d[0] = 1;
+
+  for (int i = 254; i >= 0; i--) {
+    int bit = (z[i >> 3] >> (i & 7)) & 1;
+
+    fieldSwap(a, b, bit);
+    fieldSwap(c, d, bit);
+    fieldAdd(e, a, c);
+    fieldSubtract(a, a, c);
+    fieldAdd(c, b, d);
+    fieldSubtract(b, b, d);
+    fieldMultiply(d, e, e);
+    fieldMultiply(f, a, a);
+    fieldMultiply(a, c, a);
+    fieldMultiply(c, b, e);
+    fieldAdd(e, a, c);
+    fieldSubtract(a, a, c);
+    fieldMultiply(b, a, a);
+    fieldSubtract(c, d, f);
+    fieldMultiply(a, c, CURVE25519_A24);
+    fieldAdd(a, a, d);
+    fieldMultiply(c, c, a);
+    fieldMultiply(a, d, f);
+    fieldMultiply(d, b, x);
+    fieldMultiply(b, e, e);
+    fieldSwap(a, b, bit);
+    fieldSwap(c, d, bit);
+  }
+
+  fieldInvert(c, c);
+  fieldMultiply(a, a, c);
+  fieldPack(output, a);
+
+  wipe(z, sizeof(z));
+  wipe(a, sizeof(a));
+  wipe(b, sizeof(b));
+  wipe(c, sizeof(c));
+  wipe(d, sizeof(d));
+  wipe(e, sizeof(e));
+  wipe(f, sizeof(f));
+}
+
+/*static*/
+void NaclBox::derivePublicKey(uint8_t publicKey[NACL_BOX_KEY_LENGTH],
+    const uint8_t secretKey[NACL_BOX_KEY_LENGTH]) {
+  scalarMult(publicKey, secretKey, CURVE25519_BASE_POINT);
+}
+
+/*
+The shared key is the same from either side; the sender's secret key with the
+recipient's public key or the recipient's secret key with the sender's public
+key. It is as sensitive as the secret key.
+*/
+
+/*static*/
+void NaclBox::precompute(uint8_t sharedKey[NACL_BOX_KEY_LENGTH],
+    const uint8_t publicKey[NACL_BOX_KEY_LENGTH], const uint8_t secretKey[NACL_BOX_KEY_LENGTH]) {
+  static const uint8_t ZERO[16] = { 0 };
+  uint8_t point[NACL_BOX_KEY_LENGTH];
+
+  scalarMult(point, secretKey, publicKey);
+  hsalsa20(sharedKey, ZERO, point);
+  wipe(point, sizeof(point));
+}
+
+/*
+Encrypts and authenticates `length` bytes of `message` into `box` which must
+have room for `NACL_BOX_TAG_LENGTH + length` bytes. The first 32 bytes of the
+key stream are the one-time Poly1305 key so the message is encrypted with the
+stream from there on. A nonce must never be used twice with the same key.
+*/
+
+/*static*/
+void NaclBox::seal(uint8_t* box, const uint8_t* message, size_t length,
+    const uint8_t nonce[NACL_BOX_NONCE_LENGTH], const uint8_t sharedKey[NACL_BOX_KEY_LENGTH]) {
+  uint8_t polyKey[NACL_BOX_KEY_LENGTH];
+
+  xsalsa20Xor(polyKey, NULL, sizeof(polyKey), 0, nonce, sharedKey);
+  xsalsa20Xor(&box[NACL_BOX_TAG_LENGTH], message, length, sizeof(polyKey), nonce, sharedKey);
+  poly1305(box, &box[NACL_BOX_TAG_LENGTH], length, polyKey);
+
+  wipe(polyKey, sizeof(polyKey));
+}
+
+/*
+Checks and decrypts a box of `NACL_BOX_TAG_LENGTH + length` bytes. Nothing is
+written to `message` unless the tag is correct.
+*/
+
+/*static*/
+bool NaclBox::open(uint8_t* message, const uint8_t* box, size_t length,
+    const uint8_t nonce[NACL_BOX_NONCE_LENGTH], const uint8_t sharedKey[NACL_BOX_KEY_LENGTH]) {
+  uint8_t polyKey[NACL_BOX_KEY_LENGTH];
+  uint8_t tag[NACL_BOX_TAG_LENGTH];
+  uint8_t difference = 0;
+
+  xsalsa20Xor(polyKey, NULL, sizeof(polyKey), 0, nonce, sharedKey);
+  poly1305(tag, &box[NACL_BOX_TAG_LENGTH], length, polyKey);
+  wipe(polyKey, sizeof(polyKey));
+
+  for (int i = 0; i < NACL_BOX_TAG_LENGTH; i++) {
+    difference |= tag[i] ^ box[i];
+  }
+
+  if (0 != difference) {
+    return false;
+  }
+
+  xsalsa20Xor(message, &box[NACL_BOX_TAG_LENGTH], length, NACL_BOX_KEY_LENGTH, nonce, sharedKey);
+  return true;
+}
+
+/*
+Clears memory that held keys. The writes are through a volatile pointer so
+that the compiler does not drop them as dead stores.
+*/
+
+/*static*/
+void NaclBox::wipe(void* data, size_t length) {
+  volatile uint8_t* bytes = (volatile uint8_t*) data;
+  for (size_t i = 0; i < length; i++) {
+    bytes[i] = 0;
+  }
+}
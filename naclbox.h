@@ -0,0 +1,63 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#ifndef NACLBOX_H
+#define NACLBOX_H
+
+// The simulator's `-c` option checks these functions against published test
+// vectors and times them; see `extras/simulator/cryptocheck.cpp`.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define NACL_BOX_KEY_LENGTH 32
+#define NACL_BOX_NONCE_LENGTH 24
+#define NACL_BOX_TAG_LENGTH 16
+
+/*
+This is the NaCl "box"; Curve25519 to agree a key, XSalsa20 to encrypt and
+Poly1305 to authenticate. It is compatible with `crypto_box` in NaCl and
+libsodium and so with Threema's end-to-end encryption.
+
+The Curve25519 step is expensive on a small microcontroller but its result
+only depends on the two keys so it is computed once with `precompute` and the
+shared key is then used for each message. Sealing a message is then only the
+symmetric step.
+
+A sealed box is the 16 byte tag followed by the ciphertext which is the same
+length as the message. This is the form that NaCl calls "easy" and that the
+Threema gateway expects.
+*/
+
+class NaclBox {
+  public:
+    static void derivePublicKey(uint8_t publicKey[NACL_BOX_KEY_LENGTH],
+      const uint8_t secretKey[NACL_BOX_KEY_LENGTH]);
+    static void precompute(uint8_t sharedKey[NACL_BOX_KEY_LENGTH],
+      const uint8_t publicKey[NACL_BOX_KEY_LENGTH],
+      const uint8_t secretKey[NACL_BOX_KEY_LENGTH]);
+
+    static void seal(uint8_t* box, const uint8_t* message, size_t length,
+      const uint8_t nonce[NACL_BOX_NONCE_LENGTH],
+      const uint8_t sharedKey[NACL_BOX_KEY_LENGTH]);
+    static bool open(uint8_t* message, const uint8_t* box, size_t length,
+      const uint8_t nonce[NACL_BOX_NONCE_LENGTH],
+      const uint8_t sharedKey[NACL_BOX_KEY_LENGTH]);
+
+    static void stream(uint8_t* output, size_t length,
+      const uint8_t nonce[NACL_BOX_NONCE_LENGTH],
+      const uint8_t key[NACL_BOX_KEY_LENGTH]);
+    static void hsalsa20(uint8_t output[NACL_BOX_KEY_LENGTH],
+      const uint8_t input[16], const uint8_t key[NACL_BOX_KEY_LENGTH]);
+
+    static void scalarMult(uint8_t output[NACL_BOX_KEY_LENGTH],
+      const uint8_t scalar[NACL_BOX_KEY_LENGTH],
+      const uint8_t point[NACL_BOX_KEY_LENGTH]);
+    static void poly1305(uint8_t tag[NACL_BOX_TAG_LENGTH],
+      const uint8_t* message, size_t length, const uint8_t key[NACL_BOX_KEY_LENGTH]);
+
+    static void wipe(void* data, size_t length);
+};
+
+#endif // NACLBOX_H
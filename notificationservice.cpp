@@ -4,83 +4,212 @@
  */
 #include "notificationservice.h"
 
-#include <ArduinoHttpClient.h>
+#include <utility/server_drv.h>
 
+#include "common.h"
 #include "constants.h"
+#include "latencytrace.h"
+#include "monotonicclock.h"
 #include "httputils.h"
 #include "settings.h"
+#include "wallclock.h"
 
-NotificationService::NotificationService() {
+#define THREEMA_MESSAGE_TYPE_TEXT 0x01
+
+NotificationService::NotificationService()
+    :
+    _historySync(NULL),
+    _deadline(0) {
 }
 
 NotificationService::~NotificationService() {
 }
 
+void NotificationService::setHistorySync(HistorySync* value) {
+    _historySync = value;
+}
 
-LogNotificationService::LogNotificationService() {
+/*
+Sets the time on the monotonic clock by which a notification should be
+delivered or given up on; zero means that there is no deadline.
+*/
+
+void NotificationService::setDeadline(uint64_t value) {
+    _deadline = value;
 }
 
-LogNotificationService::~LogNotificationService() {
+/*
+A service that kept a notification which it could not deliver, to send it
+again later, should forget it; it has been delivered some other way.
+*/
+
+void NotificationService::abandonUndelivered() {
 }
 
-void LogNotificationService::notifyOpen() {
-#ifdef SERIAL_ENABLED
-    Serial.println("Notify -> opened");
-#endif
+void NotificationService::pulse() {
 }
 
-void LogNotificationService::notifyClose() {
-#ifdef SERIAL_ENABLED
-    Serial.println("Notify -> closed");
-#endif
+/*
+Returns the time on the monotonic clock at which the service needs to be
+pulsed even if nothing else happens or zero if there is no such time.
+*/
+
+uint64_t NotificationService::wakeAt() {
+    return 0;
 }
 
-ThreemaNotificationService::ThreemaNotificationService(
-    const String& description,
-    WifiSettings* wifiSettings,
-    ThreemaSettings* threemaSettings)
-    :
-    _description(description),
-    _wifiSettings(new WifiSettings(wifiSettings)),
-    _threemaSettings(new ThreemaSettings(threemaSettings)) {
+/*
+Returns the service, this one or one that this service is made of, that
+notifies with the method or NULL if there is none.
+*/
+
+NotificationService* NotificationService::serviceFor(NotificationMethod method) {
+    return NULL;
 }
 
-ThreemaNotificationService::~ThreemaNotificationService() {
-    delete _threemaSettings;
-    delete _wifiSettings;
+/*
+Takes over whatever the prior service of the same method, if there is one,
+was holding back. The prior service is left holding nothing.
+*/
+
+void NotificationService::takeOver(NotificationService* prior) {
 }
 
-void ThreemaNotificationService::notify(String& message) {
+/*
+Subclasses call this while the Wifi is up.
+*/
+
+// protected
+void NotificationService::syncHistory() {
+    if (NULL != _historySync) {
+        _historySync->sync();
+    }
+}
+
+/*
+Returns `millis` or, if it is sooner, the time left before the deadline.
+*/
+
+// protected
+unsigned long NotificationService::boundedByDeadline(unsigned long millis) const {
+    if (0 == _deadline) {
+        return millis;
+    }
+
+    uint64_t now = MonotonicClock::now();
+
+    if (now >= _deadline) {
+        return 0;
+    }
+
+    return (unsigned long) min((uint64_t) millis, _deadline - now);
+}
+
+// protected
+bool NotificationService::isPastDeadline() const {
+    return 0 == boundedByDeadline(1);
+}
+
+/*
+Unless a subclass does better, each event that a detector relayed is
+notified as though it were an event of this board's own sensor. Returns true
+only if every event was delivered.
+*/
+
+bool NotificationService::notifyRelayed(const RelayEvent* events, int count) {
+    bool delivered = true;
+
+    for (int i = 0; i < count; i++) {
+        NotificationEvent event;
+        event.openDurationMillis = events[i].openDurationSeconds * 1000UL;
+        event.openCount = events[i].openCount;
+        event.open = events[i].open;
+        event.openNotified = true;
+        event.suppressedCount = events[i].suppressedCount;
+        event.openStats = NULL;
+        event.statsMillis = 0;
+
+        switch (events[i].kind) {
+            case RELAY_EVENT_OPEN:
+                delivered = notifyOpen(event) && delivered;
+                break;
+            case RELAY_EVENT_STILL_OPEN:
+                delivered = notifyStillOpen(event) && delivered;
+                break;
+            case RELAY_EVENT_CLOSE:
+                delivered = notifyClose(event) && delivered;
+                break;
+            case RELAY_EVENT_FLAPPING:
+                delivered = notifyFlapping(event) && delivered;
+                break;
+            case RELAY_EVENT_SETTLED:
+                delivered = notifySettled(event) && delivered;
+                break;
+        }
+    }
+
+    return delivered;
+}
+
+/*
+Associates with the access point unless the Wifi is already up, as it is on
+a hub which has to stay on the network to hear its detectors. Returns true if
+the Wifi is up. `owned` is set if the session was begun here and so should be
+ended by `endWifiSession`. The association is given up on after
+`waitMillis`.
+*/
+
+static bool beginWifiSession(const WifiSettings& wifiSettings,
+    EnergyGovernor* energyGovernor, unsigned long waitMillis, bool* owned) {
+    int status = WiFi.status();
+
+    *owned = WL_CONNECTED != status;
+
+    if (!*owned) {
+        return true;
+    }
+
+    if (0 == waitMillis) {
+        *owned = false;
+        return false;
+    }
 
 #ifdef SERIAL_ENABLED
     Serial.print("will open wifi to ssid [");
-    Serial.print(_wifiSettings->ssid());
+    Serial.print(wifiSettings.ssid());
     Serial.println("]");
 #endif
 
-    int status = WiFi.begin(
-        _wifiSettings->ssid().c_str(),
-        _wifiSettings->passphrase().c_str());
+    status = WiFi.begin(
+        wifiSettings.ssid(),
+        wifiSettings.passphrase());
 
     unsigned long start_millis = millis();
 
+    if (NULL != energyGovernor) {
+        energyGovernor->record(ENERGY_ACTIVITY_WIFI_ASSOCIATE, 1);
+    }
+
     do {
         delay(1000L);
     } while (
-        ((millis() - start_millis) < DELAY_WIFI_CONNECT_MILLIS)
+        ((millis() - start_millis) < waitMillis)
         && (WL_CONNECTED != (status = WiFi.status())));
 
     if (WL_CONNECTED != status) {
 #ifdef SERIAL_ENABLED
         Serial.println("unable to begin the wifi session");
 #endif
+        return false;
     }
-    else {
-        ThreemaRecipient* recipientNode = _threemaSettings->recipients();
-        while (NULL != recipientNode) {
-          notifyRecipient(recipientNode, message);
-          recipientNode = recipientNode->next();
-        }
+
+    LatencyTrace::mark(LATENCY_STAGE_WIFI_ASSOCIATE, MonotonicClock::now());
+    return true;
+}
+
+static void endWifiSession(bool owned) {
+    if (!owned) {
+        return;
     }
 
     WiFi.disconnect();
@@ -90,65 +219,553 @@ void ThreemaNotificationService::notify(String& message) {
 #endif
 }
 
-void ThreemaNotificationService::notifyRecipient(ThreemaRecipient* recipient, String& message) {
 
+LogNotificationService::LogNotificationService() {
+}
+
+LogNotificationService::~LogNotificationService() {
+}
+
+bool LogNotificationService::notifyOpen(const NotificationEvent& event) {
 #ifdef SERIAL_ENABLED
-    Serial.print("will send notification to threema [");
-    Serial.print(recipient->to());
-    Serial.println("]");
+    Serial.println("Notify -> opened");
 #endif
+    return true;
+}
 
-    WiFiClient wifi;
+bool LogNotificationService::notifyStillOpen(const NotificationEvent& event) {
+#ifdef SERIAL_ENABLED
+    Serial.println("Notify -> still open");
+#endif
+    return true;
+}
 
-    // The HTTP library is able to handle the connection itself, but it is not
-    // able to HTTPS connect so instead the connection is made from outside the
-    // library.  By calling `connectionKeepAlive`, the library will use the
-    // existing connection that has already been stood up instead of trying to
-    // connect.
+bool LogNotificationService::notifyClose(const NotificationEvent& event) {
+#ifdef SERIAL_ENABLED
+    Serial.println("Notify -> closed");
+#endif
+    return true;
+}
 
-    if (wifi.connectSSL(HOST_THREEMA_MSG_API, 443)) {
-      notifyRecipient(wifi, recipient, message);
-      wifi.stop(); // disconnect
-    } else {
+bool LogNotificationService::notifyFlapping(const NotificationEvent& event) {
 #ifdef SERIAL_ENABLED
-      Serial.println("unable to connect to the threema api server");
+    Serial.println("Notify -> flapping");
 #endif
+    return true;
+}
+
+bool LogNotificationService::notifySettled(const NotificationEvent& event) {
+#ifdef SERIAL_ENABLED
+    Serial.print("Notify -> settled; suppressed ");
+    Serial.println(event.suppressedCount);
+#endif
+    return true;
+}
+
+/*
+The settings are copied but the strings that they refer to are not; see
+`settings.h`.
+*/
+
+ThreemaNotificationService::ThreemaNotificationService(
+    const char* description,
+    const WifiSettings* wifiSettings,
+    const ThreemaSettings* threemaSettings,
+    const MessageSettings* messageSettings,
+    EnergyGovernor* energyGovernor)
+    :
+    _description(description),
+    _wifiSettings(*wifiSettings),
+    _threemaSettings(*threemaSettings),
+    _energyGovernor(energyGovernor),
+    _deferredAt(0),
+    _recipientKeys(NULL),
+    _randomCount(0) {
+    _message[0] = 0;
+    _deferredMessage[0] = 0;
+
+    // the templates are parsed once here so that sending a message only has
+    // to render them.
+
+    parseTemplate(_openTemplate,
+        messageSettings->openTemplate(), MESSAGE_TEMPLATE_OPEN);
+    parseTemplate(_stillOpenTemplate,
+        messageSettings->stillOpenTemplate(), MESSAGE_TEMPLATE_STILL_OPEN);
+    parseTemplate(_closeTemplate,
+        messageSettings->closeTemplate(), MESSAGE_TEMPLATE_CLOSE);
+    parseTemplate(_flappingTemplate,
+        messageSettings->flappingTemplate(), MESSAGE_TEMPLATE_FLAPPING);
+    parseTemplate(_settledTemplate,
+        messageSettings->settledTemplate(), MESSAGE_TEMPLATE_SETTLED);
+
+    if (_threemaSettings.isEndToEnd()) {
+        precomputeKeys();
     }
 }
 
-void ThreemaNotificationService::notifyRecipient(WiFiClient& wifi, ThreemaRecipient* recipient, String& message) {
-  String payload = "to=" + HttpUtils::encodeFormValue(recipient->to())
-    + "&from=" + HttpUtils::encodeFormValue(_threemaSettings->from())
-    + "&secret=" + HttpUtils::encodeFormValue(_threemaSettings->secret())
-    + "&text=" + HttpUtils::encodeFormValue(message)
-    + "\r\n";
+/*
+A deferred message that no other service has taken over is sent now so that
+it is not lost with the service.
+*/
 
-  HttpClient httpClient = HttpClient(wifi, HOST_THREEMA_MSG_API, 443);
+ThreemaNotificationService::~ThreemaNotificationService() {
+    if (0 != _deferredMessage[0]) {
+        sendDeferred();
+    }
+
+    if (NULL != _recipientKeys) {
+        NaclBox::wipe(_recipientKeys, sizeof(ThreemaRecipientKey) * recipientCount());
+        delete[] _recipientKeys;
+    }
+    NaclBox::wipe(_randomKey, sizeof(_randomKey));
+}
+
+/*
+Working out the key shared with a recipient takes a Curve25519 multiplication
+which is slow on the board so it is done here, once, rather than for each
+message. The private key also seeds the generator for the nonces; see
+`randomBytes`.
+*/
 
-  httpClient.connectionKeepAlive();
+// private
+void ThreemaNotificationService::precomputeKeys() {
+    uint8_t privateKey[NACL_BOX_KEY_LENGTH];
+    uint8_t publicKey[NACL_BOX_KEY_LENGTH];
 
+    memset(_randomKey, 0, sizeof(_randomKey));
+    _recipientKeys = new ThreemaRecipientKey[recipientCount()];
+
+    for (int i = 0; i < recipientCount(); i++) {
+        _recipientKeys[i].valid = false;
+    }
+
+    if (!Common::decodeHex(_threemaSettings.privateKey(), privateKey, NACL_BOX_KEY_LENGTH)) {
 #ifdef SERIAL_ENABLED
-  Serial.println("will connect to the threema api server");
+        Serial.println("invalid threema private key; end-to-end messages will not be sent");
 #endif
+        return;
+    }
 
-  httpClient.beginRequest();
+    for (int i = 0; i < recipientCount(); i++) {
+        ThreemaRecipientKey& key = _recipientKeys[i];
 
-  if (HTTP_SUCCESS != httpClient.post("/send_simple")) {
+        if (Common::decodeHex(_threemaSettings.recipientPublicKey(i), publicKey, NACL_BOX_KEY_LENGTH)) {
+            NaclBox::precompute(key.sharedKey, publicKey, privateKey);
+            key.valid = true;
+        } else {
 #ifdef SERIAL_ENABLED
-    Serial.print("failed to POST notification to threema server");
+            Serial.print("invalid public key for threema recipient [");
+            Serial.print(_threemaSettings.recipient(i));
+            Serial.println("]");
 #endif
-    return;
-  }
+        }
+    }
+
+    memcpy(_randomKey, privateKey, sizeof(_randomKey));
+    NaclBox::wipe(privateKey, sizeof(privateKey));
+    randomBytes(NULL, 0);
+}
+
+/*
+The board has no hardware source of random numbers. Instead a key is
+ratcheted forward with HSalsa20 over whatever varies from one call to the
+next; the time from the network, the time since boot in microseconds and a
+count. The output is the XSalsa20 stream under the new key. Because the key
+starts from the private key, the output cannot be predicted by somebody who
+does not have that key and the network time stops a reboot from repeating an
+earlier sequence.
+*/
+
+// private
+void ThreemaNotificationService::randomBytes(uint8_t* output, size_t length) {
+    static const uint8_t ZERO_NONCE[NACL_BOX_NONCE_LENGTH] = { 0 };
+    uint8_t input[16];
+    uint32_t values[4] = {
+        (uint32_t) WiFi.getTime(),
+        (uint32_t) micros(),
+        (uint32_t) millis(),
+        _randomCount++
+    };
+
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            input[(i * 4) + j] = (uint8_t) (values[i] >> (j * 8));
+        }
+    }
+
+    NaclBox::hsalsa20(_randomKey, input, _randomKey);
+
+    if (0 != length) {
+        NaclBox::stream(output, length, ZERO_NONCE, _randomKey);
+        NaclBox::hsalsa20(_randomKey, input, _randomKey);
+    }
+}
+
+/*static*/
+void ThreemaNotificationService::parseTemplate(MessageTemplate& messageTemplate,
+    const char* text, const char* defaultText) {
+    if (NULL != text && messageTemplate.parse(text)) {
+        return;
+    }
+    if (NULL != text) {
+#ifdef SERIAL_ENABLED
+        Serial.print("invalid message template [");
+        Serial.print(text);
+        Serial.println("]; will use the default");
+#endif
+    }
+    messageTemplate.parse(defaultText);
+}
+
+int ThreemaNotificationService::recipientCount() {
+    return _threemaSettings.recipientCount();
+}
+
+/*
+If there is an energy governor (the board is on a limited supply of power)
+then it will decide if the message is sent now or not. A deferred message is
+sent in the same Wifi session as the next message that is sent so that it
+does not cost a Wifi session of its own or, if no message comes along, on
+its own after `ENERGY_DEFER_MAX_MILLIS`. There is only room for one deferred
+message so while there is one a later message that would be deferred is sent
+instead, taking the deferred message with it. A message that may not be
+dropped is deferred rather than dropped.
+
+The message counts as delivered if at least one recipient was sent it.
+*/
+
+bool ThreemaNotificationService::notify(
+    const MessageTemplate& messageTemplate,
+    const NotificationEvent& event,
+    NotificationPriority priority,
+    bool mayDrop) {
+
+    MessageContext context;
+    context.description = _description;
+    context.openDurationMillis = event.openDurationMillis;
+    context.openCount = event.openCount;
+    context.uptimeMillis = MonotonicClock::now();
+    context.open = event.open;
+    context.suppressedCount = event.suppressedCount;
+    context.openStats = event.openStats;
+    context.statsMillis = event.statsMillis;
+    context.wallSeconds = WallClock::now(MonotonicClock::now());
+
+    messageTemplate.render(context, _message, MESSAGE_MAX_LENGTH);
+
+    if (NULL != _energyGovernor) {
+        int requests = recipientCount() * (0 == _deferredMessage[0] ? 1 : 2);
+        EnergyDecision decision = _energyGovernor->decide(priority, _energyGovernor->estimateSession(requests));
+
+        if (ENERGY_DECISION_DROP == decision && !mayDrop) {
+            decision = ENERGY_DECISION_DEFER;
+        }
+
+        if (ENERGY_DECISION_DEFER == decision && 0 != _deferredMessage[0]) {
+            decision = ENERGY_DECISION_SEND;
+        }
+
+        switch (decision) {
+            case ENERGY_DECISION_DEFER:
+#ifdef SERIAL_ENABLED
+                Serial.println("deferred notification to save energy");
+#endif
+                memcpy(_deferredMessage, _message, MESSAGE_MAX_LENGTH);
+                _deferredAt = MonotonicClock::now();
+                return true;
+            case ENERGY_DECISION_DROP:
+#ifdef SERIAL_ENABLED
+                Serial.println("dropped notification to save energy");
+#endif
+                return true;
+            default:
+                break;
+        }
+    }
+
+    bool ownsWifi;
+    bool delivered = false;
+
+    if (beginWifiSession(_wifiSettings, _energyGovernor,
+            boundedByDeadline(DELAY_WIFI_CONNECT_MILLIS), &ownsWifi)) {
+        notifyDeferred();
+        delivered = notifyRecipients(_message);
+        syncHistory();
+    }
+
+    endWifiSession(ownsWifi);
+    return delivered;
+}
+
+/*
+The events that detectors relayed to this hub are notified in one session.
+Each is rendered with this board's templates but with the description of the
+detector that sent it. As many as fit are then put together into one
+message, a line each, so that several events cost the recipients one message
+and the board one request to the gateway. A hub is expected to be on a mains
+supply so the energy governor is not asked about relayed events.
+
+Sending stops at the first message that no recipient could be sent and false
+is returned so that the events are kept and sent again; those in earlier
+messages may then reach the recipients twice rather than some never.
+*/
+
+bool ThreemaNotificationService::notifyRelayed(const RelayEvent* events, int count) {
+    bool ownsWifi;
+    bool delivered = true;
+
+    if (!beginWifiSession(_wifiSettings, _energyGovernor,
+            boundedByDeadline(DELAY_WIFI_CONNECT_MILLIS), &ownsWifi)) {
+        endWifiSession(ownsWifi);
+        return false;
+    }
+
+    notifyDeferred();
+
+    _message[0] = 0;
+
+    for (int i = 0; i < count && delivered; i++) {
+        const RelayEvent& event = events[i];
+        MessageContext context;
+        context.description = event.description;
+        context.openDurationMillis = event.openDurationSeconds * 1000UL;
+        context.openCount = event.openCount;
+        context.uptimeMillis = MonotonicClock::now();
+        context.open = event.open;
+        context.suppressedCount = event.suppressedCount;
+        context.openStats = NULL;
+        context.statsMillis = 0;
+        context.wallSeconds = WallClock::now(MonotonicClock::now());
+
+        relayedTemplate(event.kind).render(context, _relayedMessage, MESSAGE_MAX_LENGTH);
+
+        size_t length = strlen(_message);
+        size_t relayedLength = strlen(_relayedMessage);
+
+        if (0 != length && length + 1 + relayedLength >= MESSAGE_MAX_LENGTH) {
+            delivered = notifyRecipients(_message);
+            length = 0;
+        }
+
+        if (0 != length) {
+            _message[length++] = '\n';
+        }
+
+        memcpy(&_message[length], _relayedMessage, relayedLength + 1);
+    }
+
+    if (delivered && 0 != _message[0]) {
+        delivered = notifyRecipients(_message);
+    }
+
+    syncHistory();
+    endWifiSession(ownsWifi);
+    return delivered;
+}
+
+/*
+A deferred message that has waited for `ENERGY_DEFER_MAX_MILLIS` without
+another message to go with it is sent on its own. If it still cannot be sent
+then it waits as long again before the next attempt.
+*/
+
+void ThreemaNotificationService::pulse() {
+    uint64_t at = wakeAt();
+
+    if (0 == at || MonotonicClock::now() < at) {
+        return;
+    }
+
+    sendDeferred();
+
+    if (0 != _deferredMessage[0]) {
+        _deferredAt = MonotonicClock::now();
+    }
+}
+
+uint64_t ThreemaNotificationService::wakeAt() {
+    if (0 == _deferredMessage[0]) {
+        return 0;
+    }
+    return _deferredAt + ENERGY_DEFER_MAX_MILLIS;
+}
+
+NotificationService* ThreemaNotificationService::serviceFor(NotificationMethod method) {
+    return THREEMA == method ? this : NULL;
+}
+
+/*
+The deferred message was rendered with the prior settings; it is sent as it
+is.
+*/
+
+void ThreemaNotificationService::takeOver(NotificationService* prior) {
+    ThreemaNotificationService* priorService =
+        static_cast<ThreemaNotificationService*>(prior->serviceFor(THREEMA));
+
+    if (NULL == priorService || this == priorService || 0 == priorService->_deferredMessage[0]) {
+        return;
+    }
+
+    memcpy(_deferredMessage, priorService->_deferredMessage, MESSAGE_MAX_LENGTH);
+    _deferredAt = priorService->_deferredAt;
+    priorService->_deferredMessage[0] = 0;
+}
+
+/*
+Sends the deferred message in a Wifi session of its own.
+*/
+
+// private
+void ThreemaNotificationService::sendDeferred() {
+    bool ownsWifi;
+
+    if (beginWifiSession(_wifiSettings, _energyGovernor,
+            boundedByDeadline(DELAY_WIFI_CONNECT_MILLIS), &ownsWifi)) {
+        notifyDeferred();
+        syncHistory();
+    }
+
+    endWifiSession(ownsWifi);
+}
+
+/*
+Sends the deferred message, if there is one, while the Wifi is up. It is only
+forgotten once it has been sent.
+*/
+
+// private
+void ThreemaNotificationService::notifyDeferred() {
+    if (0 != _deferredMessage[0] && notifyRecipients(_deferredMessage)) {
+        _deferredMessage[0] = 0;
+    }
+}
+
+// private
+const MessageTemplate& ThreemaNotificationService::relayedTemplate(uint8_t kind) const {
+    switch (kind) {
+        case RELAY_EVENT_STILL_OPEN:
+            return _stillOpenTemplate;
+        case RELAY_EVENT_CLOSE:
+            return _closeTemplate;
+        case RELAY_EVENT_FLAPPING:
+            return _flappingTemplate;
+        case RELAY_EVENT_SETTLED:
+            return _settledTemplate;
+        default:
+            return _openTemplate;
+    }
+}
+
+/*
+Returns true if at least one of the recipients was sent the message. No
+recipient is started once the deadline has passed.
+*/
+
+bool ThreemaNotificationService::notifyRecipients(const char* message) {
+    bool delivered = false;
+
+    for (int i = 0; i < _threemaSettings.recipientCount() && !isPastDeadline(); i++) {
+      if (notifyRecipient(i, message)) {
+        delivered = true;
+      }
+    }
+
+    return delivered;
+}
+
+bool ThreemaNotificationService::notifyRecipient(int index, const char* message) {
+    const char* recipient = _threemaSettings.recipient(index);
+
+#ifdef SERIAL_ENABLED
+    Serial.print("will send notification to threema [");
+    Serial.print(recipient);
+    Serial.println("]");
+#endif
+
+    if (NULL != _recipientKeys && !_recipientKeys[index].valid) {
+#ifdef SERIAL_ENABLED
+      Serial.println("no usable key for the threema recipient");
+#endif
+      return false;
+    }
+
+    if (NULL != _energyGovernor) {
+        _energyGovernor->record(ENERGY_ACTIVITY_TLS_HANDSHAKE, 1);
+    }
+
+    uint8_t socket = connectGateway();
+
+    if (NO_SOCKET_AVAIL != socket) {
+      WiFiClient wifi(socket);
+      LatencyTrace::mark(LATENCY_STAGE_TLS_CONNECT, MonotonicClock::now());
+      bool delivered = notifyRecipient(wifi, index, message);
+      wifi.stop(); // disconnect
+      return delivered;
+    }
 
-  httpClient.sendHeader("Content-Type", "application/x-www-form-urlencoded");
-  httpClient.sendHeader("Connection", "close");
-  httpClient.sendHeader("Content-Length", payload.length());
+#ifdef SERIAL_ENABLED
+    Serial.println("unable to connect to the threema api server");
+#endif
+    return false;
+}
+
+/*
+`WiFiClient::connectSSL()` waits a fixed time for the connection so the Wifi
+module's driver is used directly to bound the wait by the deadline. The
+module looks the host name up itself for each connection; it connects by
+host name whenever it is given one and the host name is needed for SNI and
+to check the server's certificate. Returns the socket that is connected or
+`NO_SOCKET_AVAIL`.
+*/
+
+// private
+uint8_t ThreemaNotificationService::connectGateway() {
+    uint8_t socket = ServerDrv::getSocket();
+
+    if (NO_SOCKET_AVAIL == socket) {
+        return NO_SOCKET_AVAIL;
+    }
+
+    ServerDrv::startClient(HOST_THREEMA_MSG_API, strlen(HOST_THREEMA_MSG_API),
+        0, 443, socket, TLS_MODE);
+
+    WiFiClient wifi(socket);
+    unsigned long start = millis();
+    unsigned long waitMillis = boundedByDeadline(DELAY_TLS_CONNECT_MILLIS);
+
+    while (!wifi.connected() && (millis() - start) < waitMillis) {
+        delay(1);
+    }
+
+    if (!wifi.connected()) {
+        wifi.stop();
+        return NO_SOCKET_AVAIL;
+    }
+
+    return socket;
+}
+
+/*
+The request is written in one go and only the status line of the response is
+read after which the connection is closed by the caller.
+*/
+
+bool ThreemaNotificationService::notifyRecipient(WiFiClient& wifi, int index, const char* message) {
+  const char* recipient = _threemaSettings.recipient(index);
+  bool added = _threemaSettings.isEndToEnd()
+    ? addEndToEndFields(index, message)
+    : addBasicFields(recipient, message);
 
-  httpClient.beginBody();
-  httpClient.print(payload);
-  httpClient.endRequest();
+  if (!added) {
+      return false;
+  }
+
+  if (NULL != _energyGovernor) {
+      _energyGovernor->record(ENERGY_ACTIVITY_HTTP_SEND, 1);
+  }
 
-  int statusCode = httpClient.responseStatusCode();
+  int statusCode = _httpSender.post(wifi);
 
   if (2 != statusCode / 100) {
 #ifdef SERIAL_ENABLED
@@ -156,22 +773,557 @@ void ThreemaNotificationService::notifyRecipient(WiFiClient& wifi, ThreemaRecipi
       Serial.print(statusCode);
       Serial.println("]");
 #endif
-      return;
+      return false;
   }
 
 #ifdef SERIAL_ENABLED
   Serial.print("did send notification to threema [");
-  Serial.print(recipient->to());
+  Serial.print(recipient);
   Serial.print("] with message [");
   Serial.print(message);
   Serial.println("]");
 #endif
+  return true;
 }
 
-void ThreemaNotificationService::notifyOpen() {
-    notify("Open \"" + _description + "\"");
+/*
+In basic mode the gateway encrypts the message so it is sent as text.
+*/
+
+// private
+bool ThreemaNotificationService::addBasicFields(const char* recipient, const char* message) {
+  _httpSender.begin(HOST_THREEMA_MSG_API, "/send_simple");
+  _httpSender.addFormField("to", recipient);
+  _httpSender.addFormField("from", _threemaSettings.from());
+  _httpSender.addFormField("secret", _threemaSettings.secret());
+  _httpSender.addFormField("text", message);
+  return true;
 }
 
-void ThreemaNotificationService::notifyClose() {
-    notify("Close \"" + _description + "\"");
+/*
+In end-to-end mode the message is a Threema text message; a type byte then
+the text. It is padded PKCS#7 style; the value of each padding byte is the
+number of padding bytes. It is then sealed with the shared key of the
+recipient and a fresh nonce and both are sent as hex. The box is built in
+place so that no more memory is needed than for the box itself.
+*/
+
+// private
+bool ThreemaNotificationService::addEndToEndFields(int index, const char* message) {
+  uint8_t nonce[NACL_BOX_NONCE_LENGTH + 1];
+  uint8_t* plain = &_box[NACL_BOX_TAG_LENGTH];
+  size_t textLength = strlen(message);
+
+  randomBytes(nonce, sizeof(nonce));
+
+  size_t padding = 1 + (nonce[NACL_BOX_NONCE_LENGTH] % THREEMA_E2E_PADDING_MAX);
+
+  if (1 + textLength + padding < THREEMA_E2E_MIN_LENGTH) {
+    padding = THREEMA_E2E_MIN_LENGTH - (1 + textLength);
+  }
+
+  size_t length = 1 + textLength + padding;
+
+  if (NACL_BOX_TAG_LENGTH + length > THREEMA_E2E_BOX_MAX_LENGTH) {
+#ifdef SERIAL_ENABLED
+    Serial.println("message too long to send end-to-end");
+#endif
+    return false;
+  }
+
+  plain[0] = THREEMA_MESSAGE_TYPE_TEXT;
+  memcpy(&plain[1], message, textLength);
+  memset(&plain[1 + textLength], (int) padding, padding);
+
+  NaclBox::seal(_box, plain, length, nonce, _recipientKeys[index].sharedKey);
+
+  Common::encodeHex(nonce, NACL_BOX_NONCE_LENGTH, _nonceHex);
+  Common::encodeHex(_box, NACL_BOX_TAG_LENGTH + length, _boxHex);
+  NaclBox::wipe(_box, sizeof(_box));
+
+  _httpSender.begin(HOST_THREEMA_MSG_API, "/send_e2e");
+  _httpSender.addFormField("to", _threemaSettings.recipient(index));
+  _httpSender.addFormField("from", _threemaSettings.from());
+  _httpSender.addFormField("secret", _threemaSettings.secret());
+  _httpSender.addFormField("nonce", _nonceHex);
+  _httpSender.addFormField("box", _boxHex);
+  return true;
+}
+
+bool ThreemaNotificationService::notifyOpen(const NotificationEvent& event) {
+    return notify(_openTemplate, event, NOTIFICATION_PRIORITY_HIGH, true);
+}
+
+bool ThreemaNotificationService::notifyStillOpen(const NotificationEvent& event) {
+    return notify(_stillOpenTemplate, event, NOTIFICATION_PRIORITY_NORMAL, true);
+}
+
+/*
+The recipients that were told that the sensor opened must also be told that
+it closed so the close may then be deferred but it is never dropped.
+*/
+
+bool ThreemaNotificationService::notifyClose(const NotificationEvent& event) {
+    return notify(_closeTemplate, event, NOTIFICATION_PRIORITY_LOW, !event.openNotified);
+}
+
+bool ThreemaNotificationService::notifyFlapping(const NotificationEvent& event) {
+    return notify(_flappingTemplate, event, NOTIFICATION_PRIORITY_HIGH, true);
+}
+
+bool ThreemaNotificationService::notifySettled(const NotificationEvent& event) {
+    return notify(_settledTemplate, event, NOTIFICATION_PRIORITY_NORMAL, true);
+}
+
+
+/*
+The detector is identified to the hub by a checksum of its description so
+that each detector at a site should be given a different description.
+*/
+
+RelayNotificationService::RelayNotificationService(
+    const char* description,
+    const WifiSettings* wifiSettings,
+    const RelaySettings* relaySettings,
+    EnergyGovernor* energyGovernor)
+    :
+    _description(NULL == description ? "" : description),
+    _wifiSettings(*wifiSettings),
+    _relaySettings(*relaySettings),
+    _energyGovernor(energyGovernor),
+    _hasHubAddress(false),
+    _detectorId(0),
+    _boot(0),
+    _sequence(0),
+    _hasUnacknowledged(false),
+    _relayedCount(0),
+    _retryCount(0),
+    _unacknowledgedCount(0) {
+    _detectorId = Common::crc32((const uint8_t*) _description, strlen(_description));
+
+    if (NULL != _relaySettings.hubAddress()) {
+        _hasHubAddress = _hubAddress.fromString(_relaySettings.hubAddress());
+    }
+
+    if (!_hasHubAddress) {
+#ifdef SERIAL_ENABLED
+        Serial.println("invalid address for the relay hub; nothing will be relayed");
+#endif
+    }
+}
+
+/*
+An event that the hub has not acknowledged and that no other service has
+taken over is sent again now so that it is not lost with the service.
+*/
+
+RelayNotificationService::~RelayNotificationService() {
+    if (!_hasUnacknowledged) {
+        return;
+    }
+
+    bool ownsWifi;
+
+    if (beginWifiSession(_wifiSettings, _energyGovernor,
+            boundedByDeadline(DELAY_WIFI_CONNECT_MILLIS), &ownsWifi)) {
+        WiFiUDP udp;
+        send(udp, _unacknowledged);
+        udp.stop();
+    }
+
+    endWifiSession(ownsWifi);
+}
+
+NotificationService* RelayNotificationService::serviceFor(NotificationMethod method) {
+    return RELAY == method ? this : NULL;
+}
+
+/*
+The numbering of the events carries on from the prior service so that the
+hub is able to tell the event that is taken over from those that follow it.
+*/
+
+void RelayNotificationService::takeOver(NotificationService* prior) {
+    RelayNotificationService* priorService =
+        static_cast<RelayNotificationService*>(prior->serviceFor(RELAY));
+
+    if (NULL == priorService || this == priorService) {
+        return;
+    }
+
+    _boot = priorService->_boot;
+    _sequence = priorService->_sequence;
+
+    if (priorService->_hasUnacknowledged) {
+        memcpy(&_unacknowledged, &priorService->_unacknowledged, sizeof(_unacknowledged));
+        _hasUnacknowledged = true;
+        priorService->_hasUnacknowledged = false;
+    }
+}
+
+uint32_t RelayNotificationService::relayedCount() const {
+    return _relayedCount;
+}
+
+uint32_t RelayNotificationService::retryCount() const {
+    return _retryCount;
+}
+
+uint32_t RelayNotificationService::unacknowledgedCount() const {
+    return _unacknowledgedCount;
+}
+
+/*
+The event that the hub did not acknowledge was delivered some other way so it
+is not sent to the hub again.
+*/
+
+void RelayNotificationService::abandonUndelivered() {
+    _hasUnacknowledged = false;
+}
+
+// private
+bool RelayNotificationService::relay(RelayEventKind kind, const NotificationEvent& event) {
+    if (!_hasHubAddress) {
+        return false;
+    }
+
+    _event.detectorId = _detectorId;
+    _event.boot = 0;
+    _event.sequence = 0;
+    _event.kind = kind;
+    _event.open = event.open;
+    _event.openDurationSeconds = event.openDurationMillis / 1000UL;
+    _event.openCount = (uint16_t) min(event.openCount, 0xFFFFU);
+    _event.suppressedCount = (uint16_t) min(event.suppressedCount, 0xFFFFU);
+    strncpy(_event.description, _description, RELAY_DESCRIPTION_MAX_LENGTH);
+    _event.description[RELAY_DESCRIPTION_MAX_LENGTH] = 0;
+
+    bool ownsWifi;
+    bool sent = false;
+
+    if (beginWifiSession(_wifiSettings, _energyGovernor,
+            boundedByDeadline(DELAY_WIFI_CONNECT_MILLIS), &ownsWifi)) {
+        WiFiUDP udp;
+
+        if (_hasUnacknowledged && send(udp, _unacknowledged)) {
+            _hasUnacknowledged = false;
+        }
+
+        sent = send(udp, _event);
+        udp.stop();
+        syncHistory();
+    }
+
+    endWifiSession(ownsWifi);
+
+    if (!sent) {
+#ifdef SERIAL_ENABLED
+        Serial.println("the relay hub did not acknowledge the event; will send it again later");
+#endif
+        memcpy(&_unacknowledged, &_event, sizeof(_unacknowledged));
+        _hasUnacknowledged = true;
+        _unacknowledgedCount++;
+    }
+
+    return sent;
+}
+
+/*
+An event is numbered when it is first sent so that an event which could not
+be sent at all does not use up a number. The boot is chosen when the first
+event is sent because only then is the network time known; combined with the
+time since the board started it is unlikely to be the same as that of an
+earlier start. The event is sent again each time that the acknowledgement
+does not arrive in time.
+*/
+
+// private
+bool RelayNotificationService::send(WiFiUDP& udp, RelayEvent& event) {
+    if (0 == event.sequence) {
+        while (0 == _boot) {
+            _boot = (uint16_t) (WiFi.getTime() ^ micros() ^ (micros() >> 16));
+        }
+        if (0 == ++_sequence) {
+            ++_sequence;
+        }
+        event.boot = _boot;
+        event.sequence = _sequence;
+    }
+
+    size_t length = RelayProtocol::encodeEvent(event, _packet, sizeof(_packet));
+
+    for (int attempt = 0; attempt < RELAY_SEND_ATTEMPTS; attempt++) {
+        if (0 != attempt) {
+            if (isPastDeadline()) {
+                return false;
+            }
+            _retryCount++;
+        }
+
+        if (1 != udp.beginPacket(_hubAddress, _relaySettings.port())) {
+            return false;
+        }
+
+        udp.write(_packet, length);
+        udp.endPacket();
+
+        unsigned long start = millis();
+
+        while ((millis() - start) < RELAY_ACK_TIMEOUT_MILLIS) {
+            if (udp.parsePacket() > 0) {
+                uint8_t ackPacket[RELAY_ACK_PACKET_LENGTH + 1];
+                int ackLength = udp.read(ackPacket, sizeof(ackPacket));
+                RelayAck ack;
+
+                if (ackLength > 0
+                    && RelayProtocol::decodeAck(ackPacket, ackLength, &ack)
+                    && ack.detectorId == event.detectorId
+                    && ack.boot == event.boot
+                    && ack.sequence == event.sequence) {
+                    _relayedCount++;
+                    return true;
+                }
+            }
+
+            delay(10);
+        }
+    }
+
+    return false;
+}
+
+bool RelayNotificationService::notifyOpen(const NotificationEvent& event) {
+    return relay(RELAY_EVENT_OPEN, event);
+}
+
+bool RelayNotificationService::notifyStillOpen(const NotificationEvent& event) {
+    return relay(RELAY_EVENT_STILL_OPEN, event);
+}
+
+bool RelayNotificationService::notifyClose(const NotificationEvent& event) {
+    return relay(RELAY_EVENT_CLOSE, event);
+}
+
+bool RelayNotificationService::notifyFlapping(const NotificationEvent& event) {
+    return relay(RELAY_EVENT_FLAPPING, event);
+}
+
+bool RelayNotificationService::notifySettled(const NotificationEvent& event) {
+    return relay(RELAY_EVENT_SETTLED, event);
+}
+
+
+FallbackNotificationService::FallbackNotificationService(const DeliverySettings* deliverySettings)
+    :
+    _serviceCount(0),
+    _deadlineMillis((unsigned long) deliverySettings->deadlineSeconds() * 1000UL),
+    _fallbackCount(0),
+    _skipCount(0),
+    _undeliveredCount(0) {
+}
+
+FallbackNotificationService::~FallbackNotificationService() {
+    for (int i = 0; i < _serviceCount; i++) {
+        delete _services[i];
+    }
+}
+
+/*
+Takes ownership of the service. Returns false, having deleted the service, if
+there is no room for it.
+*/
+
+bool FallbackNotificationService::addService(NotificationService* service) {
+    if (_serviceCount >= 1 + DELIVERY_MAX_FALLBACKS) {
+        delete service;
+        return false;
+    }
+
+    _services[_serviceCount] = service;
+    _breakers[_serviceCount].configure(DELIVERY_FAILURE_LIMIT, DELIVERY_COOL_DOWN_MILLIS);
+    _serviceCount++;
+    return true;
+}
+
+void FallbackNotificationService::setHistorySync(HistorySync* value) {
+    NotificationService::setHistorySync(value);
+
+    for (int i = 0; i < _serviceCount; i++) {
+        _services[i]->setHistorySync(value);
+    }
+}
+
+int FallbackNotificationService::serviceCount() const {
+    return _serviceCount;
+}
+
+NotificationService* FallbackNotificationService::service(int index) const {
+    return _services[index];
+}
+
+const CircuitBreaker& FallbackNotificationService::breaker(int index) const {
+    return _breakers[index];
+}
+
+uint32_t FallbackNotificationService::fallbackCount() const {
+    return _fallbackCount;
+}
+
+uint32_t FallbackNotificationService::skipCount() const {
+    return _skipCount;
+}
+
+uint32_t FallbackNotificationService::undeliveredCount() const {
+    return _undeliveredCount;
+}
+
+// private
+bool FallbackNotificationService::mayTry(int index, bool anyAllowed, uint64_t now) const {
+    return !anyAllowed || _breakers[index].allows(now);
+}
+
+/*
+Delivers either the event with the function `notify` or, if there is no
+function, the events that detectors relayed.
+*/
+
+// private
+bool FallbackNotificationService::deliver(NotifyFunction notify, const NotificationEvent* event,
+    const RelayEvent* relayEvents, int relayCount) {
+    uint64_t start = MonotonicClock::now();
+    uint64_t deadline = 0 == _deadlineMillis ? 0 : start + _deadlineMillis;
+    bool anyAllowed = false;
+    uint8_t failed = 0;
+
+    for (int i = 0; i < _serviceCount; i++) {
+        anyAllowed = anyAllowed || _breakers[i].allows(start);
+    }
+
+    for (int i = 0; i < _serviceCount; i++) {
+        uint64_t now = MonotonicClock::now();
+
+        if (0 != deadline && now >= deadline) {
+#ifdef SERIAL_ENABLED
+            Serial.println("the deadline to deliver the notification has passed");
+#endif
+            break;
+        }
+
+        if (!mayTry(i, anyAllowed, now)) {
+            _skipCount++;
+            continue;
+        }
+
+        int remaining = 0;
+
+        for (int j = i; j < _serviceCount; j++) {
+            if (mayTry(j, anyAllowed, now)) {
+                remaining++;
+            }
+        }
+
+        if (0 != i) {
+#ifdef SERIAL_ENABLED
+            Serial.print("will fall back to notification service [");
+            Serial.print(i);
+            Serial.println("]");
+#endif
+            _fallbackCount++;
+        }
+
+        _services[i]->setDeadline(0 == deadline ? 0 : now + (deadline - now) / remaining);
+        bool delivered = NULL == notify
+            ? _services[i]->notifyRelayed(relayEvents, relayCount)
+            : (_services[i]->*notify)(*event);
+        _services[i]->setDeadline(0);
+
+        if (delivered) {
+            _breakers[i].recordSuccess();
+
+            for (int j = 0; j < i; j++) {
+                if (0 != (failed & (1 << j))) {
+                    _services[j]->abandonUndelivered();
+                }
+            }
+
+            return true;
+        }
+
+        _breakers[i].recordFailure(MonotonicClock::now());
+        failed |= (uint8_t) (1 << i);
+    }
+
+#ifdef SERIAL_ENABLED
+    Serial.println("no notification service was able to deliver the notification");
+#endif
+    _undeliveredCount++;
+    return false;
+}
+
+bool FallbackNotificationService::notifyOpen(const NotificationEvent& event) {
+    return deliver(&NotificationService::notifyOpen, &event, NULL, 0);
+}
+
+bool FallbackNotificationService::notifyStillOpen(const NotificationEvent& event) {
+    return deliver(&NotificationService::notifyStillOpen, &event, NULL, 0);
+}
+
+bool FallbackNotificationService::notifyClose(const NotificationEvent& event) {
+    return deliver(&NotificationService::notifyClose, &event, NULL, 0);
+}
+
+bool FallbackNotificationService::notifyFlapping(const NotificationEvent& event) {
+    return deliver(&NotificationService::notifyFlapping, &event, NULL, 0);
+}
+
+bool FallbackNotificationService::notifySettled(const NotificationEvent& event) {
+    return deliver(&NotificationService::notifySettled, &event, NULL, 0);
+}
+
+void FallbackNotificationService::pulse() {
+    for (int i = 0; i < _serviceCount; i++) {
+        _services[i]->pulse();
+    }
+}
+
+uint64_t FallbackNotificationService::wakeAt() {
+    uint64_t result = 0;
+
+    for (int i = 0; i < _serviceCount; i++) {
+        uint64_t serviceWakeAt = _services[i]->wakeAt();
+
+        if (0 == result || (0 != serviceWakeAt && serviceWakeAt < result)) {
+            result = serviceWakeAt;
+        }
+    }
+
+    return result;
+}
+
+NotificationService* FallbackNotificationService::serviceFor(NotificationMethod method) {
+    for (int i = 0; i < _serviceCount; i++) {
+        NotificationService* service = _services[i]->serviceFor(method);
+
+        if (NULL != service) {
+            return service;
+        }
+    }
+
+    return NULL;
+}
+
+void FallbackNotificationService::takeOver(NotificationService* prior) {
+    for (int i = 0; i < _serviceCount; i++) {
+        _services[i]->takeOver(prior);
+    }
+}
+
+/*
+The events that detectors relayed fall back from one service to the next in
+the same way as the events of this board's own sensor.
+*/
+
+bool FallbackNotificationService::notifyRelayed(const RelayEvent* events, int count) {
+    return deliver(NULL, NULL, events, count);
 }
@@ -8,15 +8,61 @@
 #include <Arduino.h>
 #include <WiFiNINA.h>
 
-class ThreemaSettings;
-class ThreemaRecipient;
-class WifiSettings;
+#include "circuitbreaker.h"
+#include "energygovernor.h"
+#include "historysync.h"
+#include "httpsender.h"
+#include "messagetemplate.h"
+#include "naclbox.h"
+#include "relayprotocol.h"
+#include "settings.h"
+
+// This is the longest that an end-to-end message can be once it has been
+// given its type, padded and sealed.
+
+#define THREEMA_E2E_BOX_MAX_LENGTH (NACL_BOX_TAG_LENGTH + 1 + MESSAGE_MAX_LENGTH + THREEMA_E2E_PADDING_MAX)
+
+/*
+This describes the sensor at the time that a notification is made; how long
+it has been open, how many times it has been opened since the last
+notification, whether it is open now, whether its opening was notified and
+how many notifications were suppressed because it was flapping. The statistics of how long the sensor
+has been open for are carried along so that a message can include them
+without a session of its own.
+*/
+
+struct NotificationEvent {
+    unsigned long openDurationMillis;
+    unsigned int openCount;
+    bool open;
+    bool openNotified;
+    unsigned int suppressedCount;
+    const OpenStats* openStats;
+    uint64_t statsMillis;
+};
 
 /*
 This abstract superclass of the notification services provides the
 interfaces for concrete subclasses to provide. The notification
 service has only one job; to notify out that the sensor was opened
-or closed.
+or closed or that it is still open some time after it was first notified.
+It also notifies when the sensor starts flapping, after which nothing more
+is notified until it has settled down again. On a hub, the service also
+notifies the events that detectors have relayed to it.
+
+A service that brings the Wifi up also syncs the history, if it has been
+given a history sync, before it takes the Wifi down again. The history sync
+is not owned by the service.
+
+Each notification returns false if it could not be delivered so that another
+service can be tried; a notification that the service deliberately held back
+counts as delivered. While a deadline is set, a service gives up on a
+notification rather than start anything that would run past it. A service
+that holds a notification back sends it later from `pulse()` and says when
+through `wakeAt()` so that the board is woken for it. When the service is
+rebuilt with new settings, the new service takes over what the prior service
+is holding back; a service sends anything that is still held as it is
+deleted.
 */
 
 class NotificationService {
@@ -24,8 +70,31 @@ class NotificationService {
         NotificationService();
         virtual ~NotificationService();
 
-        virtual void notifyOpen() = 0;
-        virtual void notifyClose() = 0;
+        virtual void setHistorySync(HistorySync* value);
+        void setDeadline(uint64_t value);
+
+        virtual bool notifyOpen(const NotificationEvent& event) = 0;
+        virtual bool notifyStillOpen(const NotificationEvent& event) = 0;
+        virtual bool notifyClose(const NotificationEvent& event) = 0;
+        virtual bool notifyFlapping(const NotificationEvent& event) = 0;
+        virtual bool notifySettled(const NotificationEvent& event) = 0;
+        virtual bool notifyRelayed(const RelayEvent* events, int count);
+        virtual void abandonUndelivered();
+
+        virtual void pulse();
+        virtual uint64_t wakeAt();
+
+        virtual NotificationService* serviceFor(NotificationMethod method);
+        virtual void takeOver(NotificationService* prior);
+
+    protected:
+        void syncHistory();
+        unsigned long boundedByDeadline(unsigned long millis) const;
+        bool isPastDeadline() const;
+
+    private:
+        HistorySync* _historySync;
+        uint64_t _deadline;
 };
 
 class LogNotificationService : public NotificationService {
@@ -33,30 +102,209 @@ class LogNotificationService : public NotificationService {
         LogNotificationService();
         virtual ~LogNotificationService();
 
-        virtual void notifyOpen();
-        virtual void notifyClose();
+        virtual bool notifyOpen(const NotificationEvent& event);
+        virtual bool notifyStillOpen(const NotificationEvent& event);
+        virtual bool notifyClose(const NotificationEvent& event);
+        virtual bool notifyFlapping(const NotificationEvent& event);
+        virtual bool notifySettled(const NotificationEvent& event);
+};
+
+/*
+For end-to-end messages, the key shared with each recipient is worked out
+once when the settings are loaded and is then used for each message. A
+recipient whose public key could not be used is not sent anything.
+*/
+
+struct ThreemaRecipientKey {
+    uint8_t sharedKey[NACL_BOX_KEY_LENGTH];
+    bool valid;
 };
 
 class ThreemaNotificationService : public NotificationService {
     public:
         ThreemaNotificationService(
-            const String& description,
-            WifiSettings* wifiSettings,
-            ThreemaSettings* threemaSettings);
+            const char* description,
+            const WifiSettings* wifiSettings,
+            const ThreemaSettings* threemaSettings,
+            const MessageSettings* messageSettings,
+            EnergyGovernor* energyGovernor);
         virtual ~ThreemaNotificationService();
 
-        virtual void notifyOpen();
-        virtual void notifyClose();
+        virtual bool notifyOpen(const NotificationEvent& event);
+        virtual bool notifyStillOpen(const NotificationEvent& event);
+        virtual bool notifyClose(const NotificationEvent& event);
+        virtual bool notifyFlapping(const NotificationEvent& event);
+        virtual bool notifySettled(const NotificationEvent& event);
+        virtual bool notifyRelayed(const RelayEvent* events, int count);
+
+        virtual void pulse();
+        virtual uint64_t wakeAt();
+
+        virtual NotificationService* serviceFor(NotificationMethod method);
+        virtual void takeOver(NotificationService* prior);
 
     private:
-        void notify(String& message);
-        void notifyRecipient(ThreemaRecipient* recipient, String& message);
-        void notifyRecipient(WiFiClient& wifi, ThreemaRecipient* recipient, String& message);
+        const MessageTemplate& relayedTemplate(uint8_t kind) const;
+        bool notify(const MessageTemplate& messageTemplate,
+            const NotificationEvent& event,
+            NotificationPriority priority,
+            bool mayDrop);
+        void sendDeferred();
+        void notifyDeferred();
+        bool notifyRecipients(const char* message);
+        bool notifyRecipient(int index, const char* message);
+        bool notifyRecipient(WiFiClient& wifi, int index, const char* message);
+        bool addBasicFields(const char* recipient, const char* message);
+        bool addEndToEndFields(int index, const char* message);
+        int recipientCount();
+
+        uint8_t connectGateway();
+
+        void precomputeKeys();
+        void randomBytes(uint8_t* output, size_t length);
+
+        static void parseTemplate(MessageTemplate& messageTemplate,
+            const char* text, const char* defaultText);
+
+    private:
+        const char* _description;
+        WifiSettings _wifiSettings;
+        ThreemaSettings _threemaSettings;
+        EnergyGovernor* _energyGovernor;
+        MessageTemplate _openTemplate;
+        MessageTemplate _stillOpenTemplate;
+        MessageTemplate _closeTemplate;
+        MessageTemplate _flappingTemplate;
+        MessageTemplate _settledTemplate;
+        char _message[MESSAGE_MAX_LENGTH];
+        char _deferredMessage[MESSAGE_MAX_LENGTH];
+        uint64_t _deferredAt;
+        char _relayedMessage[MESSAGE_MAX_LENGTH];
+        HttpSender _httpSender;
+        ThreemaRecipientKey* _recipientKeys;
+        uint8_t _randomKey[NACL_BOX_KEY_LENGTH];
+        uint32_t _randomCount;
+        uint8_t _box[THREEMA_E2E_BOX_MAX_LENGTH];
+        char _boxHex[(THREEMA_E2E_BOX_MAX_LENGTH * 2) + 1];
+        char _nonceHex[(NACL_BOX_NONCE_LENGTH * 2) + 1];
+};
+
+/*
+Rather than notify anybody itself, a detector sends each event to the hub on
+the local network which notifies it on the detector's behalf. Only the Wifi
+association is needed for this; there is no TLS session with the gateway.
+An event that the hub did not acknowledge is kept and sent again ahead of the
+next event. There is only room to keep one such event; a later one replaces
+an earlier one.
+*/
+
+class RelayNotificationService : public NotificationService {
+    public:
+        RelayNotificationService(
+            const char* description,
+            const WifiSettings* wifiSettings,
+            const RelaySettings* relaySettings,
+            EnergyGovernor* energyGovernor);
+        virtual ~RelayNotificationService();
+
+        virtual bool notifyOpen(const NotificationEvent& event);
+        virtual bool notifyStillOpen(const NotificationEvent& event);
+        virtual bool notifyClose(const NotificationEvent& event);
+        virtual bool notifyFlapping(const NotificationEvent& event);
+        virtual bool notifySettled(const NotificationEvent& event);
+        virtual void abandonUndelivered();
+
+        virtual NotificationService* serviceFor(NotificationMethod method);
+        virtual void takeOver(NotificationService* prior);
+
+        uint32_t relayedCount() const;
+        uint32_t retryCount() const;
+        uint32_t unacknowledgedCount() const;
+
+    private:
+        bool relay(RelayEventKind kind, const NotificationEvent& event);
+        bool send(WiFiUDP& udp, RelayEvent& event);
+
+    private:
+        const char* _description;
+        WifiSettings _wifiSettings;
+        RelaySettings _relaySettings;
+        EnergyGovernor* _energyGovernor;
+        IPAddress _hubAddress;
+        bool _hasHubAddress;
+        uint32_t _detectorId;
+        uint16_t _boot;
+        uint16_t _sequence;
+        RelayEvent _event;
+        RelayEvent _unacknowledged;
+        bool _hasUnacknowledged;
+        uint8_t _packet[RELAY_EVENT_PACKET_MAX_LENGTH];
+        uint32_t _relayedCount;
+        uint32_t _retryCount;
+        uint32_t _unacknowledgedCount;
+};
+
+/*
+This delivers each notification through the first of its services that is
+able to. The services are tried in the order that they were added and each
+has a circuit breaker so that a service which keeps failing is skipped for
+a while rather than costing the radio time of a failed attempt for every
+notification. If every breaker is open then every service is tried anyway
+so that a notification is not given up on without an attempt.
+
+With a deadline, each service that is tried is given an equal share of the
+time that is left among those still to be tried; a service that fails
+quickly leaves more time for the rest. Once a later service has delivered a
+notification, the services that failed it are told to abandon it so that
+they do not send it again later.
+
+The services are owned by this service.
+*/
+
+class FallbackNotificationService : public NotificationService {
+    public:
+        FallbackNotificationService(const DeliverySettings* deliverySettings);
+        virtual ~FallbackNotificationService();
+
+        bool addService(NotificationService* service);
+
+        virtual void setHistorySync(HistorySync* value);
+
+        virtual bool notifyOpen(const NotificationEvent& event);
+        virtual bool notifyStillOpen(const NotificationEvent& event);
+        virtual bool notifyClose(const NotificationEvent& event);
+        virtual bool notifyFlapping(const NotificationEvent& event);
+        virtual bool notifySettled(const NotificationEvent& event);
+        virtual bool notifyRelayed(const RelayEvent* events, int count);
+
+        virtual void pulse();
+        virtual uint64_t wakeAt();
+
+        virtual NotificationService* serviceFor(NotificationMethod method);
+        virtual void takeOver(NotificationService* prior);
+
+        int serviceCount() const;
+        NotificationService* service(int index) const;
+        const CircuitBreaker& breaker(int index) const;
+        uint32_t fallbackCount() const;
+        uint32_t skipCount() const;
+        uint32_t undeliveredCount() const;
+
+    private:
+        typedef bool (NotificationService::*NotifyFunction)(const NotificationEvent& event);
+
+        bool deliver(NotifyFunction notify, const NotificationEvent* event,
+            const RelayEvent* relayEvents, int relayCount);
+        bool mayTry(int index, bool anyAllowed, uint64_t now) const;
 
     private:
-        String _description;
-        WifiSettings* _wifiSettings;
-        ThreemaSettings* _threemaSettings;         
+        NotificationService* _services[1 + DELIVERY_MAX_FALLBACKS];
+        CircuitBreaker _breakers[1 + DELIVERY_MAX_FALLBACKS];
+        int _serviceCount;
+        unsigned long _deadlineMillis;
+        uint32_t _fallbackCount;
+        uint32_t _skipCount;
+        uint32_t _undeliveredCount;
 };
 
 #endif // NOTIFICATIONSERVICE_H
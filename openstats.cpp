@@ -0,0 +1,180 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#include "openstats.h"
+
+#define OPEN_STATS_DAY_MILLIS (24UL * 60UL * 60UL * 1000UL)
+
+QuantileSketch::QuantileSketch() {
+  reset();
+}
+
+void QuantileSketch::reset() {
+  for (int i = 0; i < OPEN_STATS_BUCKETS; i++) {
+    _buckets[i] = 0;
+  }
+  _count = 0;
+}
+
+/*
+Small values are their own bucket. Otherwise the bucket is chosen by the
+highest bit that is set and then by the bits below it.
+*/
+
+// private
+/*static*/
+int QuantileSketch::bucketIndex(uint32_t value) {
+  if (value < OPEN_STATS_SUB_BUCKETS) {
+    return (int) value;
+  }
+
+  int exponent = 31 - __builtin_clz(value);
+
+  if (exponent > OPEN_STATS_MAX_EXPONENT) {
+    return OPEN_STATS_BUCKETS - 1;
+  }
+
+  int shift = exponent - OPEN_STATS_SUB_BUCKET_BITS;
+  int sub = (int) ((value >> shift) & (OPEN_STATS_SUB_BUCKETS - 1));
+  return OPEN_STATS_SUB_BUCKETS * (shift + 1) + sub;
+}
+
+// private
+/*static*/
+uint32_t QuantileSketch::bucketLow(int index) {
+  if (index < OPEN_STATS_SUB_BUCKETS) {
+    return (uint32_t) index;
+  }
+
+  int shift = (index / OPEN_STATS_SUB_BUCKETS) - 1;
+  uint32_t sub = (uint32_t) (index % OPEN_STATS_SUB_BUCKETS);
+  return (OPEN_STATS_SUB_BUCKETS + sub) << shift;
+}
+
+// private
+/*static*/
+uint32_t QuantileSketch::bucketHigh(int index) {
+  if (index < OPEN_STATS_SUB_BUCKETS) {
+    return (uint32_t) index;
+  }
+  return bucketLow(index) + ((1UL << ((index / OPEN_STATS_SUB_BUCKETS) - 1)) - 1);
+}
+
+/*
+If a bucket is about to overflow then all of the buckets are halved. This
+keeps the shape of the distribution while giving more weight to the recent
+values; it happens at most once in many thousands of values.
+*/
+
+void QuantileSketch::record(uint32_t value) {
+  int index = bucketIndex(value);
+
+  if (UINT16_MAX == _buckets[index]) {
+    _count = 0;
+    for (int i = 0; i < OPEN_STATS_BUCKETS; i++) {
+      _buckets[i] /= 2;
+      _count += _buckets[i];
+    }
+  }
+
+  _buckets[index]++;
+  _count++;
+}
+
+uint32_t QuantileSketch::count() const {
+  return _count;
+}
+
+/*
+Returns the middle of the bucket that holds the value at the quantile given
+in thousandths; 500 is the median. Returns zero if nothing was recorded.
+*/
+
+uint32_t QuantileSketch::quantile(uint16_t permille) const {
+  if (0 == _count) {
+    return 0;
+  }
+
+  uint32_t rank = (uint32_t) (((uint64_t) _count * permille + 999) / 1000);
+  uint32_t seen = 0;
+
+  if (0 == rank) {
+    rank = 1;
+  }
+
+  for (int i = 0; i < OPEN_STATS_BUCKETS; i++) {
+    seen += _buckets[i];
+    if (seen >= rank) {
+      return bucketLow(i) + ((bucketHigh(i) - bucketLow(i)) / 2);
+    }
+  }
+
+  return bucketLow(OPEN_STATS_BUCKETS - 1);
+}
+
+OpenStats::OpenStats()
+  :
+  _count(0),
+  _totalMillis(0),
+  _maxMillis(0),
+  _startedAt(0) {
+}
+
+void OpenStats::reset(uint64_t now) {
+  _sketch.reset();
+  _count = 0;
+  _totalMillis = 0;
+  _maxMillis = 0;
+  _startedAt = now;
+}
+
+void OpenStats::record(unsigned long durationMillis) {
+  _sketch.record((uint32_t) (durationMillis / 1000UL));
+  _count++;
+  _totalMillis += durationMillis;
+
+  if (durationMillis > _maxMillis) {
+    _maxMillis = durationMillis;
+  }
+}
+
+uint32_t OpenStats::count() const {
+  return _count;
+}
+
+unsigned long OpenStats::meanMillis() const {
+  if (0 == _count) {
+    return 0;
+  }
+  return (unsigned long) (_totalMillis / _count);
+}
+
+unsigned long OpenStats::maxMillis() const {
+  return _maxMillis;
+}
+
+/*
+The estimate is never more than the longest that the sensor has been open.
+*/
+
+unsigned long OpenStats::quantileMillis(uint16_t permille) const {
+  unsigned long result = (unsigned long) _sketch.quantile(permille) * 1000UL;
+  return result > _maxMillis ? _maxMillis : result;
+}
+
+/*
+Returns the number of times that the sensor was opened for each day since the
+statistics were reset, in tenths so that it can be printed without floating
+point. The time must include any time spent in deep sleep.
+*/
+
+uint32_t OpenStats::opensPerDayTenths(uint64_t now) const {
+  uint64_t elapsed = now - _startedAt;
+
+  if (0 == elapsed) {
+    return 0;
+  }
+
+  return (uint32_t) (((uint64_t) _count * OPEN_STATS_DAY_MILLIS * 10) / elapsed);
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#ifndef OPENSTATS_H
+#define OPENSTATS_H
+
+#include <stdint.h>
+
+// Durations are kept in seconds. Below `2^OPEN_STATS_SUB_BUCKET_BITS` seconds
+// each second has its own bucket; above that each doubling is split into
+// that many buckets so each bucket is within 12.5% of its neighbours. The
+// last bucket also counts anything longer than `2^OPEN_STATS_MAX_EXPONENT`
+// seconds; about 194 days.
+
+#define OPEN_STATS_SUB_BUCKET_BITS 3
+#define OPEN_STATS_SUB_BUCKETS (1 << OPEN_STATS_SUB_BUCKET_BITS)
+#define OPEN_STATS_MAX_EXPONENT 24
+#define OPEN_STATS_BUCKETS (OPEN_STATS_SUB_BUCKETS * (OPEN_STATS_MAX_EXPONENT - OPEN_STATS_SUB_BUCKET_BITS + 2))
+
+/*
+A sketch of a distribution in a fixed amount of memory from which quantiles
+can be estimated. Recording a value only finds its bucket from the position
+of its highest bit so it takes the same short time whatever has been
+recorded. A quantile is estimated to within the width of a bucket.
+*/
+
+class QuantileSketch {
+  public:
+    QuantileSketch();
+
+    void reset();
+    void record(uint32_t value);
+
+    uint32_t count() const;
+    uint32_t quantile(uint16_t permille) const;
+
+  private:
+    static int bucketIndex(uint32_t value);
+    static uint32_t bucketLow(int index);
+    static uint32_t bucketHigh(int index);
+
+  private:
+    uint16_t _buckets[OPEN_STATS_BUCKETS];
+    uint32_t _count;
+};
+
+/*
+These are statistics of how long the sensor is open for; updated each time
+that it closes. They are used to choose the settings such as how long the
+sensor may be open before a notification is sent.
+*/
+
+class OpenStats {
+  public:
+    OpenStats();
+
+    void reset(uint64_t now);
+    void record(unsigned long durationMillis);
+
+    uint32_t count() const;
+    unsigned long meanMillis() const;
+    unsigned long maxMillis() const;
+    unsigned long quantileMillis(uint16_t permille) const;
+    uint32_t opensPerDayTenths(uint64_t now) const;
+
+    template <class T> void printTo(T& stream, uint64_t now) const;
+
+  private:
+    QuantileSketch _sketch;
+    uint32_t _count;
+    uint64_t _totalMillis;
+    unsigned long _maxMillis;
+    uint64_t _startedAt;
+};
+
+template <class T>
+void OpenStats::printTo(T& stream, uint64_t now) const {
+  uint32_t perDayTenths = opensPerDayTenths(now);
+  stream.print("{openStats:{count:");
+  stream.print(count());
+  stream.print(",perDay:");
+  stream.print(perDayTenths / 10);
+  stream.print(".");
+  stream.print(perDayTenths % 10);
+  stream.print(",meanMillis:");
+  stream.print(meanMillis());
+  stream.print(",maxMillis:");
+  stream.print(maxMillis());
+  stream.print(",p50Millis:");
+  stream.print(quantileMillis(500));
+  stream.print(",p90Millis:");
+  stream.print(quantileMillis(900));
+  stream.print(",p99Millis:");
+  stream.print(quantileMillis(990));
+  stream.println("}}");
+}
+
+#endif // OPENSTATS_H
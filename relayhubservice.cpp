@@ -0,0 +1,256 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#include "relayhubservice.h"
+
+#include "constants.h"
+
+RelayHubService::RelayHubService(
+  const WifiSettings* wifiSettings,
+  const RelaySettings* relaySettings,
+  NotificationService* notificationService)
+  :
+  _wifiSettings(*wifiSettings),
+  _relaySettings(*relaySettings),
+  _notificationService(notificationService),
+  _listening(false),
+  _associating(false),
+  _associateStartedAt(0L),
+  _queueLength(0),
+  _queuedAt(0L),
+  _holdMillis(RELAY_HUB_BATCH_MILLIS),
+  _receivedCount(0),
+  _duplicateCount(0),
+  _batchCount(0),
+  _refusedCount(0) {
+}
+
+/*
+Any events that are still held are notified now so that they are not lost
+with the service; they have already been acknowledged. If they can not be
+delivered then they are lost.
+*/
+
+RelayHubService::~RelayHubService() {
+  if (0 != _queueLength) {
+    flush();
+  }
+  _udp.stop();
+}
+
+void RelayHubService::setNotificationService(NotificationService* value) {
+  _notificationService = value;
+}
+
+/*
+When the service is rebuilt with new settings, the new service takes over the
+events that the prior service has acknowledged but not yet notified, along
+with what it knows of the copies that the detectors may still send, so that
+none of them are lost or notified twice. The prior service is left empty.
+*/
+
+void RelayHubService::takeOver(RelayHubService* prior) {
+  memcpy(_queue, prior->_queue, sizeof(RelayEvent) * prior->_queueLength);
+  _queueLength = prior->_queueLength;
+  _queuedAt = prior->_queuedAt;
+  _holdMillis = prior->_holdMillis;
+  _duplicates = prior->_duplicates;
+  _receivedCount = prior->_receivedCount;
+  _duplicateCount = prior->_duplicateCount;
+  _batchCount = prior->_batchCount;
+  _refusedCount = prior->_refusedCount;
+  prior->_queueLength = 0;
+}
+
+/*
+The Wifi module can not hear the detectors while the board is in deep sleep
+so a hub stays awake.
+*/
+
+bool RelayHubService::allowedToShortSleep() {
+  return false;
+}
+
+int RelayHubService::queueLength() const {
+  return _queueLength;
+}
+
+uint32_t RelayHubService::receivedCount() const {
+  return _receivedCount;
+}
+
+uint32_t RelayHubService::duplicateCount() const {
+  return _duplicateCount;
+}
+
+uint32_t RelayHubService::batchCount() const {
+  return _batchCount;
+}
+
+uint32_t RelayHubService::refusedCount() const {
+  return _refusedCount;
+}
+
+void RelayHubService::pulse() {
+  if (WL_CONNECTED != WiFi.status()) {
+    if (_listening) {
+      _udp.stop();
+      _listening = false;
+    }
+    associate();
+    return;
+  }
+
+  _associating = false;
+
+  if (!_listening) {
+    _listening = 1 == _udp.begin(_relaySettings.port());
+
+#ifdef SERIAL_ENABLED
+    Serial.print(_listening ? "relay hub is listening on port [" : "relay hub is unable to listen on port [");
+    Serial.print(_relaySettings.port());
+    Serial.println("]");
+#endif
+  }
+
+  if (_listening) {
+    receive();
+  }
+
+  if (0 != _queueLength && (millis() - _queuedAt) >= _holdMillis) {
+    flush();
+  }
+}
+
+/*
+The association is started and then left to complete while the board goes
+around the loop. If it has not completed in time it is started again.
+*/
+
+// private
+void RelayHubService::associate() {
+  if (_associating && (millis() - _associateStartedAt) < DELAY_WIFI_CONNECT_MILLIS) {
+    return;
+  }
+
+#ifdef SERIAL_ENABLED
+  Serial.print("relay hub will open wifi to ssid [");
+  Serial.print(_wifiSettings.ssid());
+  Serial.println("]");
+#endif
+
+  WiFi.begin(_wifiSettings.ssid(), _wifiSettings.passphrase());
+  _associating = true;
+  _associateStartedAt = millis();
+}
+
+// private
+void RelayHubService::receive() {
+  while (_udp.parsePacket() > 0) {
+    int length = _udp.read(_packet, sizeof(_packet));
+    RelayEvent event;
+
+    if (length <= 0 || !RelayProtocol::decodeEvent(_packet, length, &event)) {
+#ifdef SERIAL_ENABLED
+      Serial.println("relay hub ignored a packet that is not an event");
+#endif
+      continue;
+    }
+
+    _receivedCount++;
+
+    // a copy of an event that is already held or notified is acknowledged
+    // again without needing room for it.
+
+    if (_duplicates.isDuplicate(event)) {
+      acknowledge(event);
+      _duplicateCount++;
+      continue;
+    }
+
+    // a full queue is flushed early to make room unless it is waiting to
+    // retry a delivery that failed; the gateway is not tried again for each
+    // event that arrives in the meantime.
+
+    if (RELAY_HUB_QUEUE_LENGTH == _queueLength
+        && ((RELAY_HUB_RETRY_MILLIS == _holdMillis && (millis() - _queuedAt) < _holdMillis)
+          || !flush())) {
+#ifdef SERIAL_ENABLED
+      Serial.println("relay hub has no room for the event; it is not acknowledged");
+#endif
+      _refusedCount++;
+      continue;
+    }
+
+    acknowledge(event);
+    _duplicates.admit(event);
+
+#ifdef SERIAL_ENABLED
+    Serial.print("relay hub received an event from [");
+    Serial.print(event.description);
+    Serial.println("]");
+#endif
+
+    enqueue(event);
+  }
+}
+
+/*
+The acknowledgement goes back to wherever the event came from.
+*/
+
+// private
+void RelayHubService::acknowledge(const RelayEvent& event) {
+  RelayAck ack;
+  uint8_t packet[RELAY_ACK_PACKET_LENGTH];
+
+  ack.detectorId = event.detectorId;
+  ack.boot = event.boot;
+  ack.sequence = event.sequence;
+
+  size_t length = RelayProtocol::encodeAck(ack, packet, sizeof(packet));
+
+  if (1 == _udp.beginPacket(_udp.remoteIP(), _udp.remotePort())) {
+    _udp.write(packet, length);
+    _udp.endPacket();
+  }
+}
+
+/*
+The batch is timed from the first event that is held. There is always room
+for the event; see `receive()`.
+*/
+
+// private
+void RelayHubService::enqueue(const RelayEvent& event) {
+  if (0 == _queueLength) {
+    _queuedAt = millis();
+    _holdMillis = RELAY_HUB_BATCH_MILLIS;
+  }
+
+  memcpy(&_queue[_queueLength++], &event, sizeof(RelayEvent));
+}
+
+/*
+Hands the events that are held to the notification service. Returns true if
+they were delivered. Otherwise they are held for `RELAY_HUB_RETRY_MILLIS`
+before they are tried again.
+*/
+
+// private
+bool RelayHubService::flush() {
+  _batchCount++;
+
+  if (NULL != _notificationService && _notificationService->notifyRelayed(_queue, _queueLength)) {
+    _queueLength = 0;
+    return true;
+  }
+
+#ifdef SERIAL_ENABLED
+  Serial.println("relay hub was unable to notify the events; will try again later");
+#endif
+  _queuedAt = millis();
+  _holdMillis = RELAY_HUB_RETRY_MILLIS;
+  return false;
+}
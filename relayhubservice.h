@@ -0,0 +1,74 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#ifndef RELAYHUBSERVICE_H
+#define RELAYHUBSERVICE_H
+
+#include <Arduino.h>
+#include <WiFiNINA.h>
+
+#include "notificationservice.h"
+#include "relayprotocol.h"
+#include "settings.h"
+
+/*
+On a hub, this service stays on the Wifi and listens for the events that
+detectors relay to it. Each event is acknowledged as soon as it arrives if
+there is room to hold it; from then on it is the hub's to notify. A detector
+that missed the acknowledgement sends the event again so copies are filtered
+out. The events are held for a short time so that those arriving close
+together are handed to the notification service together and share a
+session with the gateway. Events that the notification service could not
+deliver are held and tried again later; while they fill the queue, further
+events are not acknowledged so that the detectors keep them instead.
+*/
+
+class RelayHubService {
+  public:
+    RelayHubService(
+      const WifiSettings* wifiSettings,
+      const RelaySettings* relaySettings,
+      NotificationService* notificationService);
+    virtual ~RelayHubService();
+
+    void setNotificationService(NotificationService* value);
+    void takeOver(RelayHubService* prior);
+
+    void pulse();
+    bool allowedToShortSleep();
+
+    int queueLength() const;
+    uint32_t receivedCount() const;
+    uint32_t duplicateCount() const;
+    uint32_t batchCount() const;
+    uint32_t refusedCount() const;
+
+  private:
+    void associate();
+    void receive();
+    void acknowledge(const RelayEvent& event);
+    void enqueue(const RelayEvent& event);
+    bool flush();
+
+  private:
+    WifiSettings _wifiSettings;
+    RelaySettings _relaySettings;
+    NotificationService* _notificationService;
+    WiFiUDP _udp;
+    bool _listening;
+    bool _associating;
+    unsigned long _associateStartedAt;
+    RelayDuplicateFilter _duplicates;
+    RelayEvent _queue[RELAY_HUB_QUEUE_LENGTH];
+    int _queueLength;
+    unsigned long _queuedAt;
+    unsigned long _holdMillis;
+    uint8_t _packet[RELAY_EVENT_PACKET_MAX_LENGTH + 1];
+    uint32_t _receivedCount;
+    uint32_t _duplicateCount;
+    uint32_t _batchCount;
+    uint32_t _refusedCount;
+};
+
+#endif // RELAYHUBSERVICE_H
@@ -0,0 +1,222 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#include "relayprotocol.h"
+
+#include <string.h>
+
+#define RELAY_FLAG_OPEN 0x01
+#define RELAY_WINDOW_BITS 32
+
+static void putUint16(uint8_t* data, uint16_t value) {
+  data[0] = (uint8_t) value;
+  data[1] = (uint8_t) (value >> 8);
+}
+
+static void putUint32(uint8_t* data, uint32_t value) {
+  putUint16(data, (uint16_t) value);
+  putUint16(&data[2], (uint16_t) (value >> 16));
+}
+
+static uint16_t getUint16(const uint8_t* data) {
+  return (uint16_t) data[0] | ((uint16_t) data[1] << 8);
+}
+
+static uint32_t getUint32(const uint8_t* data) {
+  return (uint32_t) getUint16(data) | ((uint32_t) getUint16(&data[2]) << 16);
+}
+
+static bool isPacket(const uint8_t* packet, size_t length, RelayPacketType type) {
+  return length >= 3
+    && RELAY_PACKET_MAGIC == packet[0]
+    && RELAY_PACKET_VERSION == packet[1]
+    && type == packet[2];
+}
+
+/*
+Returns the length of the packet or zero if it does not fit. A description
+that is too long is cut short.
+*/
+
+/*static*/
+size_t RelayProtocol::encodeEvent(const RelayEvent& event, uint8_t* packet, size_t length) {
+  size_t descriptionLength = strnlen(event.description, RELAY_DESCRIPTION_MAX_LENGTH);
+
+  if (length < RELAY_EVENT_HEADER_LENGTH + descriptionLength) {
+    return 0;
+  }
+
+  packet[0] = RELAY_PACKET_MAGIC;
+  packet[1] = RELAY_PACKET_VERSION;
+  packet[2] = RELAY_PACKET_EVENT;
+  packet[3] = event.kind;
+  packet[4] = event.open ? RELAY_FLAG_OPEN : 0;
+  putUint32(&packet[5], event.detectorId);
+  putUint16(&packet[9], event.boot);
+  putUint16(&packet[11], event.sequence);
+  putUint32(&packet[13], event.openDurationSeconds);
+  putUint16(&packet[17], event.openCount);
+  putUint16(&packet[19], event.suppressedCount);
+  packet[21] = (uint8_t) descriptionLength;
+  memcpy(&packet[RELAY_EVENT_HEADER_LENGTH], event.description, descriptionLength);
+
+  return RELAY_EVENT_HEADER_LENGTH + descriptionLength;
+}
+
+/*static*/
+bool RelayProtocol::decodeEvent(const uint8_t* packet, size_t length, RelayEvent* event) {
+  if (length < RELAY_EVENT_HEADER_LENGTH || !isPacket(packet, length, RELAY_PACKET_EVENT)) {
+    return false;
+  }
+
+  size_t descriptionLength = packet[21];
+
+  if (packet[3] >= RELAY_EVENT_KIND_COUNT
+      || descriptionLength > RELAY_DESCRIPTION_MAX_LENGTH
+      || length != RELAY_EVENT_HEADER_LENGTH + descriptionLength) {
+    return false;
+  }
+
+  event->kind = packet[3];
+  event->open = 0 != (packet[4] & RELAY_FLAG_OPEN);
+  event->detectorId = getUint32(&packet[5]);
+  event->boot = getUint16(&packet[9]);
+  event->sequence = getUint16(&packet[11]);
+  event->openDurationSeconds = getUint32(&packet[13]);
+  event->openCount = getUint16(&packet[17]);
+  event->suppressedCount = getUint16(&packet[19]);
+  memcpy(event->description, &packet[RELAY_EVENT_HEADER_LENGTH], descriptionLength);
+  event->description[descriptionLength] = 0;
+
+  return true;
+}
+
+/*static*/
+size_t RelayProtocol::encodeAck(const RelayAck& ack, uint8_t* packet, size_t length) {
+  if (length < RELAY_ACK_PACKET_LENGTH) {
+    return 0;
+  }
+
+  packet[0] = RELAY_PACKET_MAGIC;
+  packet[1] = RELAY_PACKET_VERSION;
+  packet[2] = RELAY_PACKET_ACK;
+  packet[3] = 0;
+  putUint32(&packet[4], ack.detectorId);
+  putUint16(&packet[8], ack.boot);
+  putUint16(&packet[10], ack.sequence);
+
+  return RELAY_ACK_PACKET_LENGTH;
+}
+
+/*static*/
+bool RelayProtocol::decodeAck(const uint8_t* packet, size_t length, RelayAck* ack) {
+  if (RELAY_ACK_PACKET_LENGTH != length || !isPacket(packet, length, RELAY_PACKET_ACK)) {
+    return false;
+  }
+
+  ack->detectorId = getUint32(&packet[4]);
+  ack->boot = getUint16(&packet[8]);
+  ack->sequence = getUint16(&packet[10]);
+
+  return true;
+}
+
+RelayDuplicateFilter::RelayDuplicateFilter() {
+  clear();
+}
+
+void RelayDuplicateFilter::clear() {
+  memset(_windows, 0, sizeof(_windows));
+  _clock = 0;
+}
+
+/*
+Returns true if the event has not been seen before. The sequence wraps
+around so it is compared by the signed difference from the highest sequence
+seen. An event older than the window can not be told apart from a duplicate
+so it is treated as one; a detector only ever has one event in flight so this
+would only happen to a copy that was delayed for a very long time.
+*/
+
+bool RelayDuplicateFilter::admit(const RelayEvent& event) {
+  RelayDetectorWindow& w = window(event.detectorId);
+
+  w.usedAt = ++_clock;
+
+  if (!w.used || w.boot != event.boot) {
+    w.used = true;
+    w.detectorId = event.detectorId;
+    w.boot = event.boot;
+    w.highestSequence = event.sequence;
+    w.seen = 1;
+    return true;
+  }
+
+  int16_t ahead = (int16_t) (event.sequence - w.highestSequence);
+
+  if (ahead > 0) {
+    w.seen = ahead >= RELAY_WINDOW_BITS ? 0 : w.seen << ahead;
+    w.seen |= 1;
+    w.highestSequence = event.sequence;
+    return true;
+  }
+
+  int behind = -ahead;
+
+  if (behind >= RELAY_WINDOW_BITS || 0 != (w.seen & (1UL << behind))) {
+    return false;
+  }
+
+  w.seen |= 1UL << behind;
+  return true;
+}
+
+/*
+Returns true if the event has been seen before, as for `admit()`, but without
+remembering the event.
+*/
+
+bool RelayDuplicateFilter::isDuplicate(const RelayEvent& event) const {
+  for (int i = 0; i < RELAY_DUPLICATE_FILTER_CAPACITY; i++) {
+    const RelayDetectorWindow& w = _windows[i];
+
+    if (w.used && w.detectorId == event.detectorId) {
+      int16_t ahead = (int16_t) (event.sequence - w.highestSequence);
+
+      if (w.boot != event.boot || ahead > 0) {
+        return false;
+      }
+
+      int behind = -ahead;
+      return behind >= RELAY_WINDOW_BITS || 0 != (w.seen & (1UL << behind));
+    }
+  }
+
+  return false;
+}
+
+/*
+Finds the window for the detector. If the detector has not been seen then the
+window that was used least recently is taken over for it.
+*/
+
+// private
+RelayDetectorWindow& RelayDuplicateFilter::window(uint32_t detectorId) {
+  int chosen = 0;
+
+  for (int i = 0; i < RELAY_DUPLICATE_FILTER_CAPACITY; i++) {
+    RelayDetectorWindow& w = _windows[i];
+
+    if (w.used && w.detectorId == detectorId) {
+      return w;
+    }
+    if (_windows[chosen].used
+        && (!w.used || w.usedAt < _windows[chosen].usedAt)) {
+      chosen = i;
+    }
+  }
+
+  _windows[chosen].used = false;
+  return _windows[chosen];
+}
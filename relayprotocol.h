@@ -0,0 +1,129 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#ifndef RELAYPROTOCOL_H
+#define RELAYPROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RELAY_PACKET_MAGIC 0xD5
+#define RELAY_PACKET_VERSION 1
+
+#define RELAY_DESCRIPTION_MAX_LENGTH 32
+#define RELAY_EVENT_HEADER_LENGTH 22
+#define RELAY_EVENT_PACKET_MAX_LENGTH (RELAY_EVENT_HEADER_LENGTH + RELAY_DESCRIPTION_MAX_LENGTH)
+#define RELAY_ACK_PACKET_LENGTH 12
+
+// This is how many detectors a hub can tell apart at once when it filters out
+// duplicates. Beyond this, the detector heard from least recently is
+// forgotten.
+
+#define RELAY_DUPLICATE_FILTER_CAPACITY 64
+
+enum RelayPacketType {
+  RELAY_PACKET_EVENT = 1,
+  RELAY_PACKET_ACK = 2
+};
+
+enum RelayEventKind {
+  RELAY_EVENT_OPEN,
+  RELAY_EVENT_STILL_OPEN,
+  RELAY_EVENT_CLOSE,
+  RELAY_EVENT_FLAPPING,
+  RELAY_EVENT_SETTLED,
+  RELAY_EVENT_KIND_COUNT
+};
+
+/*
+This is an event that a detector forwards to a hub for the hub to notify. A
+detector is identified by `detectorId` and numbers its events with
+`sequence`. Because the sequence starts again when a detector restarts, each
+start of a detector also picks a new `boot` so that the events after the
+restart are not mistaken for duplicates of those before it. The description
+of the detector travels with the event so that the hub's message can name
+it.
+*/
+
+struct RelayEvent {
+  uint32_t detectorId;
+  uint16_t boot;
+  uint16_t sequence;
+  uint8_t kind;
+  bool open;
+  uint32_t openDurationSeconds;
+  uint16_t openCount;
+  uint16_t suppressedCount;
+  char description[RELAY_DESCRIPTION_MAX_LENGTH + 1];
+};
+
+/*
+An acknowledgement names the event that it acknowledges.
+*/
+
+struct RelayAck {
+  uint32_t detectorId;
+  uint16_t boot;
+  uint16_t sequence;
+};
+
+/*
+The packets are small and of a fixed layout with the values little-endian.
+An event packet is;
+
+  magic, version, type, kind, flags, detectorId[4], boot[2], sequence[2],
+  openDurationSeconds[4], openCount[2], suppressedCount[2], length,
+  description[length]
+
+An acknowledgement packet is;
+
+  magic, version, type, 0, detectorId[4], boot[2], sequence[2]
+
+Anything that does not have this form is not decoded; other equipment on the
+same network may well send packets to the same port.
+*/
+
+class RelayProtocol {
+  public:
+    static size_t encodeEvent(const RelayEvent& event, uint8_t* packet, size_t length);
+    static bool decodeEvent(const uint8_t* packet, size_t length, RelayEvent* event);
+
+    static size_t encodeAck(const RelayAck& ack, uint8_t* packet, size_t length);
+    static bool decodeAck(const uint8_t* packet, size_t length, RelayAck* ack);
+};
+
+/*
+The hub acknowledges every event that it receives but a detector that did
+not hear the acknowledgement will send the event again. This remembers, for
+each detector, the highest sequence seen and which of the 32 sequences
+before it were seen so that each event is only notified once even if the
+copies arrive out of order.
+*/
+
+struct RelayDetectorWindow {
+  uint32_t detectorId;
+  uint16_t boot;
+  uint16_t highestSequence;
+  uint32_t seen;
+  uint32_t usedAt;
+  bool used;
+};
+
+class RelayDuplicateFilter {
+  public:
+    RelayDuplicateFilter();
+
+    bool admit(const RelayEvent& event);
+    bool isDuplicate(const RelayEvent& event) const;
+    void clear();
+
+  private:
+    RelayDetectorWindow& window(uint32_t detectorId);
+
+  private:
+    RelayDetectorWindow _windows[RELAY_DUPLICATE_FILTER_CAPACITY];
+    uint32_t _clock;
+};
+
+#endif // RELAYPROTOCOL_H
@@ -0,0 +1,56 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#include "retainedstate.h"
+
+#include <stddef.h>
+
+#include "common.h"
+
+// The layout version is folded into the magic number so that a snapshot saved
+// by firmware with a different `RetainedSensorSnapshot` or different values in
+// the enums that it holds is not resumed from after an update. Increment the
+// version when either changes.
+
+#define RETAINED_STATE_LAYOUT_VERSION 4
+#define RETAINED_STATE_MAGIC (0x5E750A00 | RETAINED_STATE_LAYOUT_VERSION)
+
+struct RetainedStateRecord {
+  uint32_t magic;
+  RetainedSensorSnapshot snapshot;
+  uint32_t crc;
+};
+
+// The `.noinit` section is not zeroed by the start-up code so the record
+// survives a reset that does not remove power from the board.
+
+static RetainedStateRecord retainedStateRecord __attribute__ ((section (".noinit")));
+
+static uint32_t retainedStateCrc() {
+  return Common::crc32(
+    (const uint8_t*) &retainedStateRecord,
+    offsetof(RetainedStateRecord, crc));
+}
+
+/*
+Copies the retained snapshot into `snapshot` and returns true if there is a
+valid snapshot to resume from.
+*/
+
+/*static*/
+bool RetainedState::load(RetainedSensorSnapshot* snapshot) {
+  if (RETAINED_STATE_MAGIC != retainedStateRecord.magic
+    || retainedStateCrc() != retainedStateRecord.crc) {
+    return false;
+  }
+  memcpy(snapshot, &retainedStateRecord.snapshot, sizeof(RetainedSensorSnapshot));
+  return true;
+}
+
+/*static*/
+void RetainedState::save(const RetainedSensorSnapshot* snapshot) {
+  retainedStateRecord.magic = RETAINED_STATE_MAGIC;
+  memcpy(&retainedStateRecord.snapshot, snapshot, sizeof(RetainedSensorSnapshot));
+  retainedStateRecord.crc = retainedStateCrc();
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#ifndef RETAINEDSTATE_H
+#define RETAINEDSTATE_H
+
+#include <Arduino.h>
+
+enum PendingNotification {
+  PENDING_NOTIFICATION_NONE,
+  PENDING_NOTIFICATION_OPEN,
+  PENDING_NOTIFICATION_STILL_OPEN,
+  PENDING_NOTIFICATION_CLOSE,
+  PENDING_NOTIFICATION_FLAPPING,
+  PENDING_NOTIFICATION_SETTLED
+};
+
+/*
+This is a snapshot of the sensor service's state that is able to survive a
+reset of the board. It holds the state in a form that does not depend on
+`millis()` because that restarts from zero after a reset; the times at which
+the sensor was opened and last notified are kept as durations instead. The
+`phase` is a `SensorPhase`. The close of a sensor whose opening was notified
+is never dropped so `openNotified` is kept too. A change to this struct or to those enums needs
+the layout version in `retainedstate.cpp` to be incremented.
+*/
+
+struct RetainedSensorSnapshot {
+  uint8_t phase;
+  uint8_t pendingNotification;
+  uint8_t reminderCount;
+  uint8_t openNotified;
+  unsigned long openForMillis;
+  unsigned long notifiedForMillis;
+};
+
+/*
+A watchdog or brown-out reset will re-run `setup()` but it does not power
+down the RAM. This class keeps a single snapshot in a section of RAM that is
+not initialized by the C runtime at start-up so that, after such a reset, the
+firmware is able to carry on where it left off. The snapshot is protected
+with a magic number and a CRC so that the random content of the RAM after a
+power-on, or a snapshot that was only partially written, is not used.
+*/
+
+class RetainedState {
+  public:
+    static bool load(RetainedSensorSnapshot* snapshot);
+    static void save(const RetainedSensorSnapshot* snapshot);
+};
+
+#endif // RETAINEDSTATE_H
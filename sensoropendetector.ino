@@ -6,29 +6,63 @@
 #include <WiFiNINA.h>
 
 #include "ArduinoLowPower.h"
+#include "RTCZero.h"
 
+#include "armingschedule.h"
 #include "constants.h"
+#include "consoleline.h"
 #include "debouncedigitalinput.h"
+#include "eventbus.h"
+#include "inputsampler.h"
 #include "sensorservice.h"
 #include "notificationservice.h"
 #include "settingsservice.h"
+#include "settingseditor.h"
 #include "indicatorservice.h"
+#include "relayhubservice.h"
+#include "retainedstate.h"
+#include "energygovernor.h"
+#include "historylog.h"
+#include "historysync.h"
+#include "latencytrace.h"
+#include "monotonicclock.h"
+#include "wallclock.h"
 
 #include "staticsettings.h"
 
+// After the settings have been saved, moving the state machine to `RELOAD`
+// will apply the new settings to the running services.
+
 enum StateMachine {
   START,
+  RELOAD,
   WATCH
 };
 
 int wifiStatus = WL_IDLE_STATUS;
+EventBus* eventBus = NULL;
+int notificationSubscriber = EVENT_BUS_NO_SUBSCRIBER;
+int consoleSubscriber = EVENT_BUS_NO_SUBSCRIBER;
+ConsoleLine consoleLine;
+SettingsEditor* settingsEditor = NULL;
+bool consoleTestPending = false;
+uint32_t sensorEdgeCount = 0;
+uint32_t buttonEdgeCount = 0;
 SettingsService* settingsService = NULL;
+const Settings* activeSettings = NULL;
 NotificationService* notificationService = NULL;
 SensorService* sensorService = NULL;
 IndicatorService* indicatorService = NULL;
+RelayHubService* relayHubService = NULL;
+HistorySync* historySync = NULL;
 DebouncedDigitalInput* buttonInput = NULL;
 DebouncedDigitalInput* sensorInput = NULL;
+InputSampler* inputSampler = NULL;
+bool sensorArmed = true;
 StateMachine stateMachine = START;
+EnergyGovernor* energyGovernor = NULL;
+uint64_t energyAccountedMillis = 0L;
+RTCZero rtc;
 
 void printWiFiStatus() {
 #ifdef SERIAL_ENABLED
@@ -78,23 +112,205 @@ void setupWifi() {
   }
 }
 
-void setupServices() {
+/*
+Returns true if anything that the notification service is built from differs
+between the two settings.
+*/
+
+bool notificationSettingsDiffer(const Settings* settings, const Settings* otherSettings) {
+  return settings->notificationMethod() != otherSettings->notificationMethod()
+    || 0 != strcmp(settings->description(), otherSettings->description())
+    || *(settings->wifiSettings()) != *(otherSettings->wifiSettings())
+    || *(settings->threemaSettings()) != *(otherSettings->threemaSettings())
+    || *(settings->messageSettings()) != *(otherSettings->messageSettings())
+    || *(settings->relaySettings()) != *(otherSettings->relaySettings())
+    || *(settings->deliverySettings()) != *(otherSettings->deliverySettings());
+}
+
+/*
+The sensor wakes the board through the interrupt on its pin unless the
+monitoring settings have it sampled instead; for a sensor that is wired to a
+pin without a "low power" wake up interrupt. While the sensor is disarmed it
+does neither so that it is unable to wake the board at all.
+*/
+
+void applySensorWake(const MonitoringSettings* monitoringSettings) {
+  int sampleSeconds = max(0, monitoringSettings->sampleSeconds());
+
+  inputSampler->setIntervalSeconds((uint32_t) sampleSeconds);
+
+  if (sensorArmed && 0 == sampleSeconds) {
+    inputSampler->remove(sensorInput);
+    LowPower.attachInterruptWakeup(PIN_SENSOR, awakeFromSensor, CHANGE);
+  } else {
+    detachInterrupt(digitalPinToInterrupt(PIN_SENSOR));
+    if (sensorArmed) {
+      inputSampler->add(sensorInput);
+    } else {
+      inputSampler->remove(sensorInput);
+    }
+  }
+}
+
+/*
+Returns true if the sensor should be watched at the time according to the
+arming windows of the settings. Until the board has learned the time of day
+the sensor is always watched.
+*/
+
+bool isScheduledArmed(const MonitoringSettings* monitoringSettings, uint64_t now) {
+  if (!WallClock::isKnown()) {
+    return true;
+  }
+
+  return ArmingSchedule::isArmed(
+    monitoringSettings->armingWindows(),
+    monitoringSettings->armingWindowCount(),
+    monitoringSettings->utcOffsetMinutes(),
+    WallClock::now(now));
+}
+
+/*
+Returns the time at which the next arming window starts or ends so that the
+board can be woken for it or zero if there is no such time.
+*/
+
+uint64_t armingBoundaryAt(const MonitoringSettings* monitoringSettings, uint64_t now) {
+  if (!WallClock::isKnown()) {
+    return 0;
+  }
+
+  uint32_t seconds = ArmingSchedule::secondsToBoundary(
+    monitoringSettings->armingWindows(),
+    monitoringSettings->armingWindowCount(),
+    monitoringSettings->utcOffsetMinutes(),
+    WallClock::now(now));
+
+  return 0 == seconds ? 0 : now + (uint64_t) seconds * 1000UL;
+}
+
+/*
+Brings the services into line with the settings from the settings service.
+The settings are compared with those that the services were last built from
+and only those services that are affected by a change are rebuilt. This means
+that, for example, changing a recipient will not lose the state of the sensor.
+*/
+
+void applySettings() {
   if (NULL == indicatorService) {
-    indicatorService = new IndicatorService(PIN_LED);
+    indicatorService = new IndicatorService(PIN_LED, eventBus);
+  }
+
+  const Settings* settings = settingsService->load();
+
+  if (NULL == settings) {
+#ifdef SERIAL_ENABLED
+    Serial.println("no settings to apply");
+#endif
+    return;
   }
-  if (NULL == notificationService || NULL == sensorService) {
-    Settings* settings = settingsService->load();
-    if (NULL == notificationService) {
-      notificationService = createNotificationService(settings);
+
+  if (NULL == notificationService
+      || NULL == activeSettings
+      || notificationSettingsDiffer(settings, activeSettings)) {
+#ifdef SERIAL_ENABLED
+    Serial.println("will rebuild the notification service");
+#endif
+    NotificationService* priorNotificationService = notificationService;
+    notificationService = createNotificationService(settings);
+
+    // a notification that the prior service was holding back is carried over
+    // to the new service; otherwise it is sent as the prior service is
+    // deleted.
+
+    if (NULL != priorNotificationService) {
+      notificationService->takeOver(priorNotificationService);
     }
-    if (NULL == sensorService) {
-      sensorService = new SensorService(
-        new MonitoringSettings(settings->monitoringSettings()),
-        notificationService,
-        indicatorService
-      );
+    if (NULL != relayHubService) {
+      relayHubService->setNotificationService(notificationService);
+    }
+    delete priorNotificationService;
+  }
+
+  // the history is only synced if there is a collector to sync it to.
+
+  if (NULL == activeSettings
+      || 0 != strcmp(settings->description(), activeSettings->description())
+      || *(settings->collectorSettings()) != *(activeSettings->collectorSettings())) {
+    delete historySync;
+    historySync = NULL;
+
+    if (settings->collectorSettings()->isEnabled()) {
+#ifdef SERIAL_ENABLED
+      Serial.println("will sync the history to the collector");
+#endif
+      historySync = new HistorySync(
+        settings->description(),
+        settings->collectorSettings(),
+        energyGovernor);
     }
-    delete settings;
+  }
+
+  notificationService->setHistorySync(historySync);
+
+  // a board is only a hub if its relay settings say so.
+
+  if (NULL == activeSettings
+      || *(settings->relaySettings()) != *(activeSettings->relaySettings())
+      || *(settings->wifiSettings()) != *(activeSettings->wifiSettings())) {
+    RelayHubService* priorRelayHubService = relayHubService;
+    relayHubService = NULL;
+
+    // the events that a prior hub has acknowledged are carried over to the
+    // new hub; otherwise they are notified as the prior hub is deleted.
+
+    if (settings->relaySettings()->isHub()) {
+#ifdef SERIAL_ENABLED
+      Serial.println("will act as a relay hub");
+#endif
+      relayHubService = new RelayHubService(
+        settings->wifiSettings(),
+        settings->relaySettings(),
+        notificationService);
+      if (NULL != priorRelayHubService) {
+        relayHubService->takeOver(priorRelayHubService);
+      }
+    }
+
+    delete priorRelayHubService;
+  }
+
+  if (NULL == sensorService) {
+    sensorService = new SensorService(
+      new MonitoringSettings(*(settings->monitoringSettings())),
+      eventBus
+    );
+    postInputState(BUS_INPUT_SENSOR, sensorInput->getState());
+    applySensorWake(settings->monitoringSettings());
+
+    // if the board was reset without losing power then carry on from where
+    // it was before the reset.
+
+    RetainedSensorSnapshot snapshot;
+    if (RetainedState::load(&snapshot)) {
+      sensorService->resume(snapshot);
+    }
+  }
+  else {
+    if (*(settings->monitoringSettings()) != *(activeSettings->monitoringSettings())) {
+#ifdef SERIAL_ENABLED
+      Serial.println("will apply changed monitoring settings");
+#endif
+      sensorService->setMonitoringSettings(
+        new MonitoringSettings(*(settings->monitoringSettings())));
+      applySensorWake(settings->monitoringSettings());
+    }
+  }
+
+  activeSettings = settings;
+
+  if (NULL != settingsEditor) {
+    settingsEditor->applied();
   }
 }
 
@@ -108,18 +324,40 @@ void setup() {
 
   pinMode(PIN_LED, OUTPUT);
 
+  eventBus = new EventBus();
+  notificationSubscriber = eventBus->subscribe(BUS_EVENT_MASK(BUS_EVENT_NOTIFY_DUE));
+
   pinMode(PIN_SENSOR, INPUT_PULLUP);
-  LowPower.attachInterruptWakeup(PIN_SENSOR, awakeFromSleep, CHANGE);
+  LowPower.attachInterruptWakeup(PIN_SENSOR, awakeFromSensor, CHANGE);
   sensorInput = new DebouncedDigitalInput(PIN_SENSOR);
 
   pinMode(PIN_BUTTON, INPUT_PULLUP);
-  LowPower.attachInterruptWakeup(PIN_BUTTON, awakeFromSleep, CHANGE);
+  LowPower.attachInterruptWakeup(PIN_BUTTON, awakeFromButton, CHANGE);
   buttonInput = new DebouncedDigitalInput(PIN_BUTTON);
 
+  inputSampler = new InputSampler();
+
   setupWifi();
 
+  // the RTC keeps running in deep sleep so it can measure the time asleep
+  rtc.begin();
+  MonotonicClock::begin(&rtc);
+  HistoryLog::begin();
+  energyAccountedMillis = MonotonicClock::now();
+
+  if (0 < ENERGY_DAILY_BUDGET_MAH) {
+    energyGovernor = new EnergyGovernor(
+      EnergyModel(),
+      (uint64_t) ENERGY_DAILY_BUDGET_MAH * 3600UL * 1000UL);
+  }
+
   settingsService = new InMemorySettingsService();
-  settingsService->save(STATICSETTINGS);
+  settingsService->save(&STATICSETTINGS);
+  settingsEditor = new SettingsEditor(settingsService, STATICSETTINGS);
+#ifdef SERIAL_ENABLED
+  consoleSubscriber = eventBus->subscribe(
+      BUS_EVENT_MASK(BUS_EVENT_NOTIFY_RESULT) | BUS_EVENT_MASK(BUS_EVENT_EDGE));
+#endif
   sensorService = NULL;
   notificationService = NULL;
 
@@ -128,13 +366,22 @@ void setup() {
 #endif
 }
 
-NotificationService* createNotificationService(Settings* settings) {
-  switch (settings->notificationMethod()) {
+NotificationService* createNotificationService(const Settings* settings, NotificationMethod method) {
+  switch (method) {
     case THREEMA:
       return new ThreemaNotificationService(
         settings->description(),
         settings->wifiSettings(),
-        settings->threemaSettings()
+        settings->threemaSettings(),
+        settings->messageSettings(),
+        energyGovernor
+      );
+    case RELAY:
+      return new RelayNotificationService(
+        settings->description(),
+        settings->wifiSettings(),
+        settings->relaySettings(),
+        energyGovernor
       );
     case LOG:
       return new LogNotificationService();
@@ -146,20 +393,325 @@ NotificationService* createNotificationService(Settings* settings) {
   }
 }
 
+/*
+With delivery settings, the service for the notification method is wrapped
+together with those of the fallback methods so that each notification can
+fall back to them.
+*/
+
+NotificationService* createNotificationService(const Settings* settings) {
+  const DeliverySettings* deliverySettings = settings->deliverySettings();
+
+  if (!deliverySettings->isEnabled()) {
+    return createNotificationService(settings, settings->notificationMethod());
+  }
+
+  FallbackNotificationService* fallbackService = new FallbackNotificationService(deliverySettings);
+  fallbackService->addService(createNotificationService(settings, settings->notificationMethod()));
+
+  for (int i = 0; i < deliverySettings->fallbackCount(); i++) {
+    if (!fallbackService->addService(createNotificationService(settings, deliverySettings->fallbackMethod(i)))) {
+#ifdef SERIAL_ENABLED
+      Serial.println("too many fallback notification methods; the rest are ignored");
+#endif
+      break;
+    }
+  }
+
+  return fallbackService;
+}
+
+void postInputState(BusInput input, bool state) {
+  BusEvent event;
+  memset(&event, 0, sizeof(BusEvent));
+  event.type = BUS_EVENT_INPUT_STATE;
+  event.input = input;
+  event.value = state;
+  event.at = MonotonicClock::now();
+  eventBus->post(event);
+}
+
+void handleEventBus() {
+  eventBus->pump(MonotonicClock::now());
+}
+
+/*
+Outside of the arming windows the sensor is not watched; it cannot wake the
+board and its changes are not taken so they lead to no notifications. The
+sensor is only disarmed once it is closed so that the recipients who were
+told that it opened are also told that it closed. On arming, the sensor is
+read again and if it is open by then that is taken as a change like any
+other.
+*/
+
+void handleArming() {
+  const MonitoringSettings* monitoringSettings = activeSettings->monitoringSettings();
+  bool armed = isScheduledArmed(monitoringSettings, MonotonicClock::now());
+
+  if (armed == sensorArmed || (!armed && sensorInput->getState())) {
+    return;
+  }
+
+  sensorArmed = armed;
+  applySensorWake(monitoringSettings);
+
+#ifdef SERIAL_ENABLED
+  Serial.println(armed ? "did arm the sensor" : "did disarm the sensor");
+#endif
+}
+
 void handleSensor() {
+  if (!sensorArmed) {
+    return;
+  }
+
+  bool priorState = sensorInput->getState();
   sensorInput->pulse();
   bool newState = sensorInput->getState();
-  sensorService->update(newState);
+
+  // a change in the sensor may lead to a notification so it starts a trace.
+
+  if (newState != priorState) {
+    LatencyTrace::begin(sensorInput->edgeAt());
+    LatencyTrace::mark(LATENCY_STAGE_DEBOUNCE, MonotonicClock::now());
+    postInputState(BUS_INPUT_SENSOR, newState);
+  }
 }
 
 void handleButton() {
   bool priorState = buttonInput->getState();
   buttonInput->pulse();
-  if (priorState && !buttonInput->getState()) {
+  bool newState = buttonInput->getState();
+
+  if (newState != priorState) {
+    postInputState(BUS_INPUT_BUTTON, newState);
+  }
+
+  if (priorState && !newState) {
 #ifdef SERIAL_ENABLED
     Serial.println("button was depressed");
 #endif
-    sensorService->togglePause();
+    BusEvent event;
+    memset(&event, 0, sizeof(BusEvent));
+    event.type = BUS_EVENT_PAUSE_TOGGLED;
+    event.input = BUS_INPUT_BUTTON;
+    event.at = MonotonicClock::now();
+    eventBus->post(event);
+  }
+}
+
+void handleSensorService() {
+  sensorService->pulse();
+}
+
+/*
+Sends a notification that the sensor service has posted as due and posts
+back whether it was delivered. The notification service may take seconds to
+send a notification and the inputs are not read meanwhile so only one
+notification is sent each time around the loop; the inputs are read again
+before the next.
+*/
+
+void handleNotifications() {
+  BusEvent event;
+
+  if (eventBus->take(notificationSubscriber, &event)) {
+    bool delivered = false;
+
+    switch (event.value) {
+      case PENDING_NOTIFICATION_OPEN:
+        delivered = notificationService->notifyOpen(event.notification);
+        break;
+      case PENDING_NOTIFICATION_STILL_OPEN:
+        delivered = notificationService->notifyStillOpen(event.notification);
+        break;
+      case PENDING_NOTIFICATION_CLOSE:
+        delivered = notificationService->notifyClose(event.notification);
+        break;
+      case PENDING_NOTIFICATION_FLAPPING:
+        delivered = notificationService->notifyFlapping(event.notification);
+        break;
+      case PENDING_NOTIFICATION_SETTLED:
+        delivered = notificationService->notifySettled(event.notification);
+        break;
+      default:
+        break;
+    }
+
+    LatencyTrace::end();
+
+    BusEvent result;
+    memset(&result, 0, sizeof(BusEvent));
+    result.type = BUS_EVENT_NOTIFY_RESULT;
+    result.value = event.value;
+    result.detail = delivered;
+    result.at = MonotonicClock::now();
+    eventBus->post(result);
+  }
+
+  // a notification that was held back may be due to be sent on its own.
+
+  notificationService->pulse();
+}
+
+/*
+Prints what has been learned of how long the sensor and the button bounce for
+and the windows that they wait for as a result, along with how many edges the
+interrupts of their pins have seen while the console was listening.
+*/
+
+void printBounceProfilesTo(Print& stream) {
+  stream.print("{bounceProfiles:{sensor:");
+  sensorInput->bounceProfile().printTo(stream);
+  stream.print(",button:");
+  buttonInput->bounceProfile().printTo(stream);
+  stream.print("},edges:{sensor:");
+  stream.print(sensorEdgeCount);
+  stream.print(",button:");
+  stream.print(buttonEdgeCount);
+  stream.println("}}");
+}
+
+bool isConsoleCommand(const char* word, const char* command, const char* shortCommand) {
+  return 0 == strcmp(word, command) || (NULL != shortCommand && 0 == strcmp(word, shortCommand));
+}
+
+void printConsoleHelpTo(Print& stream) {
+  stream.println("settings             print the settings; secrets are masked");
+  stream.println("fields               list the fields that can be got and set");
+  stream.println("get <field>          print a field of the settings");
+  stream.println("set <field> [value]  change a field of the settings and apply them");
+  stream.println("status               print the state of the sensor and the counters");
+  stream.println("stats | s            print how long the sensor has been open for");
+  stream.println("bounce | b           print the bounce profiles of the inputs");
+  stream.println("time | t             print what is known of the time of day");
+  stream.println("bus | e              print the counts of the event bus");
+  stream.println("latency | l          print how long the stages of the notifications took");
+  stream.println("notify               send a test notification");
+}
+
+/*
+Sends a notification of the sensor opening through the notification service
+just as the sensor service would, so that the settings and the messages can
+be checked. The result is printed once it comes back.
+*/
+
+void sendTestNotification() {
+  uint64_t now = MonotonicClock::now();
+
+  if (consoleTestPending || sensorService->isNotifying()) {
+    Serial.println("a notification is already being sent");
+    return;
+  }
+
+  BusEvent event;
+  memset(&event, 0, sizeof(BusEvent));
+  event.type = BUS_EVENT_NOTIFY_DUE;
+  event.value = PENDING_NOTIFICATION_OPEN;
+  event.at = now;
+  event.notification.open = true;
+  event.notification.openStats = &(sensorService->openStats());
+  event.notification.statsMillis = now;
+
+  LatencyTrace::begin(now);
+  eventBus->post(event);
+  consoleTestPending = true;
+  Serial.println("will send a test notification");
+}
+
+void runConsoleCommand() {
+  char* words[CONSOLE_MAX_WORDS];
+
+  if (consoleLine.overflowed()) {
+    Serial.println("the line is too long");
+    return;
+  }
+
+  int count = consoleLine.split(words, CONSOLE_MAX_WORDS);
+
+  if (0 == count) {
+    return;
+  }
+
+  if (isConsoleCommand(words[0], "settings", NULL)) {
+    settingsService->load()->printTo(Serial);
+  } else if (isConsoleCommand(words[0], "fields", NULL)) {
+    SettingsEditor::printFieldsTo(Serial);
+  } else if (isConsoleCommand(words[0], "get", NULL) && count >= 2) {
+    SettingsEditResult result = settingsEditor->get(words[1], Serial);
+    Serial.println(SETTINGS_EDIT_OK == result ? "" : SettingsEditor::resultAsString(result));
+  } else if (isConsoleCommand(words[0], "set", NULL) && count >= 2) {
+    SettingsEditResult result = settingsEditor->set(words[1], count > 2 ? words[2] : "");
+    Serial.println(SettingsEditor::resultAsString(result));
+    if (SETTINGS_EDIT_OK == result) {
+      stateMachine = RELOAD;
+    }
+  } else if (isConsoleCommand(words[0], "status", NULL)) {
+    sensorService->printStateTo(Serial);
+    eventBus->printTo(Serial);
+    inputSampler->printTo(Serial);
+  } else if (isConsoleCommand(words[0], "stats", "s")) {
+    sensorService->printOpenStatsTo(Serial);
+  } else if (isConsoleCommand(words[0], "bounce", "b")) {
+    printBounceProfilesTo(Serial);
+  } else if (isConsoleCommand(words[0], "time", "t")) {
+    WallClock::printTo(Serial, MonotonicClock::now());
+  } else if (isConsoleCommand(words[0], "bus", "e")) {
+    eventBus->printTo(Serial);
+  } else if (isConsoleCommand(words[0], "latency", "l")) {
+    LatencyTrace::printTo(Serial);
+  } else if (isConsoleCommand(words[0], "notify", NULL)) {
+    sendTestNotification();
+  } else if (isConsoleCommand(words[0], "help", "?")) {
+    printConsoleHelpTo(Serial);
+  } else {
+    Serial.println("unknown command; try `help`");
+  }
+}
+
+/*
+Lines typed into the serial port are commands to the board; see
+`printConsoleHelpTo()`. Only the characters that have already arrived are
+read so the loop carries on while a line is being typed. The results and the
+edges are taken from the event bus first so that the first result after a
+test has been posted is that of the test.
+*/
+
+void handleSerial() {
+#ifdef SERIAL_ENABLED
+  BusEvent event;
+
+  while (eventBus->take(consoleSubscriber, &event)) {
+    switch (event.type) {
+      case BUS_EVENT_EDGE:
+        if (BUS_INPUT_SENSOR == event.input) {
+          sensorEdgeCount += event.detail;
+        } else {
+          buttonEdgeCount += event.detail;
+        }
+        break;
+      case BUS_EVENT_NOTIFY_RESULT:
+        if (consoleTestPending) {
+          consoleTestPending = false;
+          Serial.println(event.detail ? "the test notification was delivered" : "the test notification failed");
+        }
+        break;
+      default:
+        break;
+    }
+  }
+
+  while (Serial.available() > 0) {
+    if (consoleLine.feed((char) Serial.read())) {
+      runConsoleCommand();
+    }
+  }
+#endif
+}
+
+void handleRelayHub() {
+  if (NULL != relayHubService) {
+    relayHubService->pulse();
   }
 }
 
@@ -167,39 +719,102 @@ void handleIndicator() {
   indicatorService->pulse();
 }
 
+/*
+Accounts to the energy governor for the time that the board has been awake
+since this was last called.
+*/
+
+void handleEnergy() {
+  uint64_t now = MonotonicClock::now();
+  if (NULL != energyGovernor) {
+    energyGovernor->elapse(ENERGY_ACTIVITY_AWAKE, (unsigned long) (now - energyAccountedMillis));
+  }
+  energyAccountedMillis = now;
+}
+
+/*
+Returns whichever of the two times to wake the board is sooner; zero for
+either means that there is no such time.
+*/
+
+uint64_t soonerWakeAt(uint64_t wakeAt, uint64_t otherWakeAt) {
+  if (0 == wakeAt || (0 != otherWakeAt && otherWakeAt < wakeAt)) {
+    return otherWakeAt;
+  }
+  return wakeAt;
+}
+
 void handleLoopDelay() {
   if (
       sensorService->allowedToShortSleep()
       && buttonInput->allowedToShortSleep()
       && sensorInput->allowedToShortSleep()
+      && eventBus->isDrained(notificationSubscriber)
+      && (NULL == relayHubService || relayHubService->allowedToShortSleep())
   ) {
 #ifdef SERIAL_ENABLED
     Serial.println("deep sleep..");
     Serial.end();
 #endif
-    LowPower.deepSleep();
+    // the sensor service may need the board woken even if nothing changes
+    // and so may the start or end of an arming window or a notification that
+    // was held back.
+    uint64_t wakeAt = soonerWakeAt(sensorService->wakeAt(),
+      armingBoundaryAt(activeSettings->monitoringSettings(), MonotonicClock::now()));
+    wakeAt = soonerWakeAt(wakeAt, notificationService->wakeAt());
+    uint32_t samples = inputSampler->sampleCount();
+    unsigned long sleptMillis = inputSampler->sleep(wakeAt);
+    if (NULL != energyGovernor) {
+      energyGovernor->elapse(ENERGY_ACTIVITY_SLEEP, sleptMillis);
+      energyGovernor->record(ENERGY_ACTIVITY_SAMPLE, inputSampler->sampleCount() - samples);
+    }
+    energyAccountedMillis = MonotonicClock::now();
     setupSerial();
   }
 }
 
-void awakeFromSleep() {
-  // Serial.println("..awake on pin");
+/*
+These are called from the interrupts of the pins; they wake the board from
+deep sleep but are also called while it is awake. They only post the edge to
+the event bus which is safe from an interrupt; the inputs are read by the
+loop.
+*/
+
+void postEdgeFromInterrupt(BusInput input, int pin) {
+  BusEvent event;
+  memset(&event, 0, sizeof(BusEvent));
+  event.type = BUS_EVENT_EDGE;
+  event.input = input;
+  event.value = digitalRead(pin);
+  eventBus->postFromInterrupt(event);
+}
+
+void awakeFromSensor() {
+  postEdgeFromInterrupt(BUS_INPUT_SENSOR, PIN_SENSOR);
+}
+
+void awakeFromButton() {
+  postEdgeFromInterrupt(BUS_INPUT_BUTTON, PIN_BUTTON);
 }
 
 void loop() {
   switch (stateMachine) {
     case START:
-      delete sensorService;
-      delete notificationService;
-      sensorService = NULL;
-      notificationService = NULL;
+    case RELOAD:
+      applySettings();
       stateMachine = WATCH;
       break;
     case WATCH:
-      setupServices();
+      handleEventBus();
+      handleArming();
       handleButton();
       handleSensor();
+      handleSensorService();
+      handleNotifications();
       handleIndicator();
+      handleRelayHub();
+      handleSerial();
+      handleEnergy();
       handleLoopDelay();
       break;
   }
@@ -5,11 +5,168 @@
 #include "sensorservice.h"
 
 #include "constants.h"
+#include "historylog.h"
+#include "latencytrace.h"
+#include "monotonicclock.h"
 
 /*
-This object is capturing the state of the sensor; when it was opened and when
-it was closed, when it was last notified as being opened and when it last
-notified as being closed.
+These are the actions that are carried out as a transition is taken. A
+transition may carry more than one action. The sensor is logged as open only
+when it really opens and not when a pause ends with it still open.
+*/
+
+#define SENSOR_ACTION_NONE 0x00
+#define SENSOR_ACTION_MARK_OPEN 0x01
+#define SENSOR_ACTION_MARK_CLOSED 0x02
+#define SENSOR_ACTION_NOTIFY_OPEN 0x04
+#define SENSOR_ACTION_NOTIFY_STILL_OPEN 0x08
+#define SENSOR_ACTION_NOTIFY_CLOSE 0x10
+#define SENSOR_ACTION_LOG_OPEN 0x20
+#define SENSOR_ACTION_LOG_CLOSED 0x40
+
+/*
+Each phase may have a timer which, when it runs out, turns an update of the
+sensor being open into a `SENSOR_EVENT_DUE` event.
+*/
+
+enum SensorTimer {
+  SENSOR_TIMER_NONE,
+  SENSOR_TIMER_NOTIFY_OPEN,
+  SENSOR_TIMER_NOTIFY_REPEAT
+};
+
+struct SensorPhaseDefinition {
+  SensorPhase phase;
+  IndicatorState indicator;
+  SensorTimer timer;
+  bool notified;
+};
+
+struct SensorTransition {
+  SensorPhase phase;
+  SensorEvent event;
+  SensorPhase next;
+  uint8_t actions;
+};
+
+static constexpr SensorPhaseDefinition SENSOR_PHASES[] = {
+  { SENSOR_CLOSED, INDICATOR_CLOSED, SENSOR_TIMER_NONE, false },
+  { SENSOR_OPEN, INDICATOR_OPEN_PRE_NOTIFY, SENSOR_TIMER_NOTIFY_OPEN, false },
+  { SENSOR_OPEN_NOTIFIED, INDICATOR_OPEN_WAIT_FOR_CLOSE, SENSOR_TIMER_NOTIFY_REPEAT, true },
+  { SENSOR_OPEN_REMINDED, INDICATOR_OPEN_WAIT_FOR_CLOSE, SENSOR_TIMER_NOTIFY_REPEAT, true },
+  { SENSOR_PAUSED, INDICATOR_PAUSED_UNTIL_CLOSE, SENSOR_TIMER_NONE, false }
+};
+
+/*
+This table defines the behaviour of the sensor. There is one row for every
+combination of phase and event and the rows are ordered by phase and then by
+event so that the row for a given phase and event can be found directly.
+*/
+
+static constexpr SensorTransition SENSOR_TRANSITIONS[] = {
+  { SENSOR_CLOSED, SENSOR_EVENT_CLOSED, SENSOR_CLOSED, SENSOR_ACTION_NONE },
+  { SENSOR_CLOSED, SENSOR_EVENT_OPEN, SENSOR_OPEN, SENSOR_ACTION_MARK_OPEN | SENSOR_ACTION_LOG_OPEN },
+  { SENSOR_CLOSED, SENSOR_EVENT_DUE, SENSOR_OPEN, SENSOR_ACTION_MARK_OPEN | SENSOR_ACTION_LOG_OPEN },
+  { SENSOR_CLOSED, SENSOR_EVENT_TOGGLE_PAUSE, SENSOR_CLOSED, SENSOR_ACTION_NONE },
+
+  { SENSOR_OPEN, SENSOR_EVENT_CLOSED, SENSOR_CLOSED, SENSOR_ACTION_MARK_CLOSED | SENSOR_ACTION_LOG_CLOSED },
+  { SENSOR_OPEN, SENSOR_EVENT_OPEN, SENSOR_OPEN, SENSOR_ACTION_NONE },
+  { SENSOR_OPEN, SENSOR_EVENT_DUE, SENSOR_OPEN_NOTIFIED, SENSOR_ACTION_NOTIFY_OPEN },
+  { SENSOR_OPEN, SENSOR_EVENT_TOGGLE_PAUSE, SENSOR_PAUSED, SENSOR_ACTION_NONE },
+
+  { SENSOR_OPEN_NOTIFIED, SENSOR_EVENT_CLOSED, SENSOR_CLOSED, SENSOR_ACTION_MARK_CLOSED | SENSOR_ACTION_LOG_CLOSED | SENSOR_ACTION_NOTIFY_CLOSE },
+  { SENSOR_OPEN_NOTIFIED, SENSOR_EVENT_OPEN, SENSOR_OPEN_NOTIFIED, SENSOR_ACTION_NONE },
+  { SENSOR_OPEN_NOTIFIED, SENSOR_EVENT_DUE, SENSOR_OPEN_REMINDED, SENSOR_ACTION_NOTIFY_STILL_OPEN },
+  { SENSOR_OPEN_NOTIFIED, SENSOR_EVENT_TOGGLE_PAUSE, SENSOR_PAUSED, SENSOR_ACTION_NONE },
+
+  { SENSOR_OPEN_REMINDED, SENSOR_EVENT_CLOSED, SENSOR_CLOSED, SENSOR_ACTION_MARK_CLOSED | SENSOR_ACTION_LOG_CLOSED | SENSOR_ACTION_NOTIFY_CLOSE },
+  { SENSOR_OPEN_REMINDED, SENSOR_EVENT_OPEN, SENSOR_OPEN_REMINDED, SENSOR_ACTION_NONE },
+  { SENSOR_OPEN_REMINDED, SENSOR_EVENT_DUE, SENSOR_OPEN_REMINDED, SENSOR_ACTION_NOTIFY_STILL_OPEN },
+  { SENSOR_OPEN_REMINDED, SENSOR_EVENT_TOGGLE_PAUSE, SENSOR_PAUSED, SENSOR_ACTION_NONE },
+
+  { SENSOR_PAUSED, SENSOR_EVENT_CLOSED, SENSOR_CLOSED, SENSOR_ACTION_MARK_CLOSED | SENSOR_ACTION_LOG_CLOSED },
+  { SENSOR_PAUSED, SENSOR_EVENT_OPEN, SENSOR_PAUSED, SENSOR_ACTION_NONE },
+  { SENSOR_PAUSED, SENSOR_EVENT_DUE, SENSOR_PAUSED, SENSOR_ACTION_NONE },
+  { SENSOR_PAUSED, SENSOR_EVENT_TOGGLE_PAUSE, SENSOR_OPEN, SENSOR_ACTION_MARK_OPEN }
+};
+
+/*
+The following checks are made over the whole of the tables as the software is
+compiled so that a mistake in the tables will stop the build.
+*/
+
+static constexpr bool sensorPhasesAreOrdered(int index) {
+  return index >= SENSOR_PHASE_COUNT
+    || (SENSOR_PHASES[index].phase == index && sensorPhasesAreOrdered(index + 1));
+}
+
+static constexpr bool sensorTransitionsAreOrdered(int index) {
+  return index >= SENSOR_PHASE_COUNT * SENSOR_EVENT_COUNT
+    || (SENSOR_TRANSITIONS[index].phase == index / SENSOR_EVENT_COUNT
+      && SENSOR_TRANSITIONS[index].event == index % SENSOR_EVENT_COUNT
+      && sensorTransitionsAreOrdered(index + 1));
+}
+
+static constexpr bool hasAction(const SensorTransition& transition, uint8_t action) {
+  return 0 != (transition.actions & action);
+}
+
+static constexpr bool sensorTransitionIsSound(const SensorTransition& transition) {
+  return transition.next < SENSOR_PHASE_COUNT
+    // whatever the phase, the sensor closing goes back to closed.
+    && (SENSOR_EVENT_CLOSED != transition.event || SENSOR_CLOSED == transition.next)
+    // recipients told about an open are always told about the close.
+    && (SENSOR_EVENT_CLOSED != transition.event
+      || !SENSOR_PHASES[transition.phase].notified
+      || hasAction(transition, SENSOR_ACTION_NOTIFY_CLOSE))
+    // ...and are only told about a close if they were told about the open.
+    && (!hasAction(transition, SENSOR_ACTION_NOTIFY_CLOSE)
+      || (SENSOR_PHASES[transition.phase].notified && SENSOR_CLOSED == transition.next))
+    // a notified phase is only entered by notifying.
+    && (SENSOR_PHASES[transition.phase].notified
+      || !SENSOR_PHASES[transition.next].notified
+      || hasAction(transition, SENSOR_ACTION_NOTIFY_OPEN))
+    // reminders are only sent once there has been a notification.
+    && (!hasAction(transition, SENSOR_ACTION_NOTIFY_STILL_OPEN)
+      || (SENSOR_PHASES[transition.phase].notified && SENSOR_PHASES[transition.next].notified))
+    // notifications of the sensor being open are only sent when a timer is due.
+    && (!hasAction(transition, SENSOR_ACTION_NOTIFY_OPEN | SENSOR_ACTION_NOTIFY_STILL_OPEN)
+      || (SENSOR_EVENT_DUE == transition.event
+        && SENSOR_TIMER_NONE != SENSOR_PHASES[transition.phase].timer))
+    // the log has the sensor opening exactly when it leaves closed...
+    && (hasAction(transition, SENSOR_ACTION_LOG_OPEN)
+      == (SENSOR_CLOSED == transition.phase && SENSOR_CLOSED != transition.next))
+    // ...and closing exactly when it goes back to closed.
+    && (hasAction(transition, SENSOR_ACTION_LOG_CLOSED)
+      == (SENSOR_CLOSED != transition.phase && SENSOR_CLOSED == transition.next));
+}
+
+static constexpr bool sensorTransitionsAreSound(int index) {
+  return index >= SENSOR_PHASE_COUNT * SENSOR_EVENT_COUNT
+    || (sensorTransitionIsSound(SENSOR_TRANSITIONS[index]) && sensorTransitionsAreSound(index + 1));
+}
+
+static_assert(sizeof(SENSOR_PHASES) / sizeof(SENSOR_PHASES[0]) == SENSOR_PHASE_COUNT,
+  "there must be one definition for each sensor phase");
+static_assert(sensorPhasesAreOrdered(0), "the sensor phase definitions are out of order");
+static_assert(sizeof(SENSOR_TRANSITIONS) / sizeof(SENSOR_TRANSITIONS[0]) == SENSOR_PHASE_COUNT * SENSOR_EVENT_COUNT,
+  "there must be one transition for each sensor phase and event");
+static_assert(sensorTransitionsAreOrdered(0), "the sensor transitions are out of order");
+static_assert(sensorTransitionsAreSound(0), "a sensor transition breaks the rules for notifying");
+
+/*
+If the board has been up for less time than the duration then the earliest
+time that can be represented is used. Zero is reserved to mean "never".
+*/
+
+static uint64_t rebaseMillis(uint64_t now, unsigned long durationMillis) {
+    return durationMillis < now ? now - durationMillis : 1L;
+}
+
+/*
+This object is capturing the state of the sensor; the phase that it is in,
+when it was opened and when it was closed, when a notification about it
+was last sent and how many times it was opened since then.
 */
 
 class SensorState {
@@ -19,25 +176,29 @@ class SensorState {
 
     void reset();
 
-    bool isOpen() const;
-
-    unsigned long openAt() const;
-    unsigned long closedAt() const;
-    unsigned long lastNotifiedOpenAt() const;
-    unsigned long lastNotifiedClosedAt() const;
+    SensorPhase phase() const;
+    uint64_t openAt() const;
+    uint64_t closedAt() const;
+    uint64_t notifiedAt() const;
+    int reminderCount() const;
+    unsigned int openCount() const;
 
-    void setOpenAt(unsigned long value);
-    void setClosedAt(unsigned long value);
-    void setLastNotifiedOpenAt(unsigned long value);
-    void setLastNotifiedClosedAt(unsigned long value);
+    void setPhase(SensorPhase value);
+    void setOpenAt(uint64_t value);
+    void setClosedAt(uint64_t value);
+    void setNotifiedAt(uint64_t value);
+    void setReminderCount(int value);
+    void setOpenCount(unsigned int value);
 
     void printTo(Stream& stream);
 
   private:
-    unsigned long _openAt;
-    unsigned long _closedAt;
-    unsigned long _lastNotifiedOpenAt;
-    unsigned long _lastNotifiedClosedAt;
+    SensorPhase _phase;
+    uint64_t _openAt;
+    uint64_t _closedAt;
+    uint64_t _notifiedAt;
+    int _reminderCount;
+    unsigned int _openCount;
 };
 
 SensorState::SensorState() {
@@ -48,172 +209,532 @@ SensorState::~SensorState() {
 }
 
 void SensorState::reset() {
+    _phase = SENSOR_CLOSED;
     _openAt = 0L;
     _closedAt = 0L;
-    _lastNotifiedOpenAt = 0L;
-    _lastNotifiedClosedAt = 0L;
+    _notifiedAt = 0L;
+    _reminderCount = 0;
+    _openCount = 0;
 }
 
-bool SensorState::isOpen() const {
-    return 0 != openAt() && openAt() > closedAt();
+SensorPhase SensorState::phase() const {
+    return _phase;
 }
 
-unsigned long SensorState::openAt() const {
+uint64_t SensorState::openAt() const {
   return _openAt;
 }
 
-unsigned long SensorState::closedAt() const {
+uint64_t SensorState::closedAt() const {
     return _closedAt;
 }
 
-unsigned long SensorState::lastNotifiedOpenAt() const {
-    return _lastNotifiedOpenAt;
+uint64_t SensorState::notifiedAt() const {
+    return _notifiedAt;
 }
 
-unsigned long SensorState::lastNotifiedClosedAt() const {
-    return _lastNotifiedClosedAt;
+int SensorState::reminderCount() const {
+    return _reminderCount;
 }
 
-void SensorState::setOpenAt(unsigned long value) {
+unsigned int SensorState::openCount() const {
+    return _openCount;
+}
+
+void SensorState::setPhase(SensorPhase value) {
+    _phase = value;
+}
+
+void SensorState::setOpenAt(uint64_t value) {
     _openAt = value;
 }
 
-void SensorState::setClosedAt(unsigned long value) {
+void SensorState::setClosedAt(uint64_t value) {
     _closedAt = value;
 }
 
-void SensorState::setLastNotifiedOpenAt(unsigned long value) {
-    _lastNotifiedOpenAt = value;
+void SensorState::setNotifiedAt(uint64_t value) {
+    _notifiedAt = value;
 }
 
-void SensorState::setLastNotifiedClosedAt(unsigned long value) {
-    _lastNotifiedClosedAt = value;
+void SensorState::setReminderCount(int value) {
+    _reminderCount = value;
+}
+
+void SensorState::setOpenCount(unsigned int value) {
+    _openCount = value;
 }
 
 void SensorState::printTo(Stream& stream) {
 #ifdef SERIAL_ENABLED
-    Serial.print("{openAt:");
-    Serial.print(openAt());
-    Serial.print(",closeAt:");
-    Serial.print(closedAt());
-    Serial.print("}");
+    stream.print("{phase:");
+    stream.print(phase());
+    stream.print(",openAt:");
+    stream.print((unsigned long) openAt());
+    stream.print(",closeAt:");
+    stream.print((unsigned long) closedAt());
+    stream.print(",notifiedAt:");
+    stream.print((unsigned long) notifiedAt());
+    stream.print(",reminderCount:");
+    stream.print(reminderCount());
+    stream.print("}");
 #endif
 }
 
-SensorService::SensorService(MonitoringSettings* monitoringSettings,
-    NotificationService* notificationService,
-    IndicatorService* indicatorService)
+/*
+The service starts out taking the sensor to be closed; the state of the
+sensor at the start is posted to the bus like any other.
+*/
+
+SensorService::SensorService(MonitoringSettings* monitoringSettings, EventBus* eventBus)
     :
     _sensorState(new SensorState()),
-    _isPaused(false),
+    _pendingNotification(PENDING_NOTIFICATION_NONE),
+    _pendingAt(0L),
+    _openNotified(false),
+    _retainedAt(0L),
+    _eventBus(eventBus),
+    _subscriber(eventBus->subscribe(
+        BUS_EVENT_MASK(BUS_EVENT_INPUT_STATE)
+        | BUS_EVENT_MASK(BUS_EVENT_PAUSE_TOGGLED)
+        | BUS_EVENT_MASK(BUS_EVENT_NOTIFY_RESULT))),
+    _open(false),
     _monitoringSettings(monitoringSettings),
-    _notificationService(notificationService),
-    _indicatorService(indicatorService) {
+    _flapping(false),
+    _flapSuppressedCount(0),
+    _suppressedCount(0) {
     reset();
+    configureLimit(MonotonicClock::now());
+    _openStats.reset(MonotonicClock::now());
 }
 
+/*
+The monitoring settings are owned by this service; see
+`setMonitoringSettings`.
+*/
+
 SensorService::~SensorService() {
+    delete _sensorState;
+    delete _monitoringSettings;
+}
+
+/*
+The monitoring settings are owned by this service. Changing them does not
+affect the current state of the sensor.
+*/
+
+void SensorService::setMonitoringSettings(MonitoringSettings* value) {
+    if (value != _monitoringSettings) {
+        delete _monitoringSettings;
+        _monitoringSettings = value;
+        configureLimit(MonotonicClock::now());
+    }
 }
 
 void SensorService::reset() {
-    _isPaused = false;
+    _pendingNotification = PENDING_NOTIFICATION_NONE;
+    _openNotified = false;
+    _flapping = false;
+    _flapSuppressedCount = 0;
     _sensorState->reset();
+    // ensures that the next update will write out a fresh snapshot
+    memset(&_retainedSnapshot, 0xFF, sizeof(RetainedSensorSnapshot));
+}
+
+/*
+After a reset of the board, this will bring the service back to the state that
+it was in before the reset using the snapshot that was retained in RAM. The
+clock restarts with the reset so the times at which the sensor
+was opened and notified are re-based onto the new timeline. If a notification
+was in progress when the reset happened then it will be sent again.
+*/
+
+void SensorService::resume(const RetainedSensorSnapshot& snapshot) {
+    uint64_t now = MonotonicClock::now();
+
+    if (snapshot.phase >= SENSOR_PHASE_COUNT) {
+        return;
+    }
+
+    SensorPhase phase = (SensorPhase) snapshot.phase;
+
+    _sensorState->reset();
+    _sensorState->setPhase(phase);
+    _sensorState->setReminderCount(snapshot.reminderCount);
+    _pendingNotification = PENDING_NOTIFICATION_NONE;
+    _openNotified = 0 != snapshot.openNotified;
+
+    if (SENSOR_CLOSED != phase) {
+        _sensorState->setOpenAt(rebaseMillis(now, snapshot.openForMillis));
+
+        if (SENSOR_PHASES[phase].notified) {
+            _sensorState->setNotifiedAt(rebaseMillis(now, snapshot.notifiedForMillis));
+        }
+    }
+
+#ifdef SERIAL_ENABLED
+    Serial.print("resumed from retained state ");
+    _sensorState->printTo(Serial);
+    Serial.println();
+#endif
+
+    post(BUS_EVENT_PHASE, phase, SENSOR_PHASES[phase].indicator, now);
+
+    // the sensor was found to be flapping just before the reset.
+
+    if (PENDING_NOTIFICATION_FLAPPING == snapshot.pendingNotification) {
+        _flapping = true;
+    }
+
+    if (PENDING_NOTIFICATION_NONE != snapshot.pendingNotification) {
+        notify((PendingNotification) snapshot.pendingNotification, now);
+    }
+
+    retain(now);
+}
+
+/*
+Takes the events that have been posted to the bus since the last pulse and
+then brings the sensor up to date so that timers which have run out are
+acted on even if nothing has changed. A notification whose result has not
+come back in time is no longer waited for so that the board is able to sleep
+again.
+*/
+
+void SensorService::pulse() {
+    BusEvent event;
+
+    while (_eventBus->take(_subscriber, &event)) {
+        receive(event, MonotonicClock::now());
+    }
+
+    uint64_t now = MonotonicClock::now();
+
+    if (PENDING_NOTIFICATION_NONE != _pendingNotification
+        && (now - _pendingAt) >= NOTIFY_RESULT_TIMEOUT_MILLIS) {
+#ifdef SERIAL_ENABLED
+        Serial.println("the result of the notification did not come back; will no longer wait for it");
+#endif
+        _pendingNotification = PENDING_NOTIFICATION_NONE;
+        retain(now);
+    }
+
+    update(_open);
+}
+
+// private
+void SensorService::receive(const BusEvent& event, uint64_t now) {
+    switch (event.type) {
+        case BUS_EVENT_INPUT_STATE:
+            if (BUS_INPUT_SENSOR == event.input) {
+                _open = 0 != event.value;
+            }
+            break;
+        case BUS_EVENT_PAUSE_TOGGLED:
+            togglePause();
+            break;
+        case BUS_EVENT_NOTIFY_RESULT:
+            // an opening that could not be notified leaves nobody to be told
+            // that the sensor closed again. The opening is only forgotten
+            // once the close is done with so that a close sent again after a
+            // reset is treated in the same way.
+            if ((PENDING_NOTIFICATION_OPEN == event.value && !event.detail)
+                || PENDING_NOTIFICATION_CLOSE == event.value) {
+                _openNotified = false;
+            }
+            // the notification is no longer in progress so a reset will not
+            // lead to it being sent again.
+            if (event.value == _pendingNotification) {
+                _pendingNotification = PENDING_NOTIFICATION_NONE;
+            }
+            retain(now);
+            break;
+        default:
+            break;
+    }
+}
+
+// private
+void SensorService::post(BusEventType type, uint8_t value, uint8_t detail, uint64_t now) {
+    BusEvent event;
+    memset(&event, 0, sizeof(BusEvent));
+    event.type = type;
+    event.value = value;
+    event.detail = detail;
+    event.at = now;
+    _eventBus->post(event);
 }
 
 void SensorService::update(bool open) {
-  unsigned long now = millis();
+  uint64_t now = MonotonicClock::now();
+  SensorEvent event = SENSOR_EVENT_CLOSED;
 
-  if (_isPaused) {
-    updateWithPause(open, now);
-  } else {
-    updateWithoutPause(open, now);
+  if (open) {
+    event = isDue(now) ? SENSOR_EVENT_DUE : SENSOR_EVENT_OPEN;
   }
+
+  fire(event, now);
+
+  if (_flapping && isSettled(now)) {
+    _flapping = false;
+    send(PENDING_NOTIFICATION_SETTLED, now);
+    _flapSuppressedCount = 0;
+  }
+
+  retain(now);
+}
+
+/*
+Returns true if the timer for the current phase has run out.
+*/
+
+// private
+bool SensorService::isDue(uint64_t now) {
+    switch (SENSOR_PHASES[_sensorState->phase()].timer) {
+        case SENSOR_TIMER_NOTIFY_OPEN:
+            return now - _sensorState->openAt()
+                >= (uint64_t) _monitoringSettings->notifyOpenDelayMinutes() * 60UL * 1000UL;
+        case SENSOR_TIMER_NOTIFY_REPEAT:
+            return 0 < _monitoringSettings->notifyRepeatMinutes()
+                && _sensorState->reminderCount() < _monitoringSettings->notifyRepeatLimit()
+                && now - _sensorState->notifiedAt()
+                    >= (uint64_t) _monitoringSettings->notifyRepeatMinutes() * 60UL * 1000UL;
+        default:
+            return false;
+    }
 }
 
 /*
-This is processing a change of state (open/closed) in the sensor
-is paused.
+Looks up the transition for the event in the current phase and carries out
+its actions. The phase is moved on before any notification is sent so that
+the retained state reflects the notification being in progress.
 */
 
 // private
-void SensorService::updateWithPause(bool open, unsigned long now) {
-  _indicatorService->setState(INDICATOR_PAUSED_UNTIL_CLOSE);
+void SensorService::fire(SensorEvent event, uint64_t now) {
+    const SensorTransition& transition =
+        SENSOR_TRANSITIONS[_sensorState->phase() * SENSOR_EVENT_COUNT + event];
 
-   if (_sensorState->isOpen()) {
-        if (!open) {
+    if (hasAction(transition, SENSOR_ACTION_MARK_OPEN)) {
 #ifdef SERIAL_ENABLED
-          Serial.println("detected closed in pause - unpausing");
+        Serial.println("detected open");
 #endif
-          _isPaused = !_isPaused;
-          _sensorState->reset();
-        }
+        _sensorState->setOpenAt(now);
+        _sensorState->setReminderCount(0);
+        _sensorState->setOpenCount(_sensorState->openCount() + 1);
     }
-    else {
-        if (open) {
+
+    if (hasAction(transition, SENSOR_ACTION_MARK_CLOSED)) {
 #ifdef SERIAL_ENABLED
-            Serial.println("detected open in pause; will ignore the open");
+        Serial.println("detected closed");
 #endif
-            _sensorState->setOpenAt(now);
+        _sensorState->setClosedAt(now);
+
+        if (0 != _sensorState->openAt()) {
+            _openStats.record((unsigned long) (now - _sensorState->openAt()));
         }
     }
+
+    if (hasAction(transition, SENSOR_ACTION_LOG_OPEN)) {
+        HistoryLog::append(MonotonicClock::epoch(), true);
+    }
+
+    if (hasAction(transition, SENSOR_ACTION_LOG_CLOSED)) {
+        HistoryLog::append(MonotonicClock::epoch(), false);
+    }
+
+    SensorPhase prior = _sensorState->phase();
+    _sensorState->setPhase(transition.next);
+
+    if (transition.next != prior) {
+        post(BUS_EVENT_PHASE, transition.next, SENSOR_PHASES[transition.next].indicator, now);
+    }
+
+    if (hasAction(transition, SENSOR_ACTION_NOTIFY_OPEN)) {
+        _sensorState->setNotifiedAt(now);
+        _sensorState->setReminderCount(0);
+        notify(PENDING_NOTIFICATION_OPEN, now);
+    }
+
+    if (hasAction(transition, SENSOR_ACTION_NOTIFY_STILL_OPEN)) {
+        _sensorState->setNotifiedAt(now);
+        _sensorState->setReminderCount(_sensorState->reminderCount() + 1);
+        notify(PENDING_NOTIFICATION_STILL_OPEN, now);
+    }
+
+    if (hasAction(transition, SENSOR_ACTION_NOTIFY_CLOSE)) {
+        _sensorState->setNotifiedAt(now);
+        notify(PENDING_NOTIFICATION_CLOSE, now);
+    }
+}
+
+// private
+void SensorService::notify(PendingNotification notification, uint64_t now) {
+    if (admit(notification, now)) {
+        send(notification, now);
+    }
 }
 
 /*
-This is processing a change of state (open / closed) in the sensor
-is NOT paused.
+Each notification of the sensor opening or closing takes a token from the
+limit; reminders are already paced by the settings so they do not. If there
+is no token left then the sensor is flapping; in place of the notification,
+one notification is sent to say that it is flapping and from then on the
+notifications are suppressed until it has settled.
 */
 
 // private
-void SensorService::updateWithoutPause(bool open, unsigned long now) {
-    if (_sensorState->isOpen()) {
-        if (!open) {
+bool SensorService::admit(PendingNotification notification, uint64_t now) {
+    if (PENDING_NOTIFICATION_FLAPPING == notification
+        || PENDING_NOTIFICATION_SETTLED == notification) {
+        return true;
+    }
+
+    if (!_flapping && PENDING_NOTIFICATION_STILL_OPEN == notification) {
+        return true;
+    }
+
+    if (!_flapping && _notifyLimit.take(now)) {
+        return true;
+    }
 
-            // here we are capturing that the sensor was closed.
+    _flapSuppressedCount++;
+    _suppressedCount++;
 
 #ifdef SERIAL_ENABLED
-            Serial.println("detected closed");
+    Serial.print("suppressed notification of flapping sensor; total suppressed ");
+    Serial.println(_suppressedCount);
 #endif
 
-            _sensorState->setClosedAt(now);
-            _indicatorService->setState(INDICATOR_CLOSED);
+    if (!_flapping) {
+        _flapping = true;
+        send(PENDING_NOTIFICATION_FLAPPING, now);
+    }
 
-            if (_sensorState->lastNotifiedOpenAt() > _sensorState->openAt()) {
-                _sensorState->setLastNotifiedClosedAt(now);
-                _notificationService->notifyClose();
-            }
-        }
-        else {
+    return false;
+}
+
+/*
+The two thresholds give the detection some hysteresis; the sensor starts
+flapping as soon as the limit runs out but it has only settled once the limit
+has fully recovered and the sensor has not changed for a while.
+*/
 
-            // here check to see if there is a need to notify that the sensor
-            // is open.
+// private
+bool SensorService::isSettled(uint64_t now) {
+    _notifyLimit.refill(now);
+    return _notifyLimit.isFull() && now >= settledAt();
+}
 
-            unsigned long notifyOpenDelayMillis = _monitoringSettings->notifyOpenDelayMinutes() * 60 * 1000;
+/*
+This is the earliest time at which the sensor could be found to have settled
+if it does not change again.
+*/
 
-            if (now - _sensorState->openAt() >= notifyOpenDelayMillis
-                && _sensorState->lastNotifiedOpenAt() < _sensorState->openAt()) {
-                _sensorState->setLastNotifiedOpenAt(now);
-                _notificationService->notifyOpen();
-                _indicatorService->setState(INDICATOR_OPEN_WAIT_FOR_CLOSE);
-            }
-        }
+// private
+uint64_t SensorService::settledAt() const {
+    uint64_t changedAt = max(_sensorState->openAt(), _sensorState->closedAt());
+    uint64_t quietAt = changedAt + (uint64_t) _monitoringSettings->settleMinutes() * 60UL * 1000UL;
+    return max(quietAt, _notifyLimit.fullAt());
+}
+
+// private
+void SensorService::configureLimit(uint64_t now) {
+    _notifyLimit.configure(
+        max(0, _monitoringSettings->notifyBurstLimit()),
+        (unsigned long) max(0, _monitoringSettings->notifyRefillMinutes()) * 60UL * 1000UL,
+        now);
+}
+
+/*
+The notification is recorded as pending in the retained state from when it
+is posted to the bus until the result is posted back. Should the board reset
+in between, the notification will be sent again when the state is resumed.
+*/
+
+// private
+void SensorService::send(PendingNotification notification, uint64_t now) {
+    NotificationEvent event;
+    event.openDurationMillis = 0 == _sensorState->openAt() ? 0 : (unsigned long) (now - _sensorState->openAt());
+    event.openCount = _sensorState->openCount();
+    event.open = SENSOR_CLOSED != _sensorState->phase();
+    event.openNotified = _openNotified;
+    event.suppressedCount = _flapSuppressedCount;
+    event.openStats = &_openStats;
+    event.statsMillis = now;
+
+    _sensorState->setOpenCount(0);
+
+    if (PENDING_NOTIFICATION_OPEN == notification) {
+        _openNotified = true;
     }
-    else {
-        if (open) {
-#ifdef SERIAL_ENABLED
-            Serial.println("detected open");
-#endif
-            _sensorState->setOpenAt(now);
-            _indicatorService->setState(INDICATOR_OPEN_PRE_NOTIFY);
-        }
-        else {
-          _indicatorService->setState(INDICATOR_CLOSED);
+
+    _pendingNotification = notification;
+    _pendingAt = now;
+    retain(now);
+
+    // a reminder or a summary has no change in the sensor that led to it.
+
+    if (PENDING_NOTIFICATION_STILL_OPEN == notification
+        || PENDING_NOTIFICATION_SETTLED == notification) {
+        LatencyTrace::begin(now);
+    }
+
+    LatencyTrace::mark(LATENCY_STAGE_NOTIFY_DELAY, now);
+
+    BusEvent due;
+    memset(&due, 0, sizeof(BusEvent));
+    due.type = BUS_EVENT_NOTIFY_DUE;
+    due.value = notification;
+    due.at = now;
+    due.notification = event;
+    _eventBus->post(due);
+}
+
+/*
+Writes the snapshot of the state into the retained RAM. This is only done when
+the state has changed or, while the sensor is open, periodically so that the
+durations that are retained are reasonably current.
+*/
+
+// private
+void SensorService::retain(uint64_t now) {
+    RetainedSensorSnapshot snapshot;
+    memset(&snapshot, 0, sizeof(RetainedSensorSnapshot));
+
+    SensorPhase phase = _sensorState->phase();
+
+    snapshot.phase = phase;
+    snapshot.pendingNotification = _pendingNotification;
+    snapshot.reminderCount = _sensorState->reminderCount();
+    snapshot.openNotified = _openNotified;
+
+    if (SENSOR_CLOSED != phase) {
+        snapshot.openForMillis = (unsigned long) (now - _sensorState->openAt());
+
+        if (SENSOR_PHASES[phase].notified) {
+            snapshot.notifiedForMillis = (unsigned long) (now - _sensorState->notifiedAt());
         }
     }
+
+    bool changed = snapshot.phase != _retainedSnapshot.phase
+        || snapshot.pendingNotification != _retainedSnapshot.pendingNotification
+        || snapshot.reminderCount != _retainedSnapshot.reminderCount
+        || snapshot.openNotified != _retainedSnapshot.openNotified;
+
+    if (changed
+        || (SENSOR_CLOSED != phase
+            && (now - _retainedAt) >= RETAINED_STATE_REFRESH_MILLIS)) {
+        RetainedState::save(&snapshot);
+        _retainedSnapshot = snapshot;
+        _retainedAt = now;
+    }
 }
 
 void SensorService::togglePause() {
-  _isPaused = !_isPaused && _sensorState->isOpen();
-  _sensorState->reset();
+  uint64_t now = MonotonicClock::now();
+  fire(SENSOR_EVENT_TOGGLE_PAUSE, now);
+  retain(now);
 }
 
 /*
@@ -224,16 +745,81 @@ are further changes.
 */
 
 bool SensorService::allowedToShortSleep() {
-  if (_isPaused || _sensorState->isOpen()) {
+  if (SENSOR_CLOSED != _sensorState->phase()) {
     return false;
   }
 
-  long now = millis();
-  long last = max(
+  // the result of a notification is waited for so that it is not left
+  // pending in the retained state while the board sleeps.
+
+  if (PENDING_NOTIFICATION_NONE != _pendingNotification
+      || !_eventBus->isDrained(_subscriber)) {
+    return false;
+  }
+
+  uint64_t now = MonotonicClock::now();
+  uint64_t last = max(
     max(_sensorState->openAt(), _sensorState->closedAt()),
-    max(_sensorState->lastNotifiedOpenAt(), _sensorState->lastNotifiedClosedAt())
+    _sensorState->notifiedAt()
   );
 
   return (now - last) > MIN_PERIOD_TO_SHORT_SLEEP;
 }
 
+/*
+Returns the time at which the board should be woken from deep sleep even if
+the sensor has not changed, or zero if only a change of the sensor need wake
+it. While the sensor is flapping, the board is woken to send the summary once
+the sensor has settled.
+*/
+
+uint64_t SensorService::wakeAt() {
+  if (_flapping) {
+    return settledAt();
+  }
+  return 0;
+}
+
+bool SensorService::isFlapping() const {
+  return _flapping;
+}
+
+/*
+Returns true from when a notification is posted to the bus until its result
+is posted back.
+*/
+
+bool SensorService::isNotifying() const {
+  return PENDING_NOTIFICATION_NONE != _pendingNotification;
+}
+
+/*
+This is the number of notifications that have been suppressed since the
+board started because the sensor was flapping.
+*/
+
+uint32_t SensorService::suppressedCount() const {
+  return _suppressedCount;
+}
+
+const OpenStats& SensorService::openStats() const {
+  return _openStats;
+}
+
+void SensorService::printOpenStatsTo(Stream& stream) const {
+  _openStats.printTo(stream, MonotonicClock::now());
+}
+
+void SensorService::printStateTo(Stream& stream) const {
+  stream.print("{sensor:{state:");
+  _sensorState->printTo(stream);
+  stream.print(",open:");
+  stream.print(_open ? "true" : "false");
+  stream.print(",flapping:");
+  stream.print(_flapping ? "true" : "false");
+  stream.print(",suppressed:");
+  stream.print(_suppressedCount);
+  stream.print(",pendingNotification:");
+  stream.print(_pendingNotification);
+  stream.println("}}");
+}
@@ -6,44 +6,117 @@
 #define SENSORSTATE_H
 
 #include "settings.h"
+#include "eventbus.h"
 #include "notificationservice.h"
 #include "indicatorservice.h"
+#include "openstats.h"
+#include "retainedstate.h"
+#include "tokenbucket.h"
 
 class SensorState;
 
+/*
+These are the phases that the sensor moves through. The sensor is open in all
+phases except `SENSOR_CLOSED`. Once recipients have been notified that the
+sensor is open, it is in one of the "notified" phases until it closes again.
+*/
+
+enum SensorPhase {
+  SENSOR_CLOSED,
+  SENSOR_OPEN,
+  SENSOR_OPEN_NOTIFIED,
+  SENSOR_OPEN_REMINDED,
+  SENSOR_PAUSED,
+  SENSOR_PHASE_COUNT
+};
+
+/*
+These are the events that cause the sensor to move between phases. An update
+from the sensor produces exactly one of the first three events; the
+`SENSOR_EVENT_DUE` event occurs in place of `SENSOR_EVENT_OPEN` when the timer
+for the current phase has run out.
+*/
+
+enum SensorEvent {
+  SENSOR_EVENT_CLOSED,
+  SENSOR_EVENT_OPEN,
+  SENSOR_EVENT_DUE,
+  SENSOR_EVENT_TOGGLE_PAUSE,
+  SENSOR_EVENT_COUNT
+};
+
 /*
 This object keeps track of the sensor state. A sensor can be open or closed, but there
 is also the concept of the sensor being paused. If a sensor is paused then there is no
 notification sent for the sensor being open.
 
-This service also keeps track of signalling to the notification and indicator
-services to let them know when they should send a notification or show an
-indicator (flash an LED for example) respectively. This takes into account the
-state of the sensor and the pause.
+This service learns of the sensor and the button from the event bus and, in
+turn, posts to the bus when a notification is due and when the indicator
+(flashing an LED for example) should change. It does not wait for the
+notification to be sent; the notification service posts back the result.
+This takes into account the state of the sensor and the pause.
+
+The behaviour is driven from a table of transitions in `sensorservice.cpp`;
+to change the policy, change the table rather than adding logic here.
+
+Separately from the table, the notifications are rate limited so that a
+sensor which is flapping, such as a gate blowing in the wind, sends a single
+notification that it is flapping and then a summary once it has settled.
+The service also keeps statistics of how long the sensor is open for each
+time that it closes.
 */
 
 class SensorService {
     public:
-        SensorService(MonitoringSettings* monitoringSettings,
-            NotificationService* notificationService,
-            IndicatorService* indicatorService);
+        SensorService(MonitoringSettings* monitoringSettings, EventBus* eventBus);
         ~SensorService();
 
+        void pulse();
         void update(bool open);
         void reset();
+        void resume(const RetainedSensorSnapshot& snapshot);
         void togglePause();
         bool allowedToShortSleep();
+        uint64_t wakeAt();
+
+        bool isFlapping() const;
+        bool isNotifying() const;
+        uint32_t suppressedCount() const;
+        const OpenStats& openStats() const;
+        void printOpenStatsTo(Stream& stream) const;
+        void printStateTo(Stream& stream) const;
+
+        void setMonitoringSettings(MonitoringSettings* value);
 
     private:
-        void updateWithoutPause(bool open, unsigned long now);
-        void updateWithPause(bool open, unsigned long now);
+        void receive(const BusEvent& event, uint64_t now);
+        void post(BusEventType type, uint8_t value, uint8_t detail, uint64_t now);
+        void fire(SensorEvent event, uint64_t now);
+        bool isDue(uint64_t now);
+        void notify(PendingNotification notification, uint64_t now);
+        bool admit(PendingNotification notification, uint64_t now);
+        void send(PendingNotification notification, uint64_t now);
+        bool isSettled(uint64_t now);
+        uint64_t settledAt() const;
+        void configureLimit(uint64_t now);
+        void retain(uint64_t now);
 
     private:
         SensorState* _sensorState;
-        bool _isPaused;
-        IndicatorService* _indicatorService;
+        PendingNotification _pendingNotification;
+        uint64_t _pendingAt;
+        bool _openNotified;
+        RetainedSensorSnapshot _retainedSnapshot;
+        uint64_t _retainedAt;
+        EventBus* _eventBus;
+        int _subscriber;
+        bool _open;
         MonitoringSettings* _monitoringSettings;
-        NotificationService* _notificationService;
+        TokenBucket _notifyLimit;
+        bool _flapping;
+        unsigned int _flapSuppressedCount;
+        uint32_t _suppressedCount;
+        OpenStats _openStats;
 };
 
 #endif // SENSORSTATE_H
@@ -71,232 +71,420 @@ This will return the node that is ordered direcly before the `ssid` provided.
     return node;
 }
 
-ThreemaRecipient::ThreemaRecipient(const String& to, ThreemaRecipient* next)
-  :
-  _to(to),
-  _next(next) {
-}
+/*
+The strings in the settings may be `NULL` which is taken to be the same as an
+empty string.
+*/
 
-ThreemaRecipient::ThreemaRecipient(ThreemaRecipient* other)
-  :
-  _to(other->to()),
-  _next(NULL) {
-    if (NULL != other->next()) {
-      _next = new ThreemaRecipient(other->next());
-    }
+static bool stringsEqual(const char* a, const char* b) {
+  return 0 == strcmp(NULL == a ? "" : a, NULL == b ? "" : b);
 }
 
-ThreemaRecipient::~ThreemaRecipient() {
-  delete _next;
-}
+/*
+The secrets are printed as a mask so that the settings can be printed to the
+serial port without giving them away; an empty mask means there is none.
+*/
 
-const String& ThreemaRecipient::to() const {
-  return _to;
+static void printMasked(Stream& stream, const char* value) {
+  stream.print(NULL == value || 0 == *value ? "" : SETTINGS_SECRET_MASK);
 }
 
-ThreemaRecipient* ThreemaRecipient::next() const {
-  return _next;
+const char* ThreemaSettings::from() const {
+  return _from;
 }
 
-ThreemaSettings::ThreemaSettings(
-  const String& from, const String& secret, ThreemaRecipient* recipients)
-  :
-  _from(from),
-  _secret(secret),
-  _recipients(recipients) {
+const char* ThreemaSettings::secret() const {
+  return _secret;
 }
 
-ThreemaSettings::ThreemaSettings(ThreemaSettings* other)
-  :
-  _from(other->from()),
-  _secret(other->secret()),
-  _recipients(new ThreemaRecipient(other->recipients())) {
+const char* ThreemaSettings::privateKey() const {
+  return _privateKey;
 }
 
-ThreemaSettings::~ThreemaSettings() {
-  delete _recipients;
+bool ThreemaSettings::isEndToEnd() const {
+  return NULL != _privateKey;
 }
 
-const String& ThreemaSettings::from() const {
-  return _from;
+int ThreemaSettings::recipientCount() const {
+  return _recipientCount;
 }
 
-const String& ThreemaSettings::secret() const {
-  return _secret;
+const char* ThreemaSettings::recipient(int index) const {
+  return _recipients[index];
 }
 
-ThreemaRecipient* ThreemaSettings::recipients() const {
-  return _recipients;
+/*
+Returns NULL if the messages are not sent end-to-end.
+*/
+
+const char* ThreemaSettings::recipientPublicKey(int index) const {
+  if (NULL == _recipientPublicKeys) {
+    return NULL;
+  }
+  return _recipientPublicKeys[index];
 }
 
-void ThreemaSettings::printTo(Stream& stream) {
+void ThreemaSettings::printTo(Stream& stream) const {
   stream.print("{");
   stream.print("from:");
   stream.print(from());
   stream.print(",secret:");
-  stream.print(secret());
+  printMasked(stream, secret());
+  stream.print(",endToEnd:");
+  stream.print(isEndToEnd() ? "true" : "false");
   stream.print(",recipients:");
 
-  ThreemaRecipient* node = recipients();
-
-  while (NULL != node) {
-    stream.print(node->to());
-    node = node->next();
-    if (NULL != node) {
+  for (int i = 0; i < recipientCount(); i++) {
+    if (0 != i) {
       stream.print(",");
     }
+    stream.print(recipient(i));
+    if (isEndToEnd()) {
+      stream.print("/");
+      stream.print(recipientPublicKey(i));
+    }
   }
-  
+
   stream.print("}");
 }
 
-bool ThreemaSettings::operator==(const ThreemaSettings& other) {
-  if (from() != other.from() || secret() != other.secret()) {
+bool ThreemaSettings::operator==(const ThreemaSettings& other) const {
+  if (!stringsEqual(from(), other.from())
+      || !stringsEqual(secret(), other.secret())
+      || !stringsEqual(privateKey(), other.privateKey())
+      || recipientCount() != other.recipientCount()) {
     return false;
   }
 
-  ThreemaRecipient* myRecipientNode = recipients();
-  ThreemaRecipient* otherRecipientNode = other.recipients();
-
-  while (true) {
-    if (NULL == myRecipientNode || NULL == otherRecipientNode) {
-      return (NULL == myRecipientNode) == (NULL == otherRecipientNode);
-    }
-    if (myRecipientNode->to() != otherRecipientNode->to()) {
+  for (int i = 0; i < recipientCount(); i++) {
+    if (!stringsEqual(recipient(i), other.recipient(i))
+        || !stringsEqual(recipientPublicKey(i), other.recipientPublicKey(i))) {
       return false;
     }
-    myRecipientNode = myRecipientNode->next();
-    otherRecipientNode = otherRecipientNode->next();
   }
+
+  return true;
 }
 
-bool ThreemaSettings::operator!=(const ThreemaSettings& other) {
+bool ThreemaSettings::operator!=(const ThreemaSettings& other) const {
   return !(*this == other);
 }
 
-WifiSettings::WifiSettings(const String& ssid, const String& passphrase)
-  :
-  _ssid(ssid), 
-  _passphrase(passphrase) {
+const char* WifiSettings::ssid() const {
+  return _ssid;
 }
 
-WifiSettings::WifiSettings(const WifiSettings* other)
-  :
-  _ssid(other->ssid()),
-  _passphrase(other->passphrase()) {
+const char* WifiSettings::passphrase() const {
+  return _passphrase;
 }
 
-WifiSettings::~WifiSettings() {
+void WifiSettings::printTo(Stream& stream) const {
+  stream.print("{");
+  stream.print("ssid:");
+  stream.print(ssid());
+  stream.print(",passphrase:");
+  printMasked(stream, passphrase());
+  stream.print("}");
 }
 
-const String& WifiSettings::ssid() const {
-  return _ssid;
+bool WifiSettings::operator==(const WifiSettings& other) const {
+  return stringsEqual(ssid(), other.ssid()) && stringsEqual(passphrase(), other.passphrase());
 }
 
-const String& WifiSettings::passphrase() const {
-  return _passphrase;
+bool WifiSettings::operator!=(const WifiSettings& other) const {
+  return !(*this == other);
+}
+
+const char* RelaySettings::hubAddress() const {
+  return _hubAddress;
+}
+
+int RelaySettings::port() const {
+  return _port;
+}
+
+bool RelaySettings::isHub() const {
+  return NULL == _hubAddress && 0 != _port;
 }
 
-void WifiSettings::printTo(Stream& stream) {
+void RelaySettings::printTo(Stream& stream) const {
   stream.print("{");
-  stream.print("ssid:");
-  stream.print(ssid());
-  stream.print(",passphrase:");
-  stream.print(passphrase());
+  stream.print("hubAddress:");
+  stream.print(NULL == hubAddress() ? "" : hubAddress());
+  stream.print(",port:");
+  stream.print(port());
+  stream.print(",hub:");
+  stream.print(isHub() ? "true" : "false");
   stream.print("}");
 }
 
-bool WifiSettings::operator==(const WifiSettings& other) {
-  return (ssid() == other.ssid()) && (passphrase() == other.passphrase());
+bool RelaySettings::operator==(const RelaySettings& other) const {
+  return stringsEqual(hubAddress(), other.hubAddress()) && port() == other.port();
 }
 
-bool WifiSettings::operator!=(const WifiSettings& other) {
+bool RelaySettings::operator!=(const RelaySettings& other) const {
   return !(*this == other);
 }
 
-MonitoringSettings::MonitoringSettings(int notifyOpenDelayMinutes)
-  :
-  _notifyOpenDelayMinutes(notifyOpenDelayMinutes) {
+const char* CollectorSettings::address() const {
+  return _address;
 }
 
-MonitoringSettings::MonitoringSettings(MonitoringSettings* other)
-  :
-  _notifyOpenDelayMinutes(other->notifyOpenDelayMinutes())
-{
+int CollectorSettings::port() const {
+  return _port;
 }
 
-MonitoringSettings::~MonitoringSettings() {
+const char* CollectorSettings::path() const {
+  return _path;
+}
+
+bool CollectorSettings::isEnabled() const {
+  return NULL != _address && 0 != _port && NULL != _path;
+}
+
+void CollectorSettings::printTo(Stream& stream) const {
+  stream.print("{");
+  stream.print("address:");
+  stream.print(NULL == address() ? "" : address());
+  stream.print(",port:");
+  stream.print(port());
+  stream.print(",path:");
+  stream.print(NULL == path() ? "" : path());
+  stream.print("}");
+}
+
+bool CollectorSettings::operator==(const CollectorSettings& other) const {
+  return stringsEqual(address(), other.address())
+    && port() == other.port()
+    && stringsEqual(path(), other.path());
+}
+
+bool CollectorSettings::operator!=(const CollectorSettings& other) const {
+  return !(*this == other);
+}
+
+int DeliverySettings::fallbackCount() const {
+  return _fallbackCount;
+}
+
+NotificationMethod DeliverySettings::fallbackMethod(int index) const {
+  return _fallbackMethods[index];
+}
+
+int DeliverySettings::deadlineSeconds() const {
+  return _deadlineSeconds;
+}
+
+bool DeliverySettings::isEnabled() const {
+  return 0 != _fallbackCount || 0 != _deadlineSeconds;
+}
+
+void DeliverySettings::printTo(Stream& stream) const {
+  stream.print("{");
+  stream.print("fallbackMethods:[");
+  for (int i = 0; i < fallbackCount(); i++) {
+    if (0 != i) {
+      stream.print(",");
+    }
+    stream.print(Common::notificationMethodName(fallbackMethod(i)));
+  }
+  stream.print("],deadlineSeconds:");
+  stream.print(deadlineSeconds());
+  stream.print("}");
+}
+
+bool DeliverySettings::operator==(const DeliverySettings& other) const {
+  if (fallbackCount() != other.fallbackCount() || deadlineSeconds() != other.deadlineSeconds()) {
+    return false;
+  }
+  for (int i = 0; i < fallbackCount(); i++) {
+    if (fallbackMethod(i) != other.fallbackMethod(i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool DeliverySettings::operator!=(const DeliverySettings& other) const {
+  return !(*this == other);
 }
 
 int MonitoringSettings::notifyOpenDelayMinutes() const {
   return _notifyOpenDelayMinutes;
 }
 
-void MonitoringSettings::printTo(Stream& stream) {
+int MonitoringSettings::notifyRepeatMinutes() const {
+  return _notifyRepeatMinutes;
+}
+
+int MonitoringSettings::notifyRepeatLimit() const {
+  return _notifyRepeatLimit;
+}
+
+int MonitoringSettings::notifyBurstLimit() const {
+  return _notifyBurstLimit;
+}
+
+int MonitoringSettings::notifyRefillMinutes() const {
+  return _notifyRefillMinutes;
+}
+
+int MonitoringSettings::settleMinutes() const {
+  return _settleMinutes;
+}
+
+int MonitoringSettings::sampleSeconds() const {
+  return _sampleSeconds;
+}
+
+const ArmingWindow* MonitoringSettings::armingWindows() const {
+  return _armingWindows;
+}
+
+int MonitoringSettings::armingWindowCount() const {
+  return _armingWindowCount;
+}
+
+int MonitoringSettings::utcOffsetMinutes() const {
+  return _utcOffsetMinutes;
+}
+
+void MonitoringSettings::printTo(Stream& stream) const {
   stream.print("{");
   stream.print("notifyOpenDelayMinutes:");
   stream.print(notifyOpenDelayMinutes());
+  stream.print(",notifyRepeatMinutes:");
+  stream.print(notifyRepeatMinutes());
+  stream.print(",notifyRepeatLimit:");
+  stream.print(notifyRepeatLimit());
+  stream.print(",notifyBurstLimit:");
+  stream.print(notifyBurstLimit());
+  stream.print(",notifyRefillMinutes:");
+  stream.print(notifyRefillMinutes());
+  stream.print(",settleMinutes:");
+  stream.print(settleMinutes());
+  stream.print(",sampleSeconds:");
+  stream.print(sampleSeconds());
+  stream.print(",armingWindows:[");
+  for (int i = 0; i < armingWindowCount(); i++) {
+    if (0 != i) {
+      stream.print(",");
+    }
+    armingWindows()[i].printTo(stream);
+  }
+  stream.print("],utcOffsetMinutes:");
+  stream.print(utcOffsetMinutes());
   stream.print("}");
 }
 
-bool MonitoringSettings::operator==(const MonitoringSettings& other) {
-  return notifyOpenDelayMinutes() == other.notifyOpenDelayMinutes();
+bool MonitoringSettings::operator==(const MonitoringSettings& other) const {
+  if (notifyOpenDelayMinutes() != other.notifyOpenDelayMinutes()
+    || notifyRepeatMinutes() != other.notifyRepeatMinutes()
+    || notifyRepeatLimit() != other.notifyRepeatLimit()
+    || notifyBurstLimit() != other.notifyBurstLimit()
+    || notifyRefillMinutes() != other.notifyRefillMinutes()
+    || settleMinutes() != other.settleMinutes()
+    || sampleSeconds() != other.sampleSeconds()
+    || armingWindowCount() != other.armingWindowCount()
+    || utcOffsetMinutes() != other.utcOffsetMinutes()) {
+    return false;
+  }
+  for (int i = 0; i < armingWindowCount(); i++) {
+    if (armingWindows()[i] != other.armingWindows()[i]) {
+      return false;
+    }
+  }
+  return true;
 }
 
-bool MonitoringSettings::operator!=(const MonitoringSettings& other) {
+bool MonitoringSettings::operator!=(const MonitoringSettings& other) const {
   return !(*this == other);
 }
 
-Settings::Settings(
-  const String description,
-  WifiSettings* wifiSettings,
-  MonitoringSettings* monitoringSettings,
-  NotificationMethod notificationMethod,
-  ThreemaSettings* threemaSettings)
-  :
-  _description(description),
-  _wifiSettings(wifiSettings),
-  _monitoringSettings(monitoringSettings),
-  _notificationMethod(notificationMethod),
-  _threemaSettings(threemaSettings) {
+const char* MessageSettings::openTemplate() const {
+  return _openTemplate;
 }
-  
-Settings::Settings(Settings* other)
-  :
-  _description(other->description()),
-  _wifiSettings(new WifiSettings(other->wifiSettings())),
-  _monitoringSettings(new MonitoringSettings(other->monitoringSettings())),
-  _notificationMethod(other->notificationMethod()),
-  _threemaSettings(new ThreemaSettings(other->threemaSettings())) {
+
+const char* MessageSettings::stillOpenTemplate() const {
+  return _stillOpenTemplate;
 }
 
-Settings::~Settings() {
-  delete _wifiSettings;
-  delete _monitoringSettings;
-  delete _threemaSettings;
+const char* MessageSettings::closeTemplate() const {
+  return _closeTemplate;
 }
 
-const String& Settings::description() const {
-  return _description;  
+const char* MessageSettings::flappingTemplate() const {
+  return _flappingTemplate;
 }
 
-WifiSettings* Settings::wifiSettings() const {
-  return _wifiSettings;
+const char* MessageSettings::settledTemplate() const {
+  return _settledTemplate;
 }
 
-MonitoringSettings* Settings::monitoringSettings() const {
-  return _monitoringSettings;
+void MessageSettings::printTo(Stream& stream) const {
+  stream.print("{");
+  stream.print("openTemplate:");
+  stream.print(openTemplate());
+  stream.print(",stillOpenTemplate:");
+  stream.print(stillOpenTemplate());
+  stream.print(",closeTemplate:");
+  stream.print(closeTemplate());
+  stream.print(",flappingTemplate:");
+  stream.print(flappingTemplate());
+  stream.print(",settledTemplate:");
+  stream.print(settledTemplate());
+  stream.print("}");
+}
+
+bool MessageSettings::operator==(const MessageSettings& other) const {
+  return stringsEqual(openTemplate(), other.openTemplate())
+    && stringsEqual(stillOpenTemplate(), other.stillOpenTemplate())
+    && stringsEqual(closeTemplate(), other.closeTemplate())
+    && stringsEqual(flappingTemplate(), other.flappingTemplate())
+    && stringsEqual(settledTemplate(), other.settledTemplate());
+}
+
+bool MessageSettings::operator!=(const MessageSettings& other) const {
+  return !(*this == other);
+}
+
+const char* Settings::description() const {
+  return _description;
+}
+
+const WifiSettings* Settings::wifiSettings() const {
+  return &_wifiSettings;
+}
+
+const MonitoringSettings* Settings::monitoringSettings() const {
+  return &_monitoringSettings;
 }
 
 NotificationMethod Settings::notificationMethod() const {
-  return _notificationMethod;  
+  return _notificationMethod;
+}
+
+const ThreemaSettings* Settings::threemaSettings() const {
+  return &_threemaSettings;
+}
+
+const MessageSettings* Settings::messageSettings() const {
+  return &_messageSettings;
+}
+
+const RelaySettings* Settings::relaySettings() const {
+  return &_relaySettings;
+}
+
+const CollectorSettings* Settings::collectorSettings() const {
+  return &_collectorSettings;
 }
 
-ThreemaSettings* Settings::threemaSettings() const {
-  return _threemaSettings;
+const DeliverySettings* Settings::deliverySettings() const {
+  return &_deliverySettings;
 }
 
-void Settings::printTo(Stream& stream) {
+void Settings::printTo(Stream& stream) const {
   stream.println("{");
   stream.print("description:");
   stream.print(description());
@@ -305,41 +493,32 @@ void Settings::printTo(Stream& stream) {
   stream.print(",\nmonitoringSettings:");
   monitoringSettings()->printTo(stream);
   stream.print(",\nnotificationMethod:");
-  stream.print(Common::notificationMethodAsString(notificationMethod()));
+  stream.print(Common::notificationMethodName(notificationMethod()));
   stream.print(",\nthreemaSettings:");
   threemaSettings()->printTo(stream);
+  stream.print(",\nmessageSettings:");
+  messageSettings()->printTo(stream);
+  stream.print(",\nrelaySettings:");
+  relaySettings()->printTo(stream);
+  stream.print(",\ncollectorSettings:");
+  collectorSettings()->printTo(stream);
+  stream.print(",\ndeliverySettings:");
+  deliverySettings()->printTo(stream);
   stream.println("\n}");
 }
 
-bool Settings::operator==(const Settings& other) {
-  if (description() != other.description()
-    || (NULL == wifiSettings()) != (NULL == other.wifiSettings())
-    || (NULL == monitoringSettings()) != (NULL == other.monitoringSettings())
-    || (NULL == threemaSettings()) != (NULL == other.threemaSettings())) {
-      return false;
-    }
-
-    if (NULL != wifiSettings()) {
-      if (*wifiSettings() != *(other.wifiSettings())) {
-        return false;
-      }
-    }
-
-    if (NULL != monitoringSettings()) {
-      if (*monitoringSettings() != *(other.monitoringSettings())) {
-        return false;
-      }
-    }
-
-    if (NULL != threemaSettings()) {
-      if (*threemaSettings() != (other.threemaSettings())) {
-        return false;
-      }
-    }
-
-    return true;
+bool Settings::operator==(const Settings& other) const {
+  return stringsEqual(description(), other.description())
+    && *wifiSettings() == *(other.wifiSettings())
+    && *monitoringSettings() == *(other.monitoringSettings())
+    && notificationMethod() == other.notificationMethod()
+    && *threemaSettings() == *(other.threemaSettings())
+    && *messageSettings() == *(other.messageSettings())
+    && *relaySettings() == *(other.relaySettings())
+    && *collectorSettings() == *(other.collectorSettings())
+    && *deliverySettings() == *(other.deliverySettings());
 }
 
-bool Settings::operator!=(const Settings& other) {
+bool Settings::operator!=(const Settings& other) const {
   return !(*this == other);
 }
@@ -11,7 +11,9 @@
 
 #include <Arduino.h>
 
+#include "armingschedule.h"
 #include "common.h"
+#include "constants.h"
 
 class AvailableWifiNetwork {
   public:
@@ -30,105 +32,464 @@ class AvailableWifiNetwork {
     AvailableWifiNetwork* _next;
 };
 
-class ThreemaRecipient {
+/*
+The settings classes below are immutable values that refer to, but do not own,
+their strings. Their constructors are `constexpr` so that settings which are
+known at compile time, such as those in `staticsettings.h`, can be declared
+`constexpr` and are then placed in flash rather than built on the heap. The
+strings must outlive the settings.
+*/
+
+/*
+Messages are sent through the Threema gateway. Given only the gateway's
+`secret`, the messages are sent in "basic" mode and the gateway encrypts them.
+Given also the private key of the `from` identity and the public key of each
+recipient (each 64 hex digits), they are sent in "end-to-end" mode and are
+encrypted on the board so that the gateway never sees the text.
+*/
+
+class ThreemaSettings {
   public:
-    ThreemaRecipient(const String& to, ThreemaRecipient* next);
-    ThreemaRecipient(ThreemaRecipient* other);
-    virtual ~ThreemaRecipient();
+    template <size_t N>
+    constexpr ThreemaSettings(const char* from, const char* secret, const char* const (&recipients)[N])
+      :
+      _from(from),
+      _secret(secret),
+      _privateKey(NULL),
+      _recipients(recipients),
+      _recipientPublicKeys(NULL),
+      _recipientCount(N) {
+    }
+
+    template <size_t N>
+    constexpr ThreemaSettings(
+      const char* from,
+      const char* secret,
+      const char* privateKey,
+      const char* const (&recipients)[N],
+      const char* const (&recipientPublicKeys)[N])
+      :
+      _from(from),
+      _secret(secret),
+      _privateKey(privateKey),
+      _recipients(recipients),
+      _recipientPublicKeys(recipientPublicKeys),
+      _recipientCount(N) {
+    }
+
+    const char* from() const;
+    const char* secret() const;
+    const char* privateKey() const;
+    bool isEndToEnd() const;
+    int recipientCount() const;
+    const char* recipient(int index) const;
+    const char* recipientPublicKey(int index) const;
+
+    void printTo(Stream& stream) const;
+
+    bool operator==(const ThreemaSettings& other) const;
+    bool operator!=(const ThreemaSettings& other) const;
 
-    const String& to() const;
-    ThreemaRecipient* next() const;
-  
   private:
-    String _to;
-    ThreemaRecipient* _next;
+    const char* _from;
+    const char* _secret;
+    const char* _privateKey;
+    const char* const* _recipients;
+    const char* const* _recipientPublicKeys;
+    int _recipientCount;
 };
 
-class ThreemaSettings {
+class WifiSettings {
   public:
-    ThreemaSettings(const String& from, const String& secret, ThreemaRecipient* recipients);
-    ThreemaSettings(ThreemaSettings* other);
-    virtual ~ThreemaSettings();
+    constexpr WifiSettings(const char* ssid, const char* passphrase)
+      :
+      _ssid(ssid),
+      _passphrase(passphrase) {
+    }
 
-    const String& from() const;
-    const String& secret() const;
-    ThreemaRecipient* recipients() const;
+    const char* ssid() const;
+    const char* passphrase() const;
 
-    void printTo(Stream& stream);
+    void printTo(Stream& stream) const;
 
-    bool operator==(const ThreemaSettings& other);
-    bool operator!=(const ThreemaSettings& other);
+    bool operator==(const WifiSettings& other) const;
+    bool operator!=(const WifiSettings& other) const;
 
   private:
-    String _from;
-    String _secret;
-    ThreemaRecipient* _recipients;
+    const char* _ssid;
+    const char* _passphrase;
 };
 
-class WifiSettings {
+/*
+Boards at the same site can share one connection to the gateway. One board
+is the hub; it listens on `port` for the events of the others and notifies
+them along with its own. Each of the others is a detector; its notification
+method is `RELAY` and it sends its events to the hub at `hubAddress` (an IPv4
+address such as "192.168.1.10") and `port`. With no relay settings the board
+is neither.
+*/
+
+class RelaySettings {
   public:
-    WifiSettings(const String& ssid, const String& passphrase);
-    WifiSettings(const WifiSettings* other);
-    virtual ~WifiSettings();
-  
-    const String& ssid() const;
-    const String& passphrase() const;
+    constexpr RelaySettings()
+      :
+      _hubAddress(NULL),
+      _port(0) {
+    }
+
+    constexpr RelaySettings(int port)
+      :
+      _hubAddress(NULL),
+      _port(port) {
+    }
+
+    constexpr RelaySettings(const char* hubAddress, int port)
+      :
+      _hubAddress(hubAddress),
+      _port(port) {
+    }
+
+    const char* hubAddress() const;
+    int port() const;
+    bool isHub() const;
+
+    void printTo(Stream& stream) const;
+
+    bool operator==(const RelaySettings& other) const;
+    bool operator!=(const RelaySettings& other) const;
+
+  private:
+    const char* _hubAddress;
+    int _port;
+};
+
+/*
+The board keeps a log of each opening and closing of the sensor. Given an
+`address` (an IPv4 address such as "192.168.1.20"), `port` and `path`, it
+sends the events that the collector there has not yet taken whenever the
+Wifi is up to send a notification. The events are POSTed in one compact
+batch over plain HTTP so the collector should be on the local network. With
+no collector settings the history is not synced.
+*/
+
+class CollectorSettings {
+  public:
+    constexpr CollectorSettings()
+      :
+      _address(NULL),
+      _port(0),
+      _path(NULL) {
+    }
+
+    constexpr CollectorSettings(const char* address, int port, const char* path)
+      :
+      _address(address),
+      _port(port),
+      _path(path) {
+    }
+
+    const char* address() const;
+    int port() const;
+    const char* path() const;
+    bool isEnabled() const;
+
+    void printTo(Stream& stream) const;
 
-    void printTo(Stream& stream);
-      
-    bool operator==(const WifiSettings& other);
-    bool operator!=(const WifiSettings& other);
+    bool operator==(const CollectorSettings& other) const;
+    bool operator!=(const CollectorSettings& other) const;
 
   private:
-    const String _ssid;
-    const String _passphrase;
+    const char* _address;
+    int _port;
+    const char* _path;
 };
 
+/*
+If the notification method fails then the notification may fall back to the
+`fallbackMethods`, tried in order; for example a detector that relays to a
+hub could fall back to `THREEMA` when the hub is down. Each method that has
+failed several times in a row is skipped for a while; see `constants.h`.
+Given a `deadlineSeconds`, the methods stop trying once that long has passed
+since the notification began. With no delivery settings the notification
+method is tried alone and takes as long as it takes.
+*/
+
+class DeliverySettings {
+  public:
+    constexpr DeliverySettings()
+      :
+      _fallbackMethods(NULL),
+      _fallbackCount(0),
+      _deadlineSeconds(0) {
+    }
+
+    constexpr DeliverySettings(int deadlineSeconds)
+      :
+      _fallbackMethods(NULL),
+      _fallbackCount(0),
+      _deadlineSeconds(deadlineSeconds) {
+    }
+
+    template <size_t N>
+    constexpr DeliverySettings(const NotificationMethod (&fallbackMethods)[N], int deadlineSeconds)
+      :
+      _fallbackMethods(fallbackMethods),
+      _fallbackCount(N),
+      _deadlineSeconds(deadlineSeconds) {
+    }
+
+    int fallbackCount() const;
+    NotificationMethod fallbackMethod(int index) const;
+    int deadlineSeconds() const;
+    bool isEnabled() const;
+
+    void printTo(Stream& stream) const;
+
+    bool operator==(const DeliverySettings& other) const;
+    bool operator!=(const DeliverySettings& other) const;
+
+  private:
+    const NotificationMethod* _fallbackMethods;
+    int _fallbackCount;
+    int _deadlineSeconds;
+};
+
+/*
+Once the sensor has been open long enough to notify, a reminder is sent each
+`notifyRepeatMinutes` while it stays open up to `notifyRepeatLimit` reminders.
+A `notifyRepeatMinutes` of zero means that no reminders are sent.
+
+No more than `notifyBurstLimit` notifications of the sensor opening or
+closing are sent in a burst after which one more is allowed each
+`notifyRefillMinutes`. Beyond that the sensor is
+considered to be flapping and a single notification says so; a summary
+follows once the sensor has been still for `settleMinutes`. A
+`notifyBurstLimit` of zero means that notifications are not limited.
+
+The sensor normally wakes the board from deep sleep through the interrupt on
+its pin. If the sensor is wired to a pin without a "low power" wake up
+interrupt then a non-zero `sampleSeconds` has the real time clock wake the
+board that often to sample it instead; see `InputSampler`. A change is then
+noticed up to `sampleSeconds` late.
+
+If there are `armingWindows` then the sensor is only watched in them; see
+`ArmingSchedule`. Outside of them the board sleeps through any changes of the
+sensor until the next window starts. Until the board has learned the time of
+day from the gateway the sensor is always watched.
+*/
+
 class MonitoringSettings {
   public:
-    MonitoringSettings(int notifyOpenDelayMinutes);
-    MonitoringSettings(MonitoringSettings* other);
-    virtual ~MonitoringSettings();
+    constexpr MonitoringSettings(
+      int notifyOpenDelayMinutes,
+      int notifyRepeatMinutes = 0,
+      int notifyRepeatLimit = 0,
+      int notifyBurstLimit = FLAP_NOTIFY_BURST_LIMIT,
+      int notifyRefillMinutes = FLAP_NOTIFY_REFILL_MINUTES,
+      int settleMinutes = FLAP_SETTLE_MINUTES,
+      int sampleSeconds = 0)
+      :
+      MonitoringSettings(
+        notifyOpenDelayMinutes,
+        notifyRepeatMinutes,
+        notifyRepeatLimit,
+        notifyBurstLimit,
+        notifyRefillMinutes,
+        settleMinutes,
+        sampleSeconds,
+        NULL,
+        0,
+        0) {
+    }
+
+    constexpr MonitoringSettings(
+      int notifyOpenDelayMinutes,
+      int notifyRepeatMinutes,
+      int notifyRepeatLimit,
+      int notifyBurstLimit,
+      int notifyRefillMinutes,
+      int settleMinutes,
+      int sampleSeconds,
+      const ArmingWindow* armingWindows,
+      int armingWindowCount,
+      int utcOffsetMinutes)
+      :
+      _notifyOpenDelayMinutes(notifyOpenDelayMinutes),
+      _notifyRepeatMinutes(notifyRepeatMinutes),
+      _notifyRepeatLimit(notifyRepeatLimit),
+      _notifyBurstLimit(notifyBurstLimit),
+      _notifyRefillMinutes(notifyRefillMinutes),
+      _settleMinutes(settleMinutes),
+      _sampleSeconds(sampleSeconds),
+      _armingWindows(armingWindows),
+      _armingWindowCount(armingWindowCount),
+      _utcOffsetMinutes(utcOffsetMinutes) {
+    }
+
+    template <size_t N>
+    constexpr MonitoringSettings(
+      int notifyOpenDelayMinutes,
+      int notifyRepeatMinutes,
+      int notifyRepeatLimit,
+      int notifyBurstLimit,
+      int notifyRefillMinutes,
+      int settleMinutes,
+      int sampleSeconds,
+      const ArmingWindow (&armingWindows)[N],
+      int utcOffsetMinutes)
+      :
+      MonitoringSettings(
+        notifyOpenDelayMinutes,
+        notifyRepeatMinutes,
+        notifyRepeatLimit,
+        notifyBurstLimit,
+        notifyRefillMinutes,
+        settleMinutes,
+        sampleSeconds,
+        armingWindows,
+        N,
+        utcOffsetMinutes) {
+    }
 
     int notifyOpenDelayMinutes() const;
+    int notifyRepeatMinutes() const;
+    int notifyRepeatLimit() const;
+    int notifyBurstLimit() const;
+    int notifyRefillMinutes() const;
+    int settleMinutes() const;
+    int sampleSeconds() const;
+    const ArmingWindow* armingWindows() const;
+    int armingWindowCount() const;
+    int utcOffsetMinutes() const;
+
+    void printTo(Stream& stream) const;
+
+    bool operator==(const MonitoringSettings& other) const;
+    bool operator!=(const MonitoringSettings& other) const;
+
+  private:
+    int _notifyOpenDelayMinutes;
+    int _notifyRepeatMinutes;
+    int _notifyRepeatLimit;
+    int _notifyBurstLimit;
+    int _notifyRefillMinutes;
+    int _settleMinutes;
+    int _sampleSeconds;
+    const ArmingWindow* _armingWindows;
+    int _armingWindowCount;
+    int _utcOffsetMinutes;
+};
+
+/*
+These are the templates for the text of the messages that are sent. See
+`messagetemplate.h` for the placeholders that can be used in a template.
+*/
+
+class MessageSettings {
+  public:
+    constexpr MessageSettings()
+      :
+      _openTemplate(MESSAGE_TEMPLATE_OPEN),
+      _stillOpenTemplate(MESSAGE_TEMPLATE_STILL_OPEN),
+      _closeTemplate(MESSAGE_TEMPLATE_CLOSE),
+      _flappingTemplate(MESSAGE_TEMPLATE_FLAPPING),
+      _settledTemplate(MESSAGE_TEMPLATE_SETTLED) {
+    }
+
+    constexpr MessageSettings(
+      const char* openTemplate,
+      const char* stillOpenTemplate,
+      const char* closeTemplate)
+      :
+      _openTemplate(openTemplate),
+      _stillOpenTemplate(stillOpenTemplate),
+      _closeTemplate(closeTemplate),
+      _flappingTemplate(MESSAGE_TEMPLATE_FLAPPING),
+      _settledTemplate(MESSAGE_TEMPLATE_SETTLED) {
+    }
+
+    constexpr MessageSettings(
+      const char* openTemplate,
+      const char* stillOpenTemplate,
+      const char* closeTemplate,
+      const char* flappingTemplate,
+      const char* settledTemplate)
+      :
+      _openTemplate(openTemplate),
+      _stillOpenTemplate(stillOpenTemplate),
+      _closeTemplate(closeTemplate),
+      _flappingTemplate(flappingTemplate),
+      _settledTemplate(settledTemplate) {
+    }
+
+    const char* openTemplate() const;
+    const char* stillOpenTemplate() const;
+    const char* closeTemplate() const;
+    const char* flappingTemplate() const;
+    const char* settledTemplate() const;
 
-    void printTo(Stream& stream);
+    void printTo(Stream& stream) const;
 
-    bool operator==(const MonitoringSettings& other);
-    bool operator!=(const MonitoringSettings& other);
+    bool operator==(const MessageSettings& other) const;
+    bool operator!=(const MessageSettings& other) const;
 
   private:
-    int _notifyOpenDelayMinutes;    
+    const char* _openTemplate;
+    const char* _stillOpenTemplate;
+    const char* _closeTemplate;
+    const char* _flappingTemplate;
+    const char* _settledTemplate;
 };
 
 class Settings {
   public:
-    Settings(
-      const String description,
-      WifiSettings* wifiSettings,
-      MonitoringSettings* monitoringSettings,
+    constexpr Settings(
+      const char* description,
+      WifiSettings wifiSettings,
+      MonitoringSettings monitoringSettings,
       NotificationMethod notificationMethod,
-      ThreemaSettings* threemaSettings);
-    Settings(Settings* other);
-    virtual ~Settings();
+      ThreemaSettings threemaSettings,
+      MessageSettings messageSettings = MessageSettings(),
+      RelaySettings relaySettings = RelaySettings(),
+      CollectorSettings collectorSettings = CollectorSettings(),
+      DeliverySettings deliverySettings = DeliverySettings())
+      :
+      _description(description),
+      _wifiSettings(wifiSettings),
+      _monitoringSettings(monitoringSettings),
+      _notificationMethod(notificationMethod),
+      _threemaSettings(threemaSettings),
+      _messageSettings(messageSettings),
+      _relaySettings(relaySettings),
+      _collectorSettings(collectorSettings),
+      _deliverySettings(deliverySettings) {
+    }
 
-    const String& description() const;
-    WifiSettings* wifiSettings() const;
-    MonitoringSettings* monitoringSettings() const;
+    const char* description() const;
+    const WifiSettings* wifiSettings() const;
+    const MonitoringSettings* monitoringSettings() const;
     NotificationMethod notificationMethod() const;
-    ThreemaSettings* threemaSettings() const;
+    const ThreemaSettings* threemaSettings() const;
+    const MessageSettings* messageSettings() const;
+    const RelaySettings* relaySettings() const;
+    const CollectorSettings* collectorSettings() const;
+    const DeliverySettings* deliverySettings() const;
 
-    void printTo(Stream& stream);
+    void printTo(Stream& stream) const;
 
-    bool operator==(const Settings& other);
-    bool operator!=(const Settings& other);
+    bool operator==(const Settings& other) const;
+    bool operator!=(const Settings& other) const;
 
   private:
-    String _description;
-    WifiSettings* _wifiSettings;
-    MonitoringSettings* _monitoringSettings;
+    const char* _description;
+    WifiSettings _wifiSettings;
+    MonitoringSettings _monitoringSettings;
     NotificationMethod _notificationMethod;
-    ThreemaSettings* _threemaSettings;
+    ThreemaSettings _threemaSettings;
+    MessageSettings _messageSettings;
+    RelaySettings _relaySettings;
+    CollectorSettings _collectorSettings;
+    DeliverySettings _deliverySettings;
 };
 
 #endif // SETTINGS_H
@@ -0,0 +1,434 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#include "settingseditor.h"
+
+#include <WiFiNINA.h>
+
+#define SETTINGS_EDITOR_MAX_NUMBER 1000000L
+#define SETTINGS_EDITOR_MAX_PORT 65535L
+#define SETTINGS_EDITOR_MAX_UTC_OFFSET_MINUTES (14L * 60L)
+
+enum SettingsEditorField {
+  SETTINGS_EDITOR_FIELD_DESCRIPTION,
+  SETTINGS_EDITOR_FIELD_SSID,
+  SETTINGS_EDITOR_FIELD_PASSPHRASE,
+  SETTINGS_EDITOR_FIELD_NOTIFICATION_METHOD,
+  SETTINGS_EDITOR_FIELD_NOTIFY_OPEN_DELAY_MINUTES,
+  SETTINGS_EDITOR_FIELD_NOTIFY_REPEAT_MINUTES,
+  SETTINGS_EDITOR_FIELD_NOTIFY_REPEAT_LIMIT,
+  SETTINGS_EDITOR_FIELD_NOTIFY_BURST_LIMIT,
+  SETTINGS_EDITOR_FIELD_NOTIFY_REFILL_MINUTES,
+  SETTINGS_EDITOR_FIELD_SETTLE_MINUTES,
+  SETTINGS_EDITOR_FIELD_SAMPLE_SECONDS,
+  SETTINGS_EDITOR_FIELD_ARMING_WINDOWS,
+  SETTINGS_EDITOR_FIELD_UTC_OFFSET_MINUTES,
+  SETTINGS_EDITOR_FIELD_THREEMA_FROM,
+  SETTINGS_EDITOR_FIELD_THREEMA_SECRET,
+  SETTINGS_EDITOR_FIELD_HUB_ADDRESS,
+  SETTINGS_EDITOR_FIELD_RELAY_PORT
+};
+
+struct SettingsEditorFieldDefinition {
+  const char* name;
+  SettingsEditorField field;
+  bool writable;
+};
+
+static constexpr SettingsEditorFieldDefinition SETTINGS_EDITOR_FIELDS[] = {
+  { "description", SETTINGS_EDITOR_FIELD_DESCRIPTION, true },
+  { "wifi.ssid", SETTINGS_EDITOR_FIELD_SSID, true },
+  { "wifi.passphrase", SETTINGS_EDITOR_FIELD_PASSPHRASE, true },
+  { "notificationMethod", SETTINGS_EDITOR_FIELD_NOTIFICATION_METHOD, true },
+  { "monitoring.notifyOpenDelayMinutes", SETTINGS_EDITOR_FIELD_NOTIFY_OPEN_DELAY_MINUTES, true },
+  { "monitoring.notifyRepeatMinutes", SETTINGS_EDITOR_FIELD_NOTIFY_REPEAT_MINUTES, true },
+  { "monitoring.notifyRepeatLimit", SETTINGS_EDITOR_FIELD_NOTIFY_REPEAT_LIMIT, true },
+  { "monitoring.notifyBurstLimit", SETTINGS_EDITOR_FIELD_NOTIFY_BURST_LIMIT, true },
+  { "monitoring.notifyRefillMinutes", SETTINGS_EDITOR_FIELD_NOTIFY_REFILL_MINUTES, true },
+  { "monitoring.settleMinutes", SETTINGS_EDITOR_FIELD_SETTLE_MINUTES, true },
+  { "monitoring.sampleSeconds", SETTINGS_EDITOR_FIELD_SAMPLE_SECONDS, true },
+  { "monitoring.armingWindows", SETTINGS_EDITOR_FIELD_ARMING_WINDOWS, true },
+  { "monitoring.utcOffsetMinutes", SETTINGS_EDITOR_FIELD_UTC_OFFSET_MINUTES, true },
+  { "threema.from", SETTINGS_EDITOR_FIELD_THREEMA_FROM, false },
+  { "threema.secret", SETTINGS_EDITOR_FIELD_THREEMA_SECRET, false },
+  { "relay.hubAddress", SETTINGS_EDITOR_FIELD_HUB_ADDRESS, true },
+  { "relay.port", SETTINGS_EDITOR_FIELD_RELAY_PORT, true }
+};
+
+#define SETTINGS_EDITOR_FIELD_COUNT (sizeof(SETTINGS_EDITOR_FIELDS) / sizeof(SETTINGS_EDITOR_FIELDS[0]))
+
+static const SettingsEditorFieldDefinition* settingsEditorFindField(const char* name) {
+  for (size_t i = 0; i < SETTINGS_EDITOR_FIELD_COUNT; i++) {
+    if (0 == strcmp(name, SETTINGS_EDITOR_FIELDS[i].name)) {
+      return &SETTINGS_EDITOR_FIELDS[i];
+    }
+  }
+  return NULL;
+}
+
+static bool settingsEditorParseNumber(const char* value, long minimum, long maximum, int* result) {
+  char* end = NULL;
+  long number = strtol(value, &end, 10);
+
+  if (end == value || 0 != *end || number < minimum || number > maximum) {
+    return false;
+  }
+
+  *result = (int) number;
+  return true;
+}
+
+static bool settingsEditorParseNumber(const char* value, long maximum, int* result) {
+  return settingsEditorParseNumber(value, 0, maximum, result);
+}
+
+static void settingsEditorPrintText(Print& stream, const char* value) {
+  stream.print(NULL == value ? "" : value);
+}
+
+static void settingsEditorPrintMasked(Print& stream, const char* value) {
+  stream.print(NULL == value || 0 == *value ? "" : SETTINGS_SECRET_MASK);
+}
+
+/*
+The editor starts out with copies of the initial settings but these are not
+saved to the settings service until a field is changed.
+*/
+
+SettingsEditor::SettingsEditor(SettingsService* settingsService, const Settings& initialSettings)
+  :
+  _settingsService(settingsService),
+  _slots{ initialSettings, initialSettings },
+  _windowBuffer(0),
+  _windowsChanged(false),
+  _changed(false) {
+  memset(_texts, 0, sizeof(_texts));
+  memset(_textBuffers, 0, sizeof(_textBuffers));
+  memset(_textsChanged, 0, sizeof(_textsChanged));
+}
+
+/*
+Prints the value of the field of the settings that are currently saved.
+*/
+
+SettingsEditResult SettingsEditor::get(const char* field, Print& stream) const {
+  const SettingsEditorFieldDefinition* definition = settingsEditorFindField(field);
+  const Settings* settings = _settingsService->load();
+
+  if (NULL == definition) {
+    return SETTINGS_EDIT_UNKNOWN_FIELD;
+  }
+
+  if (NULL == settings) {
+    return SETTINGS_EDIT_NO_SETTINGS;
+  }
+
+  const MonitoringSettings* monitoringSettings = settings->monitoringSettings();
+
+  switch (definition->field) {
+    case SETTINGS_EDITOR_FIELD_DESCRIPTION:
+      settingsEditorPrintText(stream, settings->description());
+      break;
+    case SETTINGS_EDITOR_FIELD_SSID:
+      settingsEditorPrintText(stream, settings->wifiSettings()->ssid());
+      break;
+    case SETTINGS_EDITOR_FIELD_PASSPHRASE:
+      settingsEditorPrintMasked(stream, settings->wifiSettings()->passphrase());
+      break;
+    case SETTINGS_EDITOR_FIELD_NOTIFICATION_METHOD:
+      stream.print(Common::notificationMethodName(settings->notificationMethod()));
+      break;
+    case SETTINGS_EDITOR_FIELD_NOTIFY_OPEN_DELAY_MINUTES:
+      stream.print(monitoringSettings->notifyOpenDelayMinutes());
+      break;
+    case SETTINGS_EDITOR_FIELD_NOTIFY_REPEAT_MINUTES:
+      stream.print(monitoringSettings->notifyRepeatMinutes());
+      break;
+    case SETTINGS_EDITOR_FIELD_NOTIFY_REPEAT_LIMIT:
+      stream.print(monitoringSettings->notifyRepeatLimit());
+      break;
+    case SETTINGS_EDITOR_FIELD_NOTIFY_BURST_LIMIT:
+      stream.print(monitoringSettings->notifyBurstLimit());
+      break;
+    case SETTINGS_EDITOR_FIELD_NOTIFY_REFILL_MINUTES:
+      stream.print(monitoringSettings->notifyRefillMinutes());
+      break;
+    case SETTINGS_EDITOR_FIELD_SETTLE_MINUTES:
+      stream.print(monitoringSettings->settleMinutes());
+      break;
+    case SETTINGS_EDITOR_FIELD_SAMPLE_SECONDS:
+      stream.print(monitoringSettings->sampleSeconds());
+      break;
+    case SETTINGS_EDITOR_FIELD_ARMING_WINDOWS:
+      for (int i = 0; i < monitoringSettings->armingWindowCount(); i++) {
+        if (0 != i) {
+          stream.print(",");
+        }
+        monitoringSettings->armingWindows()[i].printTo(stream);
+      }
+      break;
+    case SETTINGS_EDITOR_FIELD_UTC_OFFSET_MINUTES:
+      stream.print(monitoringSettings->utcOffsetMinutes());
+      break;
+    case SETTINGS_EDITOR_FIELD_THREEMA_FROM:
+      settingsEditorPrintText(stream, settings->threemaSettings()->from());
+      break;
+    case SETTINGS_EDITOR_FIELD_THREEMA_SECRET:
+      settingsEditorPrintMasked(stream, settings->threemaSettings()->secret());
+      break;
+    case SETTINGS_EDITOR_FIELD_HUB_ADDRESS:
+      settingsEditorPrintText(stream, settings->relaySettings()->hubAddress());
+      break;
+    case SETTINGS_EDITOR_FIELD_RELAY_PORT:
+      stream.print(settings->relaySettings()->port());
+      break;
+  }
+
+  return SETTINGS_EDIT_OK;
+}
+
+/*
+Builds settings which are those currently saved but with the field changed to
+the value and saves them to the settings service. An empty value clears a
+text. The caller should then have the settings applied.
+*/
+
+SettingsEditResult SettingsEditor::set(const char* field, const char* value) {
+  const SettingsEditorFieldDefinition* definition = settingsEditorFindField(field);
+  const Settings* settings = _settingsService->load();
+
+  if (NULL == definition) {
+    return SETTINGS_EDIT_UNKNOWN_FIELD;
+  }
+
+  if (!definition->writable) {
+    return SETTINGS_EDIT_READ_ONLY;
+  }
+
+  if (NULL == settings) {
+    return SETTINGS_EDIT_NO_SETTINGS;
+  }
+
+  if (strlen(value) > SETTINGS_EDITOR_TEXT_LENGTH) {
+    return SETTINGS_EDIT_TOO_LONG;
+  }
+
+  int slot = spareSlot();
+  const MonitoringSettings* monitoringSettings = settings->monitoringSettings();
+
+  // the texts and the windows are only kept once the value has been checked
+  // because keeping a change moves them to their other buffer.
+
+  const char* description = settings->description();
+  const char* ssid = settings->wifiSettings()->ssid();
+  const char* passphrase = settings->wifiSettings()->passphrase();
+  const char* hubAddress = settings->relaySettings()->hubAddress();
+  NotificationMethod notificationMethod = settings->notificationMethod();
+  int notifyOpenDelayMinutes = monitoringSettings->notifyOpenDelayMinutes();
+  int notifyRepeatMinutes = monitoringSettings->notifyRepeatMinutes();
+  int notifyRepeatLimit = monitoringSettings->notifyRepeatLimit();
+  int notifyBurstLimit = monitoringSettings->notifyBurstLimit();
+  int notifyRefillMinutes = monitoringSettings->notifyRefillMinutes();
+  int settleMinutes = monitoringSettings->settleMinutes();
+  int sampleSeconds = monitoringSettings->sampleSeconds();
+  const ArmingWindow* armingWindows = monitoringSettings->armingWindows();
+  int armingWindowCount = monitoringSettings->armingWindowCount();
+  ArmingWindow parsedWindows[ARMING_MAX_WINDOWS];
+  int utcOffsetMinutes = monitoringSettings->utcOffsetMinutes();
+  int relayPort = settings->relaySettings()->port();
+  bool valid = true;
+
+  switch (definition->field) {
+    case SETTINGS_EDITOR_FIELD_DESCRIPTION:
+      description = keepText(SETTINGS_EDITOR_TEXT_DESCRIPTION, description, value);
+      break;
+    case SETTINGS_EDITOR_FIELD_SSID:
+      ssid = keepText(SETTINGS_EDITOR_TEXT_SSID, ssid, value);
+      break;
+    case SETTINGS_EDITOR_FIELD_PASSPHRASE:
+      passphrase = keepText(SETTINGS_EDITOR_TEXT_PASSPHRASE, passphrase, value);
+      break;
+    case SETTINGS_EDITOR_FIELD_NOTIFICATION_METHOD:
+      valid = Common::parseNotificationMethod(value, &notificationMethod);
+      break;
+    case SETTINGS_EDITOR_FIELD_NOTIFY_OPEN_DELAY_MINUTES:
+      valid = settingsEditorParseNumber(value, SETTINGS_EDITOR_MAX_NUMBER, &notifyOpenDelayMinutes);
+      break;
+    case SETTINGS_EDITOR_FIELD_NOTIFY_REPEAT_MINUTES:
+      valid = settingsEditorParseNumber(value, SETTINGS_EDITOR_MAX_NUMBER, &notifyRepeatMinutes);
+      break;
+    case SETTINGS_EDITOR_FIELD_NOTIFY_REPEAT_LIMIT:
+      valid = settingsEditorParseNumber(value, SETTINGS_EDITOR_MAX_NUMBER, &notifyRepeatLimit);
+      break;
+    case SETTINGS_EDITOR_FIELD_NOTIFY_BURST_LIMIT:
+      valid = settingsEditorParseNumber(value, SETTINGS_EDITOR_MAX_NUMBER, &notifyBurstLimit);
+      break;
+    case SETTINGS_EDITOR_FIELD_NOTIFY_REFILL_MINUTES:
+      valid = settingsEditorParseNumber(value, SETTINGS_EDITOR_MAX_NUMBER, &notifyRefillMinutes);
+      break;
+    case SETTINGS_EDITOR_FIELD_SETTLE_MINUTES:
+      valid = settingsEditorParseNumber(value, SETTINGS_EDITOR_MAX_NUMBER, &settleMinutes);
+      break;
+    case SETTINGS_EDITOR_FIELD_SAMPLE_SECONDS:
+      valid = settingsEditorParseNumber(value, SETTINGS_EDITOR_MAX_NUMBER, &sampleSeconds);
+      break;
+    case SETTINGS_EDITOR_FIELD_ARMING_WINDOWS:
+      valid = ArmingSchedule::parse(value, parsedWindows, ARMING_MAX_WINDOWS, &armingWindowCount);
+      if (valid) {
+        armingWindows = keepWindows(armingWindows, monitoringSettings->armingWindowCount(),
+          parsedWindows, armingWindowCount);
+      }
+      break;
+    case SETTINGS_EDITOR_FIELD_UTC_OFFSET_MINUTES:
+      valid = settingsEditorParseNumber(value, -SETTINGS_EDITOR_MAX_UTC_OFFSET_MINUTES,
+        SETTINGS_EDITOR_MAX_UTC_OFFSET_MINUTES, &utcOffsetMinutes);
+      break;
+    case SETTINGS_EDITOR_FIELD_HUB_ADDRESS:
+      if (0 == *value) {
+        hubAddress = NULL;
+      } else {
+        IPAddress address;
+        valid = address.fromString(value);
+        if (valid) {
+          hubAddress = keepText(SETTINGS_EDITOR_TEXT_HUB_ADDRESS, hubAddress, value);
+        }
+      }
+      break;
+    case SETTINGS_EDITOR_FIELD_RELAY_PORT:
+      valid = settingsEditorParseNumber(value, SETTINGS_EDITOR_MAX_PORT, &relayPort);
+      break;
+    default:
+      return SETTINGS_EDIT_READ_ONLY;
+  }
+
+  if (!valid) {
+    return SETTINGS_EDIT_BAD_VALUE;
+  }
+
+  _slots[slot] = Settings(
+    description,
+    WifiSettings(ssid, passphrase),
+    MonitoringSettings(
+      notifyOpenDelayMinutes,
+      notifyRepeatMinutes,
+      notifyRepeatLimit,
+      notifyBurstLimit,
+      notifyRefillMinutes,
+      settleMinutes,
+      sampleSeconds,
+      armingWindows,
+      armingWindowCount,
+      utcOffsetMinutes),
+    notificationMethod,
+    *(settings->threemaSettings()),
+    *(settings->messageSettings()),
+    RelaySettings(hubAddress, relayPort),
+    *(settings->collectorSettings()),
+    *(settings->deliverySettings()));
+
+  _settingsService->save(&_slots[slot]);
+  _changed = true;
+  return SETTINGS_EDIT_OK;
+}
+
+/*
+The services have been brought into line with the saved settings so the
+buffers that they were built from before are no longer in use.
+*/
+
+void SettingsEditor::applied() {
+  memset(_textsChanged, 0, sizeof(_textsChanged));
+  _windowsChanged = false;
+  _changed = false;
+}
+
+/*static*/
+void SettingsEditor::printFieldsTo(Print& stream) {
+  for (size_t i = 0; i < SETTINGS_EDITOR_FIELD_COUNT; i++) {
+    stream.print(SETTINGS_EDITOR_FIELDS[i].name);
+    stream.println(SETTINGS_EDITOR_FIELDS[i].writable ? "" : " (read only)");
+  }
+}
+
+/*static*/
+const char* SettingsEditor::resultAsString(SettingsEditResult result) {
+  switch (result) {
+    case SETTINGS_EDIT_OK:
+      return "ok";
+    case SETTINGS_EDIT_UNKNOWN_FIELD:
+      return "unknown field";
+    case SETTINGS_EDIT_READ_ONLY:
+      return "read only";
+    case SETTINGS_EDIT_BAD_VALUE:
+      return "bad value";
+    case SETTINGS_EDIT_TOO_LONG:
+      return "too long";
+    case SETTINGS_EDIT_NO_SETTINGS:
+      return "no settings";
+    default:
+      return "???";
+  }
+}
+
+/*
+The change is built in whichever slot is not currently saved unless the saved
+one has not been applied yet; nothing has been built from that.
+*/
+
+// private
+int SettingsEditor::spareSlot() const {
+  int savedSlot = _settingsService->load() == &_slots[0] ? 0 : 1;
+  return _changed ? savedSlot : 1 - savedSlot;
+}
+
+/*
+Copies the changed text into the buffer of the text that is not in use and
+returns the copy. The buffer in use may still be referred to by the services
+until the change has been applied so it is left alone. A text that has not
+changed is not moved because nothing would be rebuilt from the copy.
+*/
+
+// private
+const char* SettingsEditor::keepText(SettingsEditorText text, const char* current, const char* value) {
+  if (NULL != current && 0 == strcmp(current, value)) {
+    return current;
+  }
+
+  uint8_t buffer = _textsChanged[text] ? _textBuffers[text] : 1 - _textBuffers[text];
+  char* copy = _texts[buffer][text];
+
+  strcpy(copy, value);
+  _textBuffers[text] = buffer;
+  _textsChanged[text] = true;
+  return copy;
+}
+
+/*
+As for the texts; copies the changed windows into their buffer that is not in
+use and returns the copy.
+*/
+
+// private
+const ArmingWindow* SettingsEditor::keepWindows(const ArmingWindow* current, int currentCount,
+    const ArmingWindow* windows, int count) {
+  bool changed = currentCount != count;
+
+  for (int i = 0; !changed && i < count; i++) {
+    changed = current[i] != windows[i];
+  }
+
+  if (!changed) {
+    return current;
+  }
+
+  uint8_t buffer = _windowsChanged ? _windowBuffer : 1 - _windowBuffer;
+
+  for (int i = 0; i < count; i++) {
+    _windows[buffer][i] = windows[i];
+  }
+
+  _windowBuffer = buffer;
+  _windowsChanged = true;
+  return _windows[buffer];
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#ifndef SETTINGSEDITOR_H
+#define SETTINGSEDITOR_H
+
+#include <Arduino.h>
+
+#include "settings.h"
+#include "settingsservice.h"
+
+// The longest text that can be set for a field; a Wifi passphrase may be up
+// to 63 characters.
+
+#define SETTINGS_EDITOR_TEXT_LENGTH 63
+
+enum SettingsEditorText {
+  SETTINGS_EDITOR_TEXT_DESCRIPTION,
+  SETTINGS_EDITOR_TEXT_SSID,
+  SETTINGS_EDITOR_TEXT_PASSPHRASE,
+  SETTINGS_EDITOR_TEXT_HUB_ADDRESS,
+  SETTINGS_EDITOR_TEXT_COUNT
+};
+
+enum SettingsEditResult {
+  SETTINGS_EDIT_OK,
+  SETTINGS_EDIT_UNKNOWN_FIELD,
+  SETTINGS_EDIT_READ_ONLY,
+  SETTINGS_EDIT_BAD_VALUE,
+  SETTINGS_EDIT_TOO_LONG,
+  SETTINGS_EDIT_NO_SETTINGS
+};
+
+/*
+This reads and changes the fields of the settings by name, for the serial
+console. The settings are immutable so a change is made by building a new
+`Settings` with the field changed and saving that to the settings service.
+
+The editor has two `Settings` of its own. A change is built in the one that
+is not currently saved so that the settings which the services were last
+built from stay intact until the new settings have been applied; see
+`applySettings()`, which then calls `applied()`. Further changes before that
+are built in the same `Settings`. Each text that can be changed, and the
+arming windows, have two buffers of their own and only move to the other
+buffer the first time they change after an apply. A service that keeps a text
+is rebuilt when that text changes so the buffer that it is left pointing into
+is never the one that is written to. Nothing is allocated after construction.
+
+The Wifi passphrase and the Threema secret can be changed, or only in the
+case of the secret checked for, but they are never printed. The arming
+windows are kept with the texts; no more than `ARMING_MAX_WINDOWS` of them.
+*/
+
+class SettingsEditor {
+  public:
+    SettingsEditor(SettingsService* settingsService, const Settings& initialSettings);
+
+    SettingsEditResult get(const char* field, Print& stream) const;
+    SettingsEditResult set(const char* field, const char* value);
+    void applied();
+
+    static void printFieldsTo(Print& stream);
+    static const char* resultAsString(SettingsEditResult result);
+
+  private:
+    int spareSlot() const;
+    const char* keepText(SettingsEditorText text, const char* current, const char* value);
+    const ArmingWindow* keepWindows(const ArmingWindow* current, int currentCount,
+      const ArmingWindow* windows, int count);
+
+  private:
+    SettingsService* _settingsService;
+    Settings _slots[2];
+    char _texts[2][SETTINGS_EDITOR_TEXT_COUNT][SETTINGS_EDITOR_TEXT_LENGTH + 1];
+    uint8_t _textBuffers[SETTINGS_EDITOR_TEXT_COUNT];
+    bool _textsChanged[SETTINGS_EDITOR_TEXT_COUNT];
+    ArmingWindow _windows[2][ARMING_MAX_WINDOWS];
+    uint8_t _windowBuffer;
+    bool _windowsChanged;
+    bool _changed;
+};
+
+#endif // SETTINGSEDITOR_H
@@ -51,7 +51,6 @@ InMemorySettingsService::InMemorySettingsService() {
 }
 
 InMemorySettingsService::~InMemorySettingsService() {
-  delete _settings;
 }
 
 bool InMemorySettingsService::isEmpty() {
@@ -59,17 +58,19 @@ bool InMemorySettingsService::isEmpty() {
 }
 
 void InMemorySettingsService::reset() {
-   delete _settings;
-   _settings = NULL;
+  _settings = NULL;
 }
 
-Settings* InMemorySettingsService::load() {
+/*
+The settings are immutable so the service simply keeps hold of the settings
+that were saved rather than copying them. The settings must outlive the
+service which is the case for those that are declared `constexpr`.
+*/
+
+const Settings* InMemorySettingsService::load() {
   return _settings;
 }
 
-void InMemorySettingsService::save(Settings* value) {
-  if (_settings != value) {
-    delete _settings;
-    _settings = new Settings(value);
-  }
+void InMemorySettingsService::save(const Settings* value) {
+  _settings = value;
 }
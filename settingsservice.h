@@ -27,8 +27,8 @@ class SettingsService {
 
     virtual bool isEmpty() = 0;
     virtual void reset() = 0;
-    virtual Settings* load() = 0;
-    virtual void save(Settings* value) = 0;
+    virtual const Settings* load() = 0;
+    virtual void save(const Settings* value) = 0;
 
     AvailableWifiNetwork* wifiNetworks();
     void setWifiNetworks(AvailableWifiNetwork* value);
@@ -46,11 +46,11 @@ class InMemorySettingsService : public SettingsService {
 
     virtual bool isEmpty();
     virtual void reset();
-    virtual Settings* load();
-    virtual void save(Settings* value);    
+    virtual const Settings* load();
+    virtual void save(const Settings* value);
 
   private:
-    Settings* _settings;
+    const Settings* _settings;
 };
 
 #endif // SETTINGSSERVICE_H
@@ -0,0 +1,94 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#include "tokenbucket.h"
+
+TokenBucket::TokenBucket()
+  :
+  _capacity(0),
+  _tokens(0),
+  _refillMillis(0),
+  _refilledAt(0) {
+}
+
+/*
+The bucket starts out full. If it is configured again then the tokens that it
+holds are kept as long as they fit into the new capacity.
+*/
+
+void TokenBucket::configure(uint16_t capacity, unsigned long refillMillis, uint64_t now) {
+  if (0 == _capacity || _tokens > capacity) {
+    _tokens = capacity;
+  }
+  _capacity = capacity;
+  _refillMillis = refillMillis;
+  _refilledAt = now;
+}
+
+/*
+Adds the tokens that have been earned since the bucket was last refilled. The
+time left over towards the next token is carried forward so that tokens are
+not lost by refilling often.
+*/
+
+void TokenBucket::refill(uint64_t now) {
+  if (_tokens >= _capacity || 0 == _refillMillis) {
+    _tokens = _capacity;
+    _refilledAt = now;
+    return;
+  }
+
+  uint64_t earned = (now - _refilledAt) / _refillMillis;
+
+  if (earned >= (uint64_t) (_capacity - _tokens)) {
+    _tokens = _capacity;
+    _refilledAt = now;
+  } else {
+    _tokens += earned;
+    _refilledAt += earned * _refillMillis;
+  }
+}
+
+/*
+Returns true if the action may go ahead in which case a token has been taken.
+*/
+
+bool TokenBucket::take(uint64_t now) {
+  if (!isLimited()) {
+    return true;
+  }
+
+  refill(now);
+
+  if (0 == _tokens) {
+    return false;
+  }
+
+  _tokens--;
+  return true;
+}
+
+bool TokenBucket::isLimited() const {
+  return 0 != _capacity;
+}
+
+bool TokenBucket::isFull() const {
+  return _tokens >= _capacity;
+}
+
+uint16_t TokenBucket::tokens() const {
+  return _tokens;
+}
+
+/*
+Returns the time at which the bucket will be full again if no more tokens are
+taken. If it is already full then this is a time in the past.
+*/
+
+uint64_t TokenBucket::fullAt() const {
+  if (isFull() || 0 == _refillMillis) {
+    return _refilledAt;
+  }
+  return _refilledAt + (uint64_t) (_capacity - _tokens) * _refillMillis;
+}
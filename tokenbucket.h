@@ -0,0 +1,37 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#ifndef TOKENBUCKET_H
+#define TOKENBUCKET_H
+
+#include <stdint.h>
+
+/*
+A token bucket holds up to `capacity` tokens and gains a token each
+`refillMillis`. Each action that is limited takes a token; once the bucket is
+empty, no more actions are allowed until a token has been refilled. A
+capacity of zero means that there is no limit.
+*/
+
+class TokenBucket {
+  public:
+    TokenBucket();
+
+    void configure(uint16_t capacity, unsigned long refillMillis, uint64_t now);
+    void refill(uint64_t now);
+    bool take(uint64_t now);
+
+    bool isLimited() const;
+    bool isFull() const;
+    uint16_t tokens() const;
+    uint64_t fullAt() const;
+
+  private:
+    uint16_t _capacity;
+    uint16_t _tokens;
+    unsigned long _refillMillis;
+    uint64_t _refilledAt;
+};
+
+#endif // TOKENBUCKET_H
@@ -0,0 +1,242 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#include "wallclock.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#define WALL_CLOCK_SECONDS_PER_DAY 86400UL
+
+// 1970-01-01 counted from 0000-03-01 in the proleptic Gregorian calendar
+
+#define WALL_CLOCK_EPOCH_DAYS 719468UL
+#define WALL_CLOCK_DAYS_PER_ERA 146097UL
+
+static const char* WALL_CLOCK_MONTHS = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+static bool wallClockKnown = false;
+static uint64_t wallClockAnchorAt = 0;
+static uint64_t wallClockAnchorMillis = 0;
+static int32_t wallClockDriftPpb = 0;
+static uint32_t wallClockSamples = 0;
+static uint32_t wallClockSteps = 0;
+
+/*
+Where the wall clock would be, in milliseconds since the Unix epoch, at the
+time `at` on the monotonic clock.
+*/
+
+static uint64_t wallClockPredict(uint64_t at) {
+  int64_t elapsed = (int64_t) (at - wallClockAnchorAt);
+  return wallClockAnchorMillis + elapsed + (elapsed * wallClockDriftPpb) / 1000000000LL;
+}
+
+static void wallClockAnchor(uint64_t observedMillis, uint64_t at) {
+  wallClockAnchorAt = at;
+  wallClockAnchorMillis = observedMillis;
+  wallClockDriftPpb = 0;
+}
+
+/*
+The number of days since 1970-01-01; see Howard Hinnant's "chrono-Compatible
+Low-Level Date Algorithms". Only dates from 1970 on are needed so the
+arithmetic can be unsigned.
+*/
+
+static uint32_t wallClockDaysFromCivil(uint32_t year, uint32_t month, uint32_t day) {
+  year -= month <= 2 ? 1 : 0;
+  uint32_t era = year / 400;
+  uint32_t yearOfEra = year - era * 400;
+  uint32_t dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  uint32_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  return era * WALL_CLOCK_DAYS_PER_ERA + dayOfEra - WALL_CLOCK_EPOCH_DAYS;
+}
+
+static bool wallClockParseDigits(const char** text, int count, uint32_t* value) {
+  *value = 0;
+
+  for (int i = 0; i < count; i++) {
+    char ch = (*text)[i];
+
+    if (ch < '0' || ch > '9') {
+      return false;
+    }
+
+    *value = (*value * 10) + (ch - '0');
+  }
+
+  *text += count;
+  return true;
+}
+
+static bool wallClockParseLiteral(const char** text, const char* literal) {
+  while (0 != *literal) {
+    if (*((*text)++) != *(literal++)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+Takes the time from the `Date` header of a response that was received at the
+time `at` on the monotonic clock. The header only has whole seconds so the
+time is taken to be half way through that second.
+*/
+
+/*static*/
+void WallClock::observe(uint32_t epochSeconds, uint64_t at) {
+  uint64_t observedMillis = ((uint64_t) epochSeconds * 1000UL) + 500UL;
+
+  wallClockSamples++;
+
+  if (!wallClockKnown) {
+    wallClockKnown = true;
+    wallClockAnchor(observedMillis, at);
+    return;
+  }
+
+  // the observation is checked against the estimate as it stood before the
+  // observation; were the drift worked out first then a step would be
+  // absorbed into it.
+
+  int64_t error = (int64_t) (observedMillis - wallClockPredict(at));
+
+  if (error > WALL_CLOCK_STEP_MILLIS || error < -WALL_CLOCK_STEP_MILLIS) {
+    wallClockSteps++;
+    wallClockAnchor(observedMillis, at);
+    return;
+  }
+
+  int64_t elapsed = (int64_t) (at - wallClockAnchorAt);
+
+  if (elapsed >= (int64_t) WALL_CLOCK_DRIFT_MIN_SPAN_MILLIS) {
+    // the drift is kept in parts per billion so that rounding it does not
+    // add up to whole seconds over weeks; the gain is limited first so that
+    // scaling it up cannot overflow.
+
+    int64_t gained = (int64_t) (observedMillis - wallClockAnchorMillis) - elapsed;
+    int64_t maxGained = (elapsed * WALL_CLOCK_MAX_DRIFT_PPM) / 1000000L;
+
+    if (gained > maxGained) {
+      gained = maxGained;
+    } else if (gained < -maxGained) {
+      gained = -maxGained;
+    }
+
+    wallClockDriftPpb = (int32_t) ((gained * 1000000000LL) / elapsed);
+  }
+}
+
+/*
+Returns the time as seconds since the Unix epoch at the time `at` on the
+monotonic clock or zero if the time is not known yet.
+*/
+
+/*static*/
+uint32_t WallClock::now(uint64_t at) {
+  if (!wallClockKnown) {
+    return 0;
+  }
+  return (uint32_t) (wallClockPredict(at) / 1000UL);
+}
+
+/*static*/
+bool WallClock::isKnown() {
+  return wallClockKnown;
+}
+
+/*static*/
+uint32_t WallClock::sampleCount() {
+  return wallClockSamples;
+}
+
+/*static*/
+uint32_t WallClock::stepCount() {
+  return wallClockSteps;
+}
+
+/*static*/
+int32_t WallClock::driftPpm() {
+  return wallClockDriftPpb / 1000;
+}
+
+/*
+Parses a date in the form that HTTP servers send; for example
+`Sun, 06 Nov 1994 08:49:37 GMT`. The obsolete forms are not accepted.
+*/
+
+/*static*/
+bool WallClock::parseHttpDate(const char* text, uint32_t* epochSeconds) {
+  uint32_t day;
+  uint32_t month = 0;
+  uint32_t year;
+  uint32_t hour;
+  uint32_t minute;
+  uint32_t second;
+
+  if (NULL == text || WALL_CLOCK_HTTP_DATE_LENGTH != strlen(text)) {
+    return false;
+  }
+
+  text += 3;
+
+  if (!wallClockParseLiteral(&text, ", ") || !wallClockParseDigits(&text, 2, &day)
+      || !wallClockParseLiteral(&text, " ")) {
+    return false;
+  }
+
+  while (month < 12 && !(WALL_CLOCK_MONTHS[month * 3] == text[0]
+      && WALL_CLOCK_MONTHS[month * 3 + 1] == text[1]
+      && WALL_CLOCK_MONTHS[month * 3 + 2] == text[2])) {
+    month++;
+  }
+
+  text += 3;
+
+  if (12 == month
+      || !wallClockParseLiteral(&text, " ") || !wallClockParseDigits(&text, 4, &year)
+      || !wallClockParseLiteral(&text, " ") || !wallClockParseDigits(&text, 2, &hour)
+      || !wallClockParseLiteral(&text, ":") || !wallClockParseDigits(&text, 2, &minute)
+      || !wallClockParseLiteral(&text, ":") || !wallClockParseDigits(&text, 2, &second)
+      || !wallClockParseLiteral(&text, " GMT")) {
+    return false;
+  }
+
+  // the seconds since the epoch run out in 2106
+
+  if (year < 1970 || year > 2105 || 0 == day || day > 31
+      || hour > 23 || minute > 59 || second > 60) {
+    return false;
+  }
+
+  *epochSeconds = wallClockDaysFromCivil(year, month + 1, day) * WALL_CLOCK_SECONDS_PER_DAY
+    + hour * 3600UL + minute * 60UL + second;
+  return true;
+}
+
+/*
+Breaks the seconds since the Unix epoch down into the date and time; the
+inverse of `wallClockDaysFromCivil`.
+*/
+
+/*static*/
+void WallClock::toCivil(uint32_t epochSeconds, WallClockCivil* civil) {
+  uint32_t days = epochSeconds / WALL_CLOCK_SECONDS_PER_DAY + WALL_CLOCK_EPOCH_DAYS;
+  uint32_t seconds = epochSeconds % WALL_CLOCK_SECONDS_PER_DAY;
+  uint32_t era = days / WALL_CLOCK_DAYS_PER_ERA;
+  uint32_t dayOfEra = days - era * WALL_CLOCK_DAYS_PER_ERA;
+  uint32_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+  uint32_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+  uint32_t monthIndex = (5 * dayOfYear + 2) / 153;
+  uint32_t month = monthIndex < 10 ? monthIndex + 3 : monthIndex - 9;
+
+  civil->year = yearOfEra + era * 400 + (month <= 2 ? 1 : 0);
+  civil->month = month;
+  civil->day = dayOfYear - (153 * monthIndex + 2) / 5 + 1;
+  civil->hour = seconds / 3600;
+  civil->minute = (seconds / 60) % 60;
+  civil->second = seconds % 60;
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright 2023, Andrew Lindesay <apl@lindesay.co.nz>
+ * All Rights Reserved. Distributed under the terms of the MIT License.
+ */
+#ifndef WALLCLOCK_H
+#define WALLCLOCK_H
+
+#include <stdint.h>
+
+// An observation this far from where the clock thinks it is means that the
+// time was changed rather than that the board's clock drifted.
+
+#define WALL_CLOCK_STEP_MILLIS 10000L
+
+// The `Date` header only has whole seconds so the drift is not worked out
+// until the observations span long enough for that to matter little.
+
+#define WALL_CLOCK_DRIFT_MIN_SPAN_MILLIS (60UL * 60UL * 1000UL)
+#define WALL_CLOCK_MAX_DRIFT_PPM 2000L
+
+#define WALL_CLOCK_HTTP_DATE_LENGTH 29
+
+/*
+A time in UTC broken down into its calendar fields.
+*/
+
+struct WallClockCivil {
+  uint16_t year;
+  uint8_t month;
+  uint8_t day;
+  uint8_t hour;
+  uint8_t minute;
+  uint8_t second;
+};
+
+/*
+This works out the time of day from the `Date` headers of the HTTP responses
+that the board receives anyway so that it costs no traffic of its own. The
+first observation anchors the wall clock to the monotonic clock. Later
+observations are compared with the anchor to estimate how fast the board's
+clock runs against the server's; the drift. The anchor is kept so that the
+estimate improves as the span of the observations grows. An observation that
+is well away from the estimate means that the time was stepped and the
+wall clock is anchored afresh.
+
+The wall clock is held in RAM only; after a reset it is unknown until the
+next HTTP response.
+*/
+
+class WallClock {
+  public:
+    static void observe(uint32_t epochSeconds, uint64_t at);
+    static uint32_t now(uint64_t at);
+
+    static bool isKnown();
+    static uint32_t sampleCount();
+    static uint32_t stepCount();
+    static int32_t driftPpm();
+
+    static bool parseHttpDate(const char* text, uint32_t* epochSeconds);
+    static void toCivil(uint32_t epochSeconds, WallClockCivil* civil);
+
+    template <class T> static void printTo(T& stream, uint64_t at);
+};
+
+template <class T>
+void WallClock::printTo(T& stream, uint64_t at) {
+  stream.print("{wallClock:{known:");
+  stream.print(isKnown() ? "true" : "false");
+  stream.print(",now:");
+  stream.print(now(at));
+  stream.print(",samples:");
+  stream.print(sampleCount());
+  stream.print(",steps:");
+  stream.print(stepCount());
+  stream.print(",driftPpm:");
+  stream.print(driftPpm());
+  stream.println("}}");
+}
+
+#endif // WALLCLOCK_H